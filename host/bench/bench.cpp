@@ -0,0 +1,366 @@
+/*
+ * Host micro-benchmarks for the public library APIs
+ *
+ * For each operation prints the host time per call and the
+ * traffic it generates per call on the simulated buses, so
+ * that regressions show up before flashing a device. Bus
+ * traffic is exact; host time is only meaningful relative
+ * to a previous run on the same machine.
+ *
+ *   host_bench [filter]
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "SPI.h"
+#include "EEPROM.h"
+
+#include "XUtils.h"
+#include "XConsole.h"
+#include "RTC.h"
+#include "TMP006.h"
+#include "ILI9341.h"
+#include "ILI9341Term.h"
+#include "ILI9341QOI.h"
+#include "ILI9341Upload.h"
+#include "XStats.h"
+#include "XLog.h"
+#include "XSched.h"
+#include "XSPIBus.h"
+
+#include "SimDS3231.h"
+#include "SimTMP006.h"
+#include "SimILI9341.h"
+
+static const char *filter;
+static volatile long sink;
+
+static double now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Run <stmt> <n> times and report per-call figures */
+#define BENCH(name, n, stmt) do { \
+  if (!filter || strstr(name, filter)) { \
+    HOST_counters_t c0 = host_counters; \
+    double t0 = now_ns(); \
+    long i_; \
+    for (i_ = 0; i_ < (n); i_++) { stmt; } \
+    report(name, n, now_ns() - t0, &c0); \
+  } \
+} while (0)
+
+static void report (const char *name, long n, double ns, const HOST_counters_t *c0)
+{
+  printf("%-28s %10.1f %9.2f %9.2f %9.2f %9.3f\n", name, ns / n,
+    (double) (host_counters.i2c_bytes - c0->i2c_bytes) / n,
+    (double) (host_counters.spi_bytes - c0->spi_bytes) / n,
+    (double) (host_counters.serial_tx - c0->serial_tx) / n,
+    (double) (host_counters.eeprom_writes - c0->eeprom_writes) / n);
+}
+
+/* Keep the captured console output from growing */
+static void drain (void)
+{
+  static char buf[8192];
+
+  Serial.host_take(buf, sizeof(buf));
+}
+
+static void bench_xutils (void)
+{
+  XConsole con;
+  char line[32];
+  const char *s;
+  long v;
+  int idx = 0;
+
+  BENCH("XUtils::xatoi", 1000000, s = "-123456"; XUtils::xatoi(&s, &v); sink = v);
+  BENCH("XUtils::xputs", 100000, con.xputs("Hello, world\n"); drain());
+  BENCH("XUtils::xprintf", 100000, con.xprintf(F("%02u:%02u:%02u %6d\n"), 12, 34, 56, -1234); drain());
+  BENCH("XUtils::xgets", 100000, Serial.host_feed("gt 1 2 3\r"); con.xgets(line, sizeof(line)); drain());
+  BENCH("XUtils::xgets_poll (idle)", 1000000, sink = con.xgets_poll(line, sizeof(line), &idx));
+}
+
+static void bench_rtc (void)
+{
+  SimDS3231 sim;
+  RTC rtc(DS3231_I2C_ADDRESS);
+  TIME_t t = { 2016, 6, 15, 4, 12, 30, 0 };
+  unsigned long e = 0;
+
+  Wire.host_attach(DS3231_I2C_ADDRESS, &sim);
+
+  BENCH("RTC::init", 100000, sink = rtc.init());
+  BENCH("RTC::settime", 100000, rtc.settime(&t));
+  BENCH("RTC::gettime", 100000, rtc.gettime(&t));
+  BENCH("RTC::toepoch", 1000000, e += RTC::toepoch(&t));
+  BENCH("RTC::fromepoch", 1000000, RTC::fromepoch(e += 86413UL, &t); sink = t.sec);
+
+  Wire.host_detach(DS3231_I2C_ADDRESS);
+}
+
+static void bench_tmp006 (void)
+{
+  SimTMP006 sim0(2), sim1;
+  TMP006 tmp, tmp1(0x41);
+  TMP006Array arr;
+  TMP006_raw_t raw = { -300, 25 << 7 };
+  TMP006_t t;
+  TMP006_fixed_t f;
+
+  Wire.host_attach(0x40, &sim0);
+  Wire.host_attach(0x41, &sim1);
+  tmp.init(TMP006_CFG_1SAMPLE | TMP006_CFG_DRDYEN);
+
+  BENCH("TMP006::convert", 1000000, raw.vobj++; tmp.convert(&raw, &t); sink = (long) t.tobj);
+  BENCH("TMP006::convert_fixed", 1000000, raw.vobj++; tmp.convert_fixed(&raw, &f); sink = f.tobj);
+  BENCH("TMP006::gettemp", 10000, tmp.gettemp(&t));
+  BENCH("TMP006::gettemp_fixed", 10000, tmp.gettemp_fixed(&f));
+
+  /* One call in ten finds a conversion, the others are idle polls */
+  BENCH("TMP006::poll (config)", 100000, delay(25); tmp.poll());
+  tmp.attach_drdy(2);
+  BENCH("TMP006::poll (DRDY)", 100000, delay(25); tmp.poll());
+  BENCH("TMP006::latest", 1000000, tmp.latest(&t));
+  BENCH("TMP006::latest_fixed", 1000000, tmp.latest_fixed(&f));
+
+  arr.add(&tmp);
+  arr.add(&tmp1);
+  arr.start(TMP006_CFG_1SAMPLE);
+  BENCH("TMP006Array::poll", 100000, delay(25); sink = arr.poll());
+
+  Wire.host_detach(0x40);
+  Wire.host_detach(0x41);
+}
+
+static void bench_xstats (void)
+{
+  XStats st(3, XSTATS_WINDOW, 0.001, 25.0);
+  XMinMax mm(XSTATS_WINDOW);
+  long x = 0;
+
+  BENCH("XMinMax::push", 1000000, x = x * 1103515245 + 12345; mm.push(x >> 20); sink = mm.min());
+  BENCH("XStats::push", 1000000, x = x * 1103515245 + 12345; st.push(i_, x >> 20); sink = st.alarm());
+}
+
+static void idle_task (void)
+{
+  sink++;
+}
+
+static void bench_xsched (void)
+{
+  XSched sched;
+  uint8_t i;
+
+  for (i = 0; i < XSCHED_TASKS; i++)
+    sched.every(1000 + i, idle_task);
+
+  BENCH("XSched::run (none due)", 1000000, sched.run());
+  BENCH("XSched::run (events)", 1000000, sched.cancel(0); sched.on_event(1, idle_task); sched.signal(1); sched.run());
+}
+
+static void bench_xlog (void)
+{
+  XLogEEPROM eeprom;
+  XLog log(eeprom, 32, 992);
+  XLOG_record_t r = { 0, { 2500, 2400 } };
+
+  EEPROM.host_erase();
+  log.begin();
+
+  BENCH("XLog::append", 100000, r.time += 250; r.v[0] += (r.time & 0x700) ? 1 : -1; log.append(&r));
+  log.rewind();
+  BENCH("XLog::read", 100, sink = log.read(&r));
+  BENCH("XLog::begin", 1000, sink = log.begin());
+}
+
+#define TFT_CS  10
+#define TFT_RST 9
+#define TFT_DC  8
+
+/* Drops what it is given */
+class NullSink: public XUtils {
+  public:
+    void xputc (char c) { sink += c; };
+    char xgetc (void) { return 0; };
+    void xwrite (const uint8_t* buf, int len) { sink += len; };
+};
+
+/* Full screen rendered a line at a time into the line buffers */
+static void draw_lines (
+  ILI9341 &tft,
+  uint16_t *buf
+)
+{
+  uint16_t *p;
+  int x, y;
+
+  tft.begin_lines(0, 239, 0, 319, buf);
+  for (y = 0; y < 320; y++) {
+    p = tft.line_buffer();
+    for (x = 0; x < 240; x++) p[x] = x ^ y;
+    tft.send_line();
+  }
+  tft.end_write();
+}
+
+/* Host end of an upload without errors: full chunks of a pixel pattern,
+   another one as soon as one is answered */
+class UploadFeed: public XUtils {
+  public:
+    UploadFeed (int bytes): _bytes(bytes) { };
+    void xputc (char c) { uint8_t b = c; xwrite(&b, 1); };
+    char xgetc (void) { return (char) _q[_qh++ % sizeof(_q)]; };
+    byte xready (void) { return _qh != _qt; };
+    void xwrite (const uint8_t* buf, int len) {
+      if (len == 5 && buf[0] == UPLOAD_MAGIC0) { _seq = 0; _off = 0; _qh = _qt = 0; send(); send(); }
+      else if (len == 1 && buf[0] == UPLOAD_ACK) send();
+    };
+
+  private:
+    void send (void) {
+      int n = _bytes - _off < UPLOAD_CHUNK ? _bytes - _off : UPLOAD_CHUNK, i;
+      uint16_t sum = (uint8_t) (_seq + n + (n >> 8));
+
+      if (n <= 0) return;
+      push(_seq++); push(n); push(n >> 8);
+      for (i = 0; i < n; i++) { push(_off + i); sum += (uint8_t) (_off + i); }
+      push(sum); push(sum >> 8);
+      _off += n;
+    };
+    void push (uint8_t b) { _q[_qt++ % sizeof(_q)] = b; };
+
+    int _bytes, _off;
+    uint8_t _seq, _q[512];
+    unsigned _qh, _qt;
+};
+
+static void bench_ili9341 (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static uint16_t pat[32 * 32], lines[2 * 240];
+  static uint8_t mask[32 * 32], list[4096];
+  ILI9341List dl(list, sizeof(list));
+  ILI9341Plot plot(tft, 0, 239, 100, 199, -1000, 1000, C_GREEN, C_BLACK);
+  static int16_t samples[10000];
+  char text[12];
+  ILI9341Field field(tft, 0, 1, text, sizeof(text), C_WHITE);
+  static uint8_t cells[2 * 40 * 8];
+  ILI9341Term term(tft, 0, 32, cells, 40, 8);
+  ILI9341QOI qoi(tft);
+  UploadFeed feed(64 * 64 * 2);
+  ILI9341Upload up(tft, feed);
+  static uint8_t img[14 + 64 * 64 * 2 + 8];
+  int img_len;
+  NullSink null;
+  int i = 0;
+
+  for (i = 0; i < 32 * 32; i++) mask[i] = i * 7;
+  i = 0;
+  tft.init();
+  BENCH("ILI9341::init", 10, tft.init());
+  BENCH("ILI9341::rectfill 8x8", 100000, tft.rectfill(i & 127, (i & 127) + 7, 40, 47, i); i++);
+  BENCH("ILI9341::rectfill full", 100, tft.rectfill(0, 239, 0, 319, i); i++);
+  BENCH("ILI9341::line", 100000, tft.line(0, 0, 239, i & 255, C_WHITE); i++);
+  BENCH("ILI9341::blt 32x32", 10000, tft.blt(10, 41, 10, 41, pat));
+  BENCH("ILI9341::send_line full", 100, draw_lines(tft, lines));
+  BENCH("ILI9341::circlefill r=50", 1000, tft.circlefill(120, 160, 50, C_RED));
+  BENCH("ILI9341::circle r=50", 1000, tft.circle(120, 160, 50, C_WHITE));
+  BENCH("ILI9341::arc gauge", 1000, tft.arc(120, 160, 60, 49, 135, 405, C_CYAN));
+  BENCH("ILI9341::roundrectfill 100x50", 1000, tft.roundrectfill(20, 119, 20, 69, 10, C_BLUE));
+  BENCH("ILI9341::trianglefill", 1000, tft.trianglefill(10, 10, 60, 10, 10, 60, C_YELLOW));
+  for (i = 0; i < 10000; i++) samples[i] = (i * 37) % 2001 - 1000;
+  BENCH("ILI9341Plot::plot 1000", 100, plot.plot(samples, 1000));
+  BENCH("ILI9341Plot::plot 10000", 100, plot.plot(samples, 10000));
+  plot.set_decimation(8);
+  BENCH("ILI9341Plot::append", 100000, plot.append(i_));
+  BENCH("ILI9341::_putc", 100000, if (!(i_ % 16)) tft.locate(0, 2); tft._putc('A' + (i_ & 15)));
+  BENCH("ILI9341::xprintf line", 10000, tft.locate(0, 1); tft.xprintf(F("T %5d.%02u C"), 21, 37));
+  BENCH("ILI9341::textbox 3 lines", 1000, tft.textbox(0, 119, 0, 31, "The quick brown fox jumps over the lazy dog", ILI9341_TEXT_CENTER));
+  tft.font_face(FontD24);
+  BENCH("ILI9341::xprintf FontD24", 10000, tft.locate(0, 1); tft.xprintf(F("%5d.%02u"), 21, 37));
+  tft.font_face(FontH8);
+  BENCH("ILI9341Field::xprintf line", 10000, field.begin(); field.xprintf(F("T %5d.%02u C"), 21, i_ % 100); field.end());
+  term.refresh();
+  BENCH("ILI9341Term::refresh line", 10000, term.xprintf(F("\rT %5d.%02u C"), 21, i_ % 100); term.refresh());
+  BENCH("ILI9341Term::refresh scroll", 1000, term.xprintf(F("\nline %d"), i_); term.refresh());
+  BENCH("ILI9341::set_orientation", 10000, tft.set_orientation(i++ & 3));
+  tft.set_orientation(0);
+  BENCH("ILI9341::get_scanline", 10000, sink = tft.get_scanline());
+  BENCH("ILI9341::rectfill_alpha 32x32", 1000, tft.rectfill_alpha(10, 41, 10, 41, C_RED, 96));
+  BENCH("ILI9341::blt_alpha 32x32", 1000, tft.blt_alpha(10, 41, 10, 41, pat, mask, 200));
+  tft.font_alpha(255, 0);
+  BENCH("ILI9341::_putc transparent", 10000, if (!(i_ % 16)) tft.locate(0, 2); tft._putc('A' + (i_ & 15)));
+  tft.font_alpha(255, 255);
+  for (i = 0; i < 12 * 16; i++)   /* A template of tiles in bands */
+    dl.rectfill((i % 12) * 20, (i % 12) * 20 + 19, (i / 12) * 20, (i / 12) * 20 + 19, (i / 48) & 1 ? C_BLUE : C_GRAY);
+  dl.text(1, 1, C_WHITE, "Template");
+  BENCH("ILI9341::replay", 10, tft.replay(dl.data()));
+  dl.optimize();
+  BENCH("ILI9341::replay optimized", 10, tft.replay(dl.data()));
+  BENCH("ILI9341List::optimize", 1000, dl.optimize());
+  tft.rectfill(0, 239, 0, 319, C_BLUE);
+  BENCH("ILI9341::capture 32x32", 1000, tft.capture(10, 41, 10, 41, null));
+  BENCH("ILI9341::capture full", 10, tft.capture(0, 239, 0, 319, null));
+  memcpy(img, "qoif\0\0\0\x40\0\0\0\x40\x03\x00", 14);   /* 64x64: a literal color every 8 pixels, diffs, runs */
+  img_len = 14;
+  for (i = 0; i < 64 * 64; i++) {
+    if (i % 64 >= 48) {
+      if (i % 64 == 48) img[img_len++] = 0xC0 | 15;
+    } else if (i % 8 == 0) {
+      img[img_len++] = 0xFE; img[img_len++] = i; img[img_len++] = i >> 4; img[img_len++] = i >> 8;
+    } else {
+      img[img_len++] = 0x40 | (3 << 4) | (2 << 2) | 1;
+    }
+  }
+  memcpy(img + img_len, "\0\0\0\0\0\0\0\x01", 8);
+  img_len += 8;
+  BENCH("ILI9341QOI::feed 64x64", 100, qoi.begin(10, 10, 0); qoi.feed(img, img_len));
+  BENCH("ILI9341QOI::feed dithered", 100, qoi.begin(10, 10, 1); qoi.feed(img, img_len));
+  BENCH("ILI9341Upload::run 64x64", 100, sink = up.run(10, 73, 10, 73, UPLOAD_RAW));
+}
+
+static void bench_xspibus (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  XSPIBus bus;
+  int i = 0;
+
+  tft.share_bus(&bus);
+  tft.init();
+  BENCH("XSPIBus rectfill batched", 100000, tft.rectfill(i & 127, (i & 127) + 7, 40, 47, i); i++);
+  bus.set_batching(0);
+  BENCH("XSPIBus rectfill unbatched", 100000, tft.rectfill(i & 127, (i & 127) + 7, 40, 47, i); i++);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc > 1) filter = argv[1];
+
+  host_reset();
+
+  printf("%-28s %10s %9s %9s %9s %9s\n", "operation", "ns/op", "i2c B/op", "spi B/op", "tx B/op", "eep W/op");
+  bench_xutils();
+  bench_rtc();
+  bench_tmp006();
+  bench_xstats();
+  bench_xsched();
+  bench_xlog();
+  bench_ili9341();
+  bench_xspibus();
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Host stand-in for the Arduino core
+ *
+ * Only what the libraries in this repository use is provided.
+ * Time is virtual: it advances with delay()/delayMicroseconds(),
+ * host_advance_us() and by 1 us on every millis()/micros()/yield() call,
+ * so that polling loops terminate.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef bool boolean;
+
+/* Program memory is ordinary memory on the host */
+#define PROGMEM
+#define PGM_P               const char *
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t *) (p))
+#define pgm_read_word(p)    (*(const uint16_t *) (p))
+#define pgm_read_dword(p)   (*(const uint32_t *) (p))
+#define memcmp_P            memcmp
+#define memcpy_P            memcpy
+#define strlen_P            strlen
+
+class __FlashStringHelper;
+#define F(s)                (reinterpret_cast<const __FlashStringHelper *>(s))
+
+#define LOW           0
+#define HIGH          1
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+
+#define DEC           10
+#define HEX           16
+
+#define HOST_NUM_PINS 64
+
+/* Clock of the board the host build stands in for (16 MHz AVR) */
+#define F_CPU         16000000UL
+
+void pinMode (uint8_t pin, uint8_t mode);
+void digitalWrite (uint8_t pin, uint8_t val);
+int digitalRead (uint8_t pin);
+
+unsigned long millis (void);
+unsigned long micros (void);
+void delay (unsigned long ms);
+void delayMicroseconds (unsigned int us);
+void yield (void);
+
+#define digitalPinToInterrupt(p)  (p)
+void attachInterrupt (uint8_t irq, void (*isr)(void), int mode);
+void detachInterrupt (uint8_t irq);
+void noInterrupts (void);
+void interrupts (void);
+
+/* Serial ports: input is fed by the host, output is captured */
+class Serial_ {
+  public:
+    Serial_ (void): _dtr(1), _rxhead(0), _rxtail(0), _txlen(0) { };
+    void begin (unsigned long baud) { };
+    operator bool () { return true; };
+    bool dtr (void) { return _dtr; };
+    int available (void);
+    int read (void);
+    int availableForWrite (void) { return 64; };
+    size_t write (uint8_t c);
+    size_t write (const uint8_t *buf, size_t n);
+    size_t readBytes (char *buf, size_t n);
+    void flush (void) { };
+
+    size_t print (const char *s);
+    size_t print (const __FlashStringHelper *s);
+    size_t print (char c);
+    size_t print (long n, int base = DEC);
+    size_t print (int n, int base = DEC) { return print((long) n, base); };
+    size_t print (unsigned long n, int base = DEC);
+    size_t print (unsigned int n, int base = DEC) { return print((unsigned long) n, base); };
+    size_t print (double n, int digits = 2);
+    template <typename T> size_t println (T v) { size_t n = print(v); return n + print("\r\n"); };
+    template <typename T> size_t println (T v, int f) { size_t n = print(v, f); return n + print("\r\n"); };
+    size_t println (void) { return print("\r\n"); };
+
+    /* Host side */
+    void host_dtr (bool dtr) { _dtr = dtr; };
+    void host_feed (const char *s);
+    void host_feed (const uint8_t *buf, size_t n);
+    size_t host_take (char *buf, size_t size);  /* Output captured so far, NUL terminated */
+
+  private:
+    bool _dtr;
+    uint8_t _rx[4096];
+    size_t _rxhead, _rxtail;
+    char _tx[8192];
+    size_t _txlen;
+};
+
+class HardwareSerial: public Serial_ {
+};
+
+extern Serial_ Serial;
+extern HardwareSerial Serial1;
+
+/* Host controls */
+
+typedef struct {
+  unsigned long i2c_bytes;      /* Bytes on the TWI bus, address bytes included */
+  unsigned long i2c_transactions;
+  unsigned long spi_bytes;      /* Bytes shifted on the SPI bus */
+  unsigned long par8_bytes;     /* Cycles on the 8080 parallel bus */
+  unsigned long serial_tx;      /* Bytes written to serial ports */
+  unsigned long serial_rx;      /* Bytes read from serial ports */
+  unsigned long eeprom_writes;  /* EEPROM cells actually written */
+} HOST_counters_t;
+
+extern HOST_counters_t host_counters;
+
+/* Simulated device, updated as virtual time goes by */
+class HostDevice {
+  public:
+    HostDevice (void);
+    virtual ~HostDevice ();
+    virtual void update (unsigned long us) { };
+
+  private:
+    friend void host_advance_us (unsigned long us);
+    HostDevice *_next;
+};
+
+void host_reset (void);                           /* Time, pins, counters, ports */
+void host_advance_us (unsigned long us);
+unsigned long host_time_us (void);
+void host_pin_drive (uint8_t pin, uint8_t val);   /* Drive an input pin (fires interrupts) */
+uint8_t host_pin_level (uint8_t pin);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Host stand-in for the EEPROM library (1 KB, erased to 0xFF)
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include "Arduino.h"
+
+#define HOST_EEPROM_SIZE  1024
+
+class EEPROMClass {
+  public:
+    EEPROMClass (void) { host_erase(); };
+    uint8_t read (int idx);
+    void write (int idx, uint8_t val);
+    void update (int idx, uint8_t val);
+    uint16_t length (void) { return HOST_EEPROM_SIZE; };
+    template <typename T> T &get (int idx, T &t) {
+      uint8_t *p = (uint8_t *) &t;
+      for (size_t i = 0; i < sizeof(T); i++) p[i] = read(idx + i);
+      return t;
+    };
+    template <typename T> const T &put (int idx, const T &t) {
+      const uint8_t *p = (const uint8_t *) &t;
+      for (size_t i = 0; i < sizeof(T); i++) update(idx + i, p[i]);
+      return t;
+    };
+
+    /* Host side */
+    void host_erase (void);
+
+  private:
+    uint8_t _mem[HOST_EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
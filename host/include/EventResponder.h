@@ -0,0 +1,35 @@
+/*
+ * Host stand-in for the EventResponder of the Teensy core
+ *
+ * Only immediate responses are modelled: the function attached is
+ * called when the event is triggered, as from an interrupt.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef EventResponder_h
+#define EventResponder_h
+
+class EventResponder;
+typedef EventResponder &EventResponderRef;
+typedef void (*EventResponderFunction)(EventResponderRef);
+
+class EventResponder {
+  public:
+    EventResponder (void): _function(0), _context(0) { };
+
+    void attachImmediate (EventResponderFunction function) { _function = function; };
+    void setContext (void *context) { _context = context; };
+    void *getContext (void) { return _context; };
+    void clearEvent (void) { };
+    void triggerEvent (int status = 0, void *data = 0) {
+      (void) status; (void) data;
+      if (_function) _function(*this);
+    };
+
+  private:
+    EventResponderFunction _function;
+    void *_context;
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Host stand-in for an 8080 8-bit parallel bus on a GPIO port
+ *
+ * Each write (WR strobe) or read (RD strobe) cycle is routed to
+ * the simulated devices whose chip select pin is low, and
+ * advances the virtual time by the cycle the port code takes
+ * on the target (4 CPU cycles to write, 8 to read).
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef Par8_h
+#define Par8_h
+
+#include "Arduino.h"
+
+/* Simulated 8080 bus slave */
+class HostPar8Device {
+  public:
+    HostPar8Device (uint8_t cs);
+    virtual ~HostPar8Device ();
+    virtual void par8_write (uint8_t d) = 0;
+    virtual uint8_t par8_read (void) = 0;
+
+  private:
+    friend class Par8Class;
+    uint8_t _cs;
+    HostPar8Device *_next;
+};
+
+class Par8Class {
+  public:
+    Par8Class (void): _ns(0) { };
+    void write (uint8_t d);
+    uint8_t read (void);
+
+  private:
+    void cycle (unsigned long ns);
+    unsigned long _ns;    /* Bus time not yet added to the virtual time */
+};
+
+extern Par8Class Par8;
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Host stand-in for the SPI library
+ *
+ * Each transfer is routed to the simulated devices whose
+ * slave select pin is low, and advances the virtual time
+ * by 8 cycles of the SPI clock.
+ *
+ * Asynchronous (DMA) transfers take the API of the Teensy core:
+ * the virtual time is left alone, the bus staying busy in the
+ * background for as long as they take. Once the virtual time
+ * gets there, the buffer is read (so that a buffer reused too
+ * early is caught) and delivered to the devices whose slave
+ * select is still low, then the event fires. A transfer started
+ * meanwhile waits for the bus first.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+
+#include "Arduino.h"
+#include "EventResponder.h"
+
+#define SPI_HAS_TRANSFER_ASYNC  1
+
+#define SPI_CLOCK_DIV4    0x00
+#define SPI_CLOCK_DIV16   0x01
+#define SPI_CLOCK_DIV64   0x02
+#define SPI_CLOCK_DIV128  0x03
+#define SPI_CLOCK_DIV2    0x04
+#define SPI_CLOCK_DIV8    0x05
+#define SPI_CLOCK_DIV32   0x06
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define LSBFIRST  0
+#define MSBFIRST  1
+
+class SPISettings {
+  public:
+    SPISettings (void): clock(4000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) { };
+    SPISettings (uint32_t c, uint8_t o, uint8_t m): clock(c), bitOrder(o), dataMode(m) { };
+
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+/* Simulated SPI slave */
+class HostSPIDevice {
+  public:
+    HostSPIDevice (uint8_t cs);
+    virtual ~HostSPIDevice ();
+    virtual uint8_t spi_transfer (uint8_t mosi) = 0;   /* Returns MISO */
+
+  private:
+    friend class SPIClass;
+    friend class SPIAsync;
+    uint8_t _cs;
+    HostSPIDevice *_next;
+};
+
+class SPIClass {
+  public:
+    void begin (void) { };
+    void end (void) { };
+    void beginTransaction (SPISettings settings);
+    void endTransaction (void);
+    void setClockDivider (uint8_t div);
+    void setDataMode (uint8_t mode) { _settings.dataMode = mode; };
+    void setBitOrder (uint8_t order) { _settings.bitOrder = order; };
+    uint8_t transfer (uint8_t data);
+    uint16_t transfer16 (uint16_t data);
+    void transfer (void *buf, size_t count);
+    bool transfer (const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event);
+
+    /* Host side */
+    const SPISettings &host_settings (void) { return _settings; };  /* Clock as generated, i.e. rounded down */
+    byte host_in_transaction (void) { return _intx; };             /* Nesting depth */
+    byte host_async_busy (void);                                   /* An asynchronous transfer is under way */
+
+  private:
+    void wait_async (void);
+
+    SPISettings _settings;
+    byte _intx;
+    unsigned long _ns;    /* Bus time not yet added to the virtual time */
+};
+
+extern SPIClass SPI;
+
+#endif
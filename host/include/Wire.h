@@ -0,0 +1,50 @@
+/*
+ * Host stand-in for the Wire (TWI) library
+ *
+ * Transactions are routed to simulated devices attached
+ * with host_attach().
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+/* Simulated TWI slave */
+class HostI2CDevice {
+  public:
+    virtual ~HostI2CDevice () { };
+    virtual void i2c_write (const uint8_t *buf, uint8_t n) = 0;  /* Master writes */
+    virtual void i2c_read (uint8_t *buf, uint8_t n) = 0;         /* Master reads */
+};
+
+class TwoWire {
+  public:
+    TwoWire (void);
+    void begin (void) { };
+    void setClock (uint32_t hz) { };
+    void beginTransmission (uint8_t address);
+    uint8_t endTransmission (uint8_t sendStop = 1);
+    size_t write (uint8_t data);
+    uint8_t requestFrom (uint8_t address, uint8_t quantity, uint8_t sendStop = 1);
+    int available (void);
+    int read (void);
+
+    /* Host side */
+    void host_attach (uint8_t address, HostI2CDevice *dev);
+    void host_detach (uint8_t address);
+
+  private:
+    HostI2CDevice *_devs[128];
+    uint8_t _addr;
+    uint8_t _tx[BUFFER_LENGTH], _txlen;
+    uint8_t _rx[BUFFER_LENGTH], _rxlen, _rxpos;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Simulated DS3231 real-time clock
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "SimDS3231.h"
+
+SimDS3231::SimDS3231 (void): _ptr(0), _last(0)
+{
+  memset(_regs, 0, sizeof(_regs));
+  _regs[3] = 7;     /* Saturday */
+  _regs[4] = 0x01;  /* 2000-01-01 */
+  _regs[5] = 0x01;
+}
+
+void SimDS3231::i2c_write (const uint8_t *buf, uint8_t n)
+{
+  if (!n) return;
+
+  _ptr = *buf++ % SIM_DS3231_REGS;
+  while (--n) {
+    _regs[_ptr] = *buf++;
+    _ptr = (_ptr + 1) % SIM_DS3231_REGS;
+  }
+  _last = host_time_us();   /* Writing the time restarts the countdown chain */
+}
+
+void SimDS3231::i2c_read (uint8_t *buf, uint8_t n)
+{
+  while (n--) {
+    *buf++ = _regs[_ptr];
+    _ptr = (_ptr + 1) % SIM_DS3231_REGS;
+  }
+}
+
+void SimDS3231::update (unsigned long us)
+{
+  while (us - _last >= 1000000UL) {
+    _last += 1000000UL;
+    tick();
+  }
+}
+
+static uint8_t bcd_inc (uint8_t *r, uint8_t mask, uint8_t wrap, uint8_t first)
+{
+  uint8_t v = (*r & mask & 0x0F) + ((*r & mask) >> 4) * 10 + 1;
+
+  if (v > wrap) v = first;
+  *r = (*r & ~mask) | (((v / 10) << 4) | (v % 10));
+
+  return v == first;
+}
+
+void SimDS3231::tick (void)
+{
+  static const uint8_t mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  uint8_t month, year, last;
+
+  if (!bcd_inc(&_regs[0], 0x7F, 59, 0)) return;
+  if (!bcd_inc(&_regs[1], 0x7F, 59, 0)) return;
+  if (!bcd_inc(&_regs[2], 0x3F, 23, 0)) return;
+
+  _regs[3] = _regs[3] % 7 + 1;
+
+  month = (_regs[5] & 0x0F) + ((_regs[5] & 0x10) >> 4) * 10;
+  year = (_regs[6] & 0x0F) + (_regs[6] >> 4) * 10;
+  last = mdays[(month - 1) % 12] + (month == 2 && !(year & 3));
+  if (!bcd_inc(&_regs[4], 0x3F, last, 1)) return;
+  if (!bcd_inc(&_regs[5], 0x1F, 12, 1)) return;
+  bcd_inc(&_regs[6], 0xFF, 99, 0);
+}
@@ -0,0 +1,38 @@
+/*
+ * Simulated DS3231 real-time clock (TWI slave)
+ *
+ * The first byte of a write sets the register pointer,
+ * further bytes are stored with auto-increment; reads
+ * start at the register pointer and auto-increment too.
+ * Time registers are held in BCD and advanced once per
+ * second of virtual time.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef SimDS3231_h
+#define SimDS3231_h
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define SIM_DS3231_REGS 0x13
+
+class SimDS3231: public HostI2CDevice, public HostDevice {
+  public:
+    SimDS3231 (void);
+    virtual void i2c_write (const uint8_t *buf, uint8_t n);
+    virtual void i2c_read (uint8_t *buf, uint8_t n);
+    virtual void update (unsigned long us);
+
+    uint8_t reg (uint8_t r) { return _regs[r % SIM_DS3231_REGS]; };
+
+  private:
+    void tick (void);
+
+    uint8_t _regs[SIM_DS3231_REGS];
+    uint8_t _ptr;
+    unsigned long _last;   /* Virtual time of the last tick */
+};
+
+#endif
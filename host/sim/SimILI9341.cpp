@@ -0,0 +1,238 @@
+/*
+ * Simulated ILI9341 display controller
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "SimILI9341.h"
+
+#define CMD_SLEEP_OUT               0x11
+#define CMD_DISPLAY_OFF             0x28
+#define CMD_DISPLAY_ON              0x29
+#define CMD_COLUMN_ADDRESS_SET      0x2A
+#define CMD_PAGE_ADDRESS_SET        0x2B
+#define CMD_MEMORY_WRITE            0x2C
+#define CMD_MEMORY_READ             0x2E
+#define CMD_TEARING_EFFECT_LINE_OFF 0x34
+#define CMD_TEARING_EFFECT_LINE_ON  0x35
+#define CMD_MEMORY_ACCESS_CONTROL   0x36
+#define CMD_WRITE_MEMORY_CONTINUE   0x3C
+#define CMD_READ_MEMORY_CONTINUE    0x3E
+#define CMD_GET_SCANLINE            0x45
+#define CMD_READ_ID4                0xD3
+
+#define MADCTL_MY   0x80
+#define MADCTL_MX   0x40
+#define MADCTL_MV   0x20
+
+SimILI9341::SimILI9341 (uint8_t cs, uint8_t dc): HostSPIDevice(cs), HostPar8Device(cs), _dc(dc), _cmd(0), _nparam(0),
+  _madctl(0), _xs(0), _xe(SIM_ILI9341_WIDTH - 1), _ys(0), _ye(SIM_ILI9341_HEIGHT - 1),
+  _x(0), _y(0), _msb(0), _rpx(0), _wmax(0), _rmax(0), _written(0), _commands(0), _untransacted(0),
+  _period(0), _te(0xFF), _teon(0), _line(0), _beam(0), _rst(0xFF), _rlow(0), _awake(0), _on(0),
+  _trst(0), _tslp(0), _terrors(0), _won(0)
+{
+  memset(_gram, 0, sizeof(_gram));
+}
+
+void SimILI9341::map (int c, int p, int *x, int *y)
+{
+  if (_madctl & MADCTL_MV) {
+    *x = p;
+    *y = c;
+  } else {
+    *x = c;
+    *y = p;
+  }
+  if (_madctl & MADCTL_MX) *x = SIM_ILI9341_WIDTH - 1 - *x;
+  if (_madctl & MADCTL_MY) *y = SIM_ILI9341_HEIGHT - 1 - *y;
+}
+
+uint16_t SimILI9341::pixel (int c, int p)
+{
+  int x, y;
+
+  map(c, p, &x, &y);
+  if (x < 0 || x >= SIM_ILI9341_WIDTH || y < 0 || y >= SIM_ILI9341_HEIGHT) return 0;
+
+  return _gram[y][x];
+}
+
+void SimILI9341::store (uint16_t color)
+{
+  int x, y;
+
+  map(_x, _y, &x, &y);
+  if (x >= 0 && x < SIM_ILI9341_WIDTH && y >= 0 && y < SIM_ILI9341_HEIGHT)
+    _gram[y][x] = color;
+  _written++;
+  if (_period && y == scanline()) _beam++;
+
+  if (++_x > _xe) {
+    _x = _xs;
+    if (++_y > _ye) _y = _ys;
+  }
+}
+
+void SimILI9341::set_refresh (unsigned long period_us, uint8_t te)
+{
+  _period = period_us;
+  _te = te;
+  update(host_time_us());
+}
+
+uint16_t SimILI9341::scanline (void)
+{
+  if (!_period) return 0;
+
+  return (host_time_us() % _period) * SIM_ILI9341_LINES / _period;
+}
+
+void SimILI9341::update (unsigned long us)
+{
+  uint8_t level;
+
+  watch_reset();
+  if (_te == 0xFF) return;
+
+  level = _teon && _period && (us % _period) * SIM_ILI9341_LINES / _period >= SIM_ILI9341_HEIGHT ? HIGH : LOW;
+  if (host_pin_level(_te) != level) host_pin_drive(_te, level);
+}
+
+/* Next byte of a memory read: 6 bits per channel, left aligned */
+uint8_t SimILI9341::fetch (void)
+{
+  uint8_t c = (_nparam - 1) % 3;
+
+  if (c == 0) {
+    _rpx = pixel(_x, _y);
+    if (++_x > _xe) {
+      _x = _xs;
+      if (++_y > _ye) _y = _ys;
+    }
+  }
+
+  switch (c) {
+  case 0:
+    return (_rpx >> 8) & 0xF8;
+  case 1:
+    return (_rpx >> 3) & 0xFC;
+  default:
+    return (_rpx << 3) & 0xF8;
+  }
+}
+
+void SimILI9341::watch_reset (void)
+{
+  uint8_t low;
+
+  if (_rst == 0xFF) return;
+
+  low = host_pin_level(_rst) == LOW;
+  if (_rlow && !low) {    /* Out of reset: sleep in, display off, full window */
+    _trst = host_time_us();
+    _awake = 0;
+    _on = 0;
+    _xs = 0; _xe = SIM_ILI9341_WIDTH - 1;
+    _ys = 0; _ye = SIM_ILI9341_HEIGHT - 1;
+  }
+  _rlow = low;
+}
+
+void SimILI9341::timing (uint8_t cmd)
+{
+  unsigned long now = host_time_us();
+
+  watch_reset();
+  if (_rlow || now - _trst < 5000 || (_awake && now - _tslp < 5000)) _terrors++;
+  if (cmd == CMD_SLEEP_OUT) {
+    if (now - _trst < 120000) _terrors++;
+    _tslp = now;
+    _awake = 1;
+  }
+}
+
+uint8_t SimILI9341::spi_transfer (uint8_t mosi)
+{
+  uint32_t clock = SPI.host_settings().clock;
+  uint8_t miso;
+
+  if (!SPI.host_in_transaction()) _untransacted++;
+
+  if (_wmax && clock > _wmax && host_pin_level(_dc) == HIGH)
+    mosi ^= 0x04;     /* Marginal link: a data line is sampled wrong */
+
+  miso = cycle(mosi);
+
+  if (_rmax && clock > _rmax && host_pin_level(_dc) == HIGH) miso ^= 0x10;
+
+  return miso;
+}
+
+uint8_t SimILI9341::cycle (uint8_t mosi)
+{
+  uint8_t miso = 0xFF;
+
+  if (host_pin_level(_dc) == LOW) {
+    _cmd = mosi;
+    _nparam = 0;
+    _commands++;
+    if (_rst != 0xFF) timing(mosi);
+    if (_cmd == CMD_DISPLAY_ON) {
+      _on = 1;
+      _won = _written;
+    }
+    if (_cmd == CMD_DISPLAY_OFF) _on = 0;
+    if (_cmd == CMD_MEMORY_WRITE || _cmd == CMD_MEMORY_READ) {
+      _x = _xs;
+      _y = _ys;
+    }
+    if (_cmd == CMD_TEARING_EFFECT_LINE_OFF) _teon = 0;
+    return 0xFF;
+  }
+
+  switch (_cmd) {
+  case CMD_COLUMN_ADDRESS_SET:
+  case CMD_PAGE_ADDRESS_SET:
+    if (_nparam < 4) _param[_nparam] = mosi;
+    if (_nparam == 3) {
+      if (_cmd == CMD_COLUMN_ADDRESS_SET) {
+        _xs = (_param[0] << 8) | _param[1];
+        _xe = (_param[2] << 8) | _param[3];
+      } else {
+        _ys = (_param[0] << 8) | _param[1];
+        _ye = (_param[2] << 8) | _param[3];
+      }
+    }
+    break;
+  case CMD_MEMORY_ACCESS_CONTROL:
+    if (_nparam == 0) _madctl = mosi;
+    break;
+  case CMD_MEMORY_WRITE:
+  case CMD_WRITE_MEMORY_CONTINUE:
+    if (_nparam & 1)
+      store(((uint16_t) _msb << 8) | mosi);
+    else
+      _msb = mosi;
+    break;
+  case CMD_MEMORY_READ:
+  case CMD_READ_MEMORY_CONTINUE:
+    if (_nparam) miso = fetch();    /* First byte is a dummy one */
+    break;
+  case CMD_TEARING_EFFECT_LINE_ON:
+    _teon = 1;
+    break;
+  case CMD_GET_SCANLINE:
+    if (_nparam == 0) _line = scanline();
+    else if (_nparam == 1) miso = _line >> 8;
+    else if (_nparam == 2) miso = _line;
+    break;
+  case CMD_READ_ID4:
+    if (_nparam == 2) miso = 0x93;
+    else if (_nparam == 3) miso = 0x41;
+    else miso = 0x00;
+    break;
+  }
+  _nparam++;
+
+  return miso;
+}
@@ -0,0 +1,95 @@
+/*
+ * Simulated ILI9341 display controller (SPI or 8080 parallel slave)
+ *
+ * Decodes the command set the ILI9341 library uses and
+ * keeps a 240 x 320 frame memory with the window and
+ * scanning direction semantics of the real controller.
+ *
+ * Link quality can be degraded with set_limits(): data
+ * shifted faster than the given clocks gets corrupted.
+ *
+ * With set_refresh() the panel is scanned line by line
+ * (320 lines plus 4 of vertical blanking per period),
+ * GET_SCANLINE reports the line being scanned and the TE
+ * pin is high during vertical blanking once enabled.
+ *
+ * With set_reset() commands are checked against the power up
+ * timing: none during reset, nor within 5 ms of its end or of
+ * sleep out, and sleep out no sooner than 120 ms after reset.
+ * The end of a reset pulse is seen as the time advances; it
+ * sets the window back to the full screen.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef SimILI9341_h
+#define SimILI9341_h
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "Par8.h"
+
+#define SIM_ILI9341_WIDTH   240
+#define SIM_ILI9341_HEIGHT  320
+#define SIM_ILI9341_LINES   324   /* Including vertical blanking */
+
+class SimILI9341: public HostSPIDevice, public HostPar8Device, public HostDevice {
+  public:
+    SimILI9341 (uint8_t cs, uint8_t dc);
+    virtual uint8_t spi_transfer (uint8_t mosi);
+    virtual void par8_write (uint8_t d) { cycle(d); };
+    virtual uint8_t par8_read (void) { return cycle(0); };
+    virtual void update (unsigned long us);
+
+    /* Pixel at column/page address (c, p) as seen through the current MADCTL */
+    uint16_t pixel (int c, int p);
+    unsigned long pixels_written (void) { return _written; };
+    unsigned long commands (void) { return _commands; };
+    uint8_t madctl (void) { return _madctl; };
+
+    /* Fastest clocks (Hz) data is written/read reliably at, 0: no limit */
+    void set_limits (uint32_t wmax, uint32_t rmax) { _wmax = wmax; _rmax = rmax; };
+    unsigned long untransacted (void) { return _untransacted; };  /* Bytes shifted outside SPI transactions */
+
+    /* Refresh period (0: no scanning) and TE pin (0xFF: none) */
+    void set_refresh (unsigned long period_us, uint8_t te);
+    uint16_t scanline (void);
+    unsigned long beam_writes (void) { return _beam; };   /* Pixels written to the line being scanned */
+
+    /* Reset pin (0xFF: none), timing violations, display on state */
+    void set_reset (uint8_t rst) { _rst = rst; _rlow = 0; _awake = 0; };
+    unsigned long timing_errors (void) { return _terrors; };
+    uint8_t display_on (void) { return _on; };
+    unsigned long written_at_on (void) { return _won; };   /* pixels_written() as the display last went on */
+
+  private:
+    uint8_t cycle (uint8_t in);
+    void map (int c, int p, int *x, int *y);
+    void store (uint16_t color);
+    uint8_t fetch (void);
+    void watch_reset (void);
+    void timing (uint8_t cmd);
+
+    uint8_t _dc;
+    uint8_t _cmd;         /* Command in progress */
+    unsigned long _nparam;  /* Parameter bytes received for it */
+    uint8_t _param[4];
+    uint8_t _madctl;
+    uint16_t _xs, _xe, _ys, _ye;  /* Window */
+    uint16_t _x, _y;              /* Write pointer */
+    uint8_t _msb;
+    uint16_t _rpx;                /* Pixel being read */
+    uint32_t _wmax, _rmax;
+    unsigned long _written, _commands, _untransacted;
+    unsigned long _period;        /* Refresh period (us) */
+    uint8_t _te, _teon;           /* TE pin, TE output enabled */
+    uint16_t _line;               /* Latched by GET_SCANLINE */
+    unsigned long _beam;
+    uint8_t _rst, _rlow;          /* Reset pin, low when last seen */
+    uint8_t _awake, _on;          /* Out of sleep, display on */
+    unsigned long _trst, _tslp;   /* End of reset, sleep out (us) */
+    unsigned long _terrors, _won;
+    uint16_t _gram[SIM_ILI9341_HEIGHT][SIM_ILI9341_WIDTH];
+};
+
+#endif
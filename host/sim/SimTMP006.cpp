@@ -0,0 +1,95 @@
+/*
+ * Simulated TMP006 infrared thermopile sensor
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "SimTMP006.h"
+
+#define REG_VOBJ    0x00
+#define REG_TAMB    0x01
+#define REG_CONFIG  0x02
+#define REG_MANID   0xFE
+#define REG_DEVID   0xFF
+
+#define CFG_RESET   0x8000
+#define CFG_MODEON  0x7000
+#define CFG_DRDYEN  0x0100
+#define CFG_DRDY    0x0080
+#define CFG_DEFAULT 0x7400  /* Power-on value: continuous, 4 samples */
+
+SimTMP006::SimTMP006 (uint8_t drdy_pin): _drdy(drdy_pin), _ptr(0), _config(CFG_DEFAULT),
+  _vobj(0), _tamb(0), _next_vobj(0), _next_tamb(25 << 7), _start(0), _conversions(0)
+{
+}
+
+void SimTMP006::i2c_write (const uint8_t *buf, uint8_t n)
+{
+  uint16_t val;
+
+  if (!n) return;
+
+  _ptr = buf[0];
+  if (n < 3 || _ptr != REG_CONFIG) return;
+
+  val = ((uint16_t) buf[1] << 8) | buf[2];
+  if (val & CFG_RESET) val = CFG_DEFAULT;
+
+  /* A configuration write aborts the conversion in progress */
+  _config = val & ~CFG_DRDY;
+  _start = host_time_us();
+  if (_drdy != 0xFF) host_pin_drive(_drdy, HIGH);
+}
+
+void SimTMP006::i2c_read (uint8_t *buf, uint8_t n)
+{
+  uint16_t val;
+
+  switch (_ptr) {
+  case REG_VOBJ:
+    val = _vobj;
+    break;
+  case REG_TAMB:
+    val = _tamb;
+    break;
+  case REG_CONFIG:
+    val = _config;
+    break;
+  case REG_MANID:
+    val = 0x5449;
+    break;
+  case REG_DEVID:
+    val = 0x0067;
+    break;
+  default:
+    val = 0;
+  }
+
+  if (_ptr == REG_VOBJ || _ptr == REG_TAMB) {
+    _config &= ~CFG_DRDY;
+    if (_drdy != 0xFF) host_pin_drive(_drdy, HIGH);
+  }
+
+  if (n > 0) buf[0] = val >> 8;
+  if (n > 1) buf[1] = val;
+}
+
+void SimTMP006::update (unsigned long us)
+{
+  unsigned long period;
+
+  if ((_config & CFG_MODEON) != CFG_MODEON) {
+    _start = us;
+    return;
+  }
+
+  period = 250000UL << ((_config >> 9) & 0x07);
+  while (us - _start >= period) {
+    _start += period;
+    _vobj = _next_vobj;
+    _tamb = _next_tamb;
+    _conversions++;
+    _config |= CFG_DRDY;
+    if (_drdy != 0xFF && (_config & CFG_DRDYEN)) host_pin_drive(_drdy, LOW);
+  }
+}
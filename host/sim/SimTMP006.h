@@ -0,0 +1,44 @@
+/*
+ * Simulated TMP006 infrared thermopile sensor (TWI slave)
+ *
+ * Register protocol as per datasheet: the first byte of a
+ * write is the register pointer, two more bytes (MSB first)
+ * are written to the configuration register. Conversions
+ * complete every 250 ms times the number of averaged samples
+ * of virtual time while in continuous conversion mode;
+ * completion sets DRDY in the configuration register and,
+ * if enabled, pulls the DRDY pin low. Reading either result
+ * register releases both.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#ifndef SimTMP006_h
+#define SimTMP006_h
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class SimTMP006: public HostI2CDevice, public HostDevice {
+  public:
+    SimTMP006 (uint8_t drdy_pin = 0xFF);
+    virtual void i2c_write (const uint8_t *buf, uint8_t n);
+    virtual void i2c_read (uint8_t *buf, uint8_t n);
+    virtual void update (unsigned long us);
+
+    /* Values latched by the next conversion */
+    void set_result (int16_t vobj, int16_t tamb) { _next_vobj = vobj; _next_tamb = tamb; };
+    uint16_t config (void) { return _config; };
+    unsigned long conversions (void) { return _conversions; };
+
+  private:
+    uint8_t _drdy;
+    uint8_t _ptr;
+    uint16_t _config;
+    int16_t _vobj, _tamb;
+    int16_t _next_vobj, _next_tamb;
+    unsigned long _start;         /* Virtual time the current conversion began */
+    unsigned long _conversions;
+};
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * Host stand-in for the Arduino core: virtual time, pins,
+ * interrupts and serial ports
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include <stdio.h>
+
+#include "Arduino.h"
+
+HOST_counters_t host_counters;
+
+Serial_ Serial;
+HardwareSerial Serial1;
+
+static unsigned long now_us;
+static uint8_t pin_level[HOST_NUM_PINS];
+static uint8_t pin_mode[HOST_NUM_PINS];
+static void (*pin_isr[HOST_NUM_PINS])(void);
+static int pin_isr_mode[HOST_NUM_PINS];
+static HostDevice *devices;
+
+/*----------------------------------------------*/
+/* Virtual time                                 */
+/*----------------------------------------------*/
+
+HostDevice::HostDevice (void)
+{
+  _next = devices;
+  devices = this;
+}
+
+HostDevice::~HostDevice ()
+{
+  HostDevice **p;
+
+  for (p = &devices; *p; p = &(*p)->_next) {
+    if (*p == this) {
+      *p = _next;
+      break;
+    }
+  }
+}
+
+void host_advance_us (unsigned long us)
+{
+  HostDevice *d;
+
+  now_us += us;
+  for (d = devices; d; d = d->_next)
+    d->update(now_us);
+}
+
+unsigned long host_time_us (void)
+{
+  return now_us;
+}
+
+unsigned long micros (void)
+{
+  host_advance_us(1);
+  return now_us;
+}
+
+unsigned long millis (void)
+{
+  host_advance_us(1);
+  return now_us / 1000;
+}
+
+void delay (unsigned long ms)
+{
+  host_advance_us(ms * 1000);
+}
+
+void delayMicroseconds (unsigned int us)
+{
+  host_advance_us(us);
+}
+
+void yield (void)
+{
+  host_advance_us(1);
+}
+
+void host_reset (void)
+{
+  uint8_t i;
+
+  now_us = 0;
+  memset(&host_counters, 0, sizeof(host_counters));
+  for (i = 0; i < HOST_NUM_PINS; i++) {
+    pin_level[i] = HIGH;
+    pin_mode[i] = INPUT;
+    pin_isr[i] = 0;
+  }
+  Serial = Serial_();
+  Serial1 = HardwareSerial();
+}
+
+/*----------------------------------------------*/
+/* Pins and interrupts                          */
+/*----------------------------------------------*/
+
+void pinMode (uint8_t pin, uint8_t mode)
+{
+  if (pin < HOST_NUM_PINS) pin_mode[pin] = mode;
+}
+
+void digitalWrite (uint8_t pin, uint8_t val)
+{
+  if (pin < HOST_NUM_PINS) pin_level[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead (uint8_t pin)
+{
+  host_advance_us(0);   /* Let devices catch up */
+  return pin < HOST_NUM_PINS ? pin_level[pin] : LOW;
+}
+
+uint8_t host_pin_level (uint8_t pin)
+{
+  return pin < HOST_NUM_PINS ? pin_level[pin] : LOW;
+}
+
+void host_pin_drive (uint8_t pin, uint8_t val)
+{
+  uint8_t old;
+
+  if (pin >= HOST_NUM_PINS) return;
+
+  old = pin_level[pin];
+  pin_level[pin] = val ? HIGH : LOW;
+  if (!pin_isr[pin] || old == pin_level[pin]) return;
+
+  if (pin_isr_mode[pin] == CHANGE ||
+      (pin_isr_mode[pin] == FALLING && !val) ||
+      (pin_isr_mode[pin] == RISING && val))
+    pin_isr[pin]();
+}
+
+void attachInterrupt (uint8_t irq, void (*isr)(void), int mode)
+{
+  if (irq >= HOST_NUM_PINS) return;
+  pin_isr[irq] = isr;
+  pin_isr_mode[irq] = mode;
+}
+
+void detachInterrupt (uint8_t irq)
+{
+  if (irq < HOST_NUM_PINS) pin_isr[irq] = 0;
+}
+
+void noInterrupts (void)
+{
+}
+
+void interrupts (void)
+{
+}
+
+/*----------------------------------------------*/
+/* Serial ports                                 */
+/*----------------------------------------------*/
+
+int Serial_::available (void)
+{
+  return (int) (_rxhead - _rxtail);
+}
+
+int Serial_::read (void)
+{
+  if (_rxtail == _rxhead) return -1;
+  host_counters.serial_rx++;
+  return _rx[_rxtail++ % sizeof(_rx)];
+}
+
+size_t Serial_::readBytes (char *buf, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n && available(); i++)
+    buf[i] = (char) read();
+  return i;
+}
+
+size_t Serial_::write (uint8_t c)
+{
+  host_counters.serial_tx++;
+  if (_txlen < sizeof(_tx) - 1) _tx[_txlen++] = (char) c;
+  return 1;
+}
+
+size_t Serial_::write (const uint8_t *buf, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) write(buf[i]);
+  return n;
+}
+
+size_t Serial_::print (const char *s)
+{
+  size_t n = 0;
+
+  while (*s) n += write((uint8_t) *s++);
+  return n;
+}
+
+size_t Serial_::print (const __FlashStringHelper *s)
+{
+  return print(reinterpret_cast<const char *>(s));
+}
+
+size_t Serial_::print (char c)
+{
+  return write((uint8_t) c);
+}
+
+size_t Serial_::print (long n, int base)
+{
+  char buf[40];
+
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", n);
+  return print(buf);
+}
+
+size_t Serial_::print (unsigned long n, int base)
+{
+  char buf[40];
+
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", n);
+  return print(buf);
+}
+
+size_t Serial_::print (double n, int digits)
+{
+  char buf[40];
+
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return print(buf);
+}
+
+void Serial_::host_feed (const uint8_t *buf, size_t n)
+{
+  while (n--) {
+    if (_rxhead - _rxtail >= sizeof(_rx)) break;
+    _rx[_rxhead++ % sizeof(_rx)] = *buf++;
+  }
+}
+
+void Serial_::host_feed (const char *s)
+{
+  host_feed((const uint8_t *) s, strlen(s));
+}
+
+size_t Serial_::host_take (char *buf, size_t size)
+{
+  size_t n = _txlen < size - 1 ? _txlen : size - 1;
+
+  memcpy(buf, _tx, n);
+  buf[n] = 0;
+  memmove(_tx, _tx + n, _txlen - n);
+  _txlen -= n;
+
+  return n;
+}
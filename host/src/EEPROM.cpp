@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for the EEPROM library
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read (int idx)
+{
+  return idx >= 0 && idx < HOST_EEPROM_SIZE ? _mem[idx] : 0xFF;
+}
+
+void EEPROMClass::write (int idx, uint8_t val)
+{
+  if (idx < 0 || idx >= HOST_EEPROM_SIZE) return;
+  _mem[idx] = val;
+  host_counters.eeprom_writes++;
+}
+
+void EEPROMClass::update (int idx, uint8_t val)
+{
+  if (read(idx) != val) write(idx, val);
+}
+
+void EEPROMClass::host_erase (void)
+{
+  memset(_mem, 0xFF, sizeof(_mem));
+}
@@ -0,0 +1,67 @@
+/*
+ * Host stand-in for an 8080 8-bit parallel bus
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "Par8.h"
+
+#define WRITE_NS  (4000000000ULL / F_CPU)
+#define READ_NS   (8000000000ULL / F_CPU)
+
+Par8Class Par8;
+
+static HostPar8Device *devices;
+
+HostPar8Device::HostPar8Device (uint8_t cs): _cs(cs)
+{
+  _next = devices;
+  devices = this;
+}
+
+HostPar8Device::~HostPar8Device ()
+{
+  HostPar8Device **p;
+
+  for (p = &devices; *p; p = &(*p)->_next) {
+    if (*p == this) {
+      *p = _next;
+      break;
+    }
+  }
+}
+
+void Par8Class::cycle (unsigned long ns)
+{
+  host_counters.par8_bytes++;
+  _ns += ns;
+  if (_ns >= 1000) {
+    host_advance_us(_ns / 1000);
+    _ns %= 1000;
+  }
+}
+
+void Par8Class::write (uint8_t d)
+{
+  HostPar8Device *dev;
+
+  cycle(WRITE_NS);
+  for (dev = devices; dev; dev = dev->_next) {
+    if (host_pin_level(dev->_cs) == LOW)
+      dev->par8_write(d);
+  }
+}
+
+uint8_t Par8Class::read (void)
+{
+  HostPar8Device *dev;
+  uint8_t d = 0xFF;   /* Pulled up */
+
+  cycle(READ_NS);
+  for (dev = devices; dev; dev = dev->_next) {
+    if (host_pin_level(dev->_cs) == LOW)
+      d &= dev->par8_read();
+  }
+  return d;
+}
@@ -0,0 +1,163 @@
+/*
+ * Host stand-in for the SPI library
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "SPI.h"
+
+SPIClass SPI;
+
+static HostSPIDevice *devices;
+
+/* Asynchronous transfer under way: the bus is busy until the virtual
+   time gets to its end, the buffer being read only then */
+class SPIAsync: public HostDevice {
+  public:
+    SPIAsync (void): event(0) { };
+
+    void update (unsigned long us) {
+      EventResponder *e;
+
+      if (event && (us >= end || us < start)) {   /* Done, or the time was reset */
+        e = event;
+        event = 0;
+        deliver();
+        e->triggerEvent();
+      }
+    };
+
+    EventResponder *event;
+    unsigned long start, end;
+    const uint8_t *tx;
+    uint8_t *rx;
+    size_t count;
+
+  private:
+    void deliver (void) {
+      HostSPIDevice *d;
+      uint8_t miso;
+
+      while (count--) {
+        miso = 0xFF;
+        for (d = devices; d; d = d->_next) {
+          if (host_pin_level(d->_cs) == LOW)
+            miso &= d->spi_transfer(tx ? *tx : 0);
+        }
+        if (tx) tx++;
+        if (rx) *rx++ = miso;
+      }
+    };
+};
+
+static SPIAsync async;
+
+HostSPIDevice::HostSPIDevice (uint8_t cs): _cs(cs)
+{
+  _next = devices;
+  devices = this;
+}
+
+HostSPIDevice::~HostSPIDevice ()
+{
+  HostSPIDevice **p;
+
+  for (p = &devices; *p; p = &(*p)->_next) {
+    if (*p == this) {
+      *p = _next;
+      break;
+    }
+  }
+}
+
+void SPIClass::beginTransaction (SPISettings settings)
+{
+  uint8_t shift;
+
+  /* Fastest clock not above the requested one, as the AVR core does */
+  for (shift = 1; shift < 7 && (F_CPU >> shift) > settings.clock; shift++) ;
+  settings.clock = F_CPU >> shift;
+
+  _settings = settings;
+  _intx++;
+}
+
+void SPIClass::endTransaction (void)
+{
+  if (_intx) _intx--;
+}
+
+void SPIClass::setClockDivider (uint8_t div)
+{
+  static const uint8_t shift[] = { 2, 4, 6, 7, 1, 3, 5 };  /* Indexed by SPI_CLOCK_DIVx */
+
+  if (div < sizeof(shift)) _settings.clock = F_CPU >> shift[div];
+}
+
+uint8_t SPIClass::transfer (uint8_t data)
+{
+  HostSPIDevice *d;
+  uint8_t miso = 0xFF;
+
+  wait_async();
+  host_counters.spi_bytes++;
+  _ns += 8000000000ULL / _settings.clock;
+  if (_ns >= 1000) {
+    host_advance_us(_ns / 1000);
+    _ns %= 1000;
+  }
+
+  for (d = devices; d; d = d->_next) {
+    if (host_pin_level(d->_cs) == LOW)
+      miso &= d->spi_transfer(data);
+  }
+
+  return miso;
+}
+
+uint16_t SPIClass::transfer16 (uint16_t data)
+{
+  uint8_t msb = transfer(data >> 8);
+
+  return ((uint16_t) msb << 8) | transfer(data);
+}
+
+void SPIClass::transfer (void *buf, size_t count)
+{
+  uint8_t *p = (uint8_t *) buf;
+
+  while (count--) {
+    *p = transfer(*p);
+    p++;
+  }
+}
+
+bool SPIClass::transfer (const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event)
+{
+  unsigned long long ns;
+
+  wait_async();
+  host_counters.spi_bytes += count;
+  ns = (unsigned long long) count * 8000000000ULL / _settings.clock;
+
+  async.tx = (const uint8_t *) txBuffer;   /* Delivered when done */
+  async.rx = (uint8_t *) rxBuffer;
+  async.count = count;
+  async.start = host_time_us();
+  async.end = async.start + (unsigned long) ((ns + 999) / 1000);
+  async.event = &event;
+  return true;
+}
+
+byte SPIClass::host_async_busy (void)
+{
+  return async.event != 0;
+}
+
+void SPIClass::wait_async (void)
+{
+  unsigned long now = host_time_us();
+
+  if (async.event) host_advance_us(now >= async.start && now < async.end ? async.end - now : 0);
+}
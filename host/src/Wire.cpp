@@ -0,0 +1,80 @@
+/*
+ * Host stand-in for the Wire (TWI) library
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "Wire.h"
+
+TwoWire Wire;
+
+TwoWire::TwoWire (void): _addr(0), _txlen(0), _rxlen(0), _rxpos(0)
+{
+  memset(_devs, 0, sizeof(_devs));
+}
+
+void TwoWire::host_attach (uint8_t address, HostI2CDevice *dev)
+{
+  if (address < 128) _devs[address] = dev;
+}
+
+void TwoWire::host_detach (uint8_t address)
+{
+  if (address < 128) _devs[address] = 0;
+}
+
+void TwoWire::beginTransmission (uint8_t address)
+{
+  _addr = address;
+  _txlen = 0;
+}
+
+size_t TwoWire::write (uint8_t data)
+{
+  if (_txlen >= BUFFER_LENGTH) return 0;
+  _tx[_txlen++] = data;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission (uint8_t sendStop)  /* 0: success, 2: address NACK */
+{
+  HostI2CDevice *dev = _addr < 128 ? _devs[_addr] : 0;
+
+  host_counters.i2c_transactions++;
+  host_counters.i2c_bytes++;  /* Address */
+  if (!dev) return 2;
+
+  host_counters.i2c_bytes += _txlen;
+  dev->i2c_write(_tx, _txlen);
+  _txlen = 0;
+
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom (uint8_t address, uint8_t quantity, uint8_t sendStop)
+{
+  HostI2CDevice *dev = address < 128 ? _devs[address] : 0;
+
+  _rxlen = _rxpos = 0;
+  host_counters.i2c_transactions++;
+  host_counters.i2c_bytes++;  /* Address */
+  if (!dev) return 0;
+
+  if (quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+  dev->i2c_read(_rx, quantity);
+  host_counters.i2c_bytes += quantity;
+  _rxlen = quantity;
+
+  return quantity;
+}
+
+int TwoWire::available (void)
+{
+  return _rxlen - _rxpos;
+}
+
+int TwoWire::read (void)
+{
+  return _rxpos < _rxlen ? _rx[_rxpos++] : -1;
+}
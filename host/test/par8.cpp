@@ -0,0 +1,121 @@
+/*
+ * Host tests for ILI9341 on the 8080 parallel bus (built with ILI9341_BUS=ILI9341_BUS_PAR8)
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "Par8.h"
+
+#include "XUtils.h"
+#include "ILI9341.h"
+
+#include "SimILI9341.h"
+
+#define TFT_CS  10
+#define TFT_RST 9
+#define TFT_DC  8
+#define TFT_WR  7
+#define TFT_RD  6
+
+static int failures, checks;
+
+#define CHECK(c) do { \
+  checks++; \
+  if (!(c)) { \
+    failures++; \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+  } \
+} while (0)
+
+/* Collects a capture stream */
+class CaptureSink: public XUtils {
+  public:
+    CaptureSink (void): len(0) { };
+    void xputc (char c) { if (len < sizeof(buf)) buf[len++] = c; };
+    char xgetc (void) { return 0; };
+
+    uint8_t buf[4096];
+    unsigned long len;
+};
+
+static void count_line (void *ctx)
+{
+  (*(int *) ctx)++;
+}
+
+static void test_par8 (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC, TFT_WR, TFT_RD);
+  static const uint16_t pat[6] = { 1, 2, 3, 4, 5, 6 };
+  static uint16_t lines[2 * 8];
+  CaptureSink cap;
+  unsigned long t0, bytes;
+  int x, y, lit, sent = 0;
+  uint16_t *p;
+
+  host_reset();
+  tft.init();
+  CHECK(host_pin_level(TFT_CS) == HIGH && host_pin_level(TFT_WR) == HIGH && host_pin_level(TFT_RD) == HIGH);
+  CHECK(sim.pixels_written() == 240UL * 320);
+  CHECK(host_counters.spi_bytes == 0 && host_counters.par8_bytes > 240UL * 320 * 2);
+  CHECK(tft.read_id() == ILI9341_ID);
+
+  /* The drawing code is the same as on SPI */
+  tft.rectfill(10, 19, 20, 24, C_RED);
+  CHECK(sim.pixel(10, 20) == C_RED && sim.pixel(19, 24) == C_RED);
+  CHECK(sim.pixel(9, 20) == C_BLACK && sim.pixel(20, 24) == C_BLACK && sim.pixel(10, 25) == C_BLACK);
+  tft.blt(0, 2, 0, 1, pat);
+  CHECK(sim.pixel(0, 0) == 1 && sim.pixel(2, 0) == 3 && sim.pixel(0, 1) == 4 && sim.pixel(2, 1) == 6);
+  tft.line(0, 100, 50, 150, C_WHITE);
+  CHECK(sim.pixel(0, 100) == C_WHITE && sim.pixel(25, 125) == C_WHITE && sim.pixel(50, 150) == C_WHITE);
+  tft.font_color(((uint32_t) C_BLACK << 16) | C_YELLOW);
+  tft.locate(0, 20);
+  tft.xputc('A');
+  for (lit = 0, y = 0; y < tft.get_font_height(); y++)
+    for (x = 0; x < tft.get_font_width(); x++)
+      lit += sim.pixel(x, 20 * tft.get_font_height() + y) == C_YELLOW;
+  CHECK(lit > 0 && lit < tft.get_font_width() * tft.get_font_height());
+
+  /* Reads turn the port around and back */
+  tft.rectfill(100, 102, 200, 201, C_GREEN);
+  CHECK(tft.capture(100, 102, 200, 201, cap) == 1 && cap.len == 6 + 3 + 2);
+  CHECK(cap.buf[6] == 0x85 && (cap.buf[7] << 8 | cap.buf[8]) == C_GREEN);   /* One run of 6 */
+  tft.rectfill(100, 100, 200, 200, C_BLUE);
+  CHECK(sim.pixel(100, 200) == C_BLUE);
+
+  /* A byte per strobe: a full screen in a fraction of the SPI time */
+  t0 = host_time_us();
+  bytes = host_counters.par8_bytes;
+  tft.rectfill(0, 239, 0, 319, C_BLUE);
+  CHECK(host_counters.par8_bytes - bytes < 240UL * 320 * 2 + 16);
+  CHECK(host_time_us() - t0 < 240UL * 320 * 16 / (ILI9341_WRITE_CLOCK / 1000000) / 3);
+
+  /* No DMA: lines are written as they are sent, pixels left as they are */
+  tft.on_line_sent(count_line, &sent);
+  CHECK(tft.begin_lines(30, 37, 40, 43, lines) == 1);
+  for (y = 0; y < 4; y++) {
+    p = tft.line_buffer();
+    for (x = 0; x < 8; x++) p[x] = (uint16_t) (y << 8 | x);
+    tft.send_line();
+    CHECK(sent == y + 1 && p[7] == (uint16_t) (y << 8 | 7));
+  }
+  tft.end_write();
+  tft.on_line_sent(0, 0);
+  CHECK(sim.pixel(30, 40) == 0x0000 && sim.pixel(37, 40) == 0x0007 && sim.pixel(30, 43) == 0x0300 && sim.pixel(37, 43) == 0x0307);
+
+  CHECK(host_pin_level(TFT_CS) == HIGH && SPI.host_in_transaction() == 0);
+}
+
+int main (void)
+{
+  test_par8();
+
+  printf("%d checks, %d failures\n", checks, failures);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,2255 @@
+/*
+ * Host unit tests for the libraries
+ *
+ * Each test resets the virtual time and the bus counters,
+ * drives the library under test and checks the result
+ * against simulated devices or a reference computation.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "SPI.h"
+#include "EEPROM.h"
+
+#include "XUtils.h"
+#include "XConsole.h"
+#undef CAN_DETECT_SERIAL_DISCONNECT   /* Both consoles define it */
+#include "XHardwareConsole.h"
+#include "RTC.h"
+#include "TMP006.h"
+#include "ILI9341.h"
+#include "ILI9341Term.h"
+#include "ILI9341QOI.h"
+#include "ILI9341Upload.h"
+#include "XStats.h"
+#include "XLog.h"
+#include "XPerf.h"
+#include "XSched.h"
+#include "XSPIBus.h"
+
+#include "SimDS3231.h"
+#include "SimTMP006.h"
+#include "SimILI9341.h"
+
+static int failures, checks;
+
+#define CHECK(c) do { \
+  checks++; \
+  if (!(c)) { \
+    failures++; \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+  } \
+} while (0)
+
+/* Console output as a string */
+static const char *output (Serial_ &port)
+{
+  static char buf[8192];
+
+  port.host_take(buf, sizeof(buf));
+  return buf;
+}
+
+/*----------------------------------------------*/
+/* XUtils / XConsole / XHardwareConsole         */
+/*----------------------------------------------*/
+
+static void test_xatoi (void)
+{
+  const char *s = " 123 -45 0x1F 0b101 077 x";
+  long v;
+
+  CHECK(XUtils::xatoi(&s, &v) && v == 123);
+  CHECK(XUtils::xatoi(&s, &v) && v == -45);
+  CHECK(XUtils::xatoi(&s, &v) && v == 0x1F);
+  CHECK(XUtils::xatoi(&s, &v) && v == 5);
+  CHECK(XUtils::xatoi(&s, &v) && v == 077);
+  CHECK(!XUtils::xatoi(&s, &v));
+}
+
+static void test_xprintf (void)
+{
+  XConsole con;
+
+  host_reset();
+  con.xprintf(F("%6d,%3d%%|%-6u|%ld|%04x|%08lX|%016b|%-4s|%4s|%c\n"),
+    -200, 5, 100, 12345678L, 0xA3, 0x123ABCL, 0x550F, "abc", "abc", 'a');
+  CHECK(!strcmp(output(Serial),
+    "  -200,  5%|100   |12345678|00a3|00123ABC|0101010100001111|abc | abc|a\r\n"));
+}
+
+static void test_xgets (void)
+{
+  XConsole con;
+  char line[8];
+
+  host_reset();
+  Serial.host_feed("ab\bc\r0123456789\r");
+  CHECK(con.xgets(line, sizeof(line)) == 1 && !strcmp(line, "ac"));
+  CHECK(con.xgets(line, sizeof(line)) == 1 && !strcmp(line, "0123456"));
+  CHECK(!strcmp(output(Serial), "ab\bc\r\n0123456\r\n"));
+
+  /* End of stream when the terminal goes away */
+  Serial.host_dtr(false);
+  CHECK(con.xgets(line, sizeof(line)) == 0);
+}
+
+static void test_hardware_console (void)
+{
+  XHardwareConsole con(Serial1);
+
+  host_reset();
+  con.xputs("x\n");
+  Serial1.host_feed("q");
+  CHECK(con.xgetc() == 'q');
+  CHECK(!strcmp(output(Serial1), "x\r\n"));
+}
+
+static void test_xgets_poll (void)
+{
+  XConsole con;
+  char line[16];
+  int idx = 0;
+
+  host_reset();
+  Serial.host_feed("he");
+  CHECK(con.xgets_poll(line, sizeof(line), &idx) == 2 && idx == 2);
+  CHECK(con.xgets_poll(line, sizeof(line), &idx) == 2 && idx == 2);
+  Serial.host_feed("l\blo\rnext");
+  CHECK(con.xgets_poll(line, sizeof(line), &idx) == 1 && idx == 0 && !strcmp(line, "helo"));
+  CHECK(con.xgets_poll(line, sizeof(line), &idx) == 2 && idx == 4);
+  Serial.host_dtr(false);
+  CHECK(con.xgets_poll(line, sizeof(line), &idx) == 0);
+}
+
+/*----------------------------------------------*/
+/* RTC                                          */
+/*----------------------------------------------*/
+
+static void test_rtc (void)
+{
+  SimDS3231 sim;
+  RTC rtc(DS3231_I2C_ADDRESS);
+  TIME_t t = { 2016, 2, 29, 2, 23, 59, 58 }, r;
+
+  host_reset();
+  Wire.host_attach(DS3231_I2C_ADDRESS, &sim);
+
+  CHECK(rtc.init() == 0);
+  CHECK(rtc.settime(&t) == 1);
+  CHECK(sim.reg(0) == 0x58 && sim.reg(2) == 0x23 && sim.reg(4) == 0x29 && sim.reg(6) == 0x16);
+
+  CHECK(rtc.gettime(&r) == 1);
+  CHECK(!memcmp(&t, &r, sizeof(t)));
+
+  /* The simulated clock rolls over into March */
+  delay(2000);
+  CHECK(rtc.gettime(&r) == 1);
+  CHECK(r.month == 3 && r.mday == 1 && r.hour == 0 && r.min == 0 && r.sec == 0 && r.wday == 3);
+  CHECK(RTC::toepoch(&r) == RTC::toepoch(&t) + 2);
+
+  Wire.host_detach(DS3231_I2C_ADDRESS);
+  CHECK(rtc.init() != 0);
+  CHECK(rtc.gettime(&r) == 0);
+}
+
+static void test_epoch (void)
+{
+  TIME_t t, r;
+  unsigned long e;
+
+  t.year = 2000; t.month = 1; t.mday = 1; t.hour = 0; t.min = 0; t.sec = 0;
+  CHECK(RTC::toepoch(&t) == 0);
+  RTC::fromepoch(0, &r);
+  CHECK(r.wday == 7);   /* Saturday */
+
+  for (e = 0; e < 3153600000UL; e += 86399UL * 7) {
+    RTC::fromepoch(e, &r);
+    CHECK(RTC::toepoch(&r) == e);
+  }
+}
+
+/*----------------------------------------------*/
+/* TMP006                                       */
+/*----------------------------------------------*/
+
+static void test_tmp006 (void)
+{
+  SimTMP006 sim;
+  TMP006 tmp;
+  TMP006_t t;
+  TMP006_fixed_t f;
+
+  host_reset();
+  Wire.host_attach(TMP006_I2C_ADDRESS, &sim);
+  sim.set_result(-300, 25 << 7);
+
+  CHECK(tmp.init(TMP006_CFG_1SAMPLE) == 0);
+  CHECK(sim.config() == (TMP006_CFG_MODEON | TMP006_CFG_1SAMPLE));
+
+  CHECK(tmp.gettemp(&t) == 1);
+  CHECK(fabs(t.tdie - 25.0) < 1e-9);
+  CHECK(t.tobj < t.tdie);
+  CHECK(!(sim.config() & TMP006_CFG_DRDY));
+
+  CHECK(tmp.gettemp_fixed(&f) == 1);
+  CHECK(f.tdie == 2500);
+  CHECK(abs(f.tobj - (int) lround(t.tobj * 100)) <= 6);
+
+  /* Nothing answers */
+  Wire.host_detach(TMP006_I2C_ADDRESS);
+  CHECK(tmp.gettemp(&t) == 0);
+}
+
+static volatile int drdy_count;
+static TMP006 *drdy_sensor;
+
+static void drdy_handler (void)
+{
+  drdy_count++;
+  drdy_sensor->drdy_isr();
+}
+
+static void test_tmp006_poll (void)
+{
+  SimTMP006 sim(2);
+  TMP006 tmp;
+  TMP006_sample_t s;
+  unsigned long bytes;
+  int i;
+
+  host_reset();
+  Wire.host_attach(TMP006_I2C_ADDRESS, &sim);
+  drdy_sensor = &tmp;
+  drdy_count = 0;
+
+  tmp.attach_drdy(2);
+  attachInterrupt(digitalPinToInterrupt(2), drdy_handler, FALLING);
+  CHECK(tmp.init(TMP006_CFG_2SAMPLE | TMP006_CFG_DRDYEN) == 0);
+
+  /* No bus traffic while DRDY is high */
+  bytes = host_counters.i2c_bytes;
+  CHECK(tmp.poll() == 0);
+  CHECK(host_counters.i2c_bytes == bytes);
+
+  for (i = 0; i < 6; i++) {
+    sim.set_result(i, (20 + i) << 7);
+    delay(500);
+    CHECK(tmp.poll() == 1);
+    CHECK(tmp.poll() == 0);
+  }
+  CHECK(drdy_count == 6);
+  CHECK(tmp.available() == TMP006_RING_SIZE);
+  CHECK(tmp.getsample(0, &s) && s.raw.vobj == 5 && s.raw.tamb == 25 << 7);
+  CHECK(tmp.getsample(3, &s) && s.raw.vobj == 2);
+  CHECK(!tmp.getsample(TMP006_RING_SIZE, &s));
+
+  detachInterrupt(digitalPinToInterrupt(2));
+}
+
+static void test_tmp006_array (void)
+{
+  SimTMP006 sim0, sim1;
+  TMP006 t0(0x40), t1(0x41), t2(0x42);
+  TMP006Array arr;
+  int8_t seen[3] = { 0, 0, 0 }, i;
+  int n;
+
+  host_reset();
+  Wire.host_attach(0x40, &sim0);
+  Wire.host_attach(0x41, &sim1);
+
+  CHECK(arr.add(&t0) == 0 && arr.add(&t1) == 1 && arr.add(&t2) == 2);
+  CHECK(arr.start(TMP006_CFG_1SAMPLE) == 2);
+
+  delay(300);
+  for (n = 0; n < 4; n++) {
+    i = arr.poll();
+    if (i >= 0) seen[i]++;
+  }
+  CHECK(seen[0] == 1 && seen[1] == 1 && seen[2] == 0);
+
+  Wire.host_detach(0x40);
+  Wire.host_detach(0x41);
+}
+
+static void test_tmp006_calibration (void)
+{
+  static const TMP006_cal_t cal = { 6.4e-14, 1.75e-3, -1.678e-5, -2.94e-5, -5.7e-7, 4.63e-9, 13.4 };
+  TMP006_cal_t cal2;
+  TMP006 tmp;
+  TMP006_raw_t raw = { 300, 30 << 7 };
+  TMP006_t d0, d1;
+  TMP006_fixed_t f1;
+  int td, bad;
+  long v;
+
+  tmp.convert(&raw, &d0);
+  tmp.set_calibration(&cal);
+  tmp.convert(&raw, &d1);
+  tmp.convert_fixed(&raw, &f1);
+  CHECK(d1.tobj < d0.tobj);
+  CHECK(abs(f1.tobj - (int) lround(d1.tobj * 100)) <= 6);
+
+  tmp.set_calibration(0);
+  tmp.convert(&raw, &d1);
+  CHECK(d1.tobj == d0.tobj);
+
+  /* Out of the fixed-point range: rejected, the defaults kept */
+  cal2 = cal;
+  cal2.a1 = 5e-3;
+  CHECK(tmp.set_calibration(&cal2) == 0);
+  cal2 = cal;
+  cal2.s0 = 0;
+  CHECK(tmp.set_calibration(&cal2) == 0);
+  tmp.convert(&raw, &d1);
+  tmp.convert_fixed(&raw, &f1);
+  CHECK(d1.tobj == d0.tobj && abs(f1.tobj - (int) lround(d0.tobj * 100)) <= 6);
+  CHECK(tmp.set_calibration(&cal) == 1);
+
+  /* At the top of the a2 and b2 ranges, up to the hottest die: no overflow */
+  cal2 = cal;
+  cal2.a2 = 4.88e-4;
+  cal2.b2 = 7.8e-8;
+  CHECK(tmp.set_calibration(&cal2) == 1);
+  for (bad = 0, td = 90 * 32; td <= 125 * 32; td += 32) {
+    raw.tamb = td * 4;
+    for (v = -2000; v <= 2000; v += 100) {
+      raw.vobj = v;
+      tmp.convert(&raw, &d1);
+      tmp.convert_fixed(&raw, &f1);
+      bad += d1.tobj == d1.tobj && fabs(f1.tobj / 100.0 - d1.tobj) > 0.06;
+    }
+  }
+  CHECK(bad == 0);
+  tmp.set_calibration(0);
+}
+
+/* Fixed-point conversion against the double one over the sensor range */
+static void test_tmp006_fixed_bound (void)
+{
+  TMP006 tmp;
+  TMP006_raw_t raw;
+  TMP006_t d;
+  TMP006_fixed_t f;
+  double err, worst = 0;
+  long v;
+  int td;
+
+  for (td = -40 * 32; td <= 125 * 32; td += 8) {
+    raw.tamb = td * 4;
+    for (v = -32768; v <= 32767; v += 7) {
+      raw.vobj = v;
+      tmp.convert(&raw, &d);
+      if (d.tobj != d.tobj || d.tobj < -40 || d.tobj > 200) continue;
+      tmp.convert_fixed(&raw, &f);
+      err = fabs(f.tobj / 100.0 - d.tobj);
+      if (err > worst) worst = err;
+      CHECK(f.tdie == (int) lround(d.tdie * 100) || fabs(f.tdie / 100.0 - d.tdie) < 0.01);
+      if (err > 0.06) {
+        printf("tamb %d vobj %ld: %f vs %f\n", td, v, f.tobj / 100.0, d.tobj);
+        return;
+      }
+    }
+  }
+  printf("  TMP006 fixed-point worst error: %.3f C\n", worst);
+  CHECK(worst <= 0.06);
+}
+
+/*----------------------------------------------*/
+/* XStats                                       */
+/*----------------------------------------------*/
+
+static void test_xstats (void)
+{
+  XMinMax mm(5);
+  XStats st(2, 5, 0.001, 25.0);
+  long hist[64], lo, hi;
+  int i, j;
+
+  srand(1);
+  for (i = 0; i < 64; i++) {
+    hist[i] = rand() % 2001 - 1000;
+    mm.push(hist[i]);
+    lo = hi = hist[i];
+    for (j = i; j >= 0 && j > i - 5; j--) {
+      if (hist[j] < lo) lo = hist[j];
+      if (hist[j] > hi) hi = hist[j];
+    }
+    CHECK(mm.min() == lo && mm.max() == hi);
+  }
+
+  st.set_alarm(0, 1000, 50);
+  for (i = 0; i < 20; i++) st.push(i, 500);
+  CHECK(st.ema() == 500 && st.alarm() == XSTATS_ALARM_NONE);
+  for (i = 0; i < 20; i++) st.push(i, 1200);
+  CHECK(st.alarm() == XSTATS_ALARM_HIGH);
+  for (i = 0; i < 20; i++) st.push(i, 980);
+  CHECK(st.alarm() == XSTATS_ALARM_HIGH);   /* Within hysteresis */
+  for (i = 0; i < 20; i++) st.push(i, 900);
+  CHECK(st.alarm() == XSTATS_ALARM_NONE);
+  CHECK(st.count() == 80 && st.last() == 900);
+}
+
+/*----------------------------------------------*/
+/* XSched                                       */
+/*----------------------------------------------*/
+
+static XSched *sched;
+static int runs_fast, runs_slow, runs_once, runs_event;
+
+static void task_fast (void) { runs_fast++; }
+static void task_slow (void) { runs_slow++; delay(35); }
+static void task_once (void) { runs_once++; }
+static void task_event (void) { runs_event++; }
+static void isr_event (void) { sched->signal(XSCHED_EVENT(3)); }
+
+/* One-shot that re-arms itself while rearm_left > 0 */
+static int rearm_left, rearm_runs, rearm_id;
+static void task_rearm (void)
+{
+  rearm_runs++;
+  delay(3);
+  if (rearm_left-- > 0) rearm_id = sched->after(10, task_rearm);
+}
+
+static void test_xsched (void)
+{
+  XSched s;
+  XSCHED_stats_t st;
+  int8_t fast, slow, once, ev;
+  unsigned long t0;
+
+  host_reset();
+  sched = &s;
+  runs_fast = runs_slow = runs_once = runs_event = 0;
+
+  fast = s.every(10, task_fast);
+  slow = s.every(100, task_slow);
+  once = s.after(55, task_once);
+  ev = s.on_event(XSCHED_EVENT(3), task_event);
+  CHECK(fast >= 0 && slow >= 0 && once >= 0 && ev >= 0);
+  attachInterrupt(digitalPinToInterrupt(5), isr_event, FALLING);
+
+  /* The slow task makes the fast one miss some activations */
+  t0 = millis();
+  while (millis() - t0 < 1000) {
+    s.run();
+    delayMicroseconds(500);
+  }
+  CHECK(runs_slow >= 9 && runs_slow <= 10);
+  CHECK(runs_once == 1);
+  CHECK(!s.getstats(once, &st));          /* Removed once run */
+  CHECK(s.getstats(fast, &st));
+  CHECK(st.runs == (unsigned long) runs_fast && st.misses > 0);
+  CHECK(st.runs + st.misses >= 98 && st.runs + st.misses <= 100);
+  CHECK(st.max_late >= 20 && st.max_late <= 36);
+  CHECK(s.getstats(slow, &st) && st.max_us >= 35000 && st.misses == 0);
+
+  /* Events run their task once per run(), however many signals came in */
+  CHECK(runs_event == 0);
+  host_pin_drive(5, LOW);
+  host_pin_drive(5, HIGH);
+  host_pin_drive(5, LOW);
+  s.run();
+  s.run();
+  CHECK(runs_event == 1);
+
+  s.cancel(fast);
+  s.reset_stats();
+  CHECK(!s.getstats(fast, &st));
+  CHECK(s.getstats(slow, &st) && st.runs == 0);
+
+  /* A one-shot re-arming itself keeps its slot and statistics, then
+     goes once it stops */
+  rearm_left = 2;
+  rearm_runs = 0;
+  once = s.after(5, task_rearm);
+  rearm_id = once;
+  while (rearm_runs < 2) {
+    s.run();
+    delayMicroseconds(500);
+  }
+  CHECK(rearm_id == once && s.getstats(once, &st) && st.runs == 2 && st.max_us >= 3000);
+  while (rearm_runs < 3) {
+    s.run();
+    delayMicroseconds(500);
+  }
+  CHECK(rearm_id == once && !s.getstats(once, &st));
+
+  /* Table full */
+  while (s.after(1000, task_once) >= 0) ;
+  CHECK(s.every(10, task_fast) < 0);
+
+  detachInterrupt(digitalPinToInterrupt(5));
+}
+
+/*----------------------------------------------*/
+/* XLog                                         */
+/*----------------------------------------------*/
+
+/* Store that stops writing after a given number of bytes */
+class FailingStore: public XLogStore {
+  public:
+    FailingStore (void): left(-1) { memset(mem, 0xFF, sizeof(mem)); };
+    virtual uint8_t read (uint16_t addr) { return mem[addr]; };
+    virtual void write (uint16_t addr, uint8_t val) {
+      if (left == 0) return;
+      if (left > 0) left--;
+      mem[addr] = val;
+    };
+
+    uint8_t mem[512];
+    long left;
+};
+
+static void make_record (long i, XLOG_record_t *r)
+{
+  uint8_t c;
+
+  r->time = 1000 + i * 250;
+  for (c = 0; c < XLOG_CHANNELS; c++)
+    r->v[c] = (int16_t) (2500 + (i % 17) * (c + 1) - (i % 5) * 3);
+  if (i % 50 == 49) r->time += 100000;  /* Forces a key record */
+}
+
+static byte same_record (const XLOG_record_t *a, const XLOG_record_t *b)
+{
+  uint8_t c;
+
+  if (a->time != b->time) return 0;
+  for (c = 0; c < XLOG_CHANNELS; c++)
+    if (a->v[c] != b->v[c]) return 0;
+  return 1;
+}
+
+static void test_xlog (void)
+{
+  XLogEEPROM eeprom;
+  XLog log(eeprom, 32, 512);
+  XLOG_record_t w, r;
+  long i, first, n;
+
+  host_reset();
+  EEPROM.host_erase();
+  CHECK(log.begin() == 0);
+  for (i = 0; i < 300; i++) {
+    make_record(i, &w);
+    CHECK(log.append(&w));
+  }
+
+  /* Wrapped: the oldest records are gone, the rest reads back in order */
+  XLog again(eeprom, 32, 512);
+  CHECK(again.begin() > 0);
+  again.rewind();
+  CHECK(again.read(&r));
+  for (first = 0; first < 300; first++) {
+    make_record(first, &w);
+    if (same_record(&w, &r)) break;
+  }
+  CHECK(first > 0 && first < 300);
+  for (n = 1, i = first + 1; again.read(&r); i++, n++) {
+    make_record(i, &w);
+    CHECK(same_record(&w, &r));
+  }
+  CHECK(i == 300);
+  printf("  XLog: %ld records in 480 bytes\n", n);
+
+  log.format();
+  log.rewind();
+  CHECK(!log.read(&r));
+}
+
+static void test_xlog_powerfail (void)
+{
+  FailingStore store;
+  XLOG_record_t w, r;
+  long cut, i, n;
+
+  for (cut = 0; cut < 200; cut += 3) {
+    memset(store.mem, 0xFF, sizeof(store.mem));
+    store.left = -1;
+    {
+      XLog log(store, 0, sizeof(store.mem));
+      log.begin();
+      for (i = 0; i < 40; i++) {
+        make_record(i, &w);
+        log.append(&w);
+      }
+      store.left = cut;
+      for (; i < 80; i++) {
+        make_record(i, &w);
+        log.append(&w);
+      }
+    }
+    store.left = -1;
+
+    /* Whatever survived is a prefix of what was written */
+    XLog log(store, 0, sizeof(store.mem));
+    log.begin();
+    log.rewind();
+    for (n = 0; log.read(&r); n++) {
+      make_record(n, &w);
+      CHECK(same_record(&w, &r));
+    }
+    CHECK(n >= 40);
+
+    /* And appending carries on from there */
+    make_record(n, &w);
+    CHECK(log.append(&w));
+  }
+}
+
+static void test_xlog_file (void)
+{
+  const char *path = "xlog_test.bin";
+  XLOG_record_t w, r;
+  long i;
+
+  remove(path);
+  {
+    XLogFile f(path, 256);
+    XLog log(f, 0, 256);
+    log.begin();
+    for (i = 0; i < 20; i++) {
+      make_record(i, &w);
+      log.append(&w);
+    }
+  }
+  {
+    XLogFile f(path, 256);
+    XLog log(f, 0, 256);
+    CHECK(log.begin() > 0);
+    log.rewind();
+    for (i = 0; log.read(&r); i++) {
+      make_record(i, &w);
+      CHECK(same_record(&w, &r));
+    }
+    CHECK(i == 20);
+  }
+  remove(path);
+}
+
+/*----------------------------------------------*/
+/* ILI9341                                      */
+/*----------------------------------------------*/
+
+#define TFT_CS  10
+#define TFT_RST 9
+#define TFT_DC  8
+
+static void test_ili9341 (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static const uint16_t pat[6] = { 1, 2, 3, 4, 5, 6 };
+  int x, y, lit;
+
+  host_reset();
+  tft.init();
+  CHECK(host_pin_level(TFT_CS) == HIGH);
+  CHECK(sim.pixels_written() == 240UL * 320);
+
+  tft.rectfill(10, 19, 20, 24, C_RED);
+  CHECK(sim.pixel(10, 20) == C_RED && sim.pixel(19, 24) == C_RED);
+  CHECK(sim.pixel(9, 20) == C_BLACK && sim.pixel(20, 24) == C_BLACK && sim.pixel(10, 25) == C_BLACK);
+
+  /* Clipped to the mask */
+  tft.setmask(0, 99, 0, 99);
+  tft.rectfill(90, 200, 95, 200, C_GREEN);
+  CHECK(sim.pixel(99, 99) == C_GREEN && sim.pixel(100, 99) == C_BLACK && sim.pixel(99, 100) == C_BLACK);
+  tft.setmask(0, tft.get_width() - 1, 0, tft.get_height() - 1);
+
+  tft.blt(0, 2, 0, 1, pat);
+  CHECK(sim.pixel(0, 0) == 1 && sim.pixel(2, 0) == 3 && sim.pixel(0, 1) == 4 && sim.pixel(2, 1) == 6);
+
+  tft.line(0, 100, 50, 150, C_WHITE);
+  CHECK(sim.pixel(0, 100) == C_WHITE && sim.pixel(25, 125) == C_WHITE && sim.pixel(50, 150) == C_WHITE);
+  tft.line(60, 150, 60, 100, C_WHITE);    /* Upwards */
+  CHECK(sim.pixel(60, 100) == C_WHITE && sim.pixel(60, 150) == C_WHITE);
+
+  /* A glyph lights up some, not all, pixels of its cell */
+  tft.font_color(((uint32_t) C_BLACK << 16) | C_YELLOW);
+  tft.locate(0, 20);
+  tft.xputc('A');
+  lit = 0;
+  for (y = 0; y < tft.get_font_height(); y++)
+    for (x = 0; x < tft.get_font_width(); x++)
+      lit += sim.pixel(x, 20 * tft.get_font_height() + y) == C_YELLOW;
+  CHECK(lit > 0 && lit < tft.get_font_width() * tft.get_font_height());
+
+  /* Landscape */
+  tft.set_orientation(1);
+  CHECK(tft.get_width() == 320 && (sim.madctl() & 0x20));
+  tft.rectfill(300, 300, 5, 5, C_BLUE);
+  CHECK(sim.pixel(300, 5) == C_BLUE);
+
+  /* Every transfer is made within an SPI transaction */
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+static void test_ili9341_calibrate (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  uint32_t w, r;
+
+  host_reset();
+  tft.init();
+  CHECK(tft.read_id() == ILI9341_ID);
+  tft.get_spi_clock(&w, &r);
+  CHECK(w == ILI9341_WRITE_CLOCK && r == ILI9341_READ_CLOCK);
+
+  /* A clean link runs at F_CPU / 2 both ways */
+  tft.rectfill(0, 20, 0, 0, C_WHITE);
+  CHECK(tft.calibrate() == 1);
+  tft.get_spi_clock(&w, &r);
+  CHECK(w == F_CPU / 2 && r == F_CPU / 2);
+  CHECK(sim.pixel(0, 0) == C_BLACK && sim.pixel(15, 0) == C_BLACK && sim.pixel(16, 0) == C_WHITE);
+
+  /* A marginal one gets the fastest clocks that work */
+  sim.set_limits(5000000, 3000000);
+  CHECK(tft.calibrate() == 1);
+  tft.get_spi_clock(&w, &r);
+  CHECK(w == 6000000 && r == 2000000);
+  tft.rectfill(0, 9, 0, 9, C_RED);
+  CHECK(sim.pixel(0, 0) == C_RED && sim.pixel(9, 9) == C_RED);
+
+  /* A broken one keeps the previous settings */
+  sim.set_limits(500000, 500000);
+  CHECK(tft.calibrate() == 0);
+  tft.get_spi_clock(&w, &r);
+  CHECK(w == 6000000 && r == 2000000);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Largest per-channel difference from d + (s - d) * a / 32 */
+static int blend_error (uint16_t px, uint16_t s, uint16_t d, int a)
+{
+  static const int shift[3] = { 11, 5, 0 }, max[3] = { 31, 63, 31 };
+  int c, cs, cd, e, worst = 0;
+
+  for (c = 0; c < 3; c++) {
+    cs = (s >> shift[c]) & max[c];
+    cd = (d >> shift[c]) & max[c];
+    e = abs(((px >> shift[c]) & max[c]) * 32 - (cd * 32 + (cs - cd) * a));
+    if (e > worst) worst = e;
+  }
+  return (worst + 31) / 32;
+}
+
+static void test_ili9341_blend (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static uint16_t ramp[40 * 3], back[40 * 3];
+  static uint8_t mask[40 * 3];
+  unsigned long written;
+  int i, a, worst, lit, x, y;
+
+  host_reset();
+  tft.init();
+
+  /* Every opacity over a background of varied pixels (odd width: pairs span rows) */
+  for (i = 0; i < 40 * 3; i++) back[i] = (uint16_t)(i * 2654435761UL >> 7);
+  worst = 0;
+  for (a = 0; a <= 255; a++) {
+    tft.blt(0, 39, 0, 2, back);
+    tft.rectfill_alpha(0, 38, 0, 2, 0xA5C3, a);
+    for (i = 0; i < 39 * 3; i++) {
+      int e = blend_error(sim.pixel(i % 39, i / 39), 0xA5C3, back[(i / 39) * 40 + i % 39], (a + 4) >> 3);
+      if (e > worst) worst = e;
+    }
+    CHECK(sim.pixel(39, 0) == back[39]);  /* Outside untouched */
+  }
+  CHECK(worst <= 1);
+  tft.blt(0, 39, 0, 2, back);
+  tft.rectfill_alpha(0, 38, 0, 2, 0xA5C3, 255);
+  CHECK(sim.pixel(0, 0) == 0xA5C3 && sim.pixel(38, 2) == 0xA5C3);
+
+  /* Transparent: nothing goes over the bus */
+  written = sim.pixels_written();
+  tft.rectfill_alpha(0, 239, 0, 319, C_WHITE, 0);
+  CHECK(sim.pixels_written() == written);
+
+  /* Per-pixel mask, scaled by the overall opacity, clipped to the mask */
+  for (i = 0; i < 40 * 3; i++) {
+    ramp[i] = C_WHITE;
+    mask[i] = i % 40 < 20 ? 0 : 255;
+  }
+  tft.rectfill(100, 139, 100, 102, C_BLACK);
+  tft.setmask(0, 129, 0, 319);
+  tft.blt_alpha(100, 139, 100, 102, ramp, mask, 128);
+  tft.setmask(0, tft.get_width() - 1, 0, tft.get_height() - 1);
+  CHECK(sim.pixel(119, 101) == C_BLACK);
+  CHECK(blend_error(sim.pixel(120, 101), C_WHITE, C_BLACK, 16) <= 1 && blend_error(sim.pixel(129, 102), C_WHITE, C_BLACK, 16) <= 1);
+  CHECK(sim.pixel(130, 101) == C_BLACK);
+
+  /* Text with a transparent background keeps what is behind the glyph */
+  tft.rectfill(0, 239, 200, 239, C_BLUE);
+  tft.font_color(((uint32_t) C_BLACK << 16) | C_YELLOW);
+  tft.font_alpha(255, 0);
+  tft.locate(0, 200 / tft.get_font_height());
+  tft.xputc('A');
+  lit = 0;
+  for (y = 0; y < tft.get_font_height(); y++)
+    for (x = 0; x < tft.get_font_width(); x++) {
+      uint16_t px = sim.pixel(x, 200 + y);
+      CHECK(px == C_YELLOW || px == C_BLUE);
+      lit += px == C_YELLOW;
+    }
+  CHECK(lit > 0 && lit < tft.get_font_width() * tft.get_font_height());
+
+  /* Translucent background */
+  tft.font_alpha(255, 128);
+  tft.xputc(' ');
+  CHECK(blend_error(sim.pixel(tft.get_font_width(), 200), C_BLACK, C_BLUE, 16) <= 1);
+  tft.font_alpha(255, 255);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+#define TFT_TE  6
+
+static void test_ili9341_present (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  ILI9341_frame_stats_t fs;
+  unsigned long beam;
+  int i, y;
+
+  host_reset();
+  tft.init();
+
+  /* Not synchronized until turned on */
+  CHECK(tft.frame_begin() == 0 && tft.chase(0, 239, 0, 15) == 0);
+  tft.frame_end();
+
+  /* No refresh: no vertical sync */
+  CHECK(tft.tearing_on(TFT_TE) == 0 && tft.get_refresh_period() == 0);
+
+  /* 70 Hz, TE pin */
+  sim.set_refresh(14286, TFT_TE);
+  CHECK(tft.tearing_on(TFT_TE) == 1);
+  CHECK(tft.get_refresh_period() >= 14286 - 20 && tft.get_refresh_period() <= 14286 + 20);
+  CHECK(host_pin_level(TFT_TE) == LOW || sim.scanline() >= 320);
+
+  /* Small updates keep pace with the refresh */
+  tft.reset_frame_stats();
+  for (i = 0; i < 10; i++) {
+    CHECK(tft.frame_begin() == 1);
+    CHECK(sim.scanline() >= 320);
+    tft.rectfill(0, 239, 0, 15, i & 1 ? C_RED : C_GREEN);
+    tft.frame_end();
+  }
+  tft.get_frame_stats(&fs);
+  CHECK(fs.frames == 10 && fs.missed == 0 && fs.late == 0);
+  CHECK(fs.max_us > 0 && fs.max_us < 14286 && fs.total_us <= 10 * fs.max_us);
+
+  /* A full screen update outlasts several refreshes */
+  tft.frame_begin();
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.frame_end();
+  tft.frame_begin();
+  tft.frame_end();
+  tft.get_frame_stats(&fs);
+  CHECK(fs.frames == 12 && fs.late == 1 && fs.missed >= 5);
+
+  /* GET_SCANLINE polling, no TE pin */
+  tft.tearing_off();
+  CHECK(tft.get_refresh_period() == 0);
+  CHECK(tft.tearing_on() == 1);
+  CHECK(tft.get_refresh_period() >= 14286 - 20 && tft.get_refresh_period() <= 14286 + 20);
+  CHECK(tft.frame_begin() == 1);
+  CHECK(sim.scanline() >= 320 || sim.scanline() < 4);
+
+  /* Writes chasing the scanline never land on the line being refreshed */
+  beam = sim.beam_writes();
+  for (i = 0, y = 100; i < 20; i++) {
+    delayMicroseconds(1237 * i);
+    CHECK(tft.chase(0, 239, y, y + 15) == 1);
+    CHECK(sim.scanline() > y + 15);
+    tft.rectfill(0, 239, y, y + 15, i & 1 ? C_RED : C_GREEN);
+  }
+  CHECK(sim.beam_writes() == beam);
+  CHECK(tft.chase(0, 239, 0, 319) == 0);   /* Takes longer than a refresh */
+
+  /* ... while unsynchronized ones do */
+  for (i = 0; i < 20; i++) {
+    delayMicroseconds(1237 * i);
+    tft.rectfill(0, 239, y, y + 15, i & 1 ? C_RED : C_GREEN);
+  }
+  CHECK(sim.beam_writes() > beam);
+
+  /* Landscape: areas span panel lines by column */
+  tft.set_orientation(1);
+  CHECK(tft.chase(300, 319, 0, 239) == 1 && sim.scanline() >= 320);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Keeps what capture() streams */
+class CaptureSink: public XUtils {
+  public:
+    CaptureSink (void): len(0), writes(0) { };
+    void xputc (char c) { if (len < sizeof(buf)) buf[len++] = c; };
+    char xgetc (void) { return 0; };
+    void xwrite (const uint8_t* b, int n) { writes++; while (n--) xputc(*b++); };
+
+    uint8_t buf[4 * 240 * 320];
+    unsigned long len, writes;
+};
+
+/* Decode a capture stream against the simulated display, 1: match */
+static byte capture_matches (const CaptureSink &s, SimILI9341 &sim, int left, int top)
+{
+  unsigned long i = 6, n, k, w, h;
+  uint16_t px, sum = 0;
+  byte run;
+
+  if (s.len < 8 || s.buf[0] != ILI9341_CAPTURE_MAGIC0 || s.buf[1] != ILI9341_CAPTURE_MAGIC1) return 0;
+  w = s.buf[2] | (s.buf[3] << 8);
+  h = s.buf[4] | (s.buf[5] << 8);
+
+  for (n = 0; n < w * h; ) {
+    if (i >= s.len) return 0;
+    run = s.buf[i] & 0x80;
+    k = (s.buf[i++] & 0x7F) + 1;
+    while (k--) {
+      if (i + 2 > s.len || n >= w * h) return 0;
+      px = (s.buf[i] << 8) | s.buf[i + 1];
+      if (!run || !k) i += 2;
+      if (sim.pixel(left + n % w, top + n / w) != px) return 0;
+      sum += px;
+      n++;
+    }
+  }
+
+  return i + 2 == s.len && s.buf[i] == (sum & 0xFF) && s.buf[i + 1] == (sum >> 8);
+}
+
+static void test_ili9341_capture (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static CaptureSink s1, s2, s3;
+  static uint16_t noise[37 * 23];
+  unsigned long spi;
+  int i;
+
+  host_reset();
+  tft.init();
+
+  /* Flat areas compress well */
+  tft.rectfill(0, 119, 0, 319, C_BLUE);
+  tft.rectfill(20, 200, 40, 60, C_YELLOW);
+  tft.line(0, 0, 239, 319, C_WHITE);
+  spi = host_counters.spi_bytes;
+  CHECK(tft.capture(0, 239, 0, 319, s1) == 1);
+  CHECK(capture_matches(s1, sim, 0, 0));
+  CHECK(s1.len < 240UL * 320 * 2 / 20);
+  CHECK(host_counters.spi_bytes - spi < 240UL * 320 * 3 * 103 / 100);   /* Close to the raw read rate */
+
+  /* Incompressible ones do not grow much */
+  for (i = 0; i < 37 * 23; i++) noise[i] = (uint16_t)(i * 40503U);
+  tft.blt(100, 136, 200, 222, noise);
+  CHECK(tft.capture(100, 136, 200, 222, s2) == 1);
+  CHECK(capture_matches(s2, sim, 100, 200));
+  CHECK(s2.len < 37UL * 23 * 2 * 102 / 100 + 8);
+  CHECK(s2.writes > 1);
+
+  /* A single pixel, and areas off screen */
+  CHECK(tft.capture(239, 239, 319, 319, s3) == 1);
+  CHECK(s3.len == 11 && capture_matches(s3, sim, 239, 319));
+  CHECK(tft.capture(0, 240, 0, 0, s3) == 0 && tft.capture(0, 0, -1, 0, s3) == 0);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* A screen template: banded tiles, overlapping boxes, a line, an image and text */
+static void record_scene (ILI9341List &dl)
+{
+  static const uint16_t icon[4] = { C_RED, C_GREEN, C_BLUE, C_WHITE };
+  int tx, ty;
+
+  for (ty = 15; ty >= 0; ty--)     /* Bottom up, right to left: optimize() has to sort */
+    for (tx = 11; tx >= 0; tx--)
+      CHECK(dl.rectfill(tx * 20, tx * 20 + 19, ty * 20, ty * 20 + 19, (ty / 4) & 1 ? C_BLUE : C_GRAY) == 1);
+  CHECK(dl.rectfill(30, 89, 30, 89, C_RED) == 1);
+  CHECK(dl.rectfill(0, 19, 0, 19, C_GREEN) == 1);   /* Covers a tile, then is covered */
+  CHECK(dl.rectfill(10, 49, 10, 49, C_YELLOW) == 1);
+  CHECK(dl.line(0, 319, 19, 300, C_WHITE) == 1);
+  CHECK(dl.blt(100, 101, 100, 101, icon) == 1);
+  CHECK(dl.text(2, 30, ((uint32_t) C_BLACK << 16) | C_CYAN, "Template") == 1);
+  CHECK(dl.rectfill(0, 9, 300, 309, C_MAGENTA) == 1);
+  CHECK(dl.rectfill(10, 19, 300, 309, C_MAGENTA) == 1);
+}
+
+static void test_ili9341_list (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static uint8_t buf[4096], small[20];
+  static uint16_t ref[320][240];
+  ILI9341List dl(buf, sizeof(buf)), full(small, sizeof(small));
+  static CaptureSink out;
+  unsigned long plain, opt, len;
+  int x, y, diff;
+
+  host_reset();
+  tft.init();
+
+  record_scene(dl);
+  len = dl.length();
+  CHECK(dl.data()[len] == ILI9341_DL_END);
+
+  /* As recorded: same as the calls themselves */
+  plain = sim.commands();
+  tft.replay(dl.data());
+  plain = sim.commands() - plain;
+  for (y = 0; y < 320; y++)
+    for (x = 0; x < 240; x++)
+      ref[y][x] = sim.pixel(x, y);
+  CHECK(ref[5][5] == C_GREEN && ref[15][15] == C_YELLOW && ref[40][40] == C_YELLOW && ref[60][60] == C_RED);
+  CHECK(ref[305][5] == C_MAGENTA && ref[100][101] == C_GREEN);
+
+  /* Optimized: fewer operations and commands, same picture */
+  dl.optimize();
+  CHECK(dl.length() < len / 4);
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  opt = sim.commands();
+  tft.replay(dl.data());
+  opt = sim.commands() - opt;
+  diff = 0;
+  for (y = 0; y < 320; y++)
+    for (x = 0; x < 240; x++)
+      diff += sim.pixel(x, y) != ref[y][x];
+  CHECK(diff == 0);
+  CHECK(opt < plain / 4);   /* Window setup and write commands */
+
+  /* Optimizing again changes nothing */
+  len = dl.length();
+  dl.optimize();
+  CHECK(dl.length() == len);
+
+  /* From program memory */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.replay_P(dl.data());
+  CHECK(sim.pixel(15, 15) == C_YELLOW && sim.pixel(239, 319) == ref[319][239]);
+
+  /* As a C initializer */
+  dl.dump(out);
+  out.buf[out.len] = 0;
+  CHECK(!strncmp((const char *) out.buf, "{\n  0x01,", 9));
+
+  /* A full buffer refuses, and keeps a valid list */
+  CHECK(full.rectfill(0, 1, 0, 1, C_RED) == 1);
+  CHECK(full.rectfill(0, 1, 0, 1, C_RED) == 0 && full.text(0, 0, 0, "too long") == 0);
+  CHECK(full.length() == 11 && full.data()[11] == ILI9341_DL_END);
+  full.clear();
+  CHECK(full.length() == 0 && full.data()[0] == ILI9341_DL_END);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Pixels of a color on the whole screen, into set[][] if given */
+static long count_color (SimILI9341 &sim, uint16_t color, bool (*set)[240])
+{
+  long n = 0;
+  int x, y;
+
+  for (y = 0; y < 320; y++)
+    for (x = 0; x < 240; x++) {
+      bool in = sim.pixel(x, y) == color;
+      if (set) set[y][x] = in;
+      n += in;
+    }
+  return n;
+}
+
+/* Outline pixels are exactly those of the solid shape next to a pixel outside it */
+static bool is_boundary (bool (*solid)[240], bool (*outline)[240])
+{
+  int x, y;
+  bool edge;
+
+  for (y = 0; y < 320; y++)
+    for (x = 0; x < 240; x++) {
+      edge = solid[y][x] && (x == 0 || y == 0 || x == 239 || y == 319 ||
+        !solid[y][x - 1] || !solid[y][x + 1] || !solid[y - 1][x] || !solid[y + 1][x]);
+      if (edge != outline[y][x]) return false;
+    }
+  return true;
+}
+
+static void test_ili9341_shapes (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static bool solid[320][240], outline[320][240];
+  static const int box[8] = { 100, 200, 139, 200, 139, 219, 100, 219 };
+  unsigned long cmds;
+  long n;
+  int x, y;
+
+  host_reset();
+  tft.init();
+
+  /* Solid circle: pixel centers within r + 1/2, one span per row */
+  cmds = sim.commands();
+  tft.circlefill(120, 160, 50, C_RED);
+  cmds = sim.commands() - cmds;
+  n = count_color(sim, C_RED, solid);
+  CHECK(labs(n - 8012) < 80);     /* pi * 50.5^2 */
+  CHECK(cmds <= 3 * 101);
+  CHECK(sim.pixel(120, 110) == C_RED && sim.pixel(120, 109) == C_BLACK);
+  CHECK(sim.pixel(70, 160) == C_RED && sim.pixel(69, 160) == C_BLACK && sim.pixel(170, 160) == C_RED);
+  n = 0;
+  for (y = 0; y < 320; y++)
+    for (x = 0; x < 240; x++) {
+      long d = (long)(x - 120) * (x - 120) + (long)(y - 160) * (y - 160);
+      n += (d <= 49L * 49 && !solid[y][x]) || (d > 51L * 51 && solid[y][x]);
+    }
+  CHECK(n == 0);
+
+  /* Hollow shapes trace the edge of the solid ones */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.circle(120, 160, 50, C_WHITE);
+  count_color(sim, C_WHITE, outline);
+  CHECK(is_boundary(solid, outline));
+
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.ellipsefill(120, 160, 80, 30, C_GREEN);
+  n = count_color(sim, C_GREEN, solid);
+  CHECK(labs(n - 7713) < 150);    /* pi * 80.5 * 30.5 */
+  CHECK(sim.pixel(40, 160) == C_GREEN && sim.pixel(39, 160) == C_BLACK);
+  CHECK(sim.pixel(120, 130) == C_GREEN && sim.pixel(120, 129) == C_BLACK);
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.ellipse(120, 160, 80, 30, C_WHITE);
+  count_color(sim, C_WHITE, outline);
+  CHECK(is_boundary(solid, outline));
+
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.roundrectfill(20, 119, 20, 69, 10, C_BLUE);
+  count_color(sim, C_BLUE, solid);
+  CHECK(!solid[20][20] && solid[23][23] && solid[20][70] && solid[45][20] && solid[45][119] && !solid[69][119]);
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.roundrect(20, 119, 20, 69, 10, C_WHITE);
+  count_color(sim, C_WHITE, outline);
+  CHECK(is_boundary(solid, outline));
+
+  /* No radius: square corners, hollow as a rect() */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.roundrectfill(20, 119, 20, 69, 0, C_BLUE);
+  CHECK(count_color(sim, C_BLUE, solid) == 100 * 50);
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.roundrect(20, 119, 20, 69, 0, C_WHITE);
+  CHECK(count_color(sim, C_WHITE, outline) == 2 * 100 + 2 * 48);
+  CHECK(is_boundary(solid, outline) && !outline[45][70]);
+
+  /* Ring sectors, clockwise from 3 o'clock */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.arc(120, 160, 60, 49, 0, 360, C_CYAN);
+  n = count_color(sim, C_CYAN, NULL);
+  CHECK(labs(n - 3801) < 80);     /* pi * (60.5^2 - 49.5^2) */
+  CHECK(sim.pixel(120, 160) == C_BLACK && sim.pixel(175, 160) == C_CYAN && sim.pixel(165, 160) == C_BLACK);
+
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.arc(120, 160, 60, 49, 0, 90, C_CYAN);
+  n = count_color(sim, C_CYAN, solid);
+  CHECK(labs(n - 3801 / 4) < 40);
+  CHECK(solid[160][175] && solid[215][120] && solid[200][160] && !solid[160][65] && !solid[105][120]);
+  n = 0;
+  for (y = 0; y < 320; y++)
+    for (x = 0; x < 240; x++)
+      n += solid[y][x] && (x < 120 || y < 160);
+  CHECK(n == 0);
+
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.arc(120, 160, 60, -1, 0, 270, C_CYAN);    /* Pie, more than a half */
+  CHECK(sim.pixel(120, 160) == C_CYAN && sim.pixel(81, 121) == C_CYAN && sim.pixel(159, 121) == C_BLACK);
+
+  /* Triangles and convex polygons */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.trianglefill(10, 10, 60, 10, 10, 60, C_YELLOW);
+  n = count_color(sim, C_YELLOW, NULL);
+  CHECK(n >= 1275 && n <= 1326);
+  CHECK(sim.pixel(10, 10) == C_YELLOW && sim.pixel(60, 10) == C_YELLOW && sim.pixel(10, 60) == C_YELLOW);
+  CHECK(sim.pixel(35, 35) == C_YELLOW && sim.pixel(40, 40) == C_BLACK && sim.pixel(9, 30) == C_BLACK);
+  tft.triangle(10, 10, 60, 10, 10, 60, C_WHITE);
+  CHECK(sim.pixel(35, 35) == C_WHITE && sim.pixel(30, 10) == C_WHITE && sim.pixel(10, 30) == C_WHITE);
+
+  tft.polygonfill(box, 4, C_MAGENTA);
+  CHECK(count_color(sim, C_MAGENTA, NULL) == 40 * 20);
+  CHECK(sim.pixel(100, 200) == C_MAGENTA && sim.pixel(139, 219) == C_MAGENTA);
+
+  /* Clipped to the mask */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.setmask(100, 139, 100, 139);
+  tft.circlefill(120, 120, 50, C_RED);
+  tft.arc(120, 120, 50, 10, 0, 360, C_GREEN);
+  tft.trianglefill(0, 0, 239, 0, 120, 319, C_BLUE);
+  tft.setmask(0, tft.get_width() - 1, 0, tft.get_height() - 1);
+  CHECK(count_color(sim, C_BLACK, NULL) == 240L * 320 - 40 * 40);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+static void test_ili9341_plot (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  ILI9341Plot plot(tft, 20, 219, 100, 199, -1000, 1000, C_GREEN, C_BLACK);
+  static int16_t data[10000];
+  unsigned long bytes, small;
+  int i, x, y, bad, lo, hi, top, bot, last;
+
+  host_reset();
+  tft.init();
+
+  /* A sine in 1/1000, 50 samples per column */
+  for (i = 0; i < 10000; i++) data[i] = (int16_t) lround(1000 * sin(i * 2 * M_PI / 2500));
+
+  bytes = host_counters.spi_bytes;
+  plot.plot(data, 10000);
+  bytes = host_counters.spi_bytes - bytes;
+  CHECK(bytes < 200UL * (100 * 2 + 12));     /* One burst of the full height per column */
+
+  /* Each column spans its samples and the last one of the previous column */
+  bad = 0;
+  for (x = 0; x < 200; x++) {
+    lo = hi = data[x * 50];
+    for (i = x * 50; i < x * 50 + 50; i++) {
+      if (data[i] < lo) lo = data[i];
+      if (data[i] > hi) hi = data[i];
+    }
+    if (x) {
+      last = data[x * 50 - 1];
+      if (last < lo) lo = last;
+      if (last > hi) hi = last;
+    }
+    top = 199 - (int)(((hi + 1000) * ((99UL << 16) / 2000) + 0x8000) >> 16);    /* 16.16 scale */
+    bot = 199 - (int)(((lo + 1000) * ((99UL << 16) / 2000) + 0x8000) >> 16);
+    for (y = 100; y < 200; y++)
+      bad += (sim.pixel(20 + x, y) == C_GREEN) != (y >= top && y <= bot);
+  }
+  CHECK(bad == 0);
+  CHECK(sim.pixel(19, 150) == C_BLACK && sim.pixel(220, 150) == C_BLACK);
+
+  /* Draw time depends on the width, not on the number of samples */
+  small = host_counters.spi_bytes;
+  plot.plot(data, 1000);
+  small = host_counters.spi_bytes - small;
+  CHECK(labs((long) small - (long) bytes) <= 16);
+
+  /* Fewer samples than columns: stretched */
+  plot.plot_P(data, 100);
+  CHECK(sim.pixel(20, 150) == C_GREEN && sim.pixel(21, 150) == C_GREEN);
+
+  /* Appending only draws the completed columns */
+  plot.clear();
+  plot.set_decimation(4);
+  bytes = host_counters.spi_bytes;
+  CHECK(plot.append(0) == 0 && plot.append(10) == 0 && plot.append(-10) == 0);
+  CHECK(host_counters.spi_bytes == bytes);
+  CHECK(plot.append(1000) == 1);
+  CHECK(host_counters.spi_bytes - bytes < 100 * 2 + 12);
+  CHECK(sim.pixel(20, 100) == C_GREEN && sim.pixel(20, 150) == C_GREEN && sim.pixel(20, 151) == C_BLACK && sim.pixel(21, 100) == C_BLACK);
+
+  /* Past the right end, the plot sweeps over from the left */
+  for (i = 0; i < 199 * 4; i++) plot.append(-1000);
+  CHECK(sim.pixel(219, 199) == C_GREEN && sim.pixel(20, 100) == C_GREEN);
+  for (i = 0; i < 4; i++) plot.append(-1000);
+  CHECK(sim.pixel(20, 100) == C_BLACK && sim.pixel(20, 199) == C_GREEN);
+
+  /* Clipped to the mask */
+  tft.setmask(0, 119, 0, 149);
+  plot.plot(data, 10000);
+  tft.setmask(0, tft.get_width() - 1, 0, tft.get_height() - 1);
+  CHECK(sim.pixel(219, 199) == C_GREEN);    /* Left from the sweep */
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Same pixels in two character cell runs */
+static bool same_cells (SimILI9341 &sim, ILI9341 &tft, int col1, int row1, int col2, int row2, int n)
+{
+  int x, y, fw = tft.get_font_width(), fh = tft.get_font_height();
+
+  for (y = 0; y < fh; y++)
+    for (x = 0; x < n * fw; x++)
+      if (sim.pixel(col1 * fw + x, row1 * fh + y) != sim.pixel(col2 * fw + x, row2 * fh + y)) return false;
+  return true;
+}
+
+static void test_ili9341_field (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  char buf[12];
+  ILI9341Field field(tft, 2, 5, buf, sizeof(buf), ((uint32_t) C_BLUE << 16) | C_WHITE);
+  unsigned long bytes, cmds;
+  int glyph;
+
+  host_reset();
+  tft.init();
+  glyph = tft.get_font_width() * tft.get_font_height() * 2;
+
+  /* First update: the whole field, as _putc would draw it */
+  CHECK(field.update("12:59:59") == 12);
+  tft.font_color(((uint32_t) C_BLUE << 16) | C_WHITE);
+  tft.locate(2, 10);
+  tft.xputs("12:59:59    ");
+  CHECK(same_cells(sim, tft, 2, 5, 2, 10, 12));
+  CHECK(sim.pixel(2 * tft.get_font_width() - 1, 5 * tft.get_font_height()) == C_BLACK);
+
+  /* Unchanged: nothing on the bus */
+  bytes = host_counters.spi_bytes;
+  CHECK(field.update("12:59:59") == 0);
+  CHECK(host_counters.spi_bytes == bytes);
+
+  /* One digit */
+  bytes = host_counters.spi_bytes;
+  field.begin();
+  field.xprintf(F("%02u:%02u:%02u"), 12, 59, 58);
+  CHECK(field.end() == 1);
+  CHECK(host_counters.spi_bytes - bytes < (unsigned long) glyph + 16);
+
+  /* Adjacent changes share a window: 3 runs */
+  cmds = sim.commands();
+  CHECK(field.update("13:00:00") == 5);
+  CHECK(sim.commands() - cmds <= 3 * 3);
+  tft.locate(2, 10);
+  tft.xputs("13:00:00    ");
+  CHECK(same_cells(sim, tft, 2, 5, 2, 10, 12));
+
+  /* Shorter content is blanked out, longer content truncated */
+  CHECK(field.update("1:00") == 6);
+  tft.locate(2, 10);
+  tft.xputs("1:00        ");
+  CHECK(same_cells(sim, tft, 2, 5, 2, 10, 12));
+  CHECK(field.update("1:00 and a long tail") == 5);
+  CHECK(!memcmp(buf, "1:00 and a l", 12));
+
+  /* A color change or invalidate() redraws it all */
+  field.set_color(C_WHITE);
+  CHECK(field.update("1:00 and a l") == 12);
+  field.invalidate();
+  CHECK(field.update("1:00 and a l") == 12);
+
+  /* Clipped at the right edge of the screen */
+  {
+    char edge[8];
+    int cols = tft.get_width() / tft.get_font_width();
+    ILI9341Field clip(tft, cols - 3, 0, edge, sizeof(edge), C_WHITE);
+    CHECK(clip.update("abcdefgh") == 8);
+    tft.font_color(C_WHITE);
+    tft.locate(cols - 3, 12);
+    tft.xputs("abc");
+    CHECK(same_cells(sim, tft, cols - 3, 0, cols - 3, 12, 3));
+  }
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Character at a cell of a terminal grid */
+#define TERM_CHAR(cells, cols, x, y)  ((char) (cells)[(y) * (cols) + (x)])
+#define TERM_ATTR(cells, cols, rows, x, y)  ((cells)[(cols) * (rows) + (y) * (cols) + (x)] & ~TERM_ATTR_DIRTY)
+
+static void test_ili9341_term (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static uint8_t cells[2 * 20 * 6];
+  ILI9341Term term(tft, 2, 3, cells, 20, 6);
+  unsigned long bytes;
+  uint8_t cx, cy;
+  int glyph, y, lit;
+
+  host_reset();
+  tft.init();
+  glyph = tft.get_font_width() * tft.get_font_height() * 2;
+
+  /* The first refresh paints the whole grid */
+  CHECK(term.refresh() == 20 * 6);
+  CHECK(term.refresh() == 0);
+
+  /* Text, LF as CRLF, deferred wrap */
+  term.xputs("ab\ncd");
+  CHECK(TERM_CHAR(cells, 20, 0, 0) == 'a' && TERM_CHAR(cells, 20, 1, 1) == 'd');
+  term.xputs("\r01234567890123456789");
+  term.get_cursor(&cx, &cy);
+  CHECK(cx == 19 && cy == 1);
+  term.xputc('X');
+  term.get_cursor(&cx, &cy);
+  CHECK(TERM_CHAR(cells, 20, 0, 2) == 'X' && cx == 1 && cy == 2);
+
+  /* Painted as _putc would, in the terminal's place */
+  CHECK(term.refresh() == 2 + 20 + 1);
+  tft.font_color(((uint32_t) RGB16(0,0,0) << 16) | RGB16(229,229,229));
+  tft.locate(2, 20);
+  tft.xputs("ab");
+  CHECK(same_cells(sim, tft, 2, 3, 2, 20, 3));
+
+  /* Cursor addressing, erase */
+  term.xputs("\e[H\e[2J\e[3;5HQ");
+  CHECK(TERM_CHAR(cells, 20, 4, 2) == 'Q' && TERM_CHAR(cells, 20, 0, 0) == ' ');
+  term.xputs("\e[2;1Habcdef\e[1;4H\e[1K");   /* Row 2 untouched */
+  CHECK(TERM_CHAR(cells, 20, 0, 1) == 'a');
+  term.xputs("\e[2;3H\e[K");
+  CHECK(TERM_CHAR(cells, 20, 1, 1) == 'b' && TERM_CHAR(cells, 20, 2, 1) == ' ' && TERM_CHAR(cells, 20, 5, 1) == ' ');
+  term.xputs("\e[2;2H\e[1K");
+  CHECK(TERM_CHAR(cells, 20, 0, 1) == ' ' && TERM_CHAR(cells, 20, 1, 1) == ' ');
+  term.xputs("\e[A\e[3C");
+  term.get_cursor(&cx, &cy);
+  CHECK(cx == 4 && cy == 0);
+
+  /* Colors */
+  term.xputs("\e[H\e[2J\e[31;44mR\e[1mB\e[7mV\e[0mN");
+  CHECK(TERM_ATTR(cells, 20, 6, 0, 0) == 0x41 && TERM_ATTR(cells, 20, 6, 1, 0) == 0x49);
+  CHECK(TERM_ATTR(cells, 20, 6, 2, 0) == 0x1C && TERM_ATTR(cells, 20, 6, 3, 0) == TERM_ATTR_DEFAULT);
+  term.refresh();
+  lit = 0;
+  for (y = 0; y < tft.get_font_height(); y++)
+    lit += sim.pixel(2 * tft.get_font_width() + 3, 3 * tft.get_font_height() + y) == RGB16(205,0,0);
+  CHECK(lit > 0);
+  CHECK(sim.pixel(3 * tft.get_font_width() - 1, 3 * tft.get_font_height()) == RGB16(0,0,238));   /* Spacing column */
+
+  /* Scroll region: rows outside it stay */
+  term.xputs("\e[H\e[2Jtop\e[6;1Hbottom\e[2;5r");
+  term.xputs("\e[2;1H1\n2\n3\n4\n5");
+  CHECK(TERM_CHAR(cells, 20, 0, 0) == 't' && TERM_CHAR(cells, 20, 0, 5) == 'b');
+  CHECK(TERM_CHAR(cells, 20, 0, 1) == '2' && TERM_CHAR(cells, 20, 0, 4) == '5');
+  term.xputs("\e[2;1H\eMx");    /* Reverse index at the top of the region */
+  CHECK(TERM_CHAR(cells, 20, 0, 1) == 'x' && TERM_CHAR(cells, 20, 0, 2) == '2' && TERM_CHAR(cells, 20, 0, 4) == '4');
+  term.xputs("\e[r");
+
+  /* Only changed cells go over the bus */
+  term.refresh();
+  bytes = host_counters.spi_bytes;
+  term.xputs("\e[1;1Htop");
+  CHECK(term.refresh() == 0 && host_counters.spi_bytes == bytes);
+  term.xputs("\e[1;2HO");
+  CHECK(term.refresh() == 1 && host_counters.spi_bytes - bytes < (unsigned long) glyph + 16);
+
+  /* Unknown and overlong sequences are swallowed */
+  term.xputs("\e[?25l\e[1;2;3;4;5;6mZ");
+  CHECK(TERM_CHAR(cells, 20, 2, 0) == 'Z');
+
+  /* Reset */
+  term.xputs("\ec");
+  term.get_cursor(&cx, &cy);
+  CHECK(cx == 0 && cy == 0 && TERM_CHAR(cells, 20, 0, 0) == ' ');
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Pixel of a FONTRL glyph by a plain scan of its runs: 1 foreground, 0 background, -1 no glyph */
+static int rl_pixel (const uint8_t *font, uint8_t chr, int x, int y)
+{
+  int first = font[16], last = font[17], n = last - first + 1, i = chr - first, adv, pos, at;
+  const uint8_t *p;
+
+  if (chr < first || chr > last || (adv = font[FONT_RL_HEAD + i]) == 0) return -1;
+  p = font + FONT_RL_HEAD + 3 * n + (font[FONT_RL_HEAD + n + 2 * i] | font[FONT_RL_HEAD + n + 2 * i + 1] << 8);
+  at = y * adv + x;
+  for (pos = 0; ; p++) {
+    if (at < (pos += *p >> 4)) return 0;
+    if (at < (pos += *p & 0x0F)) return 1;
+  }
+}
+
+/* Glyph drawn at x, y against the reference */
+static bool same_glyph (SimILI9341 &sim, const uint8_t *font, uint8_t chr, int x, int y, int w, uint16_t fg, uint16_t bg)
+{
+  for (int r = 0; r < font[15]; r++)
+    for (int c = 0; c < w; c++)
+      if (sim.pixel(x + c, y + r) != (rl_pixel(font, chr, c, r) ? fg : bg)) return false;
+  return true;
+}
+
+static void test_ili9341_rlfont (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  unsigned long bytes;
+  int x, y, lit;
+
+  host_reset();
+  tft.init();
+  tft.font_face(FontD24);
+  CHECK(tft.get_font_width() == 17 && tft.get_font_height() == 24);
+
+  /* Proportional advances; characters without a glyph take no room */
+  CHECK(tft.get_text_width("1.5") == 17 + 6 + 17);
+  CHECK(tft.get_text_width("1A!\r\n") == 17);
+
+  /* Glyphs as encoded, each in one window */
+  tft.font_color(((uint32_t) C_BLUE << 16) | C_WHITE);
+  tft.locate(0, 1);
+  bytes = host_counters.spi_bytes;
+  tft.xputs("8");
+  CHECK(host_counters.spi_bytes - bytes < 17 * 24 * 2 + 16);
+  CHECK(same_glyph(sim, FontD24, '8', 0, 24, 17, C_WHITE, C_BLUE));
+  CHECK(sim.pixel(5, 24) == C_WHITE && sim.pixel(0, 24) == C_BLUE);
+  tft.xputs("1.5A!-");
+  CHECK(same_glyph(sim, FontD24, '1', 17, 24, 17, C_WHITE, C_BLUE));
+  CHECK(same_glyph(sim, FontD24, '.', 34, 24, 6, C_WHITE, C_BLUE));
+  CHECK(same_glyph(sim, FontD24, '5', 40, 24, 17, C_WHITE, C_BLUE));
+  CHECK(same_glyph(sim, FontD24, '-', 57, 24, 17, C_WHITE, C_BLUE));
+  CHECK(sim.pixel(36, 24 + 21) == C_WHITE);
+
+  /* Clipped at the right and bottom edges */
+  tft.font_color(C_WHITE);
+  tft.locate(tft.get_width() / 17, tft.get_height() / 24);
+  tft.xputs("8");
+  lit = 0;
+  for (y = 0; y < 24 && (tft.get_height() / 24) * 24 + y < tft.get_height(); y++)
+    for (x = 0; x < 17 && (tft.get_width() / 17) * 17 + x < tft.get_width(); x++)
+      if (sim.pixel((tft.get_width() / 17) * 17 + x, (tft.get_height() / 24) * 24 + y) != (rl_pixel(FontD24, '8', x, y) ? C_WHITE : C_BLACK)) lit++;
+  CHECK(lit == 0);
+
+  /* Translucent background: the glyph over what was there */
+  tft.rectfill(0, 16, 48, 71, C_RED);
+  tft.font_alpha(255, 0);
+  tft.locate(0, 2);
+  tft.xputs("8");
+  tft.font_alpha(255, 255);
+  lit = 0;
+  for (y = 0; y < 24; y++)
+    for (x = 0; x < 17; x++)
+      if (sim.pixel(x, 48 + y) != (rl_pixel(FontD24, '8', x, y) ? C_WHITE : C_RED)) lit++;
+  CHECK(lit == 0);
+
+  /* Fields draw them in cells of the widest advance */
+  {
+    char buf[4];
+    ILI9341Field field(tft, 0, 4, buf, sizeof(buf), ((uint32_t) C_BLUE << 16) | C_WHITE);
+
+    CHECK(field.update("1.5") == 4);
+    CHECK(same_glyph(sim, FontD24, '1', 0, 96, 17, C_WHITE, C_BLUE));
+    CHECK(same_glyph(sim, FontD24, '.', 17, 96, 6, C_WHITE, C_BLUE));
+    CHECK(sim.pixel(17 + 6, 96) == C_BLUE && sim.pixel(17 + 16, 96 + 23) == C_BLUE);
+    CHECK(same_glyph(sim, FontD24, '5', 34, 96, 17, C_WHITE, C_BLUE));
+    CHECK(sim.pixel(51, 96) == C_BLUE && sim.pixel(67, 96 + 12) == C_BLUE);
+  }
+
+  /* Back to the fixed font */
+  tft.font_face(FontH8);
+  CHECK(tft.get_font_width() == 6 && tft.get_text_width("1.5") == 18);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Reference line drawn with _putc at a cell */
+static void ref_line (ILI9341 &tft, int col, int row, const char *s)
+{
+  tft.locate(col, row);
+  tft.xputs(s);
+}
+
+static void test_ili9341_textbox (void)
+{
+  static const PROGMEM char flash[] = "The quick brown fox jumps";
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  unsigned long bytes, cmds;
+  int x, y, lit;
+
+  host_reset();
+  tft.init();
+  tft.font_color(C_WHITE);
+
+  /* Greedy word wrap in a box of 10 characters */
+  CHECK(tft.text_lines("The quick brown fox jumps", 60, 0) == 3);
+  CHECK(tft.text_lines("The quick brown fox jumps", 60, ILI9341_TEXT_NOWRAP) == 1);
+  CHECK(tft.text_lines("a\n\nb", 60, 0) == 3);
+  CHECK(tft.text_lines("", 60, 0) == 0);
+  tft.rectfill(0, 59, 16, 47, C_RED);
+  bytes = host_counters.spi_bytes;
+  cmds = sim.commands();
+  CHECK(tft.textbox(0, 59, 16, 47, "The quick brown fox jumps", ILI9341_TEXT_LEFT) == 3);
+  CHECK(sim.commands() - cmds <= 4 * 3);   /* One window per line, then the rest of the box */
+  CHECK(host_counters.spi_bytes - bytes < 60 * 32 * 2 + 4 * 16);
+  ref_line(tft, 0, 20, "The quick ");
+  ref_line(tft, 0, 21, "brown fox ");
+  ref_line(tft, 0, 22, "jumps     ");
+  ref_line(tft, 0, 23, "          ");
+  for (y = 0; y < 4; y++) CHECK(same_cells(sim, tft, 0, 2 + y, 0, 20 + y, 10));
+
+  /* The same from flash */
+  tft.rectfill(0, 59, 16, 47, C_RED);
+  CHECK(tft.textbox_P(0, 59, 16, 47, flash, ILI9341_TEXT_LEFT) == 3);
+  for (y = 0; y < 4; y++) CHECK(same_cells(sim, tft, 0, 2 + y, 0, 20 + y, 10));
+
+  /* Alignment; words longer than the box are cut */
+  CHECK(tft.textbox(0, 59, 16, 47, "The quick abcd", ILI9341_TEXT_RIGHT) == 2);
+  ref_line(tft, 0, 20, " The quick");
+  ref_line(tft, 0, 21, "      abcd");
+  for (y = 0; y < 2; y++) CHECK(same_cells(sim, tft, 0, 2 + y, 0, 20 + y, 10));
+  CHECK(tft.textbox(0, 59, 16, 47, "abcd  \n  abcdefghijklmnop", ILI9341_TEXT_CENTER) == 3);
+  ref_line(tft, 0, 20, "   abcd   ");
+  ref_line(tft, 0, 21, "  abcdefgh");
+  ref_line(tft, 0, 22, " ijklmnop ");
+  for (y = 0; y < 3; y++) CHECK(same_cells(sim, tft, 0, 2 + y, 0, 20 + y, 10));
+
+  /* Ellipsis on the last line when text is left, and on cut lines */
+  CHECK(tft.textbox(0, 59, 16, 31, "The quick brown fox jumps", ILI9341_TEXT_ELLIPSIS) == 2);
+  ref_line(tft, 0, 20, "The quick ");
+  ref_line(tft, 0, 21, "brown f...");
+  for (y = 0; y < 2; y++) CHECK(same_cells(sim, tft, 0, 2 + y, 0, 20 + y, 10));
+  CHECK(tft.textbox(0, 59, 16, 31, "Temperature sensor\nOK", ILI9341_TEXT_NOWRAP | ILI9341_TEXT_ELLIPSIS | ILI9341_TEXT_RIGHT) == 2);
+  ref_line(tft, 0, 20, "Tempera...");
+  ref_line(tft, 0, 21, "        OK");
+  for (y = 0; y < 2; y++) CHECK(same_cells(sim, tft, 0, 2 + y, 0, 20 + y, 10));
+  CHECK(tft.textbox(0, 59, 16, 31, "", 0) == 0);
+  CHECK(sim.pixel(0, 16) == C_BLACK && sim.pixel(59, 31) == C_BLACK);
+
+  /* Clipped to the mask */
+  tft.rectfill(0, 59, 16, 47, C_RED);
+  tft.setmask(0, 29, 20, 319);
+  CHECK(tft.textbox(0, 59, 16, 47, "The quick brown fox jumps", 0) == 3);
+  tft.setmask(0, tft.get_width() - 1, 0, tft.get_height() - 1);
+  ref_line(tft, 0, 20, "The quick ");
+  lit = 0;
+  for (y = 16; y < 48; y++)
+    for (x = 0; x < 60; x++)
+      if (x >= 30 || y < 20) lit += sim.pixel(x, y) != C_RED;
+      else if (y < 24) lit += sim.pixel(x, y) != sim.pixel(x, 160 + y - 16);
+  CHECK(lit == 0);
+
+  /* Proportional font, right aligned */
+  tft.font_face(FontD24);
+  tft.font_color(((uint32_t) C_BLUE << 16) | C_WHITE);
+  CHECK(tft.textbox(0, 99, 200, 223, "21.5", ILI9341_TEXT_RIGHT) == 1);
+  CHECK(same_glyph(sim, FontD24, '2', 43, 200, 17, C_WHITE, C_BLUE));
+  CHECK(same_glyph(sim, FontD24, '.', 77, 200, 6, C_WHITE, C_BLUE));
+  CHECK(same_glyph(sim, FontD24, '5', 83, 200, 17, C_WHITE, C_BLUE));
+  CHECK(sim.pixel(0, 200) == C_BLUE && sim.pixel(42, 223) == C_BLUE);
+  tft.font_face(FontH8);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Reference QOI encoder, RGBA input */
+static int qoi_encode (const uint8_t *rgba, int w, int h, uint8_t *out)
+{
+  uint8_t index[64][4], prev[4] = { 0, 0, 0, 255 };
+  const uint8_t *px;
+  int p = 0, run = 0, i, k;
+
+  memset(index, 0, sizeof(index));
+  memcpy(out, "qoif", 4);
+  out[4] = out[5] = 0; out[6] = w >> 8; out[7] = w;
+  out[8] = out[9] = 0; out[10] = h >> 8; out[11] = h;
+  out[12] = 4; out[13] = 0;
+  p = 14;
+  for (i = 0; i < w * h; i++) {
+    px = rgba + i * 4;
+    if (!memcmp(px, prev, 4)) {
+      if (++run == 62 || i == w * h - 1) { out[p++] = 0xC0 | (run - 1); run = 0; }
+      continue;
+    }
+    if (run) { out[p++] = 0xC0 | (run - 1); run = 0; }
+    k = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+    if (!memcmp(index[k], px, 4)) {
+      out[p++] = k;
+    } else {
+      memcpy(index[k], px, 4);
+      int vr = (int8_t)(px[0] - prev[0]), vg = (int8_t)(px[1] - prev[1]), vb = (int8_t)(px[2] - prev[2]);
+      if (px[3] != prev[3]) {
+        out[p++] = 0xFF; memcpy(out + p, px, 4); p += 4;
+      } else if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+        out[p++] = 0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+      } else if (vr - vg > -9 && vr - vg < 8 && vg > -33 && vg < 32 && vb - vg > -9 && vb - vg < 8) {
+        out[p++] = 0x80 | (vg + 32);
+        out[p++] = (vr - vg + 8) << 4 | (vb - vg + 8);
+      } else {
+        out[p++] = 0xFE; memcpy(out + p, px, 3); p += 3;
+      }
+    }
+    memcpy(prev, px, 4);
+  }
+  memset(out + p, 0, 7);
+  out[p + 7] = 1;
+  return p + 8;
+}
+
+/* A test image using every chunk type: gradients, flat bands, a palette and noise */
+static void qoi_image (uint8_t *rgba, int w, int h)
+{
+  static const uint8_t palette[4][3] = { { 255, 0, 0 }, { 0, 128, 255 }, { 17, 34, 51 }, { 200, 200, 200 } };
+  uint32_t seed = 12345;
+  uint8_t *p;
+  int x, y;
+
+  for (y = 0; y < h; y++)
+    for (x = 0; x < w; x++) {
+      p = rgba + (y * w + x) * 4;
+      seed = seed * 1103515245 + 12345;
+      p[3] = 255;
+      if (y >= 10 && y < 13) {                  /* Flat band: runs */
+        p[0] = 40; p[1] = 80; p[2] = 120;
+      } else if (x < w / 3) {                   /* Gradient: diffs and lumas */
+        p[0] = x * 7; p[1] = y * 11; p[2] = (x + y) * 3;
+      } else if (x < 2 * w / 3) {               /* Palette: index hits */
+        memcpy(p, palette[(x / 3 + y) & 3], 3);
+      } else {                                  /* Noise, some translucent */
+        p[0] = seed >> 24; p[1] = seed >> 16; p[2] = seed >> 8;
+        if (!(seed & 0x700)) p[3] = 128;
+      }
+    }
+}
+
+/* Byte source handing out a few bytes at a time */
+class BurstSource: public XUtils {
+  public:
+    BurstSource (const uint8_t *p, int n): _p(p), _n(n), _ready(0) { };
+    void xputc (char c) { (void) c; };
+    char xgetc (void) { _n--; _ready--; return (char) *_p++; };
+    byte xready (void) {
+      if (_n <= 0) return 0;
+      if (_ready < 0) { _ready = 5; return 0; }   /* Gap between bursts */
+      if (_ready == 0) _ready = -1;
+      return _ready > 0;
+    };
+    int left (void) { return _n; };
+
+  private:
+    const uint8_t *_p;
+    int _n, _ready;
+};
+
+static void test_ili9341_qoi (void)
+{
+  static uint8_t rgba[37 * 23 * 4], qoi[37 * 23 * 5 + 22];
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  ILI9341QOI dec(tft);
+  unsigned long bytes;
+  uint16_t w, h;
+  int n, x, y, bad, i, polls;
+  uint8_t *p;
+  long sum[3];
+
+  host_reset();
+  tft.init();
+  qoi_image(rgba, 37, 23);
+  n = qoi_encode(rgba, 37, 23, qoi);
+
+  /* In one piece: every pixel as RGB565, no more than one window */
+  bytes = host_counters.spi_bytes;
+  dec.begin(10, 20, 0);
+  CHECK(dec.feed(qoi, n) == QOI_DONE);
+  CHECK(host_counters.spi_bytes - bytes < 37 * 23 * 2 + 16);
+  dec.get_size(&w, &h);
+  CHECK(w == 37 && h == 23);
+  for (bad = 0, y = 0; y < 23; y++)
+    for (x = 0; x < 37; x++) {
+      p = rgba + (y * 37 + x) * 4;
+      bad += sim.pixel(10 + x, 20 + y) != RGB16(p[0], p[1], p[2]);
+    }
+  CHECK(bad == 0);
+  CHECK(dec.end() == QOI_DONE);
+
+  /* Byte by byte from a source with gaps, then from flash */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  {
+    BurstSource src(qoi, n);
+
+    dec.begin(100, 200, 0);
+    for (polls = 0; polls < 10000 && dec.feed(src) == QOI_MORE; polls++) ;
+    CHECK(dec.feed(src) == QOI_DONE && src.left() == 0 && polls > n / 6);
+  }
+  for (bad = 0, y = 0; y < 23; y++)
+    for (x = 0; x < 37; x++) {
+      p = rgba + (y * 37 + x) * 4;
+      bad += sim.pixel(100 + x, 200 + y) != RGB16(p[0], p[1], p[2]);
+    }
+  CHECK(bad == 0);
+
+  /* Clipped by the mask and the screen: the rest is dropped */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.setmask(0, 219, 0, 319);
+  dec.begin(200, 310, 0);
+  for (i = 0; i < n; i++) dec.feed(&qoi[i], 1);
+  CHECK(dec.end() == QOI_DONE);
+  tft.setmask(0, 239, 0, 319);
+  for (bad = 0, y = 0; y < 10; y++)
+    for (x = 0; x < 37 && 200 + x < 240; x++) {
+      p = rgba + (y * 37 + x) * 4;
+      bad += sim.pixel(200 + x, 310 + y) != (200 + x < 220 ? RGB16(p[0], p[1], p[2]) : C_BLACK);
+    }
+  CHECK(bad == 0);
+
+  /* Dithering: exact levels stay put, others average out */
+  for (i = 0; i < 16 * 16; i++) {
+    rgba[i * 4] = 100; rgba[i * 4 + 1] = 150; rgba[i * 4 + 2] = 13; rgba[i * 4 + 3] = 255;
+    if (i >= 128) { rgba[i * 4] = 96; rgba[i * 4 + 1] = 148; rgba[i * 4 + 2] = 8; }
+  }
+  n = qoi_encode(rgba, 16, 16, qoi);
+  dec.begin(0, 0, 1);
+  CHECK(dec.feed(qoi, n) == QOI_DONE);
+  sum[0] = sum[1] = sum[2] = 0;
+  for (bad = 0, y = 0; y < 16; y++)
+    for (x = 0; x < 16; x++) {
+      uint16_t c = sim.pixel(x, y);
+      if (y >= 8) { bad += c != RGB16(96, 148, 8); continue; }
+      sum[0] += (c >> 11) << 3; sum[1] += ((c >> 5) & 0x3F) << 2; sum[2] += (c & 0x1F) << 3;
+    }
+  CHECK(bad == 0);
+  CHECK(labs(sum[0] / 128 - 100) <= 1 && labs(sum[1] / 128 - 150) <= 1 && labs(sum[2] / 128 - 13) <= 1);
+
+  /* Broken streams */
+  dec.begin(0, 0, 0);
+  CHECK(dec.feed((const uint8_t *) "qoix", 4) == QOI_ERROR);
+  memcpy(qoi + 12, "\x05", 1);
+  dec.begin(0, 0, 0);
+  CHECK(dec.feed(qoi, n) == QOI_ERROR);
+  qoi[12] = 4;
+  dec.begin(0, 0, 0);
+  CHECK(dec.feed(qoi, n / 2) == QOI_MORE);
+  CHECK(dec.end() == QOI_ERROR);
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+/* Host end of the upload protocol: chunks of uneven lengths, so that
+   pixels straddle them, go-back-N on a NAK */
+class UploadHost: public XUtils {
+  public:
+    UploadHost (const uint8_t *data, int n): corrupt(-1), extra(0), badlen(0), silent(0),
+      status(-1), naks(0), _data(data), _n(n), _credits(0), _chunks(0), _next(0),
+      _qh(0), _qn(0), _fn(0), _dead(0), _in(0), _polls(0) { };
+    void xputc (char c) { answer((uint8_t) c); };
+    char xgetc (void) { _qn--; return (char) _q[_qh++ % sizeof(_q)]; };
+    byte xready (void) {
+      if (silent) host_advance_us(1000);
+      return _qn && ++_polls % 4;   /* Bytes come in bursts */
+    };
+    void xwrite (const uint8_t* b, int n) { while (n--) answer(*b++); };
+
+    int corrupt;            /* Chunk damaged on its first sending */
+    byte extra;             /* 1: two bytes past the last pixel */
+    byte badlen;            /* 1: chunks longer than allowed */
+    byte silent;            /* 1: nothing is sent */
+    int status;             /* From 'U' 'E', -1 until then */
+    int naks;
+    int chunks (void) { return _chunks; };
+
+  private:
+    void push (uint8_t b) { _q[(_qh + _qn++) % sizeof(_q)] = b; };
+    void send (void) {
+      int len, i;
+      uint16_t sum;
+      uint8_t b;
+
+      while (!silent && _fn < _credits && _next < _chunks) {
+        len = badlen ? _size + 1 : _off[_next + 1] - _off[_next];
+        sum = (uint8_t) _next + (len & 0xFF) + (len >> 8);
+        push(_next); push(len); push(len >> 8);
+        for (i = 0; i < len; i++) {
+          b = _off[_next] + i < _n ? _data[_off[_next] + i] : 0;
+          sum += b;
+          if (_next == corrupt && i == 0) { b ^= 0x10; corrupt = -1; }
+          push(b);
+        }
+        push(sum); push(sum >> 8);
+        _fn++;
+        _next++;
+      }
+    };
+    void answer (uint8_t b) {
+      _msg[_in++] = b;
+      if (_msg[0] == 'U') {
+        if (_in < 3 || (_msg[1] == 'P' && _in < 5)) return;
+        if (_msg[1] == 'P') {   /* Chunks as large as allowed, then one byte short */
+          _size = _msg[2] | _msg[3] << 8;
+          _credits = _msg[4];
+          _next = _fn = _dead = 0;
+          _qn = 0;
+          for (_chunks = 0, _off[0] = 0; _off[_chunks] < _n + 2 * extra; _chunks++) {
+            _off[_chunks + 1] = _off[_chunks] + (_chunks & 1 ? _size - 1 : _size);
+            if (_off[_chunks + 1] > _n + 2 * extra) _off[_chunks + 1] = _n + 2 * extra;
+          }
+        } else {
+          status = _msg[2];
+        }
+      } else if (_msg[0] == UPLOAD_NAK) {
+        if (_in < 2) return;
+        naks++;
+        _fn--;
+        if (_dead) _dead--;       /* Sent before the NAK that rewound */
+        else {
+          CHECK(_msg[1] < _next);
+          _dead = _fn;
+          _next = _msg[1];
+        }
+      } else {
+        CHECK(_msg[0] == UPLOAD_ACK && _dead == 0);
+        _fn--;
+      }
+      _in = 0;
+      send();
+    };
+
+    const uint8_t *_data;
+    int _n, _size, _credits, _chunks, _next;
+    int _off[300];
+    uint8_t _q[1024];
+    unsigned _qh, _qn;
+    int _fn, _dead;           /* Chunks unanswered, then doomed */
+    uint8_t _msg[8], _in;
+    unsigned _polls;
+};
+
+static void test_ili9341_upload (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  static uint8_t raw[40 * 30 * 2];
+  static CaptureSink cap;
+  ILI9341_upload_stats_t st;
+  int x, y, i, bad;
+  uint16_t px;
+
+  host_reset();
+  tft.init();
+  for (i = 0; i < 40 * 30; i++) {
+    px = (uint16_t)(i * 40503U);
+    raw[2 * i] = px >> 8; raw[2 * i + 1] = px;
+  }
+
+  /* Raw, one chunk damaged: sent again, with the chunks after it */
+  {
+    UploadHost host(raw, sizeof(raw));
+    ILI9341Upload up(tft, host);
+    host.corrupt = 3;
+    CHECK(up.run(5, 44, 7, 36, UPLOAD_RAW) == UPLOAD_OK);
+    CHECK(host.status == UPLOAD_OK);
+    up.get_stats(&st);
+    CHECK(st.bytes == sizeof(raw) && st.naks >= 1 && st.naks == (uint16_t) host.naks);
+    CHECK(st.chunks == host.chunks() && st.chunks > 2 * UPLOAD_BUFFERS);
+    for (bad = 0, y = 0; y < 30; y++)
+      for (x = 0; x < 40; x++)
+        bad += sim.pixel(5 + x, 7 + y) != (raw[2 * (y * 40 + x)] << 8 | raw[2 * (y * 40 + x) + 1]);
+    CHECK(bad == 0);
+  }
+
+  /* RLE: a capture stream uploaded elsewhere */
+  tft.rectfill(0, 59, 100, 139, C_BLUE);
+  tft.rectfill(10, 30, 110, 120, C_YELLOW);
+  tft.line(0, 100, 59, 139, C_WHITE);
+  CHECK(tft.capture(0, 59, 100, 139, cap) == 1);
+  {
+    UploadHost host(cap.buf + 6, cap.len - 8);
+    ILI9341Upload up(tft, host);
+    CHECK(up.run(120, 179, 200, 239, UPLOAD_RLE) == UPLOAD_OK);
+    CHECK(host.status == UPLOAD_OK);
+    up.get_stats(&st);
+    CHECK(st.bytes == cap.len - 8 && st.chunks == host.chunks() && st.naks == 0);
+    for (bad = 0, y = 0; y < 40; y++)
+      for (x = 0; x < 60; x++)
+        bad += sim.pixel(120 + x, 200 + y) != sim.pixel(x, 100 + y);
+    CHECK(bad == 0);
+  }
+
+  /* Errors */
+  {
+    UploadHost host(raw, sizeof(raw));
+    ILI9341Upload up(tft, host);
+    host.extra = 1;
+    CHECK(up.run(5, 44, 7, 36, UPLOAD_RAW) == UPLOAD_E_DATA && host.status == UPLOAD_E_DATA);
+    host.badlen = 1; host.extra = 0;
+    CHECK(up.run(5, 44, 7, 36, UPLOAD_RAW) == UPLOAD_E_PROTOCOL);
+    CHECK(up.run(5, 240, 7, 36, UPLOAD_RAW) == UPLOAD_E_AREA);
+  }
+  {
+    UploadHost host(raw, sizeof(raw));
+    ILI9341Upload up(tft, host);
+    host.silent = 1;
+    CHECK(up.run(5, 44, 7, 36, UPLOAD_RAW) == UPLOAD_E_TIMEOUT && host.status == UPLOAD_E_TIMEOUT);
+    up.get_stats(&st);
+    CHECK(st.ms >= UPLOAD_TIMEOUT);
+  }
+
+  CHECK(sim.untransacted() == 0 && SPI.host_in_transaction() == 0);
+}
+
+static void count_line (void *ctx)
+{
+  (*(int *) ctx)++;
+}
+
+static void test_ili9341_lines (void)
+{
+  static uint16_t buf[2 * 240];
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  unsigned long t0, bytes;
+  int x, y, bad, sent = 0;
+  uint16_t *p;
+
+  host_reset();
+  tft.init();
+  tft.on_line_sent(count_line, &sent);
+
+  /* A line rendered in 400 us while the previous one goes in 480 us:
+     the redraw takes the bus time, not the sum */
+  t0 = host_time_us();
+  bytes = host_counters.spi_bytes;
+  CHECK(tft.begin_lines(0, 239, 0, 63, buf) == 1);
+  for (bad = 0, y = 0; y < 64; y++) {
+    p = tft.line_buffer();
+    host_advance_us(400);
+    for (x = 0; x < 240; x++) p[x] = (uint16_t) (x * 31 + y * 7);
+    tft.send_line();
+    bad += !SPI.host_async_busy() || sent != y;
+  }
+  CHECK(bad == 0);
+  tft.end_write();
+  CHECK(sent == 64 && !SPI.host_async_busy());
+  CHECK(host_pin_level(TFT_CS) == HIGH && SPI.host_in_transaction() == 0);
+  CHECK(host_time_us() - t0 >= 64UL * 480 && host_time_us() - t0 < 64UL * 480 + 1000);
+  CHECK(host_counters.spi_bytes - bytes < 64UL * 480 + 16);
+  for (bad = 0, y = 0; y < 64; y++)
+    for (x = 0; x < 240; x++)
+      bad += sim.pixel(x, y) != (uint16_t) (x * 31 + y * 7);
+  CHECK(bad == 0);
+
+  /* Other drawing after end_write() waits for nothing */
+  tft.rectfill(0, 9, 0, 9, C_RED);
+  CHECK(sim.pixel(0, 0) == C_RED && sim.pixel(10, 0) == (uint16_t) 310);
+
+  /* Cut to the mask: lines above it dropped, the rest trimmed */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.setmask(20, 219, 10, 319);
+  sent = 0;
+  CHECK(tft.begin_lines(0, 239, 0, 31, buf) == 1);
+  for (y = 0; y < 32; y++) {
+    p = tft.line_buffer();
+    for (x = 0; x < 240; x++) p[x] = (uint16_t) (x + y * 256);
+    tft.send_line();
+  }
+  tft.end_write();
+  tft.setmask(0, 239, 0, 319);
+  CHECK(sent == 22);
+  for (bad = 0, y = 0; y < 32; y++)
+    for (x = 0; x < 240; x++)
+      bad += sim.pixel(x, y) != (x >= 20 && x < 220 && y >= 10 ? (uint16_t) (x + y * 256) : C_BLACK);
+  CHECK(bad == 0);
+
+  /* Past the bottom of the mask: the buffers of the dropped lines are
+     only handed back once the last visible line is out */
+  tft.rectfill(0, 239, 0, 319, C_BLACK);
+  tft.setmask(0, 239, 0, 19);
+  sent = 0;
+  CHECK(tft.begin_lines(0, 239, 10, 29, buf) == 1);
+  for (y = 10; y < 30; y++) {
+    p = tft.line_buffer();
+    for (x = 0; x < 240; x++) p[x] = (uint16_t) (x + y * 256);
+    tft.send_line();
+  }
+  tft.end_write();
+  tft.setmask(0, 239, 0, 319);
+  CHECK(sent == 10);
+  for (bad = 0, y = 0; y < 30; y++)
+    for (x = 0; x < 240; x++)
+      bad += sim.pixel(x, y) != (y >= 10 && y < 20 ? (uint16_t) (x + y * 256) : C_BLACK);
+  CHECK(bad == 0);
+
+  /* Out of the mask: nothing sent */
+  bytes = host_counters.spi_bytes;
+  CHECK(tft.begin_lines(0, 239, 400, 401, buf) == 0);
+  tft.send_line();
+  tft.send_line();
+  tft.end_write();
+  tft.wait_idle();
+  CHECK(host_counters.spi_bytes == bytes && sent == 10);
+  tft.on_line_sent(0, 0);
+}
+
+static void test_ili9341_init_steps (void)
+{
+  SimILI9341 sim(TFT_CS, TFT_DC);
+  ILI9341 tft(TFT_CS, TFT_RST, TFT_DC);
+  unsigned long t0, t1, longest, w0;
+  int work;
+
+  host_reset();
+  sim.set_reset(TFT_RST);
+
+  /* Blocking: the clear overlaps the sleep out wait */
+  t0 = host_time_us();
+  tft.init();
+  CHECK(sim.timing_errors() == 0 && sim.display_on() && sim.written_at_on() == 240UL * 320);
+  CHECK(host_time_us() - t0 >= 10000UL + 10000 + 150000 + 150000 && host_time_us() - t0 < 340000UL);
+  CHECK(tft.init_step() == 0 && tft.init_wait() == 0);
+
+  /* Stepped: the caller works in between, steps are short, the screen
+     is cleared before the display goes on */
+  tft.rectfill(0, 239, 0, 319, C_RED);
+  w0 = sim.pixels_written();
+  tft.init_begin(ILI9341_INIT_CLEAR);
+  CHECK(tft.init_wait() > 9000 && tft.init_wait() <= 10000);
+  for (work = 0, longest = 0; ; work++) {
+    t1 = host_time_us();
+    if (!tft.init_step()) break;
+    if (host_time_us() - t1 > longest) longest = host_time_us() - t1;
+    host_advance_us(500);   /* Other setup work */
+  }
+  CHECK(sim.timing_errors() == 0 && sim.display_on() && sim.written_at_on() - w0 == 240UL * 320);
+  CHECK(longest < ILI9341_INIT_BAND * 240UL * 2 + 1000 && work > 300);
+  CHECK(sim.pixel(0, 0) == C_BLACK && sim.pixel(239, 319) == C_BLACK);
+  CHECK(host_pin_level(TFT_CS) == HIGH && SPI.host_in_transaction() == 0);
+
+  /* No clear: the frame memory is shown as it is */
+  tft.rectfill(0, 239, 0, 319, C_RED);
+  w0 = sim.pixels_written();
+  t0 = host_time_us();
+  tft.init_begin(ILI9341_INIT_NOCLEAR);
+  while (tft.init_step()) host_advance_us(1000);
+  CHECK(sim.timing_errors() == 0 && sim.display_on() && sim.written_at_on() == w0);
+  CHECK(sim.pixel(120, 160) == C_RED && host_time_us() - t0 < 10000UL + 10000 + 150000 + 150000 + 5000);
+
+  /* Ready to draw */
+  tft.rectfill(0, 9, 0, 9, C_BLUE);
+  CHECK(sim.pixel(0, 0) == C_BLUE && sim.pixel(10, 10) == C_RED);
+
+  /* The window set before a reset is not taken for granted */
+  tft.rectfill(0, 239, 100, 109, C_RED);
+  tft.init_begin(ILI9341_INIT_NOCLEAR);
+  while (tft.init_step()) host_advance_us(1000);
+  tft.rectfill(20, 29, 100, 109, C_BLUE);
+  CHECK(sim.pixel(20, 100) == C_BLUE && sim.pixel(20, 0) == C_RED);
+
+  /* Commands right after a reset pulse are caught */
+  digitalWrite(TFT_RST, LOW);
+  host_advance_us(10);
+  digitalWrite(TFT_RST, HIGH);
+  host_advance_us(1);
+  tft.rectfill(0, 9, 0, 9, C_RED);
+  CHECK(sim.timing_errors() > 0 && !sim.display_on());
+}
+
+#define TFT2_CS   4
+#define TFT2_RST  3
+
+static void test_xspibus (void)
+{
+  SimILI9341 sima(TFT_CS, TFT_DC), simb(TFT2_CS, TFT_DC);   /* D/C shared */
+  ILI9341 a(TFT_CS, TFT_RST, TFT_DC), b(TFT2_CS, TFT2_RST, TFT_DC);
+  XSPIBus bus;
+  XSPIBUS_stats_t st;
+  int i, bad;
+
+  host_reset();
+  simb.set_limits(4000000, 0);    /* Longer wires: writes above 4 MHz get corrupted */
+  a.share_bus(&bus);
+  b.share_bus(&bus);
+  b.set_spi_clock(4000000, ILI9341_READ_CLOCK);
+  a.init();
+  b.init();
+  CHECK(a.read_id() == ILI9341_ID && b.read_id() == ILI9341_ID);
+
+  /* Interleaved: each display at its own clock, the other one deselected */
+  bus.reset_stats();
+  for (bad = 0, i = 0; i < 100; i++) {
+    a.rectfill(i, i + 9, 0, 9, C_RED + i);
+    bad += host_pin_level(TFT_CS) != LOW || host_pin_level(TFT2_CS) != HIGH;
+    bad += SPI.host_settings().clock != F_CPU / 2;
+    b.rectfill(i, i + 9, 0, 9, C_BLUE + i);
+    bad += host_pin_level(TFT_CS) != HIGH || host_pin_level(TFT2_CS) != LOW;
+    bad += SPI.host_settings().clock != 4000000;
+  }
+  CHECK(bad == 0);
+  for (bad = 0, i = 0; i < 100; i++)
+    bad += sima.pixel(i, 5) != (uint16_t) (C_RED + i) || simb.pixel(i, 5) != (uint16_t) (C_BLUE + i);
+  CHECK(bad == 0);
+  bus.get_stats(&st);
+  CHECK(st.operations >= 200 && st.transactions == st.operations);
+
+  /* A run of operations of one display: a single transaction */
+  bus.reset_stats();
+  for (i = 0; i < 50; i++) a.rectfill(0, 9, 20 + i, 20 + i, C_GREEN);
+  a.line(0, 100, 50, 150, C_WHITE);
+  bus.get_stats(&st);
+  CHECK(st.operations >= 51 && st.transactions == 1);
+  CHECK(sima.pixel(5, 40) == C_GREEN && sima.pixel(25, 125) == C_WHITE && SPI.host_in_transaction() == 1);
+
+  /* Reads change the settings, then writes change them back */
+  bus.reset_stats();
+  CHECK(a.read_id() == ILI9341_ID);
+  a.rectfill(0, 0, 0, 0, C_RED);
+  bus.get_stats(&st);
+  CHECK(st.operations == 2 && st.transactions == 2);
+
+  /* New clocks are not left behind by a held transaction */
+  a.set_spi_clock(4000000, ILI9341_READ_CLOCK);
+  a.rectfill(0, 0, 0, 0, C_BLUE);
+  CHECK(SPI.host_settings().clock == 4000000 && sima.pixel(0, 0) == C_BLUE);
+
+  /* Handed back */
+  bus.flush();
+  CHECK(host_pin_level(TFT_CS) == HIGH && host_pin_level(TFT2_CS) == HIGH && SPI.host_in_transaction() == 0);
+  CHECK(sima.untransacted() == 0 && simb.untransacted() == 0);
+
+  /* Without batching: a transaction per operation */
+  bus.set_batching(0);
+  bus.reset_stats();
+  for (i = 0; i < 10; i++) a.rectfill(0, 9, 0, 9, C_RED);
+  bus.get_stats(&st);
+  CHECK(st.operations >= 10 && st.transactions == st.operations);
+  CHECK(host_pin_level(TFT_CS) == HIGH && SPI.host_in_transaction() == 0);
+}
+
+int main (void)
+{
+  test_xatoi();
+  test_xprintf();
+  test_xgets();
+  test_xgets_poll();
+  test_hardware_console();
+  test_rtc();
+  test_epoch();
+  test_tmp006();
+  test_tmp006_poll();
+  test_tmp006_array();
+  test_tmp006_calibration();
+  test_tmp006_fixed_bound();
+  test_xstats();
+  test_xsched();
+  test_xlog();
+  test_xlog_powerfail();
+  test_xlog_file();
+  test_ili9341();
+  test_ili9341_calibrate();
+  test_ili9341_capture();
+  test_ili9341_blend();
+  test_ili9341_present();
+  test_ili9341_list();
+  test_ili9341_shapes();
+  test_ili9341_plot();
+  test_ili9341_field();
+  test_ili9341_term();
+  test_ili9341_rlfont();
+  test_ili9341_textbox();
+  test_ili9341_qoi();
+  test_ili9341_upload();
+  test_ili9341_lines();
+  test_ili9341_init_steps();
+  test_xspibus();
+
+  /* Instrumentation is compiled out by default */
+  CHECK(XPerf::get(XPERF_RTC_GETTIME) == 0);
+
+  printf("%d checks, %d failures\n", checks, failures);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Host tests for the XPerf instrumentation (built with XPERF_ENABLE=1)
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "SPI.h"
+
+#include "XUtils.h"
+#include "XConsole.h"
+#include "RTC.h"
+#include "TMP006.h"
+#include "ILI9341.h"
+#include "XPerf.h"
+
+#include "SimDS3231.h"
+#include "SimTMP006.h"
+#include "SimILI9341.h"
+
+static int failures, checks;
+
+#define CHECK(c) do { \
+  checks++; \
+  if (!(c)) { \
+    failures++; \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+  } \
+} while (0)
+
+static void test_counters (void)
+{
+  SimDS3231 rtcsim;
+  SimTMP006 tmpsim;
+  SimILI9341 dispsim(10, 8);
+  RTC rtc(DS3231_I2C_ADDRESS);
+  TMP006 tmp;
+  ILI9341 tft(10, 9, 8);
+  XConsole con;
+  TIME_t t = { 2016, 6, 15, 4, 12, 30, 0 };
+  TMP006_t temp;
+  const XPERF_counter_t *c;
+  unsigned long spi, tx, bytes;
+  static char buf[8192];
+
+  host_reset();
+  Wire.host_attach(DS3231_I2C_ADDRESS, &rtcsim);
+  Wire.host_attach(TMP006_I2C_ADDRESS, &tmpsim);
+  XPerf::reset();
+
+  rtc.settime(&t);
+  rtc.gettime(&t);
+  rtc.gettime(&t);
+  c = XPerf::get(XPERF_RTC_GETTIME);
+  CHECK(c && c->calls == 2 && c->bytes == 16);
+  CHECK(XPerf::get(XPERF_RTC_SETTIME)->bytes == 8);
+
+  /* A blocking read takes at least one conversion */
+  tmp.init(TMP006_CFG_1SAMPLE);
+  CHECK(tmp.gettemp(&temp));
+  c = XPerf::get(XPERF_TMP006_GETTEMP);
+  CHECK(c->calls == 1 && c->max_us >= 200000 && c->total_us == c->max_us);
+  CHECK(XPerf::get(XPERF_TMP006_CONVERT)->calls == 1);
+
+  /* Bytes account for everything sent to the display; init() clears in bands */
+  tft.init();
+  c = XPerf::get(XPERF_ILI9341_RECTFILL);
+  CHECK(c->calls == (320 + ILI9341_INIT_BAND - 1) / ILI9341_INIT_BAND && c->bytes > 240UL * 320 * 2);
+  CHECK(XPerf::get(XPERF_ILI9341_INIT)->calls == 1 && XPerf::get(XPERF_ILI9341_INIT)->bytes > c->bytes);
+  spi = host_counters.spi_bytes;
+  bytes = c->bytes;
+  tft.rectfill(0, 9, 0, 9, C_RED);
+  CHECK(c->calls == (320 + ILI9341_INIT_BAND - 1) / ILI9341_INIT_BAND + 1 && c->bytes - bytes == host_counters.spi_bytes - spi);
+
+  /* Nested operations are included in the outer one */
+  tft.xprintf(F("%u"), 42);
+  CHECK(XPerf::get(XPERF_ILI9341_PUTC)->calls == 2);
+  CHECK(XPerf::get(XPERF_XUTILS_XPRINTF)->bytes == XPerf::get(XPERF_ILI9341_PUTC)->bytes);
+
+  tx = host_counters.serial_tx;
+  con.xprintf(F("%d\n"), -1);
+  CHECK(XPerf::get(XPERF_XUTILS_XPRINTF)->calls == 2);
+  CHECK(host_counters.serial_tx - tx == 4);
+
+  XPerf::dump(con);
+  Serial.host_take(buf, sizeof(buf));
+  CHECK(strstr(buf, "rtc.gettime\r\n") && strstr(buf, "tmp006.convert_fixed\r\n"));
+
+  XPerf::reset();
+  CHECK(XPerf::get(XPERF_RTC_GETTIME)->calls == 0);
+  CHECK(XPerf::get(XPERF_COUNTERS) == 0);
+  CHECK(!strcmp("tmp006.poll", XPerf::name(XPERF_TMP006_POLL)) && XPerf::name(XPERF_COUNTERS) == 0);
+
+  Wire.host_detach(DS3231_I2C_ADDRESS);
+  Wire.host_detach(TMP006_I2C_ADDRESS);
+}
+
+int main (void)
+{
+  test_counters();
+
+  printf("%d checks, %d failures\n", checks, failures);
+
+  return failures ? 1 : 0;
+}
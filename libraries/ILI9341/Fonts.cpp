@@ -102,3 +102,52 @@ const PROGMEM uint8_t FontH8[] = {
   0x40,0xA8,0x10,0x00,0x00,0x00,0x00,0x00, // ~
   0x70,0xD8,0xD8,0x70,0x00,0x00,0x00,0x00 // DEL
 };
+
+/* Generated by tools/bdf2font.py */
+const PROGMEM uint8_t FontD24[] = {
+  'F','O','N','T','R','L','F','o','n','t','D','2','4',' ',
+  17,24, /* Widest advance, height */
+  0x20,0x3A, /* First and last character */
+  /* Advances */
+  17,0,0,0,0,0,0,0,0,0,0,17,0,17,6,0,
+  17,17,17,17,17,17,17,17,17,17,6,
+  /* Offsets */
+  0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+  0x00,0x00,0x00,0x00,0x00,0x00,0x1C,0x00,0x00,0x00,0x39,0x00,0x54,0x00,0x00,0x00,
+  0x60,0x00,0x8D,0x00,0xAC,0x00,0xCB,0x00,0xEA,0x00,0x10,0x01,0x2F,0x01,0x56,0x01,
+  0x75,0x01,0xA4,0x01,0xCB,0x01,
+  /* Runs (background << 4 | foreground) */
+  0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0, // 0x20
+  0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0x30,
+  0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0x31,0xF0,0x03,0xE3,0xE3,0xC8,0x8A,0x88,0xB3, // +
+  0xE3,0xE3,0xF0,0x01,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0x90,
+  0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0x88,0x8A,0x88,0xF0,0xF0, // -
+  0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xD0,
+  0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0xF0,0x13,0x33,0x33,0x80, // .
+  0x38,0x8A,0x61,0x18,0x11,0x43,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33, // 0
+  0x83,0x33,0x83,0x41,0xA1,0xF0,0x71,0xA1,0x43,0x83,0x33,0x83,0x33,0x83,0x33,0x83,
+  0x33,0x83,0x33,0x83,0x33,0x83,0x41,0x18,0x11,0x6A,0x88,0xF0,0x80,
+  0xF0,0xF0,0xF0,0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0xF0,0xF0, // 1
+  0x31,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0xF0,0xF0,0xF0,0xA0,
+  0x38,0x8A,0x88,0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0x68,0x11,0x6A,0x61, // 2
+  0x18,0x63,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0x18,0x8A,0x88,0xF0,0x80,
+  0x38,0x8A,0x88,0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0x68,0x11,0x6A,0x88, // 3
+  0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0x68,0x11,0x6A,0x88,0xF0,0x80,
+  0xF0,0xF0,0x51,0xA1,0x43,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83, // 4
+  0x33,0x83,0x41,0x18,0x11,0x6A,0x88,0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,
+  0xF0,0x01,0xF0,0xF0,0xF0,0xA0,
+  0x38,0x8A,0x61,0x18,0x63,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0x18,0x8A,0x88, // 5
+  0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0x68,0x11,0x6A,0x88,0xF0,0x80,
+  0x38,0x8A,0x61,0x18,0x63,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0x18,0x8A,0x61, // 6
+  0x18,0x11,0x43,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,
+  0x41,0x18,0x11,0x6A,0x88,0xF0,0x80,
+  0x38,0x8A,0x88,0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0xF0,0xF0, // 7
+  0x31,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,0xE3,0xF0,0x01,0xF0,0xF0,0xF0,0xA0,
+  0x38,0x8A,0x61,0x18,0x11,0x43,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33, // 8
+  0x83,0x33,0x83,0x41,0x18,0x11,0x6A,0x61,0x18,0x11,0x43,0x83,0x33,0x83,0x33,0x83,
+  0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x41,0x18,0x11,0x6A,0x88,0xF0,0x80,
+  0x38,0x8A,0x61,0x18,0x11,0x43,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33,0x83,0x33, // 9
+  0x83,0x33,0x83,0x41,0x18,0x11,0x6A,0x88,0x11,0xF0,0x03,0xE3,0xE3,0xE3,0xE3,0xE3,
+  0xE3,0x68,0x11,0x6A,0x88,0xF0,0x80,
+  0xF0,0xF0,0x73,0x33,0x33,0xF0,0xF0,0x93,0x33,0x33,0xF0,0xF0,0x80, // :
+};
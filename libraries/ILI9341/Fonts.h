@@ -5,6 +5,34 @@
 
 #define FONT_START_CHAR 0x20 /* Save some program space by not storing chars below this index */
 
+/*
+ * Fonts come in two formats, told apart by their first 6 bytes:
+ *
+ * FONTX2, fixed cells from FONT_START_CHAR on:
+ *   [0..5]   "FONTX2"
+ *   [6..13]  Name
+ *   [14]     Width
+ *   [15]     Height
+ *   [16]     Code flag (0)
+ *   [17..]   Bitmaps, (width + 7) / 8 bytes per raster, MSB first
+ *
+ * FONTRL, proportional and run-length encoded (tools/bdf2font.py):
+ *   [0..5]   "FONTRL"
+ *   [6..13]  Name
+ *   [14]     Widest advance
+ *   [15]     Height
+ *   [16]     First character
+ *   [17]     Last character
+ *   [18..]   Advance (glyph width) per character, 0: no glyph
+ *   then     Offset of the runs per character, 2 bytes little endian,
+ *            from the start of the runs
+ *   then     Runs: per glyph, its advance x height cell scanned raster by
+ *            raster as bytes of (background run << 4 | foreground run),
+ *            runs 0..15 pixels long, wrapping from a raster to the next
+ */
+#define FONT_RL_HEAD    18    /* FONTRL header size */
+
 extern const PROGMEM uint8_t FontH8[];
+extern const PROGMEM uint8_t FontD24[];   /* Seven-segment numerals " +-.0-9:", 24 pixels high, FONTRL */
 
 #endif
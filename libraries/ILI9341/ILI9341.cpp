@@ -5,16 +5,15 @@
  */
 
 #include "Arduino.h"
-#include "SPI.h"
 #include "ILI9341.h"
 #include "Fonts.h"
+#include "XPerf.h"
 
-#define CS_LOW()      digitalWrite(_cs, LOW)
-#define CS_HIGH()     digitalWrite(_cs, HIGH)
+#define CS_LOW()      _bus.select()       /* Select display for writing */
+#define CS_LOW_RD()   _bus.select_read()  /* Select display for reading */
+#define CS_HIGH()     _bus.release()      /* Release display */
 #define RESET_LOW()   digitalWrite(_reset, LOW)
 #define RESET_HIGH()  digitalWrite(_reset, HIGH)
-#define DC_LOW()      digitalWrite(_dc, LOW)
-#define DC_HIGH()     digitalWrite(_dc, HIGH)
 
 /* Level 1 Commands (from the display Datasheet) */
 #define ILI9341_CMD_NOP                             0x00
@@ -97,10 +96,31 @@
 #define ILI9341_CMD_DIGITAL_GAMMA_CONTROL_2         0xE3
 #define ILI9341_CMD_INTERFACE_CONTROL               0xF6
 
-#define CMD_WRB(c)  { DC_LOW(); SPI.transfer(c); DC_HIGH(); } /* Write a command to the display */
-#define DATA_WRB(d) { SPI.transfer(d); }  /* Write a byte to the display */
-#define DATA_WRW(d) { SPI.transfer((d)>>8); SPI.transfer(d); }  /* Write a word to the display */
-#define DATA_WPX(d) { SPI.transfer((d)>>8); SPI.transfer(d); }  /* Write a pixel to the display */
+#define CMD_WRB(c)  { _bus.command(c); XPERF_BYTES(1); } /* Write a command to the display */
+#define DATA_WRB(d) { _bus.write(d); XPERF_BYTES(1); }  /* Write a byte to the display */
+#define DATA_WRW(d) { _bus.write16(d); XPERF_BYTES(2); }  /* Write a word to the display */
+#define DATA_WPX(d) { _bus.write16(d); XPERF_BYTES(2); }  /* Write a pixel to the display */
+#define DATA_RDB()  (_bus.read())   /* Read a byte from the display */
+
+void ILI9341::window (
+  int left,       /* Left end (0..DISP_XS-1) */
+  int right,      /* Right end (0..DISP_XS-1, >= left) */
+  int top,        /* Top end (0..DISP_YS-1) */
+  int bottom      /* Bottom end (0..DISP_YS-1, >= top) */
+)
+{
+  if (left != _wl || right != _wr) {
+    CMD_WRB(ILI9341_CMD_COLUMN_ADDRESS_SET);    /* Set H range */
+    DATA_WRW(left); DATA_WRW(right);
+    _wl = left; _wr = right;
+  }
+
+  if (top != _wt || bottom != _wb) {
+    CMD_WRB(ILI9341_CMD_PAGE_ADDRESS_SET);  /* Set V range */
+    DATA_WRW(top); DATA_WRW(bottom);
+    _wt = top; _wb = bottom;
+  }
+}
 
 void ILI9341::setrect (
   int left,       /* Left end (0..DISP_XS-1) */
@@ -111,84 +131,581 @@ void ILI9341::setrect (
 {
   CS_LOW();          /* Select display */
 
-  CMD_WRB(ILI9341_CMD_COLUMN_ADDRESS_SET);    /* Set H range */
-  DATA_WRW(left); DATA_WRW(right);
-
-  CMD_WRB(ILI9341_CMD_PAGE_ADDRESS_SET);  /* Set V range */
-  DATA_WRW(top); DATA_WRW(bottom);
+  window(left, right, top, bottom);
 
   CMD_WRB(ILI9341_CMD_MEMORY_WRITE);  /* Ready to receive pixel data */
 }
 
-void ILI9341::init (void)
+/* Initialization steps */
+#define IS_IDLE     0   /* Not initializing */
+#define IS_POWER    1   /* Reset high after power up */
+#define IS_RESET    2   /* Reset pulse */
+#define IS_CONFIG   3   /* Out of reset: registers */
+#define IS_SLEEP    4   /* Sleep out */
+#define IS_CLEAR    5   /* Frame memory cleared a band at a time, display off */
+#define IS_ON       6   /* Display on */
+
+/* Initialization waits (us) */
+#define WAIT_POWER  10000   /* Reset high before the pulse */
+#define WAIT_RESET  10000   /* Reset pulse */
+#define WAIT_CMD    5000    /* From the end of reset or sleep out to the next command */
+#define WAIT_SLEEP  150000  /* From the end of reset to sleep out, from sleep out to display on */
+
+static const PROGMEM uint8_t ili9341[] = {
+  2, ILI9341_CMD_POWER_CONTROL_1, 0x25,       /* Set the GVDD level to 4.70 V */
+  2, ILI9341_CMD_POWER_CONTROL_2, 0x11,       /* Set factor used in the step-up circuits */
+  3, ILI9341_CMD_VCOM_CONTROL_1, 0x5C, 0x4C,  /* Set the VCOMH/VXOML voltage */
+  2, ILI9341_CMD_VCOM_CONTROL_2, 0x94,        /* Set the VCOM offset voltage */
+  2, ILI9341_CMD_MEMORY_ACCESS_CONTROL, 0x08 | (1 << 6) |  /* Define read/write scanning direction of frame memory */
+      ((DISP_LANDSCAPE << 5) | (DISP_LANDSCAPE << 7)),
+  2, ILI9341_CMD_COLMOD_PIXEL_FORMAT_SET, 0x05,   /* Set the pixel format for the RGB image data to 16 bits / pixel */
+  3, ILI9341_CMD_FRAME_RATE_CONTROL_NORMAL, 0x00, 0x18,   /* Set the division ratio to 1 and 24 clocks per line */
+  0
+};
+
+void ILI9341::init_next (
+  byte state,     /* Next step (IS_xxx) */
+  unsigned long wait, /* Wait before it (us) */
+  byte restart    /* 1: wait from now, 0: from the last reset edge or sleep out */
+)
+{
+  _istate = state;
+  _iwait = wait;
+  if (restart) _it0 = micros();
+}
+
+void ILI9341::init_begin (
+  byte options    /* ILI9341_INIT_xxx */
+)
+{
+  /* Initialize display module control port */
+  _bus.begin();
+  pinMode(_reset, OUTPUT);
+  RESET_HIGH();
+
+  /* Register text fonts */
+  font_face(FontH8);
+
+  /* Reset current position */
+  moveto(0, 0);
+
+  _iopt = options;
+  init_next(IS_POWER, WAIT_POWER, 1);
+}
+
+byte ILI9341::init_step (void)
 {
-  static const PROGMEM uint8_t ili9341[] = {
-    2, ILI9341_CMD_POWER_CONTROL_1, 0x25,       /* Set the GVDD level to 4.70 V */
-    2, ILI9341_CMD_POWER_CONTROL_2, 0x11,       /* Set factor used in the step-up circuits */
-    3, ILI9341_CMD_VCOM_CONTROL_1, 0x5C, 0x4C,  /* Set the VCOMH/VXOML voltage */
-    2, ILI9341_CMD_VCOM_CONTROL_2, 0x94,        /* Set the VCOM offset voltage */
-    2, ILI9341_CMD_MEMORY_ACCESS_CONTROL, 0x08 | (1 << 6) |  /* Define read/write scanning direction of frame memory */
-        ((DISP_LANDSCAPE << 5) | (DISP_LANDSCAPE << 7)),
-    2, ILI9341_CMD_COLMOD_PIXEL_FORMAT_SET, 0x05,   /* Set the pixel format for the RGB image data to 16 bits / pixel */
-    3, ILI9341_CMD_FRAME_RATE_CONTROL_NORMAL, 0x00, 0x18,   /* Set the division ratio to 1 and 24 clocks per line */
-    1, ILI9341_CMD_SLEEP_OUT,                   /* Turn off sleep mode */
-    0,
-    ILI9341_CMD_DISPLAY_ON                      /* Display on */
-  };
   const uint8_t *p;
   uint8_t cmd;
   int n, i;
 
 
-  /* Initialize display module control port */
-  pinMode(_cs, OUTPUT);
-  pinMode(_reset, OUTPUT);
-  pinMode(_dc, OUTPUT);
+  if (_istate == IS_IDLE) return 0;
+  if (micros() - _it0 < _iwait) return 1;   /* Not due yet */
 
-  CS_HIGH();
-  RESET_HIGH();
+  switch (_istate) {
+  case IS_POWER:      /* Reset display module */
+    RESET_LOW();
+    init_next(IS_RESET, WAIT_RESET, 1);
+    break;
 
-  SPI.setClockDivider(SPI_CLOCK_DIV2);
-  SPI.setDataMode(SPI_MODE3);
+  case IS_RESET:
+    RESET_HIGH();
+    _wl = _wt = -1;   /* Window reset */
+    init_next(IS_CONFIG, WAIT_CMD, 1);
+    break;
 
-  CS_LOW();          /* Select display */
+  case IS_CONFIG:     /* Send initialization data */
+    CS_LOW();
+    p = ili9341;
+    while ((n = pgm_read_byte(p++)) != 0) {
+      cmd = pgm_read_byte(p++); n--;
+      CMD_WRB(cmd);
+      for (i = 0; i < n; i++) DATA_WRB(pgm_read_byte(p++));
+    }
+    CS_HIGH();
 
-  /* Reset display module */
-  delay(10);
-  RESET_LOW();
-  delay(10);
-  RESET_HIGH();
-  delay(150);
+    /* Set initial orientation for get_width()/get_height() */
+    Orientation = DISP_LANDSCAPE ? 3 : 0;
+    setmask(0, get_width() - 1, 0, get_height() - 1);
+    init_next(IS_SLEEP, WAIT_SLEEP, 0);
+    break;
+
+  case IS_SLEEP:      /* Turn off sleep mode */
+    CS_LOW();
+    CMD_WRB(ILI9341_CMD_SLEEP_OUT);
+    CS_HIGH();
+    _iy = 0;
+    if (_iopt & ILI9341_INIT_NOCLEAR) init_next(IS_ON, WAIT_SLEEP, 1);
+    else init_next(IS_CLEAR, WAIT_CMD, 1);
+    break;
+
+  case IS_CLEAR:      /* Clear screen, while the sleep out wait runs */
+    n = get_height() - _iy < ILI9341_INIT_BAND ? get_height() - _iy : ILI9341_INIT_BAND;
+    rectfill(0, get_width() - 1, _iy, _iy + n - 1, C_BLACK);
+    if ((_iy += n) == get_height()) init_next(IS_ON, WAIT_SLEEP, 0);
+    break;
 
-  /* Send initialization data */
-  p = ili9341;
-  while ((n = pgm_read_byte(p++)) != 0) {
-    cmd = pgm_read_byte(p++); n--;
-    CMD_WRB(cmd);
-    for (i = 0; i < n; i++) DATA_WRB(pgm_read_byte(p++));
+  case IS_ON:         /* Display ON */
+    CS_LOW();
+    CMD_WRB(ILI9341_CMD_DISPLAY_ON);
+    CS_HIGH();
+    _istate = IS_IDLE;
+    return 0;
   }
+  return 1;
+}
 
-  delay(150);
+unsigned long ILI9341::init_wait (void)
+{
+  unsigned long t;
 
-  /* Set initial orientation for get_width()/get_height() */
-  Orientation = DISP_LANDSCAPE ? 3 : 0;
 
-  /* Clear screen */
-  setmask(0, get_width() - 1, 0, get_height() - 1);
-  rectfill(0, get_width() - 1, 0, get_height() - 1, C_BLACK);
+  if (_istate == IS_IDLE) return 0;
+  t = micros() - _it0;
+  return t < _iwait ? _iwait - t : 0;
+}
+
+void ILI9341::init (void)
+{
+  unsigned long w;
+  XPERF_SCOPE(XPERF_ILI9341_INIT);
+
+
+  init_begin(ILI9341_INIT_CLEAR);
+  while (init_step()) {
+    w = init_wait();
+    if (w >= 1000) delay(w / 1000);
+    else delayMicroseconds(w);
+  }
+}
+
+/*----------------------------------------------*/
+/* SPI clock calibration                        */
+/*----------------------------------------------*/
+
+#define CAL_PIXELS  16  /* Test pattern length */
+#define CAL_PASSES  4   /* Consecutive clean transfers required at a clock rate */
+
+#if ILI9341_BUS == ILI9341_BUS_SPI
+void ILI9341::set_spi_clock (
+  uint32_t wclock,  /* Write clock (Hz) */
+  uint32_t rclock   /* Read clock (Hz) */
+)
+{
+  _wclock = wclock;
+  _rclock = rclock;
+  _wl = _wt = -1;     /* Window set at another clock might not have made it */
+  _bus.set_clock(wclock, rclock);
+}
+
+void ILI9341::get_spi_clock (
+  uint32_t *wclock, /* Write clock (Hz) */
+  uint32_t *rclock  /* Read clock (Hz) */
+)
+{
+  *wclock = _wclock;
+  *rclock = _rclock;
+}
+#endif
+
+uint16_t ILI9341::read_id (void)
+{
+  uint16_t id;
+
+
+  CS_LOW_RD();       /* Select display */
+
+  CMD_WRB(ILI9341_CMD_READ_ID4);
+  DATA_RDB();         /* Dummy read */
+  DATA_RDB();         /* IC version */
+  id = DATA_RDB() << 8;
+  id |= DATA_RDB();
+
+  CS_HIGH();          /* Release display */
+
+  return id;
+}
+
+void ILI9341::readrect (
+  int left,       /* Left end (0..DISP_XS-1) */
+  int right,      /* Right end (0..DISP_XS-1, >= left) */
+  int top,        /* Top end (0..DISP_YS-1) */
+  int bottom,     /* Bottom end (0..DISP_YS-1, >= top) */
+  uint16_t *buf   /* Pixels read */
+)
+{
+  uint32_t n;
+  uint8_t r, g, b;
+
+
+  CS_LOW_RD();       /* Select display */
+
+  window(left, right, top, bottom);
+
+  CMD_WRB(ILI9341_CMD_MEMORY_READ);   /* Pixels come as 6 bits per channel, left aligned */
+  DATA_RDB();         /* Dummy read */
+
+  n = (uint32_t)(right - left + 1) * (uint32_t)(bottom - top + 1);
+  do {
+    r = DATA_RDB(); g = DATA_RDB(); b = DATA_RDB();
+    *buf++ = RGB16(r, g, b);
+  } while (--n);
+
+  CS_HIGH();          /* Release display */
+}
+
+#if ILI9341_BUS == ILI9341_BUS_SPI
+byte ILI9341::calibrate (void)
+{
+  /* Candidate clocks, fastest first (those above F_CPU / 2 are skipped) */
+  static const PROGMEM uint32_t clocks[] = {
+    40000000, 24000000, 16000000, 12000000, 8000000, 6000000, 4000000, 2000000, 1000000
+  };
+  /* Test patterns toggling every data line; red and blue match so that the
+     comparison holds also for controllers swapping them on memory reads */
+  static const PROGMEM uint16_t pattern[] = {
+    0xA815, 0x57EA, 0xFFFF, 0x0000, 0xF81F, 0x07E0, 0x57EA, 0x0000
+  };
+  uint16_t buf[CAL_PIXELS], pd;
+  uint32_t wsave = _wclock, rsave = _rclock, rclock, clk;
+  uint8_t i, j, pass;
+  byte ok = 0;
+
+
+  /* Read clock: READ_ID4 answers consistently */
+  for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]) && !ok; i++) {
+    clk = pgm_read_dword(&clocks[i]);
+    if (clk > F_CPU / 2) continue;
+
+    set_spi_clock(wsave, clk);
+    for (pass = 0, ok = 1; pass < CAL_PASSES && ok; pass++)
+      ok = read_id() == ILI9341_ID;
+  }
+  if (!ok) {
+    set_spi_clock(wsave, rsave);
+    return 0;
+  }
+  rclock = _rclock;
+
+  /* Write clock: patterns read back intact at the read clock just found */
+  for (i = 0, ok = 0; i < sizeof(clocks) / sizeof(clocks[0]) && !ok; i++) {
+    clk = pgm_read_dword(&clocks[i]);
+    if (clk > F_CPU / 2) continue;
+
+    set_spi_clock(clk, rclock);
+    for (pass = 0, ok = 1; pass < CAL_PASSES && ok; pass++) {
+      setrect(0, CAL_PIXELS - 1, 0, 0);
+      for (j = 0; j < CAL_PIXELS; j++) {
+        pd = pgm_read_word(&pattern[(j + pass) % (sizeof(pattern) / sizeof(pattern[0]))]);
+        DATA_WPX(pd);
+      }
+      CS_HIGH();          /* Release display */
+
+      readrect(0, CAL_PIXELS - 1, 0, 0, buf);
+      for (j = 0; j < CAL_PIXELS; j++) {
+        if (buf[j] != pgm_read_word(&pattern[(j + pass) % (sizeof(pattern) / sizeof(pattern[0]))]))
+          ok = 0;
+      }
+    }
+  }
+  if (!ok) {
+    set_spi_clock(wsave, rsave);
+    return 0;
+  }
+
+  /* Clear the test area */
+  setrect(0, CAL_PIXELS - 1, 0, 0);
+  for (j = 0; j < CAL_PIXELS; j++) DATA_WPX(C_BLACK);
+  CS_HIGH();          /* Release display */
+
+  return 1;
+}
+#endif
+
+/*----------------------------------------------*/
+/* Tear-free frame presentation                 */
+/*----------------------------------------------*/
+
+#define SCAN_LINES  320   /* Panel lines, portrait */
+#define SCAN_TOTAL  324   /* Lines per refresh, with the default porches (BLANKING_PORCH_CONTROL) */
+
+byte ILI9341::tearing_on (
+  uint8_t te      /* TE pin */
+)
+{
+  unsigned long t;
+
+
+  _te = te;
+  if (_te != ILI9341_NO_PIN) pinMode(_te, INPUT);
 
   CS_LOW();          /* Select display */
 
-  /* Display ON */
-  CMD_WRB(pgm_read_byte(p));
+  CMD_WRB(ILI9341_CMD_TEARING_EFFECT_LINE_ON);
+  DATA_WRB(0x00);     /* V-blanking information only */
 
   CS_HIGH();          /* Release display */
 
-  /* Register text fonts */
-  font_face(FontH8);
+  /* Measure the refresh period */
+  _period = 0;
+  _synced = 0;
+  if (!wait_vsync()) return 0;
+  t = _vsync;
+  if (!wait_vsync()) return 0;
+  _period = _vsync - t;
 
-  /* Reset current position */
-  moveto(0, 0);
+  return 1;
+}
+
+void ILI9341::tearing_off (void)
+{
+  CS_LOW();          /* Select display */
+
+  CMD_WRB(ILI9341_CMD_TEARING_EFFECT_LINE_OFF);
+
+  CS_HIGH();          /* Release display */
+
+  _period = 0;
+  _synced = 0;
+}
+
+uint16_t ILI9341::get_scanline (void)
+{
+  uint16_t line;
+
+
+  CS_LOW_RD();       /* Select display */
+
+  CMD_WRB(ILI9341_CMD_GET_SCANLINE);
+  DATA_RDB();         /* Dummy read */
+  line = DATA_RDB() << 8;
+  line |= DATA_RDB();
+
+  CS_HIGH();          /* Release display */
+
+  return line & 0x3FF;
+}
+
+byte ILI9341::wait_vsync (void)
+{
+  unsigned long t0 = millis();
+  uint16_t line, last;
+
+
+  if (_te != ILI9341_NO_PIN) {
+    while (digitalRead(_te) == HIGH) {  /* Let a blanking in progress end */
+      if (millis() - t0 > ILI9341_SYNC_TIMEOUT) return 0;
+    }
+    while (digitalRead(_te) == LOW) {   /* Rising edge */
+      if (millis() - t0 > ILI9341_SYNC_TIMEOUT) return 0;
+    }
+  } else {
+    while ((last = get_scanline()) >= SCAN_LINES) {   /* Let a blanking in progress end */
+      if (millis() - t0 > ILI9341_SYNC_TIMEOUT) return 0;
+    }
+    for (;;) {
+      line = get_scanline();
+      if (line >= SCAN_LINES || line < last) break;   /* Into blanking, or wrapped past it */
+      last = line;
+      if (millis() - t0 > ILI9341_SYNC_TIMEOUT) return 0;
+    }
+  }
+  _vsync = micros();
+
+  return 1;
+}
+
+byte ILI9341::frame_begin (void)
+{
+  unsigned long prev = _vsync;
+  byte synced;
+
+
+  synced = _period && wait_vsync();
+  if (synced && _synced)  /* Refreshes since the previous frame, one expected */
+    _fstats.missed += (_vsync - prev + _period / 2) / _period - 1;
+  _synced = synced;
+  _frame = micros();
+
+  return synced;
+}
+
+void ILI9341::frame_end (void)
+{
+  unsigned long us = micros() - _frame;
+
+  _fstats.frames++;
+  _fstats.total_us += us;
+  if (us > _fstats.max_us) _fstats.max_us = us;
+  if (_period && us > _period) _fstats.late++;
+}
+
+byte ILI9341::chase (
+  int left,       /* Left end (0..DISP_XS-1) */
+  int right,      /* Right end (0..DISP_XS-1, >= left) */
+  int top,        /* Top end (0..DISP_YS-1) */
+  int bottom      /* Bottom end (0..DISP_YS-1, >= top) */
+)
+{
+  unsigned long t0 = millis(), need, tline;
+  uint16_t line;
+  int first, last;
+
+
+  if (!_period || left > right || top > bottom) return 0;
+
+  /* Time the area takes to write (with a margin for the clock rounding and the CPU) */
+  need = (unsigned long)(right - left + 1) * (bottom - top + 1) * 16 * 1000 / (_wclock / 1000);
+  need += need >> 2;
+  tline = _period / SCAN_TOTAL;
+
+  switch (Orientation) {    /* Panel lines spanned by the area, as set by set_orientation() */
+  case 0:
+    first = top; last = bottom;
+    break;
+  case 1:
+    first = left; last = right;
+    break;
+  case 2:
+    first = SCAN_LINES - 1 - bottom; last = SCAN_LINES - 1 - top;
+    break;
+  default:
+    first = SCAN_LINES - 1 - right; last = SCAN_LINES - 1 - left;
+    break;
+  }
+  if (first < 0) first = 0;
+  if (last > SCAN_LINES - 1) last = SCAN_LINES - 1;
+
+  /* Too slow to write between two refreshes of the area */
+  if (need > (SCAN_TOTAL - 1 - last + first) * tline) return 0;
+
+  /* Behind the scanline, with time to finish before it comes back to the area */
+  do {
+    line = get_scanline();
+    if (line > last && (SCAN_TOTAL - line + first) * tline >= need) return 1;
+  } while (millis() - t0 <= ILI9341_SYNC_TIMEOUT);
+
+  return 0;
+}
+
+/*----------------------------------------------*/
+/* Screen capture                               */
+/*----------------------------------------------*/
+
+#define CAP_CHUNK   32    /* Pixels read per MEMORY_READ transaction */
+#define CAP_BUF     128   /* Output buffer (a chunk adds at most 3 bytes per pixel) */
+
+typedef struct {
+  uint8_t buf[CAP_BUF];
+  uint8_t len;      /* Bytes in buf */
+  uint8_t lit;      /* Header of the open literal packet, CAP_BUF: none */
+  uint8_t run;      /* Length of the pending run, 0: none */
+  uint16_t px;      /* Pixel of the pending run */
+  uint16_t sum;     /* Sum of the pixels so far */
+} capture_t;
+
+static void cap_flush (
+  capture_t *cap,   /* Encoder state */
+  XUtils &out       /* Sink */
+)
+{
+  if (cap->len) out.xwrite(cap->buf, cap->len);
+  cap->len = 0;
+  cap->lit = CAP_BUF;   /* Literal packets do not span flushes */
+}
+
+static void cap_emit (
+  capture_t *cap    /* Encoder state */
+)
+{
+  if (cap->run == 1) {    /* Single pixel: append to the open literal packet */
+    if (cap->lit == CAP_BUF || cap->buf[cap->lit] == 0x7F) {
+      cap->lit = cap->len;
+      cap->buf[cap->len++] = 0x00;
+    } else {
+      cap->buf[cap->lit]++;
+    }
+  } else {                /* Run packet */
+    cap->lit = CAP_BUF;
+    cap->buf[cap->len++] = 0x80 | (cap->run - 1);
+  }
+  cap->buf[cap->len++] = cap->px >> 8;
+  cap->buf[cap->len++] = cap->px;
+  cap->run = 0;
+}
+
+static inline void cap_put (
+  capture_t *cap,   /* Encoder state */
+  uint16_t px       /* Pixel */
+)
+{
+  cap->sum += px;
+  if (cap->run && px == cap->px && cap->run < 128) {
+    cap->run++;
+    return;
+  }
+  if (cap->run) cap_emit(cap);
+  cap->px = px;
+  cap->run = 1;
+}
+
+byte ILI9341::capture (
+  int left,       /* Left end (0..DISP_XS-1) */
+  int right,      /* Right end (0..DISP_XS-1, >= left) */
+  int top,        /* Top end (0..DISP_YS-1) */
+  int bottom,     /* Bottom end (0..DISP_YS-1, >= top) */
+  XUtils &out     /* Sink */
+)
+{
+  capture_t cap;
+  uint32_t n;
+  uint16_t w, h;
+  uint8_t i, k, r, g, b;
+
+
+  if (left < 0 || right >= get_width() || left > right || top < 0 || bottom >= get_height() || top > bottom) return 0;
+
+  w = right - left + 1;
+  h = bottom - top + 1;
+  cap.buf[0] = ILI9341_CAPTURE_MAGIC0;
+  cap.buf[1] = ILI9341_CAPTURE_MAGIC1;
+  cap.buf[2] = w; cap.buf[3] = w >> 8;
+  cap.buf[4] = h; cap.buf[5] = h >> 8;
+  cap.len = 6;
+  cap.lit = CAP_BUF;
+  cap.run = 0;
+  cap.sum = 0;
+
+  for (n = (uint32_t) w * h; n; n -= k) {
+    if (cap.len > CAP_BUF - 3 * CAP_CHUNK) cap_flush(&cap, out);  /* Never with the display selected */
+    k = n < CAP_CHUNK ? n : CAP_CHUNK;
+
+    CS_LOW_RD();       /* Select display */
+
+    if (cap.run == 0) {   /* First chunk */
+      window(left, right, top, bottom);
+      CMD_WRB(ILI9341_CMD_MEMORY_READ);
+    } else {
+      CMD_WRB(ILI9341_CMD_READ_MEMORY_CONTINUE);  /* Resume after the last pixel read */
+    }
+    DATA_RDB();         /* Dummy read */
+
+    for (i = k; i; i--) {
+      r = DATA_RDB(); g = DATA_RDB(); b = DATA_RDB();
+      cap_put(&cap, RGB16(r, g, b));
+    }
+
+    CS_HIGH();          /* Release display */
+  }
+
+  cap_emit(&cap);
+  if (cap.len > CAP_BUF - 2) cap_flush(&cap, out);
+  cap.buf[cap.len++] = cap.sum;
+  cap.buf[cap.len++] = cap.sum >> 8;
+  cap_flush(&cap, out);
+
+  return 1;
 }
 
 void ILI9341::set_orientation (uint8_t o)
@@ -299,6 +816,7 @@ void ILI9341::rectfill (
 )
 {
   uint32_t n;
+  XPERF_SCOPE(XPERF_ILI9341_RECTFILL);
 
 
   if (left > right || top > bottom) return;   /* Check validity */
@@ -348,12 +866,13 @@ void ILI9341::lineto (
 {
   int32_t xr, yr, xp, yp, xd, yd;
   int ctr;
+  XPERF_SCOPE(XPERF_ILI9341_LINE);
 
 
   xd = x - LocX; xr = (int32_t) LocX << 16; LocX = x;
   yd = y - LocY; yr = (int32_t) LocY << 16; LocY = y;
-  if (!xd || !yd) {
-    rectfill(x - xd, x, y - yd, y, color);
+  if (!xd || !yd) {   /* Horizontal or vertical, either way */
+    rectfill(xd < 0 ? x : x - xd, xd < 0 ? x - xd : x, yd < 0 ? y : y - yd, yd < 0 ? y - yd : y, color);
     return;
   }
   if ((xd < 0 ? 0 - xd : xd) >= (yd < 0 ? 0 - yd : yd)) {
@@ -373,10 +892,7 @@ void ILI9341::lineto (
   do {
     xp = xr >> 16; yp = yr >> 16;
     if (xp >= MaskL && xp <= MaskR && yp >= MaskT && yp <= MaskB) {
-      CMD_WRB(ILI9341_CMD_COLUMN_ADDRESS_SET);    /* Set H position */
-      DATA_WRW(xp); DATA_WRW(xp);
-      CMD_WRB(ILI9341_CMD_PAGE_ADDRESS_SET);  /* Set V position */
-      DATA_WRW(yp); DATA_WRW(yp);
+      window(xp, xp, yp, yp);   /* Set position */
       CMD_WRB(ILI9341_CMD_MEMORY_WRITE);  /* Write a pixel data */
       DATA_WPX(color);
     }
@@ -408,6 +924,7 @@ void ILI9341::blt (
 {
   int yc, xc, xl, xs;
   uint16_t pd;
+  XPERF_SCOPE(XPERF_ILI9341_BLT);
 
 
   if (left > right || top > bottom) return;   /* Check validity */
@@ -454,45 +971,911 @@ void ILI9341::blt (
   CS_HIGH();          /* Release display */
 }
 
-void ILI9341::locate (
-  int col,    /* Column position */
-  int row     /* Row position */
+byte ILI9341::begin_write (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom      /* Bottom end (-32768..32767, >=top) */
 )
 {
-  if (FontS) {
-    LocX = col * pgm_read_byte(&FontS[14]);
-    LocY = row * pgm_read_byte(&FontS[15]);
-  }
+  int l, r, t, b;
+
+
+  _pon = 0;
+  if (left > right || top > bottom) return 0;   /* Check validity */
+
+  _pl = left; _pr = right;
+  _px = left; _py = top;
+  if (left > MaskR || right < MaskL  || top > MaskB || bottom < MaskT) return 0;    /* Nothing to draw: pixels are dropped */
+
+  l = left < MaskL ? MaskL : left;    /* Window on the visible part */
+  r = right > MaskR ? MaskR : right;
+  t = top < MaskT ? MaskT : top;
+  b = bottom > MaskB ? MaskB : bottom;
+  _pclip = l != left || r != right || t != top || b != bottom;
+
+  setrect(l, r, t, b);
+  _pon = 1;
+  return 1;
 }
 
-void ILI9341::font_face (
-    const uint8_t *font /* Pointer to the font structure in FONTX2 format */
+void ILI9341::write_pixels (
+  uint16_t color, /* Pixel color */
+  uint16_t n      /* Number of pixels */
 )
 {
-  if (!memcmp_P("FONTX2", font, 6)) {
-    FontS = font;
+  if (!_pclip) {      /* Whole area visible: straight into the window */
+    if (_pon) {
+      while (n--) DATA_WPX(color);
+    }
+    return;
+  }
+
+  while (n--) {
+    if (_pon && _px >= MaskL && _px <= MaskR && _py >= MaskT && _py <= MaskB) DATA_WPX(color);
+    if (++_px > _pr) {
+      _px = _pl;
+      _py++;
+    }
   }
 }
 
-void ILI9341::font_color (
-  uint32_t color  /* (bg << 16) + fg */
-)
+void ILI9341::end_write (void)
 {
-  ChrColor = color;
+  if (_pon) CS_HIGH();  /* Release display, once the last line is sent */
+  _pon = 0;
 }
 
-void ILI9341::_putc (
-  uint8_t chr     /* Character to be output */
+byte ILI9341::begin_lines (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  uint16_t *buf   /* Line buffers (2 * (right - left + 1) pixels) */
 )
 {
-  const uint8_t *fnt;;
-  uint8_t b, d;
-  uint16_t dchr;
-  uint32_t color;
-  int h, wc, w, wb, i, fofs;
+  _lbuf[0] = buf;
+  _lbuf[1] = buf + (right - left + 1);
+  _lnext = 0;
+  return begin_write(left, right, top, bottom);
+}
 
+void ILI9341::send_line (void)
+{
+  uint16_t *buf = _lbuf[_lnext];
+  int l, r;
 
-  if ((fnt = FontS) == 0) return; /* Exit if no font registerd */
+
+  _lnext ^= 1;
+  if (_pon && _py >= MaskT && _py <= MaskB) {   /* The window holds the visible part only */
+    l = _pl < MaskL ? MaskL : _pl;
+    r = _pr > MaskR ? MaskR : _pr;
+    _bus.write_line(buf + (l - _pl), r - l + 1);  /* Waits for the other buffer first */
+    XPERF_BYTES((uint32_t) (r - l + 1) * 2);
+  } else {
+    _bus.wait();    /* Dropped: the other buffer may still be in flight */
+  }
+  _py++;
+}
+
+/*----------------------------------------------*/
+/* Filled shapes                                */
+/*----------------------------------------------*/
+
+/* Each scanline span is drawn by rectfill(): one window setup and one
+ * burst of pixels, clipped to the mask */
+
+#define SIN_ONE   16384   /* sin_q[] scale */
+
+/* Sine of 0..90 degrees */
+static const PROGMEM int16_t sin_q[91] = {
+  0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+  2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+  5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+  8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+  10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+  12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+  14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+  15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+  16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+  16384
+};
+
+/* Direction of an angle (0..359 degrees, clockwise from 3 o'clock) */
+static void angle_dir (
+  int deg,      /* Angle */
+  long *c,      /* Cosine (SIN_ONE scale) */
+  long *s       /* Sine, positive downwards (SIN_ONE scale) */
+)
+{
+  long sa, ca;
+
+
+  sa = (int16_t) pgm_read_word(&sin_q[deg % 90]);
+  ca = (int16_t) pgm_read_word(&sin_q[90 - deg % 90]);
+  switch (deg / 90) {
+    case 0: *c = ca; *s = sa; break;
+    case 1: *c = -sa; *s = ca; break;
+    case 2: *c = -ca; *s = -sa; break;
+    default: *c = sa; *s = -ca; break;
+  }
+}
+
+#define ARC_FAR   1024    /* Beyond any radius: open end of a run */
+
+/* Sector edge walked a row at a time: on row dy the side u * dy - v * px >= 0
+   is px <= q (v > 0) or px >= -q (v < 0), q = floor(u * dy / |v|) being kept
+   as a quotient and a remainder, stepped without divisions */
+typedef struct {
+  long u, v, d;   /* Edge, |v| */
+  long q, r;      /* Row crossing */
+  long sq, sr;    /* Step per row */
+} arc_edge_t;
+
+static void edge_begin (
+  arc_edge_t *e,  /* Edge */
+  long u,         /* Side u * dy - v * px >= 0 */
+  long v,
+  int dy          /* First row */
+)
+{
+  e->u = u; e->v = v;
+  e->d = v < 0 ? -v : v ? v : 1;    /* Any for a horizontal edge */
+  e->q = u * dy / e->d; e->r = u * dy % e->d;
+  if (e->r < 0) { e->r += e->d; e->q--; }   /* Rounded down */
+  e->sq = u / e->d; e->sr = u % e->d;
+  if (e->sr < 0) { e->sr += e->d; e->sq--; }
+}
+
+static void edge_row (
+  arc_edge_t *e,  /* Edge, moved on to the next row */
+  int dy,         /* Row */
+  int *a,         /* Run of the row on the inside (a > b: none) */
+  int *b
+)
+{
+  int q;
+
+
+  if (!e->v) {    /* Horizontal: the whole row or nothing */
+    *a = e->u * dy >= 0 ? -ARC_FAR : ARC_FAR;
+    *b = -*a;
+    return;
+  }
+  q = e->q < -ARC_FAR ? -ARC_FAR : e->q > ARC_FAR ? ARC_FAR : e->q;
+  if (e->v > 0) { *a = -ARC_FAR; *b = q; }
+  else { *a = -q; *b = ARC_FAR; }
+  e->q += e->sq; e->r += e->sr;
+  if (e->r >= e->d) { e->r -= e->d; e->q++; }
+}
+
+/* Flip a run open at one end (or none, or the whole row) to the rest of the row */
+static void edge_outside (
+  int *a,
+  int *b
+)
+{
+  if (*a > *b) { *a = -ARC_FAR; *b = ARC_FAR; }
+  else if (*a == -ARC_FAR && *b == ARC_FAR) { *a = ARC_FAR; *b = -ARC_FAR; }
+  else if (*a == -ARC_FAR) { *a = *b + 1; *b = ARC_FAR; }
+  else { *b = *a - 1; *a = -ARC_FAR; }
+}
+
+/* Integer square root (rounded down) */
+static unsigned int isqrt (
+  uint32_t v
+)
+{
+  uint32_t r = 0, b = (uint32_t) 1 << 30;
+
+
+  while (b > v) b >>= 2;
+  while (b) {
+    if (v >= r + b) {
+      v -= r + b;
+      r = (r >> 1) + b;
+    } else {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+  return r;
+}
+
+void ILI9341::quadspans (
+  int xc,         /* Center of the left quadrants */
+  int yc,         /* Center of the top quadrants */
+  int dx,         /* Offset of the right quadrants */
+  int dy,         /* Offset of the bottom quadrants */
+  int y,          /* Row, above/below the centers */
+  int xa,         /* Run of the row, away from the centers */
+  int xb,
+  uint16_t color  /* Color */
+)
+{
+  int row = yc - y;
+
+
+  for (;;) {
+    if (xa <= 0) {      /* The run reaches the vertical axis: one span */
+      rectfill(xc - xb, xc + dx + xb, row, row, color);
+    } else {
+      rectfill(xc - xb, xc - xa, row, row, color);
+      rectfill(xc + dx + xa, xc + dx + xb, row, row, color);
+    }
+    if (row == yc + dy + y) break;
+    row = yc + dy + y;
+  }
+}
+
+void ILI9341::quadrants (
+  int xc,         /* Center of the left quadrants */
+  int yc,         /* Center of the top quadrants */
+  int rx,         /* Horizontal radius */
+  int ry,         /* Vertical radius */
+  int dx,         /* Offset of the right quadrants */
+  int dy,         /* Offset of the bottom quadrants */
+  byte fill,      /* 1: filled, 0: outline */
+  uint16_t color  /* Color */
+)
+{
+  int32_t rx2, ry2, p;
+  int x, y, xa;
+
+
+  if (rx < 0 || ry < 0) return;
+  if (!rx || !ry) {   /* Degenerate: a box (a line when dx or dy is 0 too) */
+    if (fill) rectfill(xc - rx, xc + dx + rx, yc - ry, yc + dy + ry, color);
+    else rect(xc - rx, xc + dx + rx, yc - ry, yc + dy + ry, color);
+    return;
+  }
+
+  /* Midpoint ellipse, decision variable scaled by 4, walking the
+     top right quadrant row by row: each row is a run xa..x */
+  rx2 = (int32_t) rx * rx; ry2 = (int32_t) ry * ry;
+  x = 0; y = ry; xa = 0;
+  p = 4 * ry2 - 4 * rx2 * ry + rx2;
+  while (ry2 * x < rx2 * y) {   /* Region 1: slope above -1, x steps */
+    if (p < 0) {
+      p += 4 * ry2 * (2 * x + 3);
+    } else {
+      quadspans(xc, yc, dx, dy, y, fill ? 0 : xa, x, color);
+      p += 4 * ry2 * (2 * x + 3) + 4 * rx2 * (2 - 2 * y);
+      y--;
+      xa = x + 1;
+    }
+    x++;
+  }
+  p += ry2 * (-4 * x - 3) + rx2 * (-4 * y + 3);
+  while (y > 0) {               /* Region 2: y steps */
+    quadspans(xc, yc, dx, dy, y, fill ? 0 : xa, x, color);
+    if (p > 0) {
+      p += 4 * rx2 * (3 - 2 * y);
+    } else {
+      p += 4 * rx2 * (3 - 2 * y) + 4 * ry2 * (2 * x + 2);
+      x++;
+    }
+    y--;
+    xa = x;
+  }
+  quadspans(xc, yc, dx, dy, 0, fill ? 0 : xa, x, color);
+}
+
+void ILI9341::circle (
+  int x,          /* Center X (-32768..32767) */
+  int y,          /* Center Y (-32768..32767) */
+  int r,          /* Radius (0..255) */
+  uint16_t color  /* Color */
+)
+{
+  quadrants(x, y, r, r, 0, 0, 0, color);
+}
+
+void ILI9341::circlefill (
+  int x,          /* Center X (-32768..32767) */
+  int y,          /* Center Y (-32768..32767) */
+  int r,          /* Radius (0..255) */
+  uint16_t color  /* Color */
+)
+{
+  quadrants(x, y, r, r, 0, 0, 1, color);
+}
+
+void ILI9341::ellipse (
+  int x,          /* Center X (-32768..32767) */
+  int y,          /* Center Y (-32768..32767) */
+  int rx,         /* Horizontal radius (0..255) */
+  int ry,         /* Vertical radius (0..255) */
+  uint16_t color  /* Color */
+)
+{
+  quadrants(x, y, rx, ry, 0, 0, 0, color);
+}
+
+void ILI9341::ellipsefill (
+  int x,          /* Center X (-32768..32767) */
+  int y,          /* Center Y (-32768..32767) */
+  int rx,         /* Horizontal radius (0..255) */
+  int ry,         /* Vertical radius (0..255) */
+  uint16_t color  /* Color */
+)
+{
+  quadrants(x, y, rx, ry, 0, 0, 1, color);
+}
+
+void ILI9341::roundrect (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  int r,          /* Corner radius */
+  uint16_t color  /* Color */
+)
+{
+  if (left > right || top > bottom) return;   /* Check validity */
+  if (r > (right - left) / 2) r = (right - left) / 2;
+  if (r > (bottom - top) / 2) r = (bottom - top) / 2;
+  if (r < 0) r = 0;
+
+  quadrants(left + r, top + r, r, r, right - left - 2 * r, bottom - top - 2 * r, 0, color);
+  rectfill(left, left, top + r + 1, bottom - r - 1, color);
+  rectfill(right, right, top + r + 1, bottom - r - 1, color);
+}
+
+void ILI9341::roundrectfill (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  int r,          /* Corner radius */
+  uint16_t color  /* Color */
+)
+{
+  if (left > right || top > bottom) return;   /* Check validity */
+  if (r > (right - left) / 2) r = (right - left) / 2;
+  if (r > (bottom - top) / 2) r = (bottom - top) / 2;
+  if (r < 0) r = 0;
+
+  quadrants(left + r, top + r, r, r, right - left - 2 * r, bottom - top - 2 * r, 1, color);
+  rectfill(left, right, top + r + 1, bottom - r - 1, color);
+}
+
+void ILI9341::arc (
+  int x,          /* Center X (-32768..32767) */
+  int y,          /* Center Y (-32768..32767) */
+  int ro,         /* Outer radius (0..255) */
+  int ri,         /* Inner radius (< ro, -1 for a pie slice) */
+  int start,      /* Start angle (degrees, clockwise from 3 o'clock) */
+  int end,        /* End angle (degrees, >= start) */
+  uint16_t color  /* Color */
+)
+{
+  long sc, ss, ec, es;
+  arc_edge_t se, ee;
+  int sweep, dy, xo, xi, sa, sb, ea, eb, i, j, l, r;
+  int sect[2][2], ring[2][2];   /* Runs of the row within the sector, the ring */
+  byte ns, nr;
+
+
+  if (ro < 0 || end <= start) return;
+  sweep = end - start >= 360 ? 360 : end - start;
+  start %= 360; if (start < 0) start += 360;
+  end = (start + sweep) % 360;
+  angle_dir(start, &sc, &ss);
+  angle_dir(end, &ec, &es);
+
+  /* Clockwise of the start: sc * dy - ss * px >= 0; counterclockwise
+     of the end: ec * dy - es * px <= 0 */
+  edge_begin(&se, sc, ss, -ro);
+  edge_begin(&ee, -ec, -es, -ro);
+
+  for (dy = -ro; dy <= ro; dy++) {
+    edge_row(&se, dy, &sa, &sb);
+    edge_row(&ee, dy, &ea, &eb);
+    if (y + dy < MaskT) continue;
+    if (y + dy > MaskB) break;
+
+    ns = 1;
+    if (sweep >= 360) {
+      sect[0][0] = -ARC_FAR; sect[0][1] = ARC_FAR;
+    } else if (sweep <= 180) {  /* Both sides */
+      sect[0][0] = sa > ea ? sa : ea; sect[0][1] = sb < eb ? sb : eb;
+    } else {                    /* Either side: all but the gap outside both */
+      edge_outside(&sa, &sb);
+      edge_outside(&ea, &eb);
+      l = sa > ea ? sa : ea; r = sb < eb ? sb : eb;
+      if (l > r) {
+        sect[0][0] = -ARC_FAR; sect[0][1] = ARC_FAR;
+      } else {
+        sect[0][0] = -ARC_FAR; sect[0][1] = l - 1;
+        sect[1][0] = r + 1; sect[1][1] = ARC_FAR;
+        ns = 2;
+      }
+    }
+
+    xo = isqrt((int32_t) ro * ro + ro - (int32_t) dy * dy);   /* Pixel centers within ro + 1/2 */
+    xi = (ri >= 0 && (int32_t) dy * dy <= (int32_t) ri * ri + ri) ? isqrt((int32_t) ri * ri + ri - (int32_t) dy * dy) + 1 : 0;
+    ring[0][0] = -xo; ring[0][1] = xi > 0 ? -xi : xo;   /* Left of the hole, or the whole row */
+    ring[1][0] = xi; ring[1][1] = xo;
+    nr = xi > 0 ? 2 : 1;
+
+    for (i = 0; i < ns; i++)
+      for (j = 0; j < nr; j++) {
+        l = sect[i][0] > ring[j][0] ? sect[i][0] : ring[j][0];
+        r = sect[i][1] < ring[j][1] ? sect[i][1] : ring[j][1];
+        if (l <= r) rectfill(x + l, x + r, y + dy, y + dy, color);
+      }
+  }
+}
+
+void ILI9341::triangle (
+  int x1,         /* Vertices (-32768..32767) */
+  int y1,
+  int x2,
+  int y2,
+  int x3,
+  int y3,
+  uint16_t color  /* Color */
+)
+{
+  line(x1, y1, x2, y2, color);
+  lineto(x3, y3, color);
+  lineto(x1, y1, color);
+}
+
+void ILI9341::trianglefill (
+  int x1,         /* Vertices (-32768..32767) */
+  int y1,
+  int x2,
+  int y2,
+  int x3,
+  int y3,
+  uint16_t color  /* Color */
+)
+{
+  int pts[6];
+
+
+  pts[0] = x1; pts[1] = y1;
+  pts[2] = x2; pts[3] = y2;
+  pts[4] = x3; pts[5] = y3;
+  polygonfill(pts, 3, color);
+}
+
+void ILI9341::polygon (
+  const int *pts, /* Vertices, x and y of each */
+  uint8_t n,      /* Number of vertices */
+  uint16_t color  /* Color */
+)
+{
+  uint8_t i;
+
+
+  if (!n) return;
+  moveto(pts[0], pts[1]);
+  for (i = 1; i < n; i++) lineto(pts[2 * i], pts[2 * i + 1], color);
+  lineto(pts[0], pts[1], color);
+}
+
+void ILI9341::polygonfill (
+  const int *pts, /* Vertices, x and y of each (convex polygon) */
+  uint8_t n,      /* Number of vertices (1..ILI9341_POLY_MAX) */
+  uint16_t color  /* Color */
+)
+{
+  int32_t ex[ILI9341_POLY_MAX], edx[ILI9341_POLY_MAX];   /* Edge x at the current row and per row, 16.16 */
+  int ytop, ybot, y, xl, xr, xp, ya, yb, xa, xb;
+  uint8_t i, j;
+
+
+  if (!n || n > ILI9341_POLY_MAX) return;
+
+  ytop = ybot = pts[1];
+  for (i = 0; i < n; i++) {
+    j = i + 1 < n ? i + 1 : 0;
+    xa = pts[2 * i]; ya = pts[2 * i + 1];
+    xb = pts[2 * j]; yb = pts[2 * j + 1];
+    if (ya > yb) { xp = xa; xa = xb; xb = xp; xp = ya; ya = yb; yb = xp; }
+    ex[i] = ((int32_t) xa << 16) + ((int32_t) 1 << 15);   /* x at the top end, rounding to nearest */
+    edx[i] = ya < yb ? ((int32_t)(xb - xa) << 16) / (yb - ya) : 0;
+    if (ya < ytop) ytop = ya;
+    if (yb > ybot) ybot = yb;
+  }
+  if (ybot > MaskB) ybot = MaskB;
+
+  for (y = ytop; y <= ybot; y++) {
+    /* Walk every edge spanning the row, the span runs between the outermost ones */
+    xl = 32767; xr = -32768;
+    for (i = 0; i < n; i++) {
+      j = i + 1 < n ? i + 1 : 0;
+      xa = pts[2 * i]; ya = pts[2 * i + 1];
+      xb = pts[2 * j]; yb = pts[2 * j + 1];
+      if (ya > yb) { xp = xa; xa = xb; xb = xp; xp = ya; ya = yb; yb = xp; }
+      if (y < ya || y > yb) continue;
+      if (ya == yb) {       /* Horizontal edge */
+        if (xa > xb) { xp = xa; xa = xb; xb = xp; }
+      } else {
+        if (y > ya) ex[i] += edx[i];
+        xa = xb = ex[i] >> 16;
+      }
+      if (xa < xl) xl = xa;
+      if (xb > xr) xr = xb;
+    }
+    if (y >= MaskT && xl <= xr) rectfill(xl, xr, y, y, color);
+  }
+}
+
+/*----------------------------------------------*/
+/* Alpha blending                               */
+/*----------------------------------------------*/
+
+#define BLEND_CHUNK 32    /* Pixels read back and written per block */
+
+#define ALPHA5(a)   (((a) + 4) >> 3)  /* 0..255 to 0..32 */
+
+/* Average of two pixels in each 16-bit half, per channel, rounding down */
+#define AVG2(x, y)  ((((x) & 0xF7DEF7DEUL) >> 1) + (((y) & 0xF7DEF7DEUL) >> 1) + ((x) & (y) & 0x08210821UL))
+
+/* Blend two pixels over two others, one per 16-bit half, with opacities a0 and a1 (0..32)
+   d + (s - d) * a / 32 is built one bit of a at a time, lsb first, by
+   averaging with either s or d: no multiplications and no carries across
+   channels, so both pixels go through each step together */
+static inline uint32_t blend2 (
+  uint32_t s,       /* Pixels blended */
+  uint32_t d,       /* Pixels blended over */
+  uint8_t a0,       /* Opacity of the lower half */
+  uint8_t a1        /* Opacity of the upper half */
+)
+{
+  uint32_t x = d, m;
+  uint8_t i;
+
+
+  if (a0 >= 32) { x = (x & 0xFFFF0000UL) | (s & 0x0000FFFFUL); a0 = 31; }  /* Opaque: averages s with itself */
+  if (a1 >= 32) { x = (x & 0x0000FFFFUL) | (s & 0xFFFF0000UL); a1 = 31; }
+
+  for (i = 0; i < 5; i++) {
+    m = ((a0 & 1) ? 0x0000FFFFUL : 0) | ((a1 & 1) ? 0xFFFF0000UL : 0);
+    x = AVG2(x, (s & m) | (d & ~m));
+    a0 >>= 1; a1 >>= 1;
+  }
+
+  return x;
+}
+
+void ILI9341::blendrect (
+  int left,       /* Left end (0..DISP_XS-1) */
+  int right,      /* Right end (0..DISP_XS-1, >= left) */
+  int top,        /* Top end (0..DISP_YS-1) */
+  int bottom,     /* Bottom end (0..DISP_YS-1, >= top) */
+  blend_src_t src,  /* Pixel source */
+  const void *ctx   /* Pixel source context */
+)
+{
+  uint16_t dst[BLEND_CHUNK + 1], col[BLEND_CHUNK + 1];
+  uint8_t alpha[BLEND_CHUNK + 1], any, all;
+  uint32_t d;
+  int x, y, w, rows, n, i, k;
+  XPERF_SCOPE(XPERF_ILI9341_BLEND);
+
+
+  w = right - left + 1;
+  rows = w <= BLEND_CHUNK ? BLEND_CHUNK / w : 1;  /* Whole rows per block if they fit */
+
+  for (y = top; y <= bottom; y += rows) {
+    if (y + rows - 1 > bottom) rows = bottom - y + 1;
+
+    for (x = left; x <= right; x += n) {
+      n = right - x + 1;
+      if (n > BLEND_CHUNK) n = BLEND_CHUNK;
+      k = n * rows;
+
+      for (i = 0; i < rows; i++) src(ctx, x, y + i, n, &col[i * n], &alpha[i * n]);
+
+      any = 0; all = 32;
+      for (i = 0; i < k; i++) { any |= alpha[i]; if (alpha[i] < all) all = alpha[i]; }
+      if (!any) continue;     /* Nothing to blend */
+
+      if (all == 32) {        /* Opaque: no need to read back */
+        setrect(x, x + n - 1, y, y + rows - 1);
+        for (i = 0; i < k; i++) DATA_WPX(col[i]);
+      } else {
+        readrect(x, x + n - 1, y, y + rows - 1, dst);
+        dst[k] = col[k] = alpha[k] = 0;   /* Pad to a pair */
+        for (i = 0; i < k; i += 2) {
+          d = blend2(col[i] | (uint32_t) col[i + 1] << 16, dst[i] | (uint32_t) dst[i + 1] << 16, alpha[i], alpha[i + 1]);
+          dst[i] = d;
+          dst[i + 1] = d >> 16;
+        }
+
+        CS_LOW();          /* Select display */
+        CMD_WRB(ILI9341_CMD_MEMORY_WRITE);  /* Same window as the read */
+        for (i = 0; i < k; i++) DATA_WPX(dst[i]);
+      }
+
+      CS_HIGH();          /* Release display */
+    }
+  }
+}
+
+typedef struct {
+  uint16_t color;
+  uint8_t alpha;    /* 0..32 */
+} fill_src_t;
+
+static void fill_src (const void *ctx, int x, int y, uint8_t n, uint16_t *color, uint8_t *alpha)
+{
+  const fill_src_t *f = (const fill_src_t *) ctx;
+
+  while (n--) {
+    *color++ = f->color;
+    *alpha++ = f->alpha;
+  }
+}
+
+typedef struct {
+  const uint16_t *pat;  /* Pattern data (unclipped) */
+  const uint8_t *mask;  /* Per-pixel opacity, NULL for none */
+  int left, top, width; /* Pattern position and size */
+  uint8_t alpha;        /* Overall opacity (0..255) */
+} blt_src_t;
+
+static void blt_src (const void *ctx, int x, int y, uint8_t n, uint16_t *color, uint8_t *alpha)
+{
+  const blt_src_t *b = (const blt_src_t *) ctx;
+  long o = (long)(y - b->top) * b->width + (x - b->left);
+
+  while (n--) {
+    *color++ = pgm_read_word(&b->pat[o]);
+    *alpha++ = b->mask ? ALPHA5((pgm_read_byte(&b->mask[o]) * b->alpha) >> 8) : ALPHA5(b->alpha);
+    o++;
+  }
+}
+
+typedef struct {
+  const uint8_t *fnt;   /* Glyph bitmap */
+  int left, top, wb;    /* Glyph position and byte width */
+  uint32_t color;       /* (bg << 16) + fg */
+  uint8_t fga, bga;     /* Opacities (0..32) */
+} glyph_src_t;
+
+static void glyph_src (const void *ctx, int x, int y, uint8_t n, uint16_t *color, uint8_t *alpha)
+{
+  const glyph_src_t *g = (const glyph_src_t *) ctx;
+  const uint8_t *row = g->fnt + (y - g->top) * g->wb;
+  int c = x - g->left;
+
+  while (n--) {
+    if (pgm_read_byte(&row[c >> 3]) & (0x80 >> (c & 7))) {
+      *color++ = g->color;
+      *alpha++ = g->fga;
+    } else {
+      *color++ = g->color >> 16;
+      *alpha++ = g->bga;
+    }
+    c++;
+  }
+}
+
+static const uint8_t *rl_glyph (
+  const uint8_t *fnt, /* FONTRL font */
+  uint8_t chr,        /* Character */
+  uint8_t *adv        /* Advance (0: no glyph) */
+)
+{
+  uint8_t first = pgm_read_byte(&fnt[16]), last = pgm_read_byte(&fnt[17]);
+  uint16_t n, i, o;
+
+
+  *adv = 0;
+  if (chr < first || chr > last) return 0;
+  n = last - first + 1;
+  i = chr - first;
+  if ((*adv = pgm_read_byte(&fnt[FONT_RL_HEAD + i])) == 0) return 0;
+  o = pgm_read_byte(&fnt[FONT_RL_HEAD + n + 2 * i]) | (uint16_t) pgm_read_byte(&fnt[FONT_RL_HEAD + n + 2 * i + 1]) << 8;
+  return fnt + FONT_RL_HEAD + 3 * n + o;
+}
+
+typedef struct {
+  const uint8_t *p;   /* Next byte of runs */
+  uint8_t b;          /* Current byte */
+  uint8_t n;          /* Pixels left in the current run */
+  uint8_t fg;         /* Current run is foreground */
+} rl_dec_t;
+
+static void rl_init (rl_dec_t *d, const uint8_t *runs)
+{
+  d->p = runs;
+  d->b = 0;
+  d->n = 0;
+  d->fg = 1;
+}
+
+static void rl_next (rl_dec_t *d)   /* Load the next non-empty run if the current one is over */
+{
+  while (!d->n) {
+    if (d->fg) {
+      d->b = pgm_read_byte(d->p++);
+      d->n = d->b >> 4;
+      d->fg = 0;
+    } else {
+      d->n = d->b & 0x0F;
+      d->fg = 1;
+    }
+  }
+}
+
+static void rl_skip (rl_dec_t *d, uint16_t n)   /* Skip n pixels */
+{
+  uint8_t k;
+
+
+  while (n) {
+    rl_next(d);
+    k = n < d->n ? n : d->n;
+    d->n -= k;
+    n -= k;
+  }
+}
+
+typedef struct {
+  rl_dec_t dec;         /* Runs, decoded up to pos */
+  uint16_t pos;         /* Pixel of the glyph cell decoded next */
+  int left, top, w;     /* Glyph position and advance */
+  uint32_t color;       /* (bg << 16) + fg */
+  uint8_t fga, bga;     /* Opacities (0..32) */
+} rl_src_t;
+
+static void rl_src (const void *ctx, int x, int y, uint8_t n, uint16_t *color, uint8_t *alpha)
+{
+  rl_src_t *g = (rl_src_t *) ctx;   /* blendrect() asks for pixels in raster order: decode forward only */
+  uint16_t to = (uint16_t)(y - g->top) * g->w + (x - g->left);
+
+
+  if (g->pos < to) {    /* Skip the pixels clipped away */
+    rl_skip(&g->dec, to - g->pos);
+    g->pos = to;
+  }
+  while (n--) {
+    rl_next(&g->dec);
+    if (g->dec.fg) {
+      *color++ = g->color;
+      *alpha++ = g->fga;
+    } else {
+      *color++ = g->color >> 16;
+      *alpha++ = g->bga;
+    }
+    g->dec.n--;
+    g->pos++;
+  }
+}
+
+void ILI9341::rectfill_alpha (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  uint16_t color, /* Box color */
+  uint8_t alpha   /* Opacity */
+)
+{
+  fill_src_t f;
+
+
+  if (left > right || top > bottom) return;   /* Check validity */
+  if (left > MaskR || right < MaskL  || top > MaskB || bottom < MaskT) return;    /* Check if in active area */
+
+  if (top < MaskT) top = MaskT;       /* Clip top of rectangular if it is out of active area */
+  if (bottom > MaskB) bottom = MaskB; /* Clip bottom of rectangular if it is out of active area */
+  if (left < MaskL) left = MaskL;     /* Clip left of rectangular if it is out of active area */
+  if (right > MaskR) right = MaskR;   /* Clip right of rectangular if it is out of active area */
+
+  f.color = color;
+  f.alpha = ALPHA5(alpha);
+  blendrect(left, right, top, bottom, fill_src, &f);
+}
+
+void ILI9341::blt_alpha (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  const uint16_t *pat,  /* Pattern data */
+  const uint8_t *mask,  /* Per-pixel opacity, NULL for none */
+  uint8_t alpha   /* Overall opacity */
+)
+{
+  blt_src_t b;
+
+
+  if (left > right || top > bottom) return;   /* Check validity */
+  if (left > MaskR || right < MaskL  || top > MaskB || bottom < MaskT) return;    /* Check if in active area */
+
+  b.pat = pat;
+  b.mask = mask;
+  b.left = left;
+  b.top = top;
+  b.width = right - left + 1;
+  b.alpha = alpha;
+
+  if (top < MaskT) top = MaskT;       /* Clip top of source image if it is out of active area */
+  if (bottom > MaskB) bottom = MaskB; /* Clip bottom of source image if it is out of active area */
+  if (left < MaskL) left = MaskL;     /* Clip left of source image if it is out of active area */
+  if (right > MaskR) right = MaskR;   /* Clip right of source image if it is out of active area */
+
+  blendrect(left, right, top, bottom, blt_src, &b);
+}
+
+int ILI9341::get_text_width (
+  const char *str /* Text */
+)
+{
+  uint8_t adv;
+  int w = 0;
+
+
+  if (!FontS) return 0;
+  for (; *str; str++) {
+    if ((uint8_t) *str < 0x20) continue;  /* Control characters take no room */
+    if (FontRL) {
+      rl_glyph(FontS, (uint8_t) *str, &adv);
+      w += adv;
+    } else {
+      w += pgm_read_byte(&FontS[14]);
+    }
+  }
+  return w;
+}
+
+void ILI9341::locate (
+  int col,    /* Column position */
+  int row     /* Row position */
+)
+{
+  if (FontS) {
+    LocX = col * pgm_read_byte(&FontS[14]);
+    LocY = row * pgm_read_byte(&FontS[15]);
+  }
+}
+
+void ILI9341::font_face (
+    const uint8_t *font /* Pointer to the font structure in FONTX2 or FONTRL format */
+)
+{
+  if (!memcmp_P("FONTX2", font, 6) || !memcmp_P("FONTRL", font, 6)) {
+    FontS = font;
+    FontRL = pgm_read_byte(&font[5]) == 'L';
+  }
+}
+
+void ILI9341::font_color (
+  uint32_t color  /* (bg << 16) + fg */
+)
+{
+  ChrColor = color;
+}
+
+void ILI9341::font_alpha (
+  uint8_t fg,     /* Glyph opacity */
+  uint8_t bg      /* Background opacity */
+)
+{
+  ChrAlpha = ((uint16_t) bg << 8) | fg;
+}
+
+void ILI9341::_putc (
+  uint8_t chr     /* Character to be output */
+)
+{
+  const uint8_t *fnt;;
+  uint8_t b, d;
+  uint16_t dchr;
+  uint32_t color;
+  int h, wc, w, wb, i, fofs;
+  XPERF_SCOPE(XPERF_ILI9341_PUTC);
+
+
+  if ((fnt = FontS) == 0) return; /* Exit if no font registerd */
 
   if (chr < 0x20) {   /* Processes the control character */
     switch (chr) {
@@ -513,37 +1896,965 @@ void ILI9341::_putc (
     }
   }
 
-  /* Exit if current position is out of screen */
-  if (LocX >= get_width() || LocY >= get_height()) return;
+  /* Exit if current position is out of screen */
+  if (LocX >= get_width() || LocY >= get_height()) return;
+
+  if (FontRL) {   /* Proportional font, drawn run by run */
+    uint8_t adv;
+    const uint8_t *runs = rl_glyph(fnt, chr, &adv);
+
+    if (!runs) return;  /* No glyph */
+    h = pgm_read_byte(&fnt[15]); w = adv;
+    if (LocX + w > get_width()) w = get_width() - LocX; /* Clip right of font face at right edge */
+    if (LocY + h > get_height()) h = get_height() - LocY; /* Clip bottom of font face at bottom edge */
+
+    if (ChrAlpha != 0xFFFF) {   /* Translucent text */
+      rl_src_t g;
+
+      rl_init(&g.dec, runs);
+      g.pos = 0;
+      g.left = LocX;
+      g.top = LocY;
+      g.w = adv;
+      g.color = ChrColor;
+      g.fga = ALPHA5(ChrAlpha & 0xFF);
+      g.bga = ALPHA5(ChrAlpha >> 8);
+      blendrect(LocX, LocX + w - 1, LocY, LocY + h - 1, rl_src, &g);
+    } else {
+      rlglyph(LocX, LocY, runs, adv, adv, w, h, ChrColor);
+    }
+
+    LocX += adv;  /* Update current position */
+    return;
+  }
+
+  dchr = chr - FONT_START_CHAR;
+  fofs = 17;      /* Font area start address */
+
+  h = pgm_read_byte(&fnt[15]); w = pgm_read_byte(&fnt[14]); wb = (w + 7) / 8; /* Font size: height, dot width and byte width */
+  fnt += fofs + dchr * wb * h;                /* Goto start of the bitmap */
+
+  if (LocX + w > get_width()) w = get_width() - LocX; /* Clip right of font face at right edge */
+  if (LocY + h > get_height()) h = get_height() - LocY; /* Clip bottom of font face at bottom edge */
+
+  if (ChrAlpha != 0xFFFF) {   /* Translucent text */
+    glyph_src_t g;
+
+    g.fnt = fnt;
+    g.left = LocX;
+    g.top = LocY;
+    g.wb = wb;
+    g.color = ChrColor;
+    g.fga = ALPHA5(ChrAlpha & 0xFF);
+    g.bga = ALPHA5(ChrAlpha >> 8);
+    blendrect(LocX, LocX + w - 1, LocY, LocY + h - 1, glyph_src, &g);
+
+    LocX += w;  /* Update current position */
+    return;
+  }
+
+  setrect(LocX, LocX + w - 1, LocY, LocY + h - 1);
+
+  d = 0;
+  do {
+    wc = w; b = i = 0;
+    do {
+      if (!b) {       /* Get next 8 bits */
+        b = 0x80;
+        d = pgm_read_byte(&fnt[i++]);
+      }
+      color = ChrColor;
+      if (!(b & d)) color >>= 16;   /* Select color, BG or FG */
+      b >>= 1;        /* Next bit */
+      DATA_WPX(color);  /* Put the color */
+    } while (--wc);
+    fnt += wb;      /* Next raster */
+  } while (--h);
+
+  LocX += w;  /* Update current position */
+
+  CS_HIGH();          /* Release display */
+}
+
+void ILI9341::glyphrun (
+  int x,          /* Left end (0..DISP_XS-1) */
+  int y,          /* Top end (0..DISP_YS-1) */
+  const char *s,  /* Characters */
+  uint8_t n,      /* Number of characters */
+  uint32_t color  /* (bg << 16) + fg */
+)
+{
+  const uint8_t *fnt, *g;
+  uint8_t b, d, k;
+  int h, fh, w, wb, r, tw, wc, left, i;
+  uint16_t chr;
+  XPERF_SCOPE(XPERF_ILI9341_PUTC);
+
+
+  if ((fnt = FontS) == 0 || !n) return; /* Exit if no font registerd */
+  if (x < 0 || y < 0 || x >= get_width() || y >= get_height()) return;
+
+  fh = h = pgm_read_byte(&fnt[15]); w = pgm_read_byte(&fnt[14]); wb = (w + 7) / 8;
+  if (y + h > get_height()) h = get_height() - y;   /* Clip at the bottom and right edges */
+  tw = n * w;
+  if (x + tw > get_width()) tw = get_width() - x;
+
+  if (FontRL) {   /* Proportional font: one window per glyph, in cells of the widest advance */
+    uint8_t adv;
+    const uint8_t *runs;
+
+    for (k = 0; k * w < tw; k++) {
+      runs = rl_glyph(fnt, (uint8_t) s[k], &adv);
+      rlglyph(x + k * w, y, runs, adv, w, tw - k * w < w ? tw - k * w : w, h, color);
+    }
+    return;
+  }
+  fnt += 17;      /* Font area start address */
+
+  setrect(x, x + tw - 1, y, y + h - 1);   /* All glyphs in one window, raster by raster */
+
+  d = 0;
+  for (r = 0; r < h; r++) {
+    left = tw;
+    for (k = 0; left > 0; k++) {
+      chr = (uint8_t) s[k] < FONT_START_CHAR ? 0 : (uint8_t) s[k] - FONT_START_CHAR;   /* Control characters as blanks */
+      g = fnt + (chr * fh + r) * wb;    /* Raster r of the glyph */
+      wc = left < w ? left : w;
+      left -= wc;
+      b = i = 0;
+      do {
+        if (!b) {       /* Get next 8 bits */
+          b = 0x80;
+          d = pgm_read_byte(&g[i++]);
+        }
+        DATA_WPX((b & d) ? color : color >> 16);  /* FG or BG */
+        b >>= 1;
+      } while (--wc);
+    }
+  }
+
+  CS_HIGH();          /* Release display */
+}
+
+void ILI9341::rlglyph (
+  int x,          /* Left end (0..DISP_XS-1) */
+  int y,          /* Top end (0..DISP_YS-1) */
+  const uint8_t *runs,  /* Runs of the glyph, NULL for a blank cell */
+  int gw,         /* Glyph advance */
+  int cw,         /* Cell width (>= gw), padded with background */
+  int vw,         /* Visible width (1..cw) */
+  int vh,         /* Visible height */
+  uint32_t color  /* (bg << 16) + fg */
+)
+{
+  rl_dec_t d;
+  uint16_t c;
+  int col, row, k, e;
+
+
+  setrect(x, x + vw - 1, y, y + vh - 1);
+
+  if (!runs || !gw) {
+    for (k = vw * vh; k > 0; k--) DATA_WPX(color >> 16);
+  } else {
+    rl_init(&d, runs);
+    col = row = 0;
+    while (row < vh) {
+      rl_next(&d);
+      k = d.n < gw - col ? d.n : gw - col;  /* Part of the run on this raster */
+      c = d.fg ? color : color >> 16;
+      for (e = (col + k < vw ? col + k : vw) - col; e > 0; e--) DATA_WPX(c);  /* Visible part */
+      d.n -= k;
+      col += k;
+      if (col == gw) {    /* End of the raster: pad to the cell */
+        for (e = vw - gw; e > 0; e--) DATA_WPX(color >> 16);
+        col = 0;
+        row++;
+      }
+    }
+  }
+
+  CS_HIGH();          /* Release display */
+}
+
+/*----------------------------------------------*/
+/* Text layout                                  */
+/*----------------------------------------------*/
+
+static uint8_t txt_char (const char *p, byte progmem)
+{
+  return progmem ? pgm_read_byte(p) : (uint8_t) *p;
+}
+
+static int txt_adv (
+  const uint8_t *fnt, /* Font */
+  byte rl,        /* FONTRL font */
+  uint8_t c       /* Character */
+)
+{
+  uint8_t adv;
+
+
+  if (c < 0x20) return 0;   /* Control characters take no room */
+  if (!rl) return pgm_read_byte(&fnt[14]);
+  rl_glyph(fnt, c, &adv);
+  return adv;
+}
+
+static int txt_span (const uint8_t *fnt, byte rl, const char *s, byte progmem, int n)
+{
+  int w = 0;
+
+
+  while (n--) w += txt_adv(fnt, rl, txt_char(s++, progmem));
+  return w;
+}
+
+/* Lay out the line starting at s: greedy word wrap, breaking in a word only
+ * when it does not fit alone; trailing spaces are dropped, and so are the
+ * leading ones of a wrapped line. Returns the number of characters drawn. */
+static int txt_line (
+  const uint8_t *fnt, /* Font */
+  byte rl,        /* FONTRL font */
+  const char *s,  /* Line start */
+  byte progmem,   /* 1: text in PROGMEM */
+  int width,      /* Box width */
+  uint8_t flags,  /* ILI9341_TEXT_NOWRAP */
+  const char **next,  /* Start of the next line, at the terminator when done */
+  int *lw,        /* Width of the characters drawn */
+  byte *cut       /* The line did not fit */
+)
+{
+  const char *p = s, *bnext = 0;
+  int n = 0, w = 0, tn = 0, tw = 0, bn = 0, bw = 0, cw;
+  uint8_t c, prev = ' ';
+
+
+  *cut = 0;
+  for (;;) {
+    c = txt_char(p, progmem);
+    if (!c || c == '\n') {  /* End of text or of a paragraph */
+      *next = c ? p + 1 : p;
+      break;
+    }
+    cw = txt_adv(fnt, rl, c);
+    if (c != ' ' && w + cw > width) {
+      if (flags & ILI9341_TEXT_NOWRAP) {  /* Cut, and go on after the next LF */
+        while ((c = txt_char(p, progmem)) != 0 && c != '\n') p++;
+        *next = c ? p + 1 : p;
+        *cut = 1;
+      } else if (bnext) {   /* Wrap at the last space */
+        tn = bn; tw = bw;
+        for (p = bnext; txt_char(p, progmem) == ' '; p++) ;
+        *next = p;
+      } else {              /* A word longer than the line: cut it */
+        if (!tn) { tn = ++n; tw = w += cw; p++; }   /* At least one character */
+        *next = p;
+        *cut = 1;
+      }
+      break;
+    }
+    if (c == ' ' && prev != ' ') {  /* Break opportunity */
+      bn = tn; bw = tw;
+      bnext = p;
+    }
+    w += cw;
+    n++;
+    if (c != ' ') { tn = n; tw = w; }
+    prev = c;
+    p++;
+  }
+
+  *lw = tw;
+  return tn;
+}
 
-  dchr = chr - FONT_START_CHAR;
-  fofs = 17;      /* Font area start address */
+static int txt_lines (const uint8_t *fnt, byte rl, const char *str, byte progmem, int width, uint8_t flags)
+{
+  int lines = 0, lw;
+  byte cut;
 
-  h = pgm_read_byte(&fnt[15]); w = pgm_read_byte(&fnt[14]); wb = (w + 7) / 8; /* Font size: height, dot width and byte width */
-  fnt += fofs + dchr * wb * h;                /* Goto start of the bitmap */
 
-  if (LocX + w > get_width()) w = get_width() - LocX; /* Clip right of font face at right edge */
-  if (LocY + h > get_height()) h = get_height() - LocY; /* Clip bottom of font face at bottom edge */
+  if (!fnt) return 0;
+  while (txt_char(str, progmem)) {
+    txt_line(fnt, rl, str, progmem, width, flags, &str, &lw, &cut);
+    lines++;
+  }
+  return lines;
+}
 
-  setrect(LocX, LocX + w - 1, LocY, LocY + h - 1);
+int ILI9341::text_lines (
+  const char *str,  /* Text */
+  int width,      /* Box width */
+  uint8_t flags   /* ILI9341_TEXT_NOWRAP */
+)
+{
+  return txt_lines(FontS, FontRL, str, 0, width, flags);
+}
 
-  d = 0;
-  do {
-    wc = w; b = i = 0;
-    do {
-      if (!b) {       /* Get next 8 bits */
-        b = 0x80;
-        d = pgm_read_byte(&fnt[i++]);
+int ILI9341::text_lines_P (
+  const char *str,  /* Text in PROGMEM */
+  int width,      /* Box width */
+  uint8_t flags   /* ILI9341_TEXT_NOWRAP */
+)
+{
+  return txt_lines(FontS, FontRL, str, 1, width, flags);
+}
+
+void ILI9341::glyphspan (
+  uint8_t c,      /* Character */
+  int r,          /* Raster */
+  int c0,         /* First column */
+  int c1,         /* Last column (< advance) */
+  uint32_t color  /* (bg << 16) + fg */
+)
+{
+  const uint8_t *g;
+  rl_dec_t d;
+  uint8_t adv;
+  int k, m, e, wb;
+  uint16_t px;
+
+
+  if (FontRL) {   /* Seek to the raster, then runs */
+    rl_init(&d, rl_glyph(FontS, c, &adv));
+    rl_skip(&d, (uint16_t) r * adv + c0);
+    for (k = c1 - c0 + 1; k > 0; k -= m) {
+      rl_next(&d);
+      m = k < d.n ? k : d.n;
+      d.n -= m;
+      px = d.fg ? color : color >> 16;
+      for (e = m; e > 0; e--) DATA_WPX(px);
+    }
+  } else {
+    wb = (pgm_read_byte(&FontS[14]) + 7) / 8;
+    g = FontS + 17 + ((uint16_t)(c - FONT_START_CHAR) * pgm_read_byte(&FontS[15]) + r) * wb;
+    for (k = c0; k <= c1; k++)
+      DATA_WPX((pgm_read_byte(&g[k >> 3]) & (0x80 >> (k & 7))) ? color : color >> 16);
+  }
+}
+
+void ILI9341::textline (
+  int cl,         /* Visible area: left end */
+  int cr,         /* Right end */
+  int ct,         /* Top end */
+  int cb,         /* Bottom end */
+  int x,          /* Text position */
+  int y,
+  const char *s,  /* Characters */
+  int n,          /* Number of characters */
+  uint8_t dots,   /* Number of dots appended */
+  byte progmem    /* 1: text in PROGMEM */
+)
+{
+  int r, k, e, gx, adv;
+  uint8_t c;
+  XPERF_SCOPE(XPERF_ILI9341_PUTC);
+
+
+  setrect(cl, cr, ct, cb);    /* The line in one window, raster by raster */
+
+  for (r = ct - y; r <= cb - y; r++) {
+    for (e = (x < cr + 1 ? x : cr + 1) - cl; e > 0; e--) DATA_WPX(ChrColor >> 16);  /* Left of the text */
+    gx = x;
+    for (k = 0; k < n + dots && gx <= cr; k++) {
+      c = k < n ? txt_char(s + k, progmem) : '.';
+      if ((adv = txt_adv(FontS, FontRL, c)) == 0) continue;
+      if (gx + adv > cl) glyphspan(c, r, gx < cl ? cl - gx : 0, gx + adv - 1 > cr ? cr - gx : adv - 1, ChrColor);
+      gx += adv;
+    }
+    for (e = cr - (gx > cl ? gx : cl) + 1; e > 0; e--) DATA_WPX(ChrColor >> 16);    /* Right of the text */
+  }
+
+  CS_HIGH();          /* Release display */
+}
+
+int ILI9341::textbox_str (
+  int left,       /* Box: left end */
+  int right,      /* Right end */
+  int top,        /* Top end */
+  int bottom,     /* Bottom end */
+  const char *str,  /* Text */
+  uint8_t flags,  /* ILI9341_TEXT_xxx */
+  byte progmem    /* 1: text in PROGMEM */
+)
+{
+  const char *s, *next;
+  int w, fh, ew, y, x, n, m, lw, lines = 0, cl, cr, ct, cb;
+  uint8_t dots;
+  byte cut;
+
+
+  if (!FontS || left > right || top > bottom) return 0;
+
+  w = right - left + 1;
+  fh = pgm_read_byte(&FontS[15]);
+  ew = 3 * txt_adv(FontS, FontRL, '.');   /* Ellipsis width */
+  cl = left > MaskL ? left : MaskL;       /* Visible area: the box within the mask */
+  cr = right < MaskR ? right : MaskR;
+  ct = top > MaskT ? top : MaskT;
+  cb = bottom < MaskB ? bottom : MaskB;
+
+  for (y = top; y + fh - 1 <= bottom && txt_char(str, progmem); y += fh, lines++) {
+    s = str;
+    n = txt_line(FontS, FontRL, s, progmem, w, flags, &str, &lw, &cut);
+    dots = 0;
+    if ((flags & ILI9341_TEXT_ELLIPSIS) && ew && (cut || (y + 2 * fh - 1 > bottom && txt_char(str, progmem)))) {
+      m = txt_line(FontS, FontRL, s, progmem, w - ew, ILI9341_TEXT_NOWRAP, &next, &lw, &cut);
+      if (m < n) n = m;   /* What fits besides the dots, within the line */
+      while (n && txt_char(s + n - 1, progmem) == ' ') n--;
+      lw = txt_span(FontS, FontRL, s, progmem, n) + ew;
+      dots = 3;
+    }
+
+    x = w - lw;         /* Room left */
+    if (x < 0) x = 0;
+    switch (flags & ILI9341_TEXT_ALIGN) {
+    case ILI9341_TEXT_CENTER: x /= 2; break;
+    case ILI9341_TEXT_RIGHT: break;
+    default: x = 0;
+    }
+    if (cl <= cr && y <= cb && y + fh - 1 >= ct)
+      textline(cl, cr, y > ct ? y : ct, y + fh - 1 < cb ? y + fh - 1 : cb, left + x, y, s, n, dots, progmem);
+  }
+
+  if (y <= bottom) rectfill(left, right, y, bottom, ChrColor >> 16);  /* Clear the rest of the box */
+  return lines;
+}
+
+int ILI9341::textbox (
+  int left,       /* Box: left end */
+  int right,      /* Right end */
+  int top,        /* Top end */
+  int bottom,     /* Bottom end */
+  const char *str,  /* Text */
+  uint8_t flags   /* ILI9341_TEXT_xxx */
+)
+{
+  return textbox_str(left, right, top, bottom, str, flags, 0);
+}
+
+int ILI9341::textbox_P (
+  int left,       /* Box: left end */
+  int right,      /* Right end */
+  int top,        /* Top end */
+  int bottom,     /* Bottom end */
+  const char *str,  /* Text in PROGMEM */
+  uint8_t flags   /* ILI9341_TEXT_xxx */
+)
+{
+  return textbox_str(left, right, top, bottom, str, flags, 1);
+}
+
+/*----------------------------------------------*/
+/* Display lists                                */
+/*----------------------------------------------*/
+
+#define DL_FILL_LEN 11      /* Bytes per RECTFILL operation */
+#define DL_BLT_LEN  (9 + sizeof(const uint16_t *))   /* Bytes per BLT operation */
+#define DL_OP_MAX   (DL_BLT_LEN > DL_FILL_LEN ? DL_BLT_LEN : DL_FILL_LEN)
+#define DL_DELETED  0xFF    /* Operation merged away by optimize() */
+
+static void put16 (uint8_t *p, int v)
+{
+  p[0] = v; p[1] = (uint16_t) v >> 8;
+}
+
+static int get16 (const uint8_t *p)
+{
+  return (int16_t)(p[0] | (p[1] << 8));
+}
+
+void ILI9341::replay (
+  const uint8_t *list   /* List */
+)
+{
+  replay_list(list, 0);
+}
+
+void ILI9341::replay_P (
+  const uint8_t *list   /* List in PROGMEM */
+)
+{
+  replay_list(list, 1);
+}
+
+void ILI9341::replay_list (
+  const uint8_t *list,  /* List */
+  byte progmem          /* 1: list in PROGMEM */
+)
+{
+  uint8_t op[DL_OP_MAX], n, i, c;
+  const uint16_t *pat;
+
+
+  for (;;) {
+    op[0] = progmem ? pgm_read_byte(list) : *list;
+    switch (op[0]) {
+    case ILI9341_DL_RECTFILL:
+    case ILI9341_DL_LINE:
+      n = DL_FILL_LEN; break;
+    case ILI9341_DL_BLT:
+      n = DL_BLT_LEN; break;
+    case ILI9341_DL_TEXT:
+      n = 7; break;
+    default:
+      return;     /* End of list */
+    }
+    for (i = 1; i < n; i++) op[i] = progmem ? pgm_read_byte(&list[i]) : list[i];
+    list += n;
+
+    switch (op[0]) {
+    case ILI9341_DL_RECTFILL:
+      rectfill(get16(&op[1]), get16(&op[3]), get16(&op[5]), get16(&op[7]), get16(&op[9]));
+      break;
+    case ILI9341_DL_LINE:
+      line(get16(&op[1]), get16(&op[3]), get16(&op[5]), get16(&op[7]), get16(&op[9]));
+      break;
+    case ILI9341_DL_BLT:
+      memcpy(&pat, &op[9], sizeof(pat));
+      blt(get16(&op[1]), get16(&op[3]), get16(&op[5]), get16(&op[7]), pat);
+      break;
+    case ILI9341_DL_TEXT:
+      locate(op[1], op[2]);
+      font_color((uint32_t) op[3] | ((uint32_t) op[4] << 8) | ((uint32_t) op[5] << 16) | ((uint32_t) op[6] << 24));
+      while ((c = progmem ? pgm_read_byte(list) : *list) != 0) {
+        _putc(c);
+        list++;
       }
-      color = ChrColor;
-      if (!(b & d)) color >>= 16;   /* Select color, BG or FG */
-      b >>= 1;        /* Next bit */
-      DATA_WPX(color);  /* Put the color */
-    } while (--wc);
-    fnt += wb;      /* Next raster */
-  } while (--h);
+      list++;
+      break;
+    }
+  }
+}
 
-  LocX += w;  /* Update current position */
+uint8_t *ILI9341List::put (
+  uint8_t op,     /* Operation */
+  uint16_t n      /* Bytes it takes */
+)
+{
+  uint8_t *p;
+
+  if ((uint32_t) _len + n + 1 > _size) return 0;  /* Room for the terminator too */
+
+  p = &_buf[_len];
+  p[0] = op;
+  _len += n;
+  _buf[_len] = ILI9341_DL_END;
+
+  return p;
+}
+
+byte ILI9341List::rectfill (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  uint16_t color  /* Box color */
+)
+{
+  uint8_t *p = put(ILI9341_DL_RECTFILL, DL_FILL_LEN);
+
+  if (!p) return 0;
+  put16(&p[1], left); put16(&p[3], right); put16(&p[5], top); put16(&p[7], bottom); put16(&p[9], color);
+
+  return 1;
+}
+
+byte ILI9341List::line (
+  int x1,     /* Start position X for the line (-32768..32767) */
+  int y1,     /* Start position Y for the line (-32768..32767) */
+  int x2,     /* End position X for the line (-32768..32767) */
+  int y2,     /* End position Y for the line (-32768..32767) */
+  uint16_t color    /* Line color */
+)
+{
+  uint8_t *p = put(ILI9341_DL_LINE, DL_FILL_LEN);
+
+  if (!p) return 0;
+  put16(&p[1], x1); put16(&p[3], y1); put16(&p[5], x2); put16(&p[7], y2); put16(&p[9], color);
+
+  return 1;
+}
+
+byte ILI9341List::blt (
+  int left,       /* Left end (-32768..32767) */
+  int right,      /* Right end (-32768..32767, >=left) */
+  int top,        /* Top end (-32768..32767) */
+  int bottom,     /* Bottom end (-32768..32767, >=top) */
+  const uint16_t *pat /* Pattern data */
+)
+{
+  uint8_t *p = put(ILI9341_DL_BLT, DL_BLT_LEN);
+
+  if (!p) return 0;
+  put16(&p[1], left); put16(&p[3], right); put16(&p[5], top); put16(&p[7], bottom);
+  memcpy(&p[9], &pat, sizeof(pat));
+
+  return 1;
+}
+
+byte ILI9341List::text (
+  uint8_t col,      /* Column position */
+  uint8_t row,      /* Row position */
+  uint32_t color,   /* (bg << 16) + fg */
+  const char *str   /* Characters */
+)
+{
+  uint16_t n = strlen(str) + 1;
+  uint8_t *p = put(ILI9341_DL_TEXT, 7 + n);
+
+  if (!p) return 0;
+  p[1] = col; p[2] = row;
+  p[3] = color; p[4] = color >> 8; p[5] = color >> 16; p[6] = color >> 24;
+  memcpy(&p[7], str, n);
+
+  return 1;
+}
+
+/* Bytes taken by the operation at p */
+static uint16_t dl_oplen (const uint8_t *p)
+{
+  switch (p[0]) {
+  case ILI9341_DL_BLT:
+    return DL_BLT_LEN;
+  case ILI9341_DL_TEXT:
+    return 7 + strlen((const char *) &p[7]) + 1;
+  default:
+    return DL_FILL_LEN;
+  }
+}
+
+/* Fills that can swap places without changing the picture */
+static byte dl_commute (const uint8_t *a, const uint8_t *b)
+{
+  return get16(&a[9]) == get16(&b[9]) ||
+    get16(&a[3]) < get16(&b[1]) || get16(&b[3]) < get16(&a[1]) ||
+    get16(&a[7]) < get16(&b[5]) || get16(&b[7]) < get16(&a[5]);
+}
+
+/* Fills ordered by top, then left */
+static byte dl_before (const uint8_t *a, const uint8_t *b)
+{
+  return get16(&a[5]) < get16(&b[5]) || (get16(&a[5]) == get16(&b[5]) && get16(&a[1]) < get16(&b[1]));
+}
+
+void ILI9341List::optimize (void)
+{
+  uint8_t tmp[DL_FILL_LEN], *a, *b, *c;
+  uint16_t i, j, k, m, run;
+  byte merged, more, ok;
+
+
+  do {        /* Merged fills can make more merges possible */
+    more = 0;
+
+    for (i = 0; i < _len; i = run) {
+      if (_buf[i] != ILI9341_DL_RECTFILL) {
+        run = i + dl_oplen(&_buf[i]);
+        continue;
+      }
+      for (run = i; run < _len && _buf[run] == ILI9341_DL_RECTFILL; run += DL_FILL_LEN) ;
+
+      /* Insertion sort of the run [i, run) */
+      for (k = i + DL_FILL_LEN; k < run; k += DL_FILL_LEN) {
+        for (m = k; m > i; m -= DL_FILL_LEN) {
+          a = &_buf[m - DL_FILL_LEN]; b = &_buf[m];
+          if (!dl_before(b, a) || !dl_commute(a, b)) break;
+          memcpy(tmp, a, DL_FILL_LEN); memcpy(a, b, DL_FILL_LEN); memcpy(b, tmp, DL_FILL_LEN);
+        }
+      }
+
+      /* Merge later fills into earlier adjacent ones of the same color */
+      for (j = i; j < run; j += DL_FILL_LEN) {
+        a = &_buf[j];
+        if (a[0] == DL_DELETED) continue;
+        do {
+          merged = 0;
+          for (k = j + DL_FILL_LEN; k < run; k += DL_FILL_LEN) {
+            b = &_buf[k];
+            if (b[0] == DL_DELETED || get16(&a[9]) != get16(&b[9])) continue;
+            if (!((get16(&a[5]) == get16(&b[5]) && get16(&a[7]) == get16(&b[7]) &&      /* Side by side */
+                   (get16(&a[3]) + 1 == get16(&b[1]) || get16(&b[3]) + 1 == get16(&a[1]))) ||
+                  (get16(&a[1]) == get16(&b[1]) && get16(&a[3]) == get16(&b[3]) &&      /* One above the other */
+                   (get16(&a[7]) + 1 == get16(&b[5]) || get16(&b[7]) + 1 == get16(&a[5])))))
+              continue;
+
+            /* b gets drawn earlier: nothing in between may overlap it */
+            for (m = j + DL_FILL_LEN, ok = 1; m < k && ok; m += DL_FILL_LEN) {
+              c = &_buf[m];
+              if (c[0] != DL_DELETED && !dl_commute(b, c)) ok = 0;
+            }
+            if (!ok) continue;
+
+            if (get16(&b[1]) < get16(&a[1])) put16(&a[1], get16(&b[1]));
+            if (get16(&b[3]) > get16(&a[3])) put16(&a[3], get16(&b[3]));
+            if (get16(&b[5]) < get16(&a[5])) put16(&a[5], get16(&b[5]));
+            if (get16(&b[7]) > get16(&a[7])) put16(&a[7], get16(&b[7]));
+            b[0] = DL_DELETED;
+            merged = more = 1;
+          }
+        } while (merged);
+      }
+    }
+
+    /* Drop the merged fills */
+    for (i = j = 0; i < _len; i += k) {
+      k = dl_oplen(&_buf[i]);
+      if (_buf[i] != DL_DELETED) {
+        memmove(&_buf[j], &_buf[i], k);
+        j += k;
+      }
+    }
+    _len = j;
+    _buf[_len] = ILI9341_DL_END;
+  } while (more);
+}
+
+void ILI9341List::dump (
+  XUtils &out     /* Output */
+)
+{
+  uint16_t i;
+
+  out.xputs(F("{"));
+  for (i = 0; i <= _len; i++) {
+    if (!(i % 16)) out.xputs(F("\n "));
+    out.xprintf(F(" 0x%02X,"), _buf[i]);
+  }
+  out.xputs(F("\n}\n"));
+}
+
+/*----------------------------------------------*/
+/* Data plots                                   */
+/*----------------------------------------------*/
+
+void ILI9341::column (
+  int x,          /* Column (-32768..32767) */
+  int top,        /* Top end of the column */
+  int bottom,     /* Bottom end of the column (>= top) */
+  int ya,         /* Top end of the trace (top..bottom) */
+  int yb,         /* Bottom end of the trace (ya..bottom) */
+  uint16_t color, /* Trace color */
+  uint16_t bg     /* Background color */
+)
+{
+  int y;
+  XPERF_SCOPE(XPERF_ILI9341_RECTFILL);
+
+
+  if (x < MaskL || x > MaskR || top > MaskB || bottom < MaskT) return;    /* Check if in active area */
+  if (top < MaskT) top = MaskT;
+  if (bottom > MaskB) bottom = MaskB;
+
+  setrect(x, x, top, bottom);   /* Background, trace and background in one burst */
+  for (y = top; y <= bottom; y++) {
+    if (y < ya || y > yb) {
+      DATA_WPX(bg);
+    } else {
+      DATA_WPX(color);
+    }
+  }
 
   CS_HIGH();          /* Release display */
 }
+
+void ILI9341Plot::set_scale (
+  int16_t vmin,   /* Value at the bottom */
+  int16_t vmax    /* Value at the top (> vmin) */
+)
+{
+  _vmin = vmin;
+  _vmax = vmax > vmin ? vmax : vmin + 1;
+  _scale = ((uint32_t)(_bottom - _top) << 16) / (uint16_t)(_vmax - _vmin);
+}
+
+int ILI9341Plot::ypos (
+  int16_t v       /* Sample */
+)
+{
+  if (v < _vmin) v = _vmin;
+  if (v > _vmax) v = _vmax;
+  return _bottom - (int)(((uint32_t)(uint16_t)(v - _vmin) * _scale + 0x8000) >> 16);
+}
+
+void ILI9341Plot::draw (
+  int x,          /* Column */
+  int16_t lo,     /* Lowest sample of the column */
+  int16_t hi      /* Highest sample of the column */
+)
+{
+  if (_prev) {        /* Reach the last sample of the previous column: a continuous trace */
+    if (_last < lo) lo = _last;
+    if (_last > hi) hi = _last;
+  }
+  _tft.column(x, _top, _bottom, ypos(hi), ypos(lo), _color, _bg);
+}
+
+void ILI9341Plot::clear (void)
+{
+  _tft.rectfill(_left, _right, _top, _bottom, _bg);
+  _x = _left;
+  _count = 0;
+  _prev = 0;
+}
+
+void ILI9341Plot::plot (
+  const int16_t *data,  /* Samples */
+  uint16_t n            /* Number of samples */
+)
+{
+  plot_data(data, n, 0);
+}
+
+void ILI9341Plot::plot_P (
+  const int16_t *data,  /* Samples in PROGMEM */
+  uint16_t n            /* Number of samples */
+)
+{
+  plot_data(data, n, 1);
+}
+
+void ILI9341Plot::plot_data (
+  const int16_t *data,  /* Samples */
+  uint16_t n,           /* Number of samples */
+  byte progmem          /* 1: samples in PROGMEM */
+)
+{
+  uint16_t w, q, r, e, take;
+  int16_t v, lo, hi;
+  int x;
+
+
+  if (!n) {
+    clear();
+    return;
+  }
+
+  /* Column x gets the samples from x * n / w on, spread with a
+     Bresenham accumulator: one division for the whole plot */
+  w = _right - _left + 1;
+  q = n / w; r = n % w; e = 0;
+  _prev = 0;
+  for (x = _left; x <= _right; x++) {
+    take = q;
+    e += r;
+    if (e >= w) {
+      e -= w;
+      take++;
+    }
+    v = progmem ? (int16_t) pgm_read_word(data) : *data;
+    lo = hi = v;
+    if (take) {     /* Fewer samples than columns: the next one is repeated */
+      while (--take) {
+        data++;
+        v = progmem ? (int16_t) pgm_read_word(data) : *data;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+      }
+      data++;
+    }
+    draw(x, lo, hi);
+    _last = v; _prev = 1;
+  }
+  _x = _left;
+  _count = 0;
+}
+
+void ILI9341Plot::set_decimation (
+  uint16_t per_column   /* Samples per column (>= 1) */
+)
+{
+  _per = per_column ? per_column : 1;
+  _count = 0;
+}
+
+byte ILI9341Plot::append (
+  int16_t v       /* Sample */
+)
+{
+  if (!_count) {
+    _lo = _hi = v;
+  } else {
+    if (v < _lo) _lo = v;
+    if (v > _hi) _hi = v;
+  }
+  if (++_count < _per) return 0;
+
+  /* Column complete: draw it, sweeping back to the left edge past the right one */
+  draw(_x, _lo, _hi);
+  _last = v; _prev = 1;
+  _count = 0;
+  if (++_x > _right) {
+    _x = _left;
+    _prev = 0;
+  }
+  return 1;
+}
+
+/*----------------------------------------------*/
+/* Text fields                                  */
+/*----------------------------------------------*/
+
+#define FIELD_NO_RUN  0xFF  /* No run of changed cells pending */
+
+void ILI9341Field::set_color (
+  uint32_t color  /* (bg << 16) + fg */
+)
+{
+  if (color != _color) {
+    _color = color;
+    invalidate();
+  }
+}
+
+void ILI9341Field::begin (void)
+{
+  _pos = 0;
+  _start = FIELD_NO_RUN;
+  _drawn = 0;
+}
+
+void ILI9341Field::flush (void)
+{
+  int fw, fh;
+
+
+  if (_start == FIELD_NO_RUN) return;
+  fw = _tft.get_font_width(); fh = _tft.get_font_height();
+  _tft.glyphrun((_col + _start) * fw, _row * fh, &_buf[_start], _pos - _start, _color);
+  _drawn += _pos - _start;
+  _start = FIELD_NO_RUN;
+}
+
+void ILI9341Field::xputc (
+  char c          /* Character */
+)
+{
+  if ((uint8_t) c < FONT_START_CHAR) return;  /* Control characters (e.g. CR of CRLF) are dropped */
+  if (_pos >= _width) return;                 /* Truncated */
+
+  if (_buf[_pos] != c) {  /* Changed: extend the run to redraw */
+    _buf[_pos] = c;
+    if (_start == FIELD_NO_RUN) _start = _pos;
+  } else {                /* Unchanged: the run so far goes in one window */
+    flush();
+  }
+  _pos++;
+}
+
+uint8_t ILI9341Field::end (void)
+{
+  while (_pos < _width) xputc(' ');   /* Blank out the rest */
+  flush();
+  return _drawn;
+}
+
+uint8_t ILI9341Field::update (
+  const char *str /* New content */
+)
+{
+  begin();
+  xputs(str);
+  return end();
+}
@@ -2,13 +2,78 @@
 #define ILI9341_h
 
 #include <inttypes.h>
+#include <string.h>
 
+#include "ILI9341Bus.h"
 #include "Fonts.h"
 #include "XUtils.h"
 
 /* 1: Initial orientation landscape */
 #define DISP_LANDSCAPE  0
 
+/* SPI clocks used until calibrated or set otherwise (Hz, rounded down by the SPI library; ILI9341_BUS_SPI) */
+#define ILI9341_WRITE_CLOCK 8000000   /* SPI_CLOCK_DIV2 on a 16 MHz AVR */
+#define ILI9341_READ_CLOCK  4000000   /* Read cycles are slower than write ones */
+
+/* Expected READ_ID4 value */
+#define ILI9341_ID      0x9341
+
+/* No TE pin wired: vertical syncs are found by polling GET_SCANLINE */
+#define ILI9341_NO_PIN  0xFF
+
+/* Longest wait for a vertical sync or for the scanline (ms) */
+#define ILI9341_SYNC_TIMEOUT  50
+
+typedef struct {
+  unsigned long frames;     /* Frames presented */
+  unsigned long missed;     /* Refreshes that went by without a new frame */
+  unsigned long late;       /* Frames written for longer than a refresh period */
+  unsigned long max_us;     /* Longest frame write */
+  unsigned long total_us;   /* Cumulative frame write time */
+} ILI9341_frame_stats_t;
+
+/* Text box flags (see textbox()) */
+#define ILI9341_TEXT_LEFT     0x00
+#define ILI9341_TEXT_CENTER   0x01
+#define ILI9341_TEXT_RIGHT    0x02
+#define ILI9341_TEXT_ALIGN    0x03  /* Alignment bits */
+#define ILI9341_TEXT_NOWRAP   0x04  /* One line per LF, cut at the right end of the box */
+#define ILI9341_TEXT_ELLIPSIS 0x08  /* End a cut line, or the last one when text is left, with "..." */
+
+/* Most vertices of a filled polygon */
+#define ILI9341_POLY_MAX  8
+
+/* Screen capture stream (see capture()):
+ *   'I' 'C', width, height (16 bits each, little endian)
+ *   packets up to width * height pixels, left to right, top to bottom:
+ *     0x00..0x7F: (n + 1) literal pixels follow
+ *     0x80..0xFF: one pixel follows, repeated (n & 0x7F) + 1 times
+ *   16-bit sum of all pixels (little endian)
+ * Pixels are RGB565, most significant byte first. */
+#define ILI9341_CAPTURE_MAGIC0  'I'
+#define ILI9341_CAPTURE_MAGIC1  'C'
+
+/* Display list operations (see ILI9341List), integers are little endian:
+ *   RECTFILL: left, right, top, bottom, color (16 bits each)
+ *   LINE:     x1, y1, x2, y2, color (16 bits each)
+ *   BLT:      left, right, top, bottom (16 bits each), pattern address (native pointer)
+ *   TEXT:     column, row (8 bits each), color (32 bits), characters, 0
+ * A list ends with END. */
+#define ILI9341_DL_END       0x00
+#define ILI9341_DL_RECTFILL  0x01
+#define ILI9341_DL_LINE      0x02
+#define ILI9341_DL_BLT       0x03
+#define ILI9341_DL_TEXT      0x04
+
+/* Initialization options (init_begin()) */
+#define ILI9341_INIT_CLEAR    0x00  /* Clear the frame memory while the display is off */
+#define ILI9341_INIT_NOCLEAR  0x01  /* Leave it as it is, e.g. when the first frame covers it all */
+
+/* Rows cleared per init_step() (can be set on the compiler command line) */
+#ifndef ILI9341_INIT_BAND
+#define ILI9341_INIT_BAND     16
+#endif
+
 /* RGB pixel data format (Create RGB565 from RGB888) */
 #define RGB16(r,g,b)    (uint16_t)(((r) & 0xF8) << 8 | ((g) & 0xFC) << 3 | (b) >> 3)
 
@@ -26,6 +91,7 @@
 
 class ILI9341: public XUtils {
   public:
+#if ILI9341_BUS == ILI9341_BUS_SPI
     /**
      * Constructor
      *
@@ -33,13 +99,205 @@ class ILI9341: public XUtils {
      * @param reset Reset pin
      * @param dc Data/command pin
      */
-    ILI9341 (byte cs, byte reset, byte dc): _cs(cs), _reset(reset), _dc(dc) { };
+    ILI9341 (byte cs, byte reset, byte dc): ChrAlpha(0xFFFF), _pon(0), _istate(0), _reset(reset), _bus(cs, dc),
+      _wl(-1), _wr(-1), _wt(-1), _wb(-1), _te(ILI9341_NO_PIN), _period(0), _synced(0) {
+      set_spi_clock(ILI9341_WRITE_CLOCK, ILI9341_READ_CLOCK);
+      reset_frame_stats();
+    };
+#elif ILI9341_BUS == ILI9341_BUS_PAR8
+    /**
+     * Constructor (data lines on the port set in ILI9341Bus.h)
+     *
+     * @param cs Chip select pin
+     * @param reset Reset pin
+     * @param dc Data/command pin
+     * @param wr Write strobe pin
+     * @param rd Read strobe pin
+     */
+    ILI9341 (byte cs, byte reset, byte dc, byte wr, byte rd): ChrAlpha(0xFFFF), _pon(0), _istate(0), _reset(reset),
+      _bus(cs, dc, wr, rd), _wclock(ILI9341_PAR8_CLOCK), _rclock(ILI9341_PAR8_CLOCK),
+      _wl(-1), _wr(-1), _wt(-1), _wb(-1), _te(ILI9341_NO_PIN), _period(0), _synced(0) {
+      reset_frame_stats();
+    };
+#endif
 
     /**
-     * Initialize display module ILI9341
+     * Initialize display module ILI9341, clearing the screen
      */
     void init (void);
 
+    /**
+     * Start initializing the display module without blocking
+     *
+     * init_step() then takes it through reset, configuration and
+     * sleep out, waiting for nothing: a step that is not due yet
+     * returns at once, so that other setup work (or the tasks of a
+     * scheduler) goes on during the reset and sleep out waits. The
+     * frame memory is cleared a band of rows per step while the
+     * display is still off, overlapping the sleep out wait. No other
+     * drawing may take place until init_step() returns 0.
+     *
+     * @param options ILI9341_INIT_CLEAR or ILI9341_INIT_NOCLEAR
+     */
+    void init_begin (byte options);
+
+    /**
+     * Take the next initialization step, if it is due
+     *
+     * @return 1: more steps to go, 0: display on and ready
+     */
+    byte init_step (void);
+
+    /**
+     * Get the time until the next initialization step is due
+     *
+     * @return Microseconds, 0: due now, or initialization over
+     */
+    unsigned long init_wait (void);
+
+#if ILI9341_BUS == ILI9341_BUS_SPI
+    /**
+     * Share the SPI bus with other devices (e.g. another display)
+     * through a bus manager: the display keeps its own clocks and slave
+     * select, and stays selected between operations until another
+     * device takes the bus. Call before init().
+     *
+     * @param bus Bus manager, 0: none (a transaction per operation)
+     */
+    void share_bus (XSPIBus *bus) {
+      _bus.share(bus);
+    }
+
+    /**
+     * Find the fastest SPI clocks the link is reliable at
+     *
+     * The read clock is the fastest at which READ_ID4 answers
+     * consistently; the write clock is the fastest at which test
+     * patterns written to the top left corner read back intact
+     * with MEMORY_READ. The corner is left black. Call after init().
+     *
+     * @return 1 if reliable clocks were found (and are now in use), 0 otherwise
+     */
+    byte calibrate (void);
+
+    /**
+     * Set the SPI clocks, e.g. as found by an earlier calibrate()
+     *
+     * @param wclock Write clock in Hz
+     * @param rclock Read clock in Hz
+     */
+    void set_spi_clock (uint32_t wclock, uint32_t rclock);
+
+    /**
+     * Get the SPI clocks in use
+     *
+     * @param wclock Write clock in Hz
+     * @param rclock Read clock in Hz
+     */
+    void get_spi_clock (uint32_t *wclock, uint32_t *rclock);
+#endif
+
+    /**
+     * Read the display identification (READ_ID4)
+     *
+     * @return ILI9341_ID for a responding ILI9341
+     */
+    uint16_t read_id (void);
+
+    /**
+     * Stream a compressed copy of a screen area
+     *
+     * The area is read back in short MEMORY_READ transactions and
+     * run-length encoded on the fly into a small fixed buffer that
+     * is flushed to the sink between transactions, so no frame
+     * buffer is needed. The stream format is described by the
+     * ILI9341_CAPTURE_* constants. The drawing mask is ignored.
+     *
+     * @param left Left end (0..DISP_XS-1)
+     * @param right Right end (0..DISP_XS-1, >= left)
+     * @param top Top end (0..DISP_YS-1)
+     * @param bottom Bottom end (0..DISP_YS-1, >= top)
+     * @param out Sink for the stream (XUtils::xwrite)
+     * @return 1 if the stream was sent, 0 if the area is not on screen
+     */
+    byte capture (int left, int right, int top, int bottom, XUtils &out);
+
+    /**
+     * Turn the tearing effect output on and measure the refresh period
+     *
+     * Call after init(). Without a TE pin, vertical syncs are found
+     * by polling GET_SCANLINE.
+     *
+     * @param te TE pin, ILI9341_NO_PIN for none
+     * @return 1 if vertical syncs were seen, 0 otherwise (frames are then not synchronized)
+     */
+    byte tearing_on (uint8_t te = ILI9341_NO_PIN);
+
+    /**
+     * Turn the tearing effect output off
+     */
+    void tearing_off (void);
+
+    /**
+     * Get the refresh period measured by tearing_on()
+     *
+     * @return period in microseconds, 0 if not synchronized
+     */
+    unsigned long get_refresh_period (void) { return _period; };
+
+    /**
+     * Read the panel line being refreshed (GET_SCANLINE)
+     *
+     * @return line, 320 and above during vertical blanking
+     */
+    uint16_t get_scanline (void);
+
+    /**
+     * Wait for the start of the next vertical blanking
+     *
+     * @return 1 on a vertical sync, 0 on timeout
+     */
+    byte wait_vsync (void);
+
+    /**
+     * Start presenting a frame: wait for the vertical sync, so that
+     * writes start ahead of the refresh
+     *
+     * @return 1 if synchronized, 0 if writing straight away
+     */
+    byte frame_begin (void);
+
+    /**
+     * Done presenting a frame: account its write time
+     */
+    void frame_end (void);
+
+    /**
+     * Wait until the refresh has gone past an area, so that it can
+     * be written behind the scanline, tear free: the write must
+     * end before the refresh comes back to the area, which is
+     * estimated from the write clock
+     *
+     * @param left Left end (0..DISP_XS-1)
+     * @param right Right end (0..DISP_XS-1, >= left)
+     * @param top Top end (0..DISP_YS-1)
+     * @param bottom Bottom end (0..DISP_YS-1, >= top)
+     * @return 1 if the area can be written, 0 if not synchronized, too large or on timeout
+     */
+    byte chase (int left, int right, int top, int bottom);
+
+    /**
+     * Get frame pacing statistics
+     *
+     * @param stats Statistics since the last reset
+     */
+    void get_frame_stats (ILI9341_frame_stats_t *stats) { *stats = _fstats; };
+
+    /**
+     * Reset frame pacing statistics
+     */
+    void reset_frame_stats (void) { memset(&_fstats, 0, sizeof(_fstats)); };
+
     /**
      * Set orientation
      *
@@ -77,6 +335,15 @@ class ILI9341: public XUtils {
      */
     int get_font_height (void);
 
+    /**
+     * Get width of a text in pixels (for the fontset currently
+     * registered), control characters taking no room
+     *
+     * @param str Text
+     * @return width in pixels
+     */
+    int get_text_width (const char *str);
+
     /**
      * Set vertical scroll definition
      *
@@ -163,6 +430,252 @@ class ILI9341: public XUtils {
      */
     void blt (int left, int right, int top, int bottom, const uint16_t *pat);
 
+    /**
+     * Start streaming pixels into an area, e.g. from a decoder
+     *
+     * Pixels are then sent with write_pixel()/write_pixels(), left to
+     * right and top to bottom, and the display is released with
+     * end_write(). Pixels falling out of the mask are dropped. No
+     * other drawing may take place until end_write().
+     *
+     * @param left Left end (-32768..32767)
+     * @param right Right end (-32768..32767, >= left)
+     * @param top Top end (-32768..32767)
+     * @param bottom Bottom end (-32768..32767, >= top)
+     * @return 1: some of the area is visible, 0: pixels will all be dropped
+     */
+    byte begin_write (int left, int right, int top, int bottom);
+
+    /**
+     * Stream pixels of the same color
+     *
+     * @param color Pixel color
+     * @param n Number of pixels
+     */
+    void write_pixels (uint16_t color, uint16_t n);
+    void write_pixel (uint16_t color) {
+      write_pixels(color, 1);
+    }
+
+    /**
+     * End streaming pixels, releasing the display
+     */
+    void end_write (void);
+
+    /**
+     * Start drawing an area a line at a time, from two line buffers
+     *
+     * The caller fills the buffer given by line_buffer() and queues it
+     * with send_line(), then fills the other one while the first is
+     * sent: by DMA where the SPI library sends asynchronously, so that
+     * the next line is rendered meanwhile, otherwise before send_line()
+     * returns. The display is released with end_write(), once the last
+     * line is sent. Lines out of the mask are dropped, or cut to it.
+     * No other drawing may take place until end_write().
+     *
+     * @param left Left end (-32768..32767)
+     * @param right Right end (-32768..32767, >= left)
+     * @param top Top end (-32768..32767)
+     * @param bottom Bottom end (-32768..32767, >= top)
+     * @param buf Line buffers, 2 * (right - left + 1) pixels
+     * @return 1: some of the area is visible, 0: lines will all be dropped
+     */
+    byte begin_lines (int left, int right, int top, int bottom, uint16_t *buf);
+
+    /**
+     * Get the line buffer to fill next (its contents are undefined)
+     *
+     * @return Buffer of right - left + 1 pixels
+     */
+    uint16_t *line_buffer (void) {
+      return _lbuf[_lnext];
+    }
+
+    /**
+     * Send the line buffer filled, as the next line of the area
+     */
+    void send_line (void);
+
+    /**
+     * Set a function called as each line has been sent; where the
+     * transfer is asynchronous, it is called from an interrupt
+     *
+     * @param cb Function, 0: none
+     * @param ctx Argument passed to the function
+     */
+    void on_line_sent (ILI9341_line_cb_t cb, void *ctx) {
+      _bus.on_line(cb, ctx);
+    }
+
+    /**
+     * Wait for the line being sent, if any
+     */
+    void wait_idle (void) {
+      _bus.wait();
+    }
+
+    /**
+     * Draw a hollow circle
+     *
+     * @param x Center X (-32768..32767)
+     * @param y Center Y (-32768..32767)
+     * @param r Radius (0..255)
+     * @param color Circle color
+     */
+    void circle (int x, int y, int r, uint16_t color);
+
+    /**
+     * Draw a solid circle
+     *
+     * @param x Center X (-32768..32767)
+     * @param y Center Y (-32768..32767)
+     * @param r Radius (0..255)
+     * @param color Circle color
+     */
+    void circlefill (int x, int y, int r, uint16_t color);
+
+    /**
+     * Draw a hollow ellipse
+     *
+     * @param x Center X (-32768..32767)
+     * @param y Center Y (-32768..32767)
+     * @param rx Horizontal radius (0..255)
+     * @param ry Vertical radius (0..255)
+     * @param color Ellipse color
+     */
+    void ellipse (int x, int y, int rx, int ry, uint16_t color);
+
+    /**
+     * Draw a solid ellipse
+     *
+     * @param x Center X (-32768..32767)
+     * @param y Center Y (-32768..32767)
+     * @param rx Horizontal radius (0..255)
+     * @param ry Vertical radius (0..255)
+     * @param color Ellipse color
+     */
+    void ellipsefill (int x, int y, int rx, int ry, uint16_t color);
+
+    /**
+     * Draw a solid ring sector, e.g. a gauge band
+     *
+     * @param x Center X (-32768..32767)
+     * @param y Center Y (-32768..32767)
+     * @param ro Outer radius (0..255)
+     * @param ri Inner radius (< ro, ro - 1 for a thin arc, -1 for a pie slice)
+     * @param start Start angle (degrees, clockwise from 3 o'clock)
+     * @param end End angle (degrees, > start; 360 apart or more for a full ring)
+     * @param color Sector color
+     */
+    void arc (int x, int y, int ro, int ri, int start, int end, uint16_t color);
+
+    /**
+     * Draw a hollow rectangle with rounded corners
+     *
+     * @param left Left end (-32768..32767)
+     * @param right Right end (-32768..32767, >=left)
+     * @param top Top end (-32768..32767, >=left)
+     * @param bottom Bottom end (-32768..32767, >=top)
+     * @param r Corner radius (limited to half the width and height)
+     * @param color Box color
+     */
+    void roundrect (int left, int right, int top, int bottom, int r, uint16_t color);
+
+    /**
+     * Draw a solid rectangle with rounded corners
+     *
+     * @param left Left end (-32768..32767)
+     * @param right Right end (-32768..32767, >=left)
+     * @param top Top end (-32768..32767, >=left)
+     * @param bottom Bottom end (-32768..32767, >=top)
+     * @param r Corner radius (limited to half the width and height)
+     * @param color Box color
+     */
+    void roundrectfill (int left, int right, int top, int bottom, int r, uint16_t color);
+
+    /**
+     * Draw a hollow triangle
+     *
+     * @param x1 First vertex X (-32768..32767)
+     * @param y1 First vertex Y (-32768..32767)
+     * @param x2 Second vertex X (-32768..32767)
+     * @param y2 Second vertex Y (-32768..32767)
+     * @param x3 Third vertex X (-32768..32767)
+     * @param y3 Third vertex Y (-32768..32767)
+     * @param color Triangle color
+     */
+    void triangle (int x1, int y1, int x2, int y2, int x3, int y3, uint16_t color);
+
+    /**
+     * Draw a solid triangle
+     *
+     * @param x1 First vertex X (-32768..32767)
+     * @param y1 First vertex Y (-32768..32767)
+     * @param x2 Second vertex X (-32768..32767)
+     * @param y2 Second vertex Y (-32768..32767)
+     * @param x3 Third vertex X (-32768..32767)
+     * @param y3 Third vertex Y (-32768..32767)
+     * @param color Triangle color
+     */
+    void trianglefill (int x1, int y1, int x2, int y2, int x3, int y3, uint16_t color);
+
+    /**
+     * Draw a hollow polygon
+     *
+     * @param pts Vertices, X and Y of each
+     * @param n Number of vertices
+     * @param color Polygon color
+     */
+    void polygon (const int *pts, uint8_t n, uint16_t color);
+
+    /**
+     * Draw a solid convex polygon
+     *
+     * @param pts Vertices, X and Y of each, in order around the polygon
+     * @param n Number of vertices (1..ILI9341_POLY_MAX)
+     * @param color Polygon color
+     */
+    void polygonfill (const int *pts, uint8_t n, uint16_t color);
+
+    /**
+     * Blend a solid rectangle over the current content
+     *
+     * @param left Left end (-32768..32767)
+     * @param right Right end (-32768..32767, >=left)
+     * @param top Top end (-32768..32767, >=left)
+     * @param bottom Bottom end (-32768..32767, >=top)
+     * @param color Box color
+     * @param alpha Opacity (0: invisible..255: opaque)
+     */
+    void rectfill_alpha (int left, int right, int top, int bottom, uint16_t color, uint8_t alpha);
+
+    /**
+     * Blend image data over the current content
+     *
+     * @param left Left end (-32768..32767)
+     * @param right Right end (-32768..32767, >=left)
+     * @param top Top end (-32768..32767, >=left)
+     * @param bottom Bottom end (-32768..32767, >=top)
+     * @param pat Pattern data
+     * @param mask Per-pixel opacity (0..255, laid out as pat), NULL for none
+     * @param alpha Overall opacity (0..255), scales the mask
+     */
+    void blt_alpha (int left, int right, int top, int bottom, const uint16_t *pat, const uint8_t *mask, uint8_t alpha);
+
+    /**
+     * Replay a display list
+     *
+     * @param list List, as recorded by ILI9341List
+     */
+    void replay (const uint8_t *list);
+
+    /**
+     * Replay a display list stored in program memory
+     *
+     * @param list List in PROGMEM, e.g. as printed by ILI9341List::dump()
+     */
+    void replay_P (const uint8_t *list);
+
     /**
      * Set current character position for putc
      *
@@ -174,7 +687,12 @@ class ILI9341: public XUtils {
     /**
      * Register text font
      *
-     * @param font Pointer to the font structure in FONTX2 format
+     * FONTRL fonts are proportional: each character advances the
+     * position by its own width, characters without a glyph are
+     * skipped and locate() and BS use the widest advance. Fields
+     * and terminals draw them in cells of the widest advance.
+     *
+     * @param font Pointer to the font structure in FONTX2 or FONTRL format (see Fonts.h)
      */
     void font_face (const uint8_t *font);
 
@@ -185,6 +703,48 @@ class ILI9341: public XUtils {
      */
     void font_color (uint32_t color);
 
+    /**
+     * Set current text opacity
+     *
+     * Text is blended over the current content unless both are 255
+     *
+     * @param fg Glyph opacity (0..255)
+     * @param bg Background opacity (0: transparent..255: opaque)
+     */
+    void font_alpha (uint8_t fg, uint8_t bg);
+
+    /**
+     * Count the lines a text takes in a box of the given width
+     *
+     * @param str Text, LF separating paragraphs
+     * @param width Box width in pixels
+     * @param flags ILI9341_TEXT_NOWRAP or 0
+     * @return number of lines
+     */
+    int text_lines (const char *str, int width, uint8_t flags);
+    int text_lines_P (const char *str, int width, uint8_t flags);
+
+    /**
+     * Draw a text laid out in a box, with the current font and colors
+     *
+     * Lines are wrapped at spaces, a word wider than the box being
+     * cut, and aligned as requested. Each line is drawn opaque in one
+     * window of the box width clipped to the mask, then the rest of the
+     * box is cleared to the background color, so that text is replaced
+     * in place without erasing first. Lines that do not fit are dropped.
+     * The current position is left alone and opacity is not applied.
+     *
+     * @param left Left end
+     * @param right Right end (>= left)
+     * @param top Top end
+     * @param bottom Bottom end (>= top)
+     * @param str Text, LF separating paragraphs
+     * @param flags ILI9341_TEXT_LEFT/CENTER/RIGHT, ILI9341_TEXT_NOWRAP, ILI9341_TEXT_ELLIPSIS
+     * @return number of lines drawn
+     */
+    int textbox (int left, int right, int top, int bottom, const char *str, uint8_t flags);
+    int textbox_P (int left, int right, int top, int bottom, const char *str, uint8_t flags);
+
     /**
      * Put a text character
      *
@@ -205,15 +765,52 @@ class ILI9341: public XUtils {
     }
 
   private:
+    friend class ILI9341Plot;
+    friend class ILI9341Field;
+    friend class ILI9341Term;
+
     int MaskT, MaskL, MaskR, MaskB;  /* Drawing mask */
     int LocX, LocY;         /* Current dot position */
     uint32_t ChrColor;      /* Current character color ((bg << 16) + fg) */
+    uint16_t ChrAlpha;      /* Current character opacity ((bg << 8) + fg) */
     const uint8_t *FontS;   /* Current font */
+    byte FontRL;            /* Current font is FONTRL */
     uint8_t Orientation;    /* Current orientation */
 
-    byte _cs;
+    int _pl, _pr;           /* Pixel stream: left and right ends */
+    int _px, _py;           /* Pixel stream: next pixel */
+    byte _pclip;            /* Pixel stream: area partly out of the mask */
+    byte _pon;              /* Pixel stream: display selected */
+    uint16_t *_lbuf[2];     /* Lines: buffers */
+    byte _lnext;            /* Lines: buffer filled next */
+
+    byte _istate, _iopt;    /* Initialization: step, options */
+    unsigned long _it0;     /* Initialization: micros() at the last reset edge or sleep out */
+    unsigned long _iwait;   /* Initialization: wait from _it0 before the step (us) */
+    int _iy;                /* Initialization: next row cleared */
+
     byte _reset;
-    byte _dc;
+    ILI9341Bus _bus;
+
+    uint32_t _wclock, _rclock;    /* SPI clocks (Hz), or the equivalent bus rate */
+    int _wl, _wr, _wt, _wb;       /* Window last set, _wl/_wt < 0: unknown */
+
+    uint8_t _te;                  /* TE pin */
+    unsigned long _period;        /* Refresh period (us), 0: not synchronized */
+    unsigned long _vsync;         /* micros() at the last vertical sync */
+    unsigned long _frame;         /* micros() at the start of the frame being presented */
+    byte _synced;                 /* Last frame started on a vertical sync */
+    ILI9341_frame_stats_t _fstats;
+
+    /**
+     * Set the window, sending only the ranges that changed
+     *
+     * @param left Left end (0..DISP_XS-1)
+     * @param right Right end (0..DISP_XS-1, >= left)
+     * @param top Top end (0..DISP_YS-1)
+     * @param bottom Bottom end (0..DISP_YS-1, >= top)
+     */
+    void window (int left, int right, int top, int bottom);
 
     /**
      * Set rectangular area to be transferred
@@ -224,6 +821,404 @@ class ILI9341: public XUtils {
      * @param bottom Bottom end (0..DISP_YS-1, >= top)
      */
     void setrect (int left, int right, int top, int bottom);
+
+    /**
+     * Move on to an initialization step
+     *
+     * @param state Step
+     * @param wait Wait before it (us)
+     * @param restart 1: wait from now, 0: from the last reset edge or sleep out
+     */
+    void init_next (byte state, unsigned long wait, byte restart);
+
+    /**
+     * Read back pixels of a rectangular area
+     *
+     * @param left Left end (0..DISP_XS-1)
+     * @param right Right end (0..DISP_XS-1, >= left)
+     * @param top Top end (0..DISP_YS-1)
+     * @param bottom Bottom end (0..DISP_YS-1, >= top)
+     * @param buf Pixels, (right - left + 1) * (bottom - top + 1) of them
+     */
+    void readrect (int left, int right, int top, int bottom, uint16_t *buf);
+
+    /**
+     * Source of the pixels to be blended: n colors and opacities
+     * (0..32) for the pixels of row y from column x onwards
+     */
+    typedef void (*blend_src_t) (const void *ctx, int x, int y, uint8_t n, uint16_t *color, uint8_t *alpha);
+
+    /**
+     * Blend pixels over a rectangular area, a few rows at a time
+     *
+     * @param left Left end (0..DISP_XS-1)
+     * @param right Right end (0..DISP_XS-1, >= left)
+     * @param top Top end (0..DISP_YS-1)
+     * @param bottom Bottom end (0..DISP_YS-1, >= top)
+     * @param src Pixel source
+     * @param ctx Pixel source context
+     */
+    void blendrect (int left, int right, int top, int bottom, blend_src_t src, const void *ctx);
+
+    /**
+     * Draw one row of the runs of four quadrants
+     *
+     * @param xc Center of the left quadrants
+     * @param yc Center of the top quadrants
+     * @param dx Offset of the right quadrants
+     * @param dy Offset of the bottom quadrants
+     * @param y Row, above the top and below the bottom centers
+     * @param xa Start of the run, away from the centers (0: from the centers)
+     * @param xb End of the run
+     * @param color Color
+     */
+    void quadspans (int xc, int yc, int dx, int dy, int y, int xa, int xb, uint16_t color);
+
+    /**
+     * Draw the four quadrants of an ellipse, the right and bottom
+     * ones offset (rounded rectangles)
+     *
+     * @param xc Center of the left quadrants
+     * @param yc Center of the top quadrants
+     * @param rx Horizontal radius
+     * @param ry Vertical radius
+     * @param dx Offset of the right quadrants
+     * @param dy Offset of the bottom quadrants
+     * @param fill 1: solid, 0: hollow
+     * @param color Color
+     */
+    void quadrants (int xc, int yc, int rx, int ry, int dx, int dy, byte fill, uint16_t color);
+
+    /**
+     * Draw a plot column: background, trace and background in one burst
+     *
+     * @param x Column (-32768..32767)
+     * @param top Top end of the column
+     * @param bottom Bottom end of the column (>= top)
+     * @param ya Top end of the trace (top..bottom)
+     * @param yb Bottom end of the trace (ya..bottom)
+     * @param color Trace color
+     * @param bg Background color
+     */
+    void column (int x, int top, int bottom, int ya, int yb, uint16_t color, uint16_t bg);
+
+    /**
+     * Put a run of characters in one window, opaque, leaving the
+     * current position and colors alone
+     *
+     * @param x Left end (0..DISP_XS-1)
+     * @param y Top end (0..DISP_YS-1)
+     * @param s Characters (control characters are drawn blank)
+     * @param n Number of characters
+     * @param color (bg << 16) + fg
+     */
+    void glyphrun (int x, int y, const char *s, uint8_t n, uint32_t color);
+
+    /**
+     * Put a glyph of a FONTRL font, opaque, run by run
+     *
+     * @param x Left end (0..DISP_XS-1)
+     * @param y Top end (0..DISP_YS-1)
+     * @param runs Runs of the glyph, NULL for a blank cell
+     * @param gw Glyph advance
+     * @param cw Cell width (>= gw), padded with background
+     * @param vw Visible width (1..cw)
+     * @param vh Visible height
+     * @param color (bg << 16) + fg
+     */
+    void rlglyph (int x, int y, const uint8_t *runs, int gw, int cw, int vw, int vh, uint32_t color);
+
+    /**
+     * Put columns of a raster of a glyph (in a window already set)
+     *
+     * @param c Character (with a glyph)
+     * @param r Raster
+     * @param c0 First column
+     * @param c1 Last column (< advance)
+     * @param color (bg << 16) + fg
+     */
+    void glyphspan (uint8_t c, int r, int c0, int c1, uint32_t color);
+
+    /**
+     * Put a line of text in one window, padded with background
+     *
+     * @param cl Left end of the visible area
+     * @param cr Right end of the visible area
+     * @param ct Top end of the visible area
+     * @param cb Bottom end of the visible area
+     * @param x Text position
+     * @param y Top of the line
+     * @param s Characters
+     * @param n Number of characters
+     * @param dots Number of dots appended
+     * @param progmem 1: text in PROGMEM
+     */
+    void textline (int cl, int cr, int ct, int cb, int x, int y, const char *s, int n, uint8_t dots, byte progmem);
+
+    /**
+     * Draw a text laid out in a box
+     *
+     * @param progmem 1: text in PROGMEM
+     * @return number of lines drawn
+     */
+    int textbox_str (int left, int right, int top, int bottom, const char *str, uint8_t flags, byte progmem);
+
+    /**
+     * Replay a display list
+     *
+     * @param list List
+     * @param progmem 1: list in PROGMEM
+     */
+    void replay_list (const uint8_t *list, byte progmem);
+};
+
+class ILI9341List {
+  public:
+    /**
+     * Constructor
+     *
+     * @param buf Buffer the list is recorded into
+     * @param size Buffer size in bytes
+     */
+    ILI9341List (uint8_t *buf, uint16_t size): _buf(buf), _size(size) { clear(); };
+
+    /**
+     * Empty the list
+     */
+    void clear (void) { _len = 0; if (_size) _buf[0] = ILI9341_DL_END; };
+
+    /**
+     * Record operations, with the arguments of the ILI9341 methods
+     *
+     * @return 1 if recorded, 0 if the buffer is full
+     */
+    byte rectfill (int left, int right, int top, int bottom, uint16_t color);
+    byte line (int x1, int y1, int x2, int y2, uint16_t color);
+    byte blt (int left, int right, int top, int bottom, const uint16_t *pat);
+    byte text (uint8_t col, uint8_t row, uint32_t color, const char *str);
+
+    /**
+     * Optimize the list for replay
+     *
+     * Runs of rectfills are sorted by region (top, then left) and
+     * adjacent fills of the same color are merged, without changing
+     * what the list draws: fills only move past fills they do not
+     * overlap or share the color with. Consecutive fills on the same
+     * rows or columns then share the window setup.
+     */
+    void optimize (void);
+
+    /**
+     * Print the list as a C array initializer, for a PROGMEM copy
+     * (BLT pattern addresses are only valid in the same build)
+     *
+     * @param out Output
+     */
+    void dump (XUtils &out);
+
+    /**
+     * Get the list
+     *
+     * @return list, terminated by ILI9341_DL_END
+     */
+    const uint8_t *data (void) { return _buf; };
+
+    /**
+     * Get the list length
+     *
+     * @return bytes used, terminator excluded
+     */
+    uint16_t length (void) { return _len; };
+
+  private:
+    uint8_t *put (uint8_t op, uint16_t n);
+
+    uint8_t *_buf;
+    uint16_t _size;
+    uint16_t _len;
+};
+
+class ILI9341Plot {
+  public:
+    /**
+     * Constructor
+     *
+     * Samples are 16-bit integers in any fixed-point format (e.g.
+     * 1/100 C), the scale being given in the same units. Each
+     * column is drawn as one burst of its full height, showing
+     * the range of its samples.
+     *
+     * @param tft Display
+     * @param left Left end of the plot area (-32768..32767)
+     * @param right Right end of the plot area (-32768..32767, >=left)
+     * @param top Top end of the plot area (-32768..32767)
+     * @param bottom Bottom end of the plot area (-32768..32767, >=top)
+     * @param vmin Value at the bottom
+     * @param vmax Value at the top (> vmin)
+     * @param color Trace color
+     * @param bg Background color
+     */
+    ILI9341Plot (ILI9341 &tft, int left, int right, int top, int bottom, int16_t vmin, int16_t vmax, uint16_t color, uint16_t bg):
+      _tft(tft), _left(left), _right(right), _top(top), _bottom(bottom), _color(color), _bg(bg),
+      _x(left), _per(1), _count(0), _prev(0) {
+      set_scale(vmin, vmax);
+    };
+
+    /**
+     * Set the vertical scale (takes effect on the next columns drawn)
+     *
+     * @param vmin Value at the bottom
+     * @param vmax Value at the top (> vmin)
+     */
+    void set_scale (int16_t vmin, int16_t vmax);
+
+    /**
+     * Fill the plot area with the background and restart appending
+     * from the left end
+     */
+    void clear (void);
+
+    /**
+     * Plot a whole series across the plot area
+     *
+     * The samples are decimated to one min/max range per column in
+     * one pass, so the time taken depends on the plot width and
+     * hardly on the number of samples. Appending restarts from the
+     * left end.
+     *
+     * @param data Samples, oldest first
+     * @param n Number of samples
+     */
+    void plot (const int16_t *data, uint16_t n);
+
+    /**
+     * Plot a whole series stored in program memory
+     *
+     * @param data Samples in PROGMEM, oldest first
+     * @param n Number of samples
+     */
+    void plot_P (const int16_t *data, uint16_t n);
+
+    /**
+     * Set the number of samples per column for append()
+     *
+     * @param per_column Samples per column (>= 1)
+     */
+    void set_decimation (uint16_t per_column);
+
+    /**
+     * Append a sample: a column is drawn once it has collected its
+     * samples, past the right end the plot sweeps over from the left
+     *
+     * @param v Sample
+     * @return 1 if a column was drawn, 0 otherwise
+     */
+    byte append (int16_t v);
+
+  private:
+    int ypos (int16_t v);
+    void draw (int x, int16_t lo, int16_t hi);
+    void plot_data (const int16_t *data, uint16_t n, byte progmem);
+
+    ILI9341 &_tft;
+    int _left, _right, _top, _bottom;   /* Plot area */
+    int16_t _vmin, _vmax;               /* Scale */
+    uint32_t _scale;                    /* Pixels per unit (16.16) */
+    uint16_t _color, _bg;
+
+    int _x;                             /* Next column appended */
+    uint16_t _per, _count;              /* Samples per column, collected so far */
+    int16_t _lo, _hi;                   /* Range collected so far */
+    int16_t _last;                      /* Last sample of the previous column */
+    byte _prev;                         /* _last valid */
+};
+
+class ILI9341Field: public XUtils {
+  public:
+    /**
+     * Constructor
+     *
+     * A text field keeps the characters it has drawn, so that an
+     * update only redraws the cells that changed, each run of
+     * adjacent changed cells in one window. The first update draws
+     * the whole field.
+     *
+     * @param tft Display
+     * @param col Column position of the field
+     * @param row Row position of the field
+     * @param buf Buffer for the characters drawn, width bytes
+     * @param width Field width in characters (1..254)
+     * @param color (bg << 16) + fg
+     */
+    ILI9341Field (ILI9341 &tft, uint8_t col, uint8_t row, char *buf, uint8_t width, uint32_t color):
+      _tft(tft), _col(col), _row(row), _buf(buf), _width(width), _color(color) {
+      invalidate();
+      begin();
+    };
+
+    /**
+     * Set the field colors, the next update redraws the whole field
+     * if they change
+     *
+     * @param color (bg << 16) + fg
+     */
+    void set_color (uint32_t color);
+
+    /**
+     * Make the next update redraw the whole field, e.g. after the
+     * screen was cleared
+     */
+    void invalidate (void) { memset(_buf, 0, _width); };
+
+    /**
+     * Start new content, to be written with xputc(), xputs() or
+     * xprintf(): changed cells are drawn as soon as a run of them ends
+     */
+    void begin (void);
+
+    /**
+     * Done with the new content: blank the rest of the field
+     *
+     * @return cells redrawn since begin()
+     */
+    uint8_t end (void);
+
+    /**
+     * Replace the content
+     *
+     * @param str New content
+     * @return cells redrawn
+     */
+    uint8_t update (const char *str);
+
+    /**
+     * Add a character to the new content (control characters are
+     * dropped, characters past the width ignored)
+     *
+     * @param c Character
+     */
+    void xputc (char c);
+
+    /**
+     * Read a character
+     *
+     * @return character read
+     */
+    char xgetc (void) {
+      return (char) 0; /* End of stream */
+    }
+
+  private:
+    void flush (void);
+
+    ILI9341 &_tft;
+    uint8_t _col, _row;     /* Position */
+    char *_buf;             /* Characters drawn */
+    uint8_t _width;
+    uint32_t _color;
+    uint8_t _pos;           /* Next cell written */
+    uint8_t _start;         /* First cell of the pending run of changed cells */
+    uint8_t _drawn;         /* Cells redrawn since begin() */
 };
 
 #endif
\ No newline at end of file
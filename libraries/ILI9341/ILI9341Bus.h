@@ -0,0 +1,216 @@
+#ifndef ILI9341Bus_h
+#define ILI9341Bus_h
+
+#include <inttypes.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+
+/*
+ * Bus backends: the drawing code talks to the controller only through
+ * a bus object (select, command, data write/read, release)
+ */
+
+/* Called as a line of pixels has been sent, from the DMA interrupt
+   where the transfer is asynchronous */
+typedef void (*ILI9341_line_cb_t)(void *ctx);
+#define ILI9341_BUS_SPI   0   /* 4-wire SPI: SCK, MOSI, MISO, CS, D/C */
+#define ILI9341_BUS_PAR8  1   /* 8080-I 8-bit parallel: D0..D7 on one port, CS, D/C, WR, RD */
+
+/* Backend compiled in (can be set on the compiler command line) */
+#ifndef ILI9341_BUS
+#define ILI9341_BUS   ILI9341_BUS_SPI
+#endif
+
+#if ILI9341_BUS == ILI9341_BUS_SPI
+
+#include "XSPIBus.h"
+
+/*
+ * SPI: each selection is an SPI transaction, at the write or the read
+ * clock, so that other devices on the bus keep their own settings.
+ * With a bus manager (share()) the transaction is the manager's, which
+ * keeps it between selections until another device takes the bus.
+ * Lines of pixels go by DMA where the SPI library can send a buffer
+ * asynchronously (SPI_HAS_TRANSFER_ASYNC, e.g. Teensy), the CPU going
+ * on meanwhile; elsewhere they are written before write_line() returns.
+ */
+class ILI9341BusSPI {
+  public:
+    ILI9341BusSPI (byte cs, byte dc): _cs(cs), _dc(dc), _mgr(0), _busy(0), _cb(0) { };
+
+    void share (XSPIBus *mgr) { if (_mgr) _mgr->flush(); _mgr = mgr; };
+    void begin (void) {
+      if (_mgr) _mgr->flush();
+      pinMode(_cs, OUTPUT);
+      pinMode(_dc, OUTPUT);
+      digitalWrite(_cs, HIGH);
+#if defined(SPI_HAS_TRANSFER_ASYNC)
+      _event.attachImmediate(done);
+      _event.setContext(this);
+#endif
+    };
+    void set_clock (uint32_t wclock, uint32_t rclock) {
+      if (_mgr) _mgr->flush();    /* Held at the clock being replaced */
+      _spiw = SPISettings(wclock, MSBFIRST, SPI_MODE3);
+      _spir = SPISettings(rclock, MSBFIRST, SPI_MODE3);
+    };
+
+    void select (void) {
+      if (_mgr) _mgr->acquire(_cs, _spiw);
+      else { SPI.beginTransaction(_spiw); digitalWrite(_cs, LOW); }
+    };
+    void select_read (void) {
+      if (_mgr) _mgr->acquire(_cs, _spir);
+      else { SPI.beginTransaction(_spir); digitalWrite(_cs, LOW); }
+    };
+    void release (void) {
+      wait();
+      if (_mgr) _mgr->release();
+      else { digitalWrite(_cs, HIGH); SPI.endTransaction(); }
+    };
+
+    void command (uint8_t c) { digitalWrite(_dc, LOW); SPI.transfer(c); digitalWrite(_dc, HIGH); };
+    void write (uint8_t d) { SPI.transfer(d); };
+    void write16 (uint16_t d) { SPI.transfer(d >> 8); SPI.transfer(d); };
+    uint8_t read (void) { return SPI.transfer(0); };
+
+    void on_line (ILI9341_line_cb_t cb, void *ctx) { _cb = cb; _ctx = ctx; };
+#if defined(SPI_HAS_TRANSFER_ASYNC)
+    /* The pixels are byte swapped in place, to go most significant byte
+       first (little endian CPU), and the buffer is in use until done */
+    void write_line (uint16_t *px, uint16_t n) {
+      uint16_t i;
+
+      wait();     /* One transfer at a time */
+      for (i = 0; i < n; i++) px[i] = px[i] << 8 | px[i] >> 8;
+      _busy = 1;
+      SPI.transfer(px, NULL, (size_t) n * 2, _event);
+    };
+    void wait (void) { while (_busy) yield(); };
+#else
+    void write_line (uint16_t *px, uint16_t n) {
+      while (n--) write16(*px++);
+      if (_cb) _cb(_ctx);
+    };
+    void wait (void) { };
+#endif
+    byte busy (void) { return _busy; };
+
+  private:
+#if defined(SPI_HAS_TRANSFER_ASYNC)
+    static void done (EventResponderRef event) {
+      ILI9341BusSPI *bus = (ILI9341BusSPI *) event.getContext();
+
+      bus->_busy = 0;
+      if (bus->_cb) bus->_cb(bus->_ctx);
+    };
+
+    EventResponder _event;
+#endif
+    byte _cs, _dc;
+    SPISettings _spiw, _spir;   /* Transaction settings for writes and reads */
+    XSPIBus *_mgr;              /* Bus manager, 0: none */
+    volatile byte _busy;        /* A line is being sent */
+    ILI9341_line_cb_t _cb;
+    void *_ctx;
+};
+
+typedef ILI9341BusSPI ILI9341Bus;
+
+#elif ILI9341_BUS == ILI9341_BUS_PAR8
+
+#if defined(ARDUINO)
+/* Port D0..D7 are wired to, in order (AVR registers): writes take the
+   whole port, so none of CS, RESET, D/C, WR, RD may be on it */
+#ifndef ILI9341_PAR8_PORT
+#define ILI9341_PAR8_PORT   PORTB
+#define ILI9341_PAR8_PIN    PINB
+#define ILI9341_PAR8_DDR    DDRB
+#endif
+#else
+#include "Par8.h"   /* Host stand-in */
+#endif
+
+/* Bus rate, as the SPI clock that would move as many bits (write cycle of 4 CPU cycles) */
+#define ILI9341_PAR8_CLOCK  (F_CPU / 4 * 8)
+
+/*
+ * 8080-I 8-bit parallel: a byte per WR (or RD) strobe, D/C, WR and RD
+ * driven through their port registers. CS stays low between strobes,
+ * so the data port can be shared with other devices only while the
+ * display is released.
+ */
+class ILI9341BusPar8 {
+  public:
+    ILI9341BusPar8 (byte cs, byte dc, byte wr, byte rd): _cs(cs), _dc(dc), _wr(wr), _rd(rd), _in(0), _cb(0) { };
+
+    void begin (void) {
+      pinMode(_cs, OUTPUT); pinMode(_dc, OUTPUT);
+      pinMode(_wr, OUTPUT); pinMode(_rd, OUTPUT);
+      digitalWrite(_cs, HIGH); digitalWrite(_dc, HIGH);
+      digitalWrite(_wr, HIGH); digitalWrite(_rd, HIGH);
+#if defined(ARDUINO)
+      _dcreg = portOutputRegister(digitalPinToPort(_dc)); _dcmask = digitalPinToBitMask(_dc);
+      _wrreg = portOutputRegister(digitalPinToPort(_wr)); _wrmask = digitalPinToBitMask(_wr);
+      _rdreg = portOutputRegister(digitalPinToPort(_rd)); _rdmask = digitalPinToBitMask(_rd);
+      ILI9341_PAR8_DDR = 0xFF;
+#endif
+      _in = 0;
+    };
+
+    void select (void) { digitalWrite(_cs, LOW); };
+    void select_read (void) { digitalWrite(_cs, LOW); };
+    void release (void) { digitalWrite(_cs, HIGH); };
+
+#if defined(ARDUINO)
+    void command (uint8_t c) { *_dcreg &= ~_dcmask; write(c); *_dcreg |= _dcmask; };
+    void write (uint8_t d) {
+      if (_in) { ILI9341_PAR8_DDR = 0xFF; _in = 0; }
+      ILI9341_PAR8_PORT = d;
+      *_wrreg &= ~_wrmask; *_wrreg |= _wrmask;    /* Latched on the rising edge */
+    };
+    uint8_t read (void) {
+      uint8_t d;
+
+      if (!_in) { ILI9341_PAR8_DDR = 0x00; ILI9341_PAR8_PORT = 0x00; _in = 1; }
+      *_rdreg &= ~_rdmask;
+      __asm__ __volatile__ ("nop\n\tnop\n\tnop\n\tnop\n\tnop\n\tnop");   /* Frame memory reads need RD low for 355 ns */
+      d = ILI9341_PAR8_PIN;
+      *_rdreg |= _rdmask;
+      return d;
+    };
+#else
+    void command (uint8_t c) { digitalWrite(_dc, LOW); write(c); digitalWrite(_dc, HIGH); };
+    void write (uint8_t d) { _in = 0; Par8.write(d); };
+    uint8_t read (void) { _in = 1; return Par8.read(); };
+#endif
+    void write16 (uint16_t d) { write(d >> 8); write(d); };
+
+    /* No DMA: lines are written by the CPU */
+    void on_line (ILI9341_line_cb_t cb, void *ctx) { _cb = cb; _ctx = ctx; };
+    void write_line (uint16_t *px, uint16_t n) {
+      while (n--) write16(*px++);
+      if (_cb) _cb(_ctx);
+    };
+    void wait (void) { };
+    byte busy (void) { return 0; };
+
+  private:
+    byte _cs, _dc, _wr, _rd;
+    byte _in;                   /* Data port turned around for reading */
+    ILI9341_line_cb_t _cb;
+    void *_ctx;
+#if defined(ARDUINO)
+    volatile uint8_t *_dcreg, *_wrreg, *_rdreg;
+    uint8_t _dcmask, _wrmask, _rdmask;
+#endif
+};
+
+typedef ILI9341BusPar8 ILI9341Bus;
+
+#else
+#error "ILI9341_BUS: unknown bus backend"
+#endif
+
+#endif
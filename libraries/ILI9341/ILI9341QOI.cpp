@@ -0,0 +1,220 @@
+/*
+ * Streaming QOI image decoder on ILI9341
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "ILI9341.h"
+#include "ILI9341QOI.h"
+
+/* Parser states */
+#define ST_HEAD     0   /* Header, 14 bytes */
+#define ST_OP       1   /* Chunk tag */
+#define ST_ARG      2   /* Chunk data */
+#define ST_TAIL     3   /* End marker, 8 bytes */
+#define ST_STOP     4   /* Done, or error */
+
+#define QOI_OP_INDEX  0x00  /* 00xxxxxx */
+#define QOI_OP_DIFF   0x40  /* 01xxxxxx */
+#define QOI_OP_LUMA   0x80  /* 10xxxxxx */
+#define QOI_OP_RUN    0xC0  /* 11xxxxxx */
+#define QOI_OP_RGB    0xFE
+#define QOI_OP_RGBA   0xFF
+
+#define QOI_HEAD_LEN  14
+#define QOI_TAIL_LEN  8
+
+/* 4x4 ordered dither thresholds (0..15) */
+static const PROGMEM uint8_t bayer[16] = {
+   0,  8,  2, 10,
+  12,  4, 14,  6,
+   3, 11,  1,  9,
+  15,  7, 13,  5
+};
+
+void ILI9341QOI::begin (
+  int x,          /* Left end of the image */
+  int y,          /* Top end of the image */
+  byte dither     /* 1: ordered dithering */
+)
+{
+  _tft.end_write();   /* In case an image was left incomplete */
+  _x = x; _y = y;
+  _w = _h = 0;
+  _dither = dither;
+  _status = QOI_MORE;
+  _state = ST_HEAD;
+  _n = 0;
+  _val = 0;
+  memset(_index, 0, sizeof(_index));
+  _px[0] = _px[1] = _px[2] = 0; _px[3] = 255;
+}
+
+uint8_t ILI9341QOI::end (void)
+{
+  _tft.end_write();
+  if (_status == QOI_MORE) _status = QOI_ERROR;
+  _state = ST_STOP;
+  return _status;
+}
+
+void ILI9341QOI::emit (
+  uint16_t n      /* Number of pixels of the current color */
+)
+{
+  uint8_t d, r, g, b;
+
+
+  if (!_dither) {
+    _tft.write_pixels(RGB16(_px[0], _px[1], _px[2]), n);
+    _cx += n;
+  } else {
+    while (n--) {   /* Thresholds follow the screen position, so that tiles line up */
+      d = pgm_read_byte(&bayer[((_y + _cy) & 3) * 4 + ((_x + _cx) & 3)]);
+      r = _px[0] > 255 - (d >> 1) ? 255 : _px[0] + (d >> 1);   /* 5 bits: up to 7/8 of a step */
+      g = _px[1] > 255 - (d >> 2) ? 255 : _px[1] + (d >> 2);   /* 6 bits: up to 3/4 of a step */
+      b = _px[2] > 255 - (d >> 1) ? 255 : _px[2] + (d >> 1);
+      _tft.write_pixel(RGB16(r, g, b));
+      _cx++;
+    }
+  }
+  while (_cx >= _w) {
+    _cx -= _w;
+    _cy++;
+  }
+}
+
+uint8_t ILI9341QOI::put (
+  uint8_t c       /* Byte of the stream */
+)
+{
+  static const PROGMEM char magic[4] = { 'q', 'o', 'i', 'f' };
+  uint8_t *px = _index[0], i;
+  uint32_t left;
+  int8_t vg;
+
+
+  switch (_state) {
+  case ST_HEAD:
+    if (_n < 4) {
+      if (c != pgm_read_byte(&magic[_n])) return QOI_ERROR;
+    } else if (_n < 12) {
+      _val = _val << 8 | c;     /* Width, then height, big endian */
+      if (_n == 7 || _n == 11) {
+        if (_val == 0 || _val > QOI_MAX_SIDE) return QOI_ERROR;
+        if (_n == 7) _w = _val; else _h = _val;
+        _val = 0;
+      }
+    } else if (_n == 12) {
+      if (c != 3 && c != 4) return QOI_ERROR;   /* Channels */
+    }
+    if (++_n == QOI_HEAD_LEN) {
+      _cx = _cy = 0;
+      _tft.begin_write(_x, _x + _w - 1, _y, _y + _h - 1);
+      _state = ST_OP;
+    }
+    return QOI_MORE;
+
+  case ST_OP:
+    if (c == QOI_OP_RGB || c == QOI_OP_RGBA) {
+      _op = c;
+      _need = c == QOI_OP_RGB ? 3 : 4;
+      _n = 0;
+      _state = ST_ARG;
+      return QOI_MORE;
+    }
+    switch (c & 0xC0) {
+    case QOI_OP_INDEX:
+      px = _index[c & 0x3F];
+      _px[0] = px[0]; _px[1] = px[1]; _px[2] = px[2]; _px[3] = px[3];
+      break;
+    case QOI_OP_DIFF:
+      _px[0] += ((c >> 4) & 3) - 2;
+      _px[1] += ((c >> 2) & 3) - 2;
+      _px[2] += (c & 3) - 2;
+      break;
+    case QOI_OP_LUMA:
+      _op = c;
+      _need = 1;
+      _n = 0;
+      _state = ST_ARG;
+      return QOI_MORE;
+    case QOI_OP_RUN:
+      left = (uint32_t) _w * (_h - _cy) - _cx;
+      i = (c & 0x3F) + 1;
+      if (i > left) return QOI_ERROR;
+      emit(i);        /* The index already holds this color */
+      goto next;
+    }
+    break;
+
+  case ST_ARG:
+    if ((_op & 0xC0) == QOI_OP_LUMA) {
+      vg = (_op & 0x3F) - 32;
+      _px[0] += vg - 8 + (c >> 4);
+      _px[1] += vg;
+      _px[2] += vg - 8 + (c & 0x0F);
+    } else {
+      _px[_n] = c;
+      if (++_n < _need) return QOI_MORE;
+    }
+    _state = ST_OP;
+    break;
+
+  case ST_TAIL:
+    if (c != (++_n == QOI_TAIL_LEN ? 1 : 0)) return QOI_ERROR;
+    if (_n == QOI_TAIL_LEN) {
+      _state = ST_STOP;
+      return QOI_DONE;
+    }
+    return QOI_MORE;
+
+  default:
+    return _status;
+  }
+
+  px = _index[(_px[0] * 3 + _px[1] * 5 + _px[2] * 7 + _px[3] * 11) & 0x3F];
+  px[0] = _px[0]; px[1] = _px[1]; px[2] = _px[2]; px[3] = _px[3];
+  emit(1);
+
+next:
+  if (_cy == _h) {    /* Last pixel: release the display, then the end marker */
+    _tft.end_write();
+    _n = 0;
+    _state = ST_TAIL;
+  }
+  return QOI_MORE;
+}
+
+uint8_t ILI9341QOI::feed (
+  const uint8_t *buf, /* Bytes */
+  uint16_t n      /* Number of bytes */
+)
+{
+  while (n-- && _status == QOI_MORE) {
+    if ((_status = put(*buf++)) == QOI_ERROR) end();
+  }
+  return _status;
+}
+
+uint8_t ILI9341QOI::feed_P (
+  const uint8_t *buf, /* Bytes in PROGMEM */
+  uint16_t n      /* Number of bytes */
+)
+{
+  while (n-- && _status == QOI_MORE) {
+    if ((_status = put(pgm_read_byte(buf++))) == QOI_ERROR) end();
+  }
+  return _status;
+}
+
+uint8_t ILI9341QOI::feed (
+  XUtils &src     /* Byte source */
+)
+{
+  while (_status == QOI_MORE && src.xready()) {
+    if ((_status = put((uint8_t) src.xgetc())) == QOI_ERROR) end();
+  }
+  return _status;
+}
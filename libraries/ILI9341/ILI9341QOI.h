@@ -0,0 +1,95 @@
+#ifndef ILI9341QOI_h
+#define ILI9341QOI_h
+
+#include <inttypes.h>
+
+#include "ILI9341.h"
+#include "XUtils.h"
+
+/* Decoder status */
+#define QOI_MORE    0   /* Waiting for more bytes */
+#define QOI_DONE    1   /* Image complete, end marker included */
+#define QOI_ERROR   2   /* Not a QOI stream, or a broken one */
+
+/* Largest image side */
+#define QOI_MAX_SIDE  4096
+
+/*
+ * Streaming decoder of QOI images (https://qoiformat.org), written
+ * straight into a display area through ILI9341::begin_write(): the
+ * state is the 64-entry color index and a few counters, no line or
+ * frame buffer. Bytes can come in pieces of any size, from RAM, flash
+ * or any XUtils source (e.g. a console). Alpha is ignored.
+ */
+class ILI9341QOI {
+  public:
+    /**
+     * Constructor
+     *
+     * @param tft Display
+     */
+    ILI9341QOI (ILI9341 &tft): _tft(tft), _status(QOI_ERROR) { };
+
+    /**
+     * Start decoding an image
+     *
+     * @param x Left end of the image on the display
+     * @param y Top end of the image on the display
+     * @param dither 1: ordered dithering from RGB888 down to RGB565
+     */
+    void begin (int x, int y, byte dither);
+
+    /**
+     * Decode bytes of the stream
+     *
+     * @param buf Bytes
+     * @param n Number of bytes
+     * @return QOI_MORE, QOI_DONE or QOI_ERROR (bytes past the end are ignored)
+     */
+    uint8_t feed (const uint8_t *buf, uint16_t n);
+    uint8_t feed_P (const uint8_t *buf, uint16_t n);
+
+    /**
+     * Decode the bytes a source has ready, without blocking
+     *
+     * @param src Source, read while xready()
+     * @return QOI_MORE, QOI_DONE or QOI_ERROR
+     */
+    uint8_t feed (XUtils &src);
+
+    /**
+     * Stop decoding, releasing the display if the image is incomplete
+     *
+     * @return QOI_DONE if the image was complete
+     */
+    uint8_t end (void);
+
+    /**
+     * Get the image size, once the header is decoded
+     *
+     * @param width Width in pixels
+     * @param height Height in pixels
+     */
+    void get_size (uint16_t *width, uint16_t *height) { *width = _w; *height = _h; };
+
+  private:
+    uint8_t put (uint8_t c);
+    void emit (uint16_t n);
+
+    ILI9341 &_tft;
+    int _x, _y;               /* Image position */
+    uint16_t _w, _h;          /* Image size */
+    uint16_t _cx, _cy;        /* Next pixel in the image */
+    byte _dither;
+
+    uint8_t _status;
+    uint8_t _state;           /* Parser state */
+    uint8_t _op;              /* Chunk being read */
+    uint8_t _n, _need;        /* Bytes read and needed */
+    uint32_t _val;            /* Header field being read */
+
+    uint8_t _px[4];           /* Previous pixel (RGBA) */
+    uint8_t _index[64][4];    /* Color index */
+};
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * VT100 terminal emulator on ILI9341
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "ILI9341.h"
+#include "ILI9341Term.h"
+
+/* Parser states */
+#define ST_TEXT     0
+#define ST_ESC      1   /* After ESC */
+#define ST_CSI      2   /* After ESC [ */
+
+#define C_ESC       0x1B
+
+/* ANSI colors, then their bright variants */
+static const PROGMEM uint16_t palette[16] = {
+  RGB16(0,0,0), RGB16(205,0,0), RGB16(0,205,0), RGB16(205,205,0),
+  RGB16(0,0,238), RGB16(205,0,205), RGB16(0,205,205), RGB16(229,229,229),
+  RGB16(127,127,127), RGB16(255,0,0), RGB16(0,255,0), RGB16(255,255,0),
+  RGB16(92,92,255), RGB16(255,0,255), RGB16(0,255,255), RGB16(255,255,255)
+};
+
+/*----------------------------------------------*/
+/* Cell grid                                    */
+/*----------------------------------------------*/
+
+void ILI9341Term::put (
+  uint8_t x,      /* Column */
+  uint8_t y,      /* Row */
+  char c,         /* Character */
+  uint8_t attr    /* Attribute */
+)
+{
+  uint16_t i = (uint16_t) y * _cols + x, n = (uint16_t) _cols * _rows;
+
+
+  if (_cells[i] != (uint8_t) c || (_cells[n + i] & ~TERM_ATTR_DIRTY) != attr) {
+    _cells[i] = c;
+    _cells[n + i] = attr | TERM_ATTR_DIRTY;
+  }
+}
+
+void ILI9341Term::erase (
+  uint16_t from,  /* First cell (row * cols + column) */
+  uint16_t to     /* Last cell */
+)
+{
+  uint8_t a = attr() & TERM_ATTR_BG;    /* Erased cells take the current background */
+
+
+  for (; from <= to; from++) put(from % _cols, from / _cols, ' ', a | (TERM_ATTR_DEFAULT & TERM_ATTR_FG));
+}
+
+void ILI9341Term::scroll (
+  byte up         /* 1: up (LF at the bottom), 0: down (reverse index at the top) */
+)
+{
+  uint16_t n = (uint16_t) _cols * _rows;
+  uint8_t x, y, src;
+
+
+  /* Cells are moved with put(), so that only those that change are repainted */
+  for (y = up ? _top : _bottom; up ? y < _bottom : y > _top; up ? y++ : y--) {
+    src = up ? y + 1 : y - 1;
+    for (x = 0; x < _cols; x++) {
+      uint16_t i = (uint16_t) src * _cols + x;
+      put(x, y, _cells[i], _cells[n + i] & ~TERM_ATTR_DIRTY);
+    }
+  }
+  erase((uint16_t) y * _cols, (uint16_t) y * _cols + _cols - 1);
+}
+
+void ILI9341Term::linefeed (void)
+{
+  if (_cy == _bottom) scroll(1);
+  else if (_cy < _rows - 1) _cy++;
+}
+
+uint8_t ILI9341Term::attr (void)
+{
+  uint8_t fg = _fg | (_bold ? 8 : 0), bg = _bg;
+
+
+  if (_reverse) {
+    fg = _bg | (_bold ? 8 : 0);
+    bg = _fg & 7;
+  }
+  return (bg << 4) | fg;
+}
+
+void ILI9341Term::reset (void)
+{
+  _cx = _cy = 0;
+  _wrap = 0;
+  _fg = TERM_ATTR_DEFAULT & TERM_ATTR_FG;
+  _bg = (TERM_ATTR_DEFAULT & TERM_ATTR_BG) >> 4;
+  _bold = _reverse = 0;
+  _top = 0; _bottom = _rows - 1;
+  _sx = _sy = 0; _sfg = _fg; _sbg = _bg; _sbold = _sreverse = 0;
+  _state = ST_TEXT;
+  erase(0, (uint16_t) _cols * _rows - 1);
+}
+
+void ILI9341Term::invalidate (void)
+{
+  uint16_t i, n = (uint16_t) _cols * _rows;
+
+
+  for (i = 0; i < n; i++) _cells[n + i] |= TERM_ATTR_DIRTY;
+}
+
+uint16_t ILI9341Term::refresh (void)
+{
+  uint16_t n = (uint16_t) _cols * _rows, i, run, done = 0;
+  uint8_t *attrs = _cells + n, a, x, y, x0;
+  uint32_t color;
+  int fw, fh;
+
+
+  fw = _tft.get_font_width(); fh = _tft.get_font_height();
+  for (y = 0; y < _rows; y++) {
+    i = (uint16_t) y * _cols;
+    for (x = 0; x < _cols; ) {
+      if (!(attrs[i + x] & TERM_ATTR_DIRTY)) {
+        x++;
+        continue;
+      }
+      /* A run of changed cells of the same colors */
+      a = attrs[i + x];
+      x0 = x;
+      do {
+        attrs[i + x] &= ~TERM_ATTR_DIRTY;
+        x++;
+      } while (x < _cols && attrs[i + x] == a);
+      run = x - x0;
+      color = ((uint32_t) pgm_read_word(&palette[(a & TERM_ATTR_BG) >> 4]) << 16) | pgm_read_word(&palette[a & TERM_ATTR_FG]);
+      _tft.glyphrun((_col + x0) * fw, (_row + y) * fh, (const char *) &_cells[i + x0], run, color);
+      done += run;
+    }
+  }
+  return done;
+}
+
+/*----------------------------------------------*/
+/* Output and control sequences                 */
+/*----------------------------------------------*/
+
+void ILI9341Term::xputc (
+  char c          /* Character */
+)
+{
+  if (_state != ST_TEXT) {
+    escape(c);
+    return;
+  }
+  if (XPUTC_LF_CRLF && c == '\n')
+    control('\r');   /* LF -> CRLF */
+  if ((uint8_t) c < 0x20) {
+    control(c);
+    return;
+  }
+
+  if (_wrap) {      /* Deferred wrap, as a VT100 does */
+    _cx = 0;
+    linefeed();
+    _wrap = 0;
+  }
+  put(_cx, _cy, c, attr());
+  if (_cx < _cols - 1) _cx++;
+  else _wrap = 1;
+}
+
+void ILI9341Term::control (
+  char c          /* Control character */
+)
+{
+  switch (c) {
+  case '\b':
+    if (_cx) _cx--;
+    _wrap = 0;
+    break;
+  case '\t':
+    _cx = (_cx | 7) + 1 < _cols ? (_cx | 7) + 1 : _cols - 1;
+    break;
+  case '\n':
+  case '\v':
+  case '\f':
+    linefeed();
+    break;
+  case '\r':
+    _cx = 0;
+    _wrap = 0;
+    break;
+  case C_ESC:
+    _state = ST_ESC;
+    break;
+  }
+}
+
+void ILI9341Term::escape (
+  char c          /* Byte of an escape sequence */
+)
+{
+  uint16_t p0, p1;
+
+
+  if (_state == ST_ESC) {
+    _state = ST_TEXT;
+    switch (c) {
+    case '[':
+      _state = ST_CSI;
+      _nparam = 0;
+      _param[0] = 0;
+      break;
+    case '7':
+      _sx = _cx; _sy = _cy; _sfg = _fg; _sbg = _bg; _sbold = _bold; _sreverse = _reverse;
+      break;
+    case '8':
+      _cx = _sx; _cy = _sy; _fg = _sfg; _bg = _sbg; _bold = _sbold; _reverse = _sreverse;
+      _wrap = 0;
+      break;
+    case 'E':
+      _cx = 0;
+      /* follow next case */
+    case 'D':
+      linefeed();
+      _wrap = 0;
+      break;
+    case 'M':
+      if (_cy == _top) scroll(0);
+      else if (_cy) _cy--;
+      _wrap = 0;
+      break;
+    case 'c':
+      reset();
+      break;
+    }
+    return;
+  }
+
+  /* Control sequence: parameters, then a final byte */
+  if (c >= '0' && c <= '9') {
+    if (_nparam < TERM_PARAMS) _param[_nparam] = _param[_nparam] * 10 + (c - '0');
+    return;
+  }
+  if (c == ';') {
+    if (_nparam < TERM_PARAMS && ++_nparam < TERM_PARAMS) _param[_nparam] = 0;
+    return;
+  }
+  if (c < 0x40) return;   /* Private markers and intermediates (e.g. '?') are ignored */
+  if (_nparam < TERM_PARAMS) _nparam++;   /* Count the last parameter */
+  _state = ST_TEXT;
+
+  p0 = _param[0] ? _param[0] : 1;
+  p1 = _nparam > 1 && _param[1] ? _param[1] : 1;
+  switch (c) {
+  case 'A':
+    _cy = _cy > p0 ? _cy - p0 : 0;
+    break;
+  case 'B':
+    _cy = _cy + p0 < _rows ? _cy + p0 : _rows - 1;
+    break;
+  case 'C':
+    _cx = _cx + p0 < _cols ? _cx + p0 : _cols - 1;
+    break;
+  case 'D':
+    _cx = _cx > p0 ? _cx - p0 : 0;
+    break;
+  case 'H':
+  case 'f':
+    _cy = p0 <= _rows ? p0 - 1 : _rows - 1;
+    _cx = p1 <= _cols ? p1 - 1 : _cols - 1;
+    break;
+  case 'J':
+    switch (_param[0]) {
+    case 0: erase((uint16_t) _cy * _cols + _cx, (uint16_t) _cols * _rows - 1); break;
+    case 1: erase(0, (uint16_t) _cy * _cols + _cx); break;
+    case 2: erase(0, (uint16_t) _cols * _rows - 1); break;
+    }
+    break;
+  case 'K':
+    switch (_param[0]) {
+    case 0: erase((uint16_t) _cy * _cols + _cx, (uint16_t) _cy * _cols + _cols - 1); break;
+    case 1: erase((uint16_t) _cy * _cols, (uint16_t) _cy * _cols + _cx); break;
+    case 2: erase((uint16_t) _cy * _cols, (uint16_t) _cy * _cols + _cols - 1); break;
+    }
+    break;
+  case 'm':
+    sgr();
+    break;
+  case 'r':
+    p1 = _nparam > 1 && _param[1] ? _param[1] : _rows;
+    if (p0 < p1 && p1 <= _rows) {
+      _top = p0 - 1;
+      _bottom = p1 - 1;
+      _cx = _cy = 0;
+    }
+    break;
+  case 's':
+    _sx = _cx; _sy = _cy;
+    break;
+  case 'u':
+    _cx = _sx; _cy = _sy;
+    break;
+  }
+  _wrap = 0;
+}
+
+void ILI9341Term::sgr (void)
+{
+  uint8_t i;
+  uint16_t p;
+
+
+  for (i = 0; i < _nparam; i++) {
+    p = _param[i];
+    if (p == 0) {
+      _fg = TERM_ATTR_DEFAULT & TERM_ATTR_FG;
+      _bg = (TERM_ATTR_DEFAULT & TERM_ATTR_BG) >> 4;
+      _bold = _reverse = 0;
+    } else if (p == 1) {
+      _bold = 1;
+    } else if (p == 7) {
+      _reverse = 1;
+    } else if (p == 22) {
+      _bold = 0;
+    } else if (p == 27) {
+      _reverse = 0;
+    } else if (p >= 30 && p <= 37) {
+      _fg = p - 30;
+    } else if (p == 39) {
+      _fg = TERM_ATTR_DEFAULT & TERM_ATTR_FG;
+    } else if (p >= 40 && p <= 47) {
+      _bg = p - 40;
+    } else if (p == 49) {
+      _bg = (TERM_ATTR_DEFAULT & TERM_ATTR_BG) >> 4;
+    } else if (p >= 90 && p <= 97) {
+      _fg = p - 90 + 8;
+    }
+  }
+}
@@ -0,0 +1,124 @@
+#ifndef ILI9341Term_h
+#define ILI9341Term_h
+
+#include <inttypes.h>
+
+#include "ILI9341.h"
+#include "XUtils.h"
+
+/* Cell attributes */
+#define TERM_ATTR_FG      0x0F  /* Foreground color (8..15: bright) */
+#define TERM_ATTR_BG      0x70  /* Background color */
+#define TERM_ATTR_DIRTY   0x80  /* Changed since the last refresh */
+#define TERM_ATTR_DEFAULT 0x07  /* White on black */
+
+/* Most numeric parameters of a control sequence */
+#define TERM_PARAMS       4
+
+/*
+ * VT100 subset:
+ *   BS, HT, LF/VT/FF, CR
+ *   ESC 7, ESC 8 (save/restore cursor), ESC D, ESC E, ESC M (index,
+ *   next line, reverse index), ESC c (reset)
+ *   CSI n A/B/C/D (cursor up/down/forward/back), CSI r;c H/f (cursor
+ *   position), CSI n J/K (erase in display/line), CSI ... m (SGR:
+ *   0, 1, 7, 22, 27, 30..37, 39, 40..47, 49, 90..97), CSI t;b r (scroll
+ *   region), CSI s/u (save/restore cursor)
+ * Other sequences are parsed and ignored.
+ */
+
+class ILI9341Term: public XUtils {
+  public:
+    /**
+     * Constructor
+     *
+     * The terminal keeps a character and an attribute per cell in a
+     * caller-provided grid; output only updates the grid, refresh()
+     * repaints the cells that changed.
+     *
+     * @param tft Display
+     * @param col Column position of the terminal on the display
+     * @param row Row position of the terminal on the display
+     * @param cells Cell grid, 2 * cols * rows bytes (characters, then attributes)
+     * @param cols Number of columns (1..255)
+     * @param rows Number of rows (1..255)
+     */
+    ILI9341Term (ILI9341 &tft, uint8_t col, uint8_t row, uint8_t *cells, uint8_t cols, uint8_t rows):
+      _tft(tft), _col(col), _row(row), _cells(cells), _cols(cols), _rows(rows) {
+      reset();
+      invalidate();
+    };
+
+    /**
+     * Reset the terminal: default colors, full scroll region, cursor
+     * home and the screen cleared (cells then blank are repainted
+     * by the next refresh)
+     */
+    void reset (void);
+
+    /**
+     * Make the next refresh repaint all cells, e.g. after the screen
+     * was drawn over
+     */
+    void invalidate (void);
+
+    /**
+     * Repaint the cells that changed since the last refresh, each
+     * run of them of the same colors in one window
+     *
+     * @return cells repainted
+     */
+    uint16_t refresh (void);
+
+    /**
+     * Get the cursor position
+     *
+     * @param col Column (0..cols-1)
+     * @param row Row (0..rows-1)
+     */
+    void get_cursor (uint8_t *col, uint8_t *row) { *col = _cx; *row = _cy; };
+
+    /**
+     * Put a character or a byte of a control sequence
+     *
+     * @param c Character
+     */
+    void xputc (char c);
+
+    /**
+     * Read a character
+     *
+     * @return character read
+     */
+    char xgetc (void) {
+      return (char) 0; /* End of stream */
+    }
+
+  private:
+    void put (uint8_t x, uint8_t y, char c, uint8_t attr);
+    void erase (uint16_t from, uint16_t to);
+    void scroll (uint8_t up);
+    void linefeed (void);
+    void escape (char c);
+    void control (char c);
+    void sgr (void);
+    uint8_t attr (void);
+
+    ILI9341 &_tft;
+    uint8_t _col, _row;       /* Position on the display */
+    uint8_t *_cells;          /* Characters, then attributes */
+    uint8_t _cols, _rows;
+
+    uint8_t _cx, _cy;         /* Cursor */
+    byte _wrap;               /* Last column written: wrap before the next character */
+    uint8_t _fg, _bg;         /* Colors (SGR) */
+    byte _bold, _reverse;
+    uint8_t _top, _bottom;    /* Scroll region */
+    uint8_t _sx, _sy, _sfg, _sbg, _sbold, _sreverse;   /* Saved cursor */
+
+    uint8_t _state;           /* Parser state */
+    uint8_t _nparam;
+    uint16_t _param[TERM_PARAMS];
+};
+
+#endif
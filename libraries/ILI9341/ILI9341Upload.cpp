@@ -0,0 +1,201 @@
+/*
+ * Pixel data upload from a host link into ILI9341
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "ILI9341.h"
+#include "ILI9341Upload.h"
+
+/* Receiver states */
+#define RS_SEQ      0   /* Sequence number */
+#define RS_LEN0     1   /* Length, low byte */
+#define RS_LEN1     2   /* Length, high byte */
+#define RS_DATA     3   /* Data */
+#define RS_SUM0     4   /* Sum, low byte */
+#define RS_SUM1     5   /* Sum, high byte */
+
+/* Answers due: an ACK, or a NAK with the sequence number expected */
+#define ANS_ACK     UPLOAD_ACK
+#define ANS_NAK(s)  ((uint16_t) UPLOAD_NAK << 8 | (s))
+
+
+void ILI9341Upload::answer (
+  uint16_t a      /* ANS_ACK or ANS_NAK() */
+)
+{
+  _ans[(_ahead + _acount++) % UPLOAD_BUFFERS] = a;
+  flush();
+}
+
+void ILI9341Upload::flush (void)
+{
+  uint8_t b[2];
+
+
+  while (_acount && _ans[_ahead] != ANS_ACK) {  /* NAKs wait for the chunks before them */
+    b[0] = UPLOAD_NAK; b[1] = (uint8_t) _ans[_ahead];
+    _link.xwrite(b, 2);
+    _ahead = (_ahead + 1) % UPLOAD_BUFFERS;
+    _acount--;
+  }
+}
+
+uint8_t ILI9341Upload::receive (
+  uint8_t c       /* Byte from the link */
+)
+{
+  uint8_t t = (_head + _count) % UPLOAD_BUFFERS;
+
+
+  switch (_rstate) {
+  case RS_SEQ:
+    _rseq = c;
+    _sum = c;
+    _rstate = RS_LEN0;
+    break;
+  case RS_LEN0:
+    _rlen = c;
+    _sum += c;
+    _rstate = RS_LEN1;
+    break;
+  case RS_LEN1:
+    _rlen |= (uint16_t) c << 8;
+    _sum += c;
+    if (_rlen == 0 || _rlen > UPLOAD_CHUNK || _acount == UPLOAD_BUFFERS) return UPLOAD_E_PROTOCOL;
+    _rn = 0;
+    _rstate = RS_DATA;
+    break;
+  case RS_DATA:
+    _buf[t][_rn] = c;   /* A chunk answered by a NAK only takes the buffer while received */
+    _sum += c;
+    if (++_rn == _rlen) _rstate = RS_SUM0;
+    break;
+  case RS_SUM0:
+    _rsum = c;
+    _rstate = RS_SUM1;
+    break;
+  case RS_SUM1:
+    _rsum |= (uint16_t) c << 8;
+    if (_rsum == _sum && _rseq == _seq) {
+      _len[t] = _rlen;
+      _count++;
+      _seq++;
+      answer(ANS_ACK);  /* Sent once drawn */
+    } else {
+      _stats.naks++;
+      answer(ANS_NAK(_seq));
+    }
+    _rstate = RS_SEQ;
+    break;
+  }
+  return UPLOAD_OK;
+}
+
+uint8_t ILI9341Upload::draw (
+  const uint8_t *p, /* Data */
+  uint8_t n       /* Number of bytes */
+)
+{
+  uint16_t color;
+
+
+  while (n--) {
+    if (_format == UPLOAD_RLE && !_run) {   /* Packet header */
+      _lit = !(*p & 0x80);
+      _run = (*p++ & 0x7F) + 1;
+      if (_run > _left) return UPLOAD_E_DATA;
+      continue;
+    }
+    if (!_half) {       /* Pixels may straddle chunks */
+      if (!_left) return UPLOAD_E_DATA;
+      _hi = *p++;
+      _half = 1;
+      continue;
+    }
+    color = (uint16_t) _hi << 8 | *p++;
+    _half = 0;
+    if (_format == UPLOAD_RAW || _lit) {
+      _tft.write_pixel(color);
+      _left--;
+      if (_run) _run--;
+    } else {
+      _tft.write_pixels(color, _run);
+      _left -= _run;
+      _run = 0;
+    }
+  }
+  return UPLOAD_OK;
+}
+
+uint8_t ILI9341Upload::run (
+  int left,       /* Left end (0..width-1) */
+  int right,      /* Right end (0..width-1, >=left) */
+  int top,        /* Top end (0..height-1) */
+  int bottom,     /* Bottom end (0..height-1, >=top) */
+  uint8_t format  /* UPLOAD_RAW or UPLOAD_RLE */
+)
+{
+  uint8_t msg[5], n, st = UPLOAD_OK;
+  unsigned long t0, last;
+
+
+  memset(&_stats, 0, sizeof(_stats));
+  if (left < 0 || right >= _tft.get_width() || left > right ||
+      top < 0 || bottom >= _tft.get_height() || top > bottom) return UPLOAD_E_AREA;
+
+  _head = _count = 0;
+  _pos = 0;
+  _ahead = _acount = 0;
+  _rstate = RS_SEQ;
+  _seq = 0;
+  _format = format;
+  _left = (uint32_t) (right - left + 1) * (bottom - top + 1);
+  _half = 0;
+  _run = 0;
+
+  _tft.begin_write(left, right, top, bottom);
+  msg[0] = UPLOAD_MAGIC0; msg[1] = UPLOAD_MAGIC1;
+  msg[2] = (uint8_t) UPLOAD_CHUNK; msg[3] = UPLOAD_CHUNK >> 8;
+  msg[4] = UPLOAD_BUFFERS;
+  _link.xwrite(msg, 5);
+
+  t0 = last = millis();
+  while (st == UPLOAD_OK && _left) {
+    /* Take what the link has, a slice at most, so that its buffer never
+       overflows while a chunk is drawn */
+    for (n = 0; n < UPLOAD_SLICE && _link.xready(); n++) {
+      if ((st = receive((uint8_t) _link.xgetc())) != UPLOAD_OK) break;
+    }
+    if (n) last = millis();
+
+    if (st == UPLOAD_OK && _count) {    /* Then draw a slice of the oldest chunk */
+      n = _len[_head] - _pos > UPLOAD_SLICE ? UPLOAD_SLICE : _len[_head] - _pos;
+      st = draw(&_buf[_head][_pos], n);
+      if ((_pos += n) == _len[_head] && st == UPLOAD_OK) {
+        _stats.bytes += _len[_head];
+        _stats.chunks++;
+        msg[0] = UPLOAD_ACK;
+        _link.xwrite(msg, 1);
+        _ahead = (_ahead + 1) % UPLOAD_BUFFERS;
+        _acount--;
+        flush();
+        _head = (_head + 1) % UPLOAD_BUFFERS;
+        _count--;
+        _pos = 0;
+        last = millis();
+      }
+    } else if (st == UPLOAD_OK && millis() - last > UPLOAD_TIMEOUT) {
+      st = UPLOAD_E_TIMEOUT;
+    }
+  }
+  _tft.end_write();
+  if (st == UPLOAD_OK && (_pos || _count || _rstate != RS_SEQ)) st = UPLOAD_E_DATA;  /* Data past the last pixel */
+  _stats.ms = millis() - t0;
+
+  msg[0] = UPLOAD_MAGIC0; msg[1] = UPLOAD_END1;
+  msg[2] = st;
+  _link.xwrite(msg, 3);
+  return st;
+}
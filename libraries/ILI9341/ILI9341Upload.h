@@ -0,0 +1,119 @@
+#ifndef ILI9341Upload_h
+#define ILI9341Upload_h
+
+#include <inttypes.h>
+
+#include "ILI9341.h"
+#include "XUtils.h"
+
+/* Pixel formats */
+#define UPLOAD_RAW      0   /* RGB565, most significant byte first */
+#define UPLOAD_RLE      1   /* Packets of the capture stream (see ILI9341::capture()) */
+
+/* Largest chunk and number of chunk buffers (the credits of the host) */
+#define UPLOAD_CHUNK    128
+#define UPLOAD_BUFFERS  2
+
+/* Longest silence of the host (ms) */
+#define UPLOAD_TIMEOUT  2000
+
+/* Bytes received, then drawn, at most between turns */
+#define UPLOAD_SLICE    32
+
+/* Upload status */
+#define UPLOAD_OK         0
+#define UPLOAD_E_TIMEOUT  1   /* The host went silent */
+#define UPLOAD_E_PROTOCOL 2   /* Bad chunk length, or more chunks than credits */
+#define UPLOAD_E_DATA     3   /* Pixel data past the end of the area */
+#define UPLOAD_E_AREA     4   /* Area off the display */
+
+/* Link protocol, integers little endian:
+ *   unit: 'U' 'P', chunk size (16 bits), credits (8 bits)
+ *   host: chunks, no more unanswered than the credits:
+ *           sequence number (8 bits, from 0), length (16 bits, 1..chunk size),
+ *           data, 16-bit sum of the bytes from the sequence number on
+ *   unit: an answer per chunk, in the order of the chunks, giving its
+ *         credit back:
+ *           ACK (0x06) once the chunk is drawn, or
+ *           NAK (0x15) and the sequence number expected, the chunk being
+ *           dropped for a checksum mismatch or as out of sequence: the host
+ *           sends again from the chunk expected, the chunks it sent in
+ *           between getting a NAK too
+ *   unit: after the last pixel or on an error, 'U' 'E', status (8 bits) */
+#define UPLOAD_MAGIC0   'U'
+#define UPLOAD_MAGIC1   'P'
+#define UPLOAD_END1     'E'
+#define UPLOAD_ACK      0x06
+#define UPLOAD_NAK      0x15
+
+typedef struct {
+  unsigned long bytes;      /* Pixel data bytes drawn */
+  unsigned long ms;         /* Time taken */
+  uint16_t chunks;          /* Chunks drawn */
+  uint16_t naks;            /* Chunks refused */
+} ILI9341_upload_stats_t;
+
+/*
+ * Receiver of pixel data sent by a host over a link (e.g. the console)
+ * straight into a display window. Chunks are received into one buffer
+ * while another is drawn, a slice at a time, so that the host keeps
+ * sending while the display is written.
+ */
+class ILI9341Upload {
+  public:
+    /**
+     * Constructor
+     *
+     * @param tft Display
+     * @param link Link to the host
+     */
+    ILI9341Upload (ILI9341 &tft, XUtils &link): _tft(tft), _link(link) { };
+
+    /**
+     * Receive pixel data into an area, until it is full or on an error
+     *
+     * @param left Left end (0..width-1)
+     * @param right Right end (0..width-1, >= left)
+     * @param top Top end (0..height-1)
+     * @param bottom Bottom end (0..height-1, >= top)
+     * @param format UPLOAD_RAW or UPLOAD_RLE
+     * @return UPLOAD_OK or UPLOAD_E_xxx
+     */
+    uint8_t run (int left, int right, int top, int bottom, uint8_t format);
+
+    /**
+     * Get statistics of the last upload
+     *
+     * @param stats Statistics
+     */
+    void get_stats (ILI9341_upload_stats_t *stats) { *stats = _stats; };
+
+  private:
+    uint8_t receive (uint8_t c);
+    uint8_t draw (const uint8_t *p, uint8_t n);
+    void answer (uint16_t a);
+    void flush (void);
+
+    ILI9341 &_tft;
+    XUtils &_link;
+    ILI9341_upload_stats_t _stats;
+
+    uint8_t _buf[UPLOAD_BUFFERS][UPLOAD_CHUNK];
+    uint16_t _len[UPLOAD_BUFFERS];
+    uint8_t _head, _count;    /* Buffer drawn, buffers full */
+    uint16_t _pos;            /* Next byte drawn */
+    uint16_t _ans[UPLOAD_BUFFERS];  /* Answers due, in the order of the chunks */
+    uint8_t _ahead, _acount;
+
+    uint8_t _rstate;          /* Receiver state */
+    uint8_t _seq, _rseq;      /* Sequence number expected, received */
+    uint16_t _rn, _rlen;      /* Bytes received, length */
+    uint16_t _sum, _rsum;     /* Sum computed, received */
+
+    uint8_t _format;
+    uint32_t _left;           /* Pixels left */
+    uint8_t _hi, _half;       /* Pixel: first byte, 1: first byte received */
+    uint8_t _run, _lit;       /* RLE: pixels left in the packet, 1: literal */
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "Arduino.h"
 #include "Wire.h"
 #include "RTC.h"
+#include "XPerf.h"
 
 byte RTC::decToBcd (byte val)
 {
@@ -30,12 +31,16 @@ byte RTC::init (void)
 
 byte RTC::gettime (TIME_t *t)
 {
+  XPERF_SCOPE(XPERF_RTC_GETTIME);
+
   Wire.beginTransmission(_address);
   Wire.write(0x00);
   if (Wire.endTransmission()) return 0;
+  XPERF_BYTES(1);
 
   Wire.requestFrom(_address, (uint8_t) 7);
   if (Wire.available() < 7) return 0;
+  XPERF_BYTES(7);
 
   t->sec = bcdToDec(Wire.read());
   t->min = bcdToDec(Wire.read());
@@ -50,6 +55,8 @@ byte RTC::gettime (TIME_t *t)
 
 byte RTC::settime (TIME_t *t)
 {
+  XPERF_SCOPE(XPERF_RTC_SETTIME);
+
   Wire.beginTransmission(_address);
   Wire.write(0x00);
   Wire.write(decToBcd(t->sec));
@@ -60,6 +67,60 @@ byte RTC::settime (TIME_t *t)
   Wire.write(decToBcd(t->month));
   Wire.write(decToBcd(t->year - 2000));
   if (Wire.endTransmission()) return 0;
+  XPERF_BYTES(8);
 
   return 1;
 }
+
+/* Days before the first of each month in a non-leap year */
+static const PROGMEM uint16_t mdays[] = {
+  0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+unsigned long RTC::toepoch (const TIME_t *t)
+{
+  word y = t->year - 2000;
+  unsigned long days;
+
+  days = y * 365UL + (y + 3) / 4 + pgm_read_word(&mdays[t->month - 1]) + t->mday - 1;
+  if (t->month > 2 && !(y & 3)) days++;   /* Past February 29th of a leap year */
+
+  return ((days * 24 + t->hour) * 60 + t->min) * 60 + t->sec;
+}
+
+void RTC::fromepoch (unsigned long epoch, TIME_t *t)
+{
+  unsigned long days;
+  word y, yd, md;
+  byte m, leap;
+
+  t->sec = epoch % 60; epoch /= 60;
+  t->min = epoch % 60; epoch /= 60;
+  t->hour = epoch % 24;
+  days = epoch / 24;
+
+  t->wday = (days + 6) % 7 + 1;   /* 2000-01-01 was a Saturday (1: Sunday) */
+
+  /* Years come in blocks of 1461 days, the first of which is a leap year */
+  y = (days / 1461) * 4;
+  days %= 1461;
+  if (days >= 366) {
+    days -= 366;
+    y += 1 + days / 365;
+    days %= 365;
+  }
+  leap = !(y & 3);
+  yd = days;
+
+  for (m = 11; m > 0; m--) {
+    md = pgm_read_word(&mdays[m]);
+    if (leap && m > 1) md++;
+    if (yd >= md) break;
+  }
+  md = pgm_read_word(&mdays[m]);
+  if (leap && m > 1) md++;
+
+  t->year = 2000 + y;
+  t->month = m + 1;
+  t->mday = yd - md + 1;
+}
@@ -23,6 +23,10 @@ class RTC {
     byte gettime (TIME_t *t);
     byte settime (TIME_t *t);
 
+    /* Seconds since 2000-01-01 00:00:00 (years 2000..2099) */
+    static unsigned long toepoch (const TIME_t *t);
+    static void fromepoch (unsigned long epoch, TIME_t *t);
+
   private:
     byte decToBcd (byte val);
     byte bcdToDec (byte val);
@@ -5,18 +5,22 @@
  * can be used just after a call to Wire.begin() is
  * made - usually in setup().
  *
+ * gettemp() waits for a conversion to complete; for
+ * non-blocking use call poll() regularly (optionally
+ * with the DRDY pin attached) and read the most recent
+ * sample with latest() or getsample().
+ *
+ * The *_fixed() variants perform the same conversion
+ * in integer arithmetic, avoiding the floating point
+ * library altogether.
+ *
  * (C) 2016 Luigi Di Fraia
  */
 
 #include "Arduino.h"
 #include "Wire.h"
 #include "TMP006.h"
-
-#define WIRE_READ_WORD_MSB()  (((uint16_t) Wire.read() << 8) | Wire.read())
-
-/* TMP006 address */
-
-const PROGMEM uint8_t tmp006_i2c_address = 0x40;
+#include "XPerf.h"
 
 /* TMP006 registers */
 
@@ -28,57 +32,195 @@ const PROGMEM uint8_t tmp006_i2c_address = 0x40;
 
 /* TMP006 conversion constants */
 
-const PROGMEM double s0   =  6e-14;
-const PROGMEM double a1   =  1.75e-3;
-const PROGMEM double a2   = -1.678e-5;
 const PROGMEM double tref =  298.15;
-const PROGMEM double b0   = -2.94e-5;
-const PROGMEM double b1   = -5.7e-7;
-const PROGMEM double b2   =  4.63e-9;
-const PROGMEM double c2   =  13.4;
 
-byte TMP006::tmp006_test (void)
+const PROGMEM TMP006_cal_t tmp006_default_cal = {
+  6e-14,      /* s0 */
+  1.75e-3,    /* a1 */
+  -1.678e-5,  /* a2 */
+  -2.94e-5,   /* b0 */
+  -5.7e-7,    /* b1 */
+  4.63e-9,    /* b2 */
+  13.4        /* c2 */
+};
+
+/* Fixed-point equivalents of the default constants above, with the
+   sensor voltage kept in LSBs (156.25 nV) and the die temperature in
+   1/128 K units (see convert_fixed() for the scaling of each term) */
+
+#define FX_TK0    34963   /* 273.15 K << 7 */
+#define FX_TREF   38163   /* tref << 7 */
+#define FX_A1     14680   /* a1 << 23 */
+#define FX_A2     -1126   /* a2 << 26 */
+#define FX_B0    -48169   /* b0 / 156.25 nV << 8 */
+#define FX_B1     -1868   /* b1 / 156.25 nV << 9 */
+#define FX_B2      1942   /* b2 / 156.25 nV << 16 */
+#define FX_C2       562   /* c2 * 156.25 nV << 28 */
+#define FX_S0     20345   /* 156.25 nV / s0 >> 7 */
+
+/*----------------------------------------------*/
+/* Rounds v into *r, 0 if out of [lo, hi]       */
+/*----------------------------------------------*/
+
+static byte fxround (double v, long lo, long hi, long *r)
 {
-  uint16_t conf;
+  if (!(v > lo - 0.5 && v < hi + 0.5)) return 0;  /* NaN too */
+  *r = lround(v);
 
-  Wire.beginTransmission(tmp006_i2c_address);
-  Wire.write(TMP006_REG_CONFIG);
+  return 1;
+}
+
+/*----------------------------------------------*/
+/* (a * b) >> 16, rounded, without 64-bit math  */
+/*----------------------------------------------*/
+
+static int32_t fxmul (int32_t a, uint16_t b)
+{
+  uint32_t m;
+
+  m = a < 0 ? 0 - (uint32_t) a : (uint32_t) a;
+  m = (m >> 16) * b + (((m & 0xFFFF) * b + 0x8000) >> 16);
+
+  return a < 0 ? -(int32_t) m : (int32_t) m;
+}
+
+/*----------------------------------------------*/
+/* Same with a signed b                         */
+/*----------------------------------------------*/
+
+static int32_t fxmuls (int32_t a, int16_t b)
+{
+  return b < 0 ? -fxmul(a, (uint16_t) -b) : fxmul(a, b);
+}
+
+/*----------------------------------------------*/
+/* Rounded integer square root                  */
+/*----------------------------------------------*/
+
+static uint32_t isqrt32 (uint32_t x)
+{
+  uint32_t r = 0, b = 0x40000000;
+
+  while (b > x) b >>= 2;
+  while (b) {
+    if (x >= r + b) {
+      x -= r + b;
+      r = (r >> 1) + b;
+    } else {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+  if (x > r && r < 0xFFFF) r++;
+
+  return r;
+}
+
+TMP006::TMP006 (uint8_t address): _address(address), _drdy(TMP006_NO_PIN), _pending(0), _head(0), _count(0)
+{
+  set_calibration(0);
+}
+
+byte TMP006::set_calibration (
+  const TMP006_cal_t *cal   /* Calibration constants (kept by reference), NULL for defaults */
+)
+{
+  long a1, a2, b0, b1, b2, c2, s0;
+
+
+  if (!cal) {
+    _cal = 0;
+    _fx.a1 = FX_A1;
+    _fx.a2 = FX_A2;
+    _fx.b0 = FX_B0;
+    _fx.b1 = FX_B1;
+    _fx.b2 = FX_B2;
+    _fx.c2 = FX_C2;
+    _fx.s0 = FX_S0;
+    return 1;
+  }
+
+  /* Same scaling as the FX_ defaults, each within its field */
+  if (!fxround(cal->a1 * 8388608.0, INT16_MIN, INT16_MAX, &a1) ||
+      !fxround(cal->a2 * 67108864.0, INT16_MIN, INT16_MAX, &a2) ||
+      !fxround(cal->b0 / 156.25e-9 * 256.0, INT32_MIN, INT32_MAX, &b0) ||
+      !fxround(cal->b1 / 156.25e-9 * 512.0, INT16_MIN, INT16_MAX, &b1) ||
+      !fxround(cal->b2 / 156.25e-9 * 65536.0, INT16_MIN, INT16_MAX, &b2) ||
+      !fxround(cal->c2 * 156.25e-9 * 268435456.0, INT16_MIN, INT16_MAX, &c2) ||
+      !fxround(156.25e-9 / cal->s0 / 128.0, 0, UINT16_MAX, &s0))
+    return 0;   /* The calibration in use is kept */
+
+  _cal = cal;
+  _fx.a1 = a1;
+  _fx.a2 = a2;
+  _fx.b0 = b0;
+  _fx.b1 = b1;
+  _fx.b2 = b2;
+  _fx.c2 = c2;
+  _fx.s0 = s0;
+  return 1;
+}
+
+byte TMP006::readreg (uint8_t reg, uint16_t *val)
+{
+  uint8_t msb;
+
+  Wire.beginTransmission(_address);
+  Wire.write(reg);
   if (Wire.endTransmission()) return 0;
+  XPERF_BYTES(1);
 
-  Wire.requestFrom(tmp006_i2c_address, (uint8_t) 2);
+  Wire.requestFrom(_address, (uint8_t) 2);
   if (Wire.available() < 2) return 0;
+  XPERF_BYTES(2);
+
+  msb = Wire.read();
+  *val = ((uint16_t) msb << 8) | Wire.read();
+
+  return 1;
+}
+
+byte TMP006::tmp006_test (void)
+{
+  uint16_t conf;
 
-  conf = WIRE_READ_WORD_MSB();
+  if (!readreg(TMP006_REG_CONFIG, &conf)) return 0;
 
   return (conf & TMP006_CFG_DRDY); // test if results are ready to read
 }
 
-byte TMP006::gettemp (TMP006_t *tmp006)
+byte TMP006::readraw (TMP006_raw_t *raw)
 {
-  uint8_t cnt;
+  uint16_t val;
+
+  /* Reading the result registers also releases the DRDY line */
+  if (!readreg(TMP006_REG_VOBJ, &val)) return 0;
+  raw->vobj = (int16_t) val;
+
+  if (!readreg(TMP006_REG_TAMB, &val)) return 0;
+  raw->tamb = (int16_t) val;
+
+  return 1;
+}
+
+void TMP006::convert (const TMP006_raw_t *raw, TMP006_t *tmp006)
+{
+  TMP006_cal_t cal;
   uint16_t regsensorvolt, regdietemp;
   double vobj, tdie, tdie_tref;
   double s, vobj_vos, fvobj, tobj;
+  XPERF_SCOPE(XPERF_TMP006_CONVERT);
 
-  for (cnt = 20; cnt > 0; cnt--) { // 5 seconds timeout
-    if (tmp006_test())
-      break;
-    delay(250);
-  }
-  if (!cnt) return 0;
-
-  Wire.beginTransmission(tmp006_i2c_address);
-  Wire.write(TMP006_REG_VOBJ);
-  if (Wire.endTransmission()) return 0;
-
-  Wire.requestFrom(tmp006_i2c_address, (uint8_t) 2);
-  if (Wire.available() < 2) return 0;
+  if (_cal)
+    cal = *_cal;
+  else
+    memcpy_P(&cal, &tmp006_default_cal, sizeof(cal));
 
   /* From datasheet: If the MSB is '1', the integer is negative and the absolute 
      value can be obtained by inverting all bits and adding '1'. An alternative 
      method of calculating the absolute value of negative integers is abs(i) = i 
      xor FFFFh + 1. */
-  regsensorvolt = WIRE_READ_WORD_MSB();
+  regsensorvolt = (uint16_t) raw->vobj;
   if (regsensorvolt & 0x8000)
     vobj = -1.0 * ((regsensorvolt ^0xFFFF) + 1);
   else
@@ -89,14 +231,7 @@ byte TMP006::gettemp (TMP006_t *tmp006)
   vobj /= 1000; // uV -> mV
   vobj /= 1000; // mV -> V
 
-  Wire.beginTransmission(tmp006_i2c_address);
-  Wire.write(TMP006_REG_TAMB);
-  if (Wire.endTransmission()) return 0;
-
-  Wire.requestFrom(tmp006_i2c_address, (uint8_t) 2);
-  if (Wire.available() < 2) return 0;
-
-  regdietemp = WIRE_READ_WORD_MSB();
+  regdietemp = (uint16_t) raw->tamb;
   if (regdietemp & 0x8000)
     tdie = -1.0 * (((regdietemp ^ 0xFFFF) >> 2) + 1);
   else
@@ -106,34 +241,242 @@ byte TMP006::gettemp (TMP006_t *tmp006)
   tdie += 273.15; // convert to Kelvin
 
   tdie_tref = tdie - tref;
-  s = s0 * (1 + a1 * tdie_tref + a2 * tdie_tref * tdie_tref);
-  vobj_vos = vobj - (b0 + b1 * tdie_tref + b2 * tdie_tref * tdie_tref);
-  fvobj = vobj_vos + c2 * vobj_vos * vobj_vos;
+  s = cal.s0 * (1 + cal.a1 * tdie_tref + cal.a2 * tdie_tref * tdie_tref);
+  vobj_vos = vobj - (cal.b0 + cal.b1 * tdie_tref + cal.b2 * tdie_tref * tdie_tref);
+  fvobj = vobj_vos + cal.c2 * vobj_vos * vobj_vos;
   tobj = sqrt(sqrt((tdie * tdie * tdie * tdie) + (fvobj / s)));
 
   tmp006->tdie = tdie - 273.15; // convert to Celsius
   tmp006->tobj = tobj - 273.15; // convert to Celsius
+}
+
+void TMP006::convert_fixed (const TMP006_raw_t *raw, TMP006_fixed_t *tmp006)
+{
+  int16_t t14;
+  uint16_t tk;
+  int32_t dt, dt2, s, vos, vv, vi, fvobj, y, tobj;
+  uint32_t tk2, is, yn;
+  uint8_t e;
+  XPERF_SCOPE(XPERF_TMP006_CONVERT_FX);
+
+  t14 = raw->tamb >> 2; // 0.03125 Celsius per LSB
+  tk = (uint16_t) (t14 * 4 + FX_TK0); // Kelvin << 7
+
+  dt = (int32_t) tk - FX_TREF; // (tdie - tref) << 7
+  dt2 = (dt * dt) >> 10; // (tdie - tref)^2 << 4
+
+  /* s / s0 << 14 and vos in LSBs << 8; the dt2 products would not fit
+     32 bits with a large a2 or b2 near the ends of the range */
+  s = 16384 + ((dt * _fx.a1) >> 16) + fxmuls(dt2, _fx.a2);
+  vos = _fx.b0 + ((dt * _fx.b1) >> 8) + fxmuls(dt2 << 4, _fx.b2);
+
+  /* f(vobj) in LSBs << 8 */
+  vv = (int32_t) raw->vobj * 256 - vos;
+  vi = (vv + 128) >> 8;
+  fvobj = vv + (int32_t) (((((uint32_t) (vi * vi)) >> 8) * _fx.c2) >> 12);
+
+  /* Work on (T / 256)^4 << 16, i.e. in units of 65536 K^4 */
+  is = (((uint32_t) 1 << 29) + (s >> 1)) / s; // s0 / s << 15
+  tk2 = (uint32_t) tk * tk; // tdie^2 << 14
+  y = fxmul((tk2 + 0x800) >> 12, (tk2 + 0x8000) >> 16) + fxmul(fxmul(fvobj, _fx.s0), is);
+
+  /* Fourth root as two square roots, normalizing the argument first so that
+     each of them yields 16 significant bits; result is tobj in Kelvin << 8 */
+  if (y > 0) {
+    e = 0;
+    yn = y;
+    while (yn < 0x10000000) {
+      yn <<= 4;
+      e++;
+    }
+    tobj = isqrt32(isqrt32(yn) << 16);
+    tobj = e > 4 ? (tobj + (1 << (e - 5))) >> (e - 4) : tobj << (4 - e);
+  } else {
+    tobj = 0;
+  }
+
+  tmp006->tdie = ((int32_t) t14 * 25 + 4) >> 3; // 3.125 hundredths per LSB
+  tmp006->tobj = ((tobj * 100 + 128) >> 8) - 27315; // convert to Celsius
+}
+
+byte TMP006::gettemp (TMP006_t *tmp006)
+{
+  uint8_t cnt;
+  TMP006_raw_t raw;
+  XPERF_SCOPE(XPERF_TMP006_GETTEMP);
+
+  for (cnt = 20; cnt > 0; cnt--) { // 5 seconds timeout
+    if (tmp006_test())
+      break;
+    delay(250);
+  }
+  if (!cnt) return 0;
+
+  if (!readraw(&raw)) return 0;
+
+  convert(&raw, tmp006);
+
+  return 1;
+}
+
+byte TMP006::gettemp_fixed (TMP006_fixed_t *tmp006)
+{
+  uint8_t cnt;
+  TMP006_raw_t raw;
+  XPERF_SCOPE(XPERF_TMP006_GETTEMP);
+
+  for (cnt = 20; cnt > 0; cnt--) { // 5 seconds timeout
+    if (tmp006_test())
+      break;
+    delay(250);
+  }
+  if (!cnt) return 0;
+
+  if (!readraw(&raw)) return 0;
+
+  convert_fixed(&raw, tmp006);
+
+  return 1;
+}
+
+void TMP006::attach_drdy (uint8_t pin)
+{
+  _drdy = pin;
+  if (pin != TMP006_NO_PIN)
+    pinMode(pin, INPUT_PULLUP);  /* DRDY is an open drain output */
+}
+
+byte TMP006::poll (void)
+{
+  TMP006_sample_t *sample;
+  XPERF_SCOPE(XPERF_TMP006_POLL);
+
+  if (_drdy != TMP006_NO_PIN) {
+    /* Cheap test: no bus traffic until the DRDY line is pulled low */
+    if (!_pending && digitalRead(_drdy) != LOW) return 0;
+  } else {
+    if (!tmp006_test()) return 0;
+  }
+  _pending = 0;
+
+  sample = &_ring[_head];
+  if (!readraw(&sample->raw)) return 0;
+  sample->ms = millis();
+
+  if (++_head == TMP006_RING_SIZE) _head = 0;
+  if (_count < TMP006_RING_SIZE) _count++;
+
+  return 1;
+}
+
+byte TMP006::getsample (
+  uint8_t age,              /* 0: most recent sample, 1: the one before, ... */
+  TMP006_sample_t *sample
+)
+{
+  uint8_t i;
+
+  if (age >= _count) return 0;
+
+  i = _head + TMP006_RING_SIZE - 1 - age;
+  if (i >= TMP006_RING_SIZE) i -= TMP006_RING_SIZE;
+  *sample = _ring[i];
+
+  return 1;
+}
+
+byte TMP006::latest (TMP006_t *tmp006)
+{
+  TMP006_sample_t sample;
+
+  if (!getsample(0, &sample)) return 0;
+
+  convert(&sample.raw, tmp006);
+
+  return 1;
+}
+
+byte TMP006::latest_fixed (TMP006_fixed_t *tmp006)
+{
+  TMP006_sample_t sample;
+
+  if (!getsample(0, &sample)) return 0;
+
+  convert_fixed(&sample.raw, tmp006);
 
   return 1;
 }
 
 byte TMP006::setconfig (uint16_t mode)
 {
-  Wire.beginTransmission(tmp006_i2c_address);
+  byte ret;
+
+  Wire.beginTransmission(_address);
   Wire.write(TMP006_REG_CONFIG);
   Wire.write(mode >> 8);
   Wire.write(mode);
-  return Wire.endTransmission();
+  ret = Wire.endTransmission();
+  if (!ret) XPERF_BYTES(3);
+
+  return ret;
 }
 
 byte TMP006::init (uint16_t samples)
 {
   byte ret;
 
-  Wire.beginTransmission(tmp006_i2c_address);
+  Wire.beginTransmission(_address);
   ret = Wire.endTransmission();
   if (ret) return ret;
 
   /* Enable continuous conversion */
   return setconfig(TMP006_CFG_MODEON | samples);
 }
+
+/*----------------------------------------------*/
+/* Sensor array: batched start and round-robin  */
+/* collection of conversions                    */
+/*----------------------------------------------*/
+
+byte TMP006Array::add (  /* Index of the sensor, 0xFF if the array is full */
+  TMP006 *sensor
+)
+{
+  if (_num >= TMP006_ARRAY_MAX) return 0xFF;
+
+  _sensors[_num] = sensor;
+  return _num++;
+}
+
+byte TMP006Array::start (  /* Number of sensors that acknowledged */
+  uint16_t samples
+)
+{
+  uint8_t i, n = 0;
+
+  /* Configure all sensors back to back so that their conversions run in step */
+  for (i = 0; i < _num; i++) {
+    if (_sensors[i]->init(samples | TMP006_CFG_DRDYEN) == 0)
+      n++;
+  }
+  _next = 0;
+
+  return n;
+}
+
+int8_t TMP006Array::poll (void)  /* Index of the sensor a sample was collected from, -1 if none */
+{
+  uint8_t i, n;
+
+  /* Start past the sensor served last so that none of them gets starved */
+  for (n = 0, i = _next; n < _num; n++) {
+    if (i >= _num) i = 0;
+    if (_sensors[i]->poll()) {
+      _next = i + 1;
+      return i;
+    }
+    i++;
+  }
+
+  return -1;
+}
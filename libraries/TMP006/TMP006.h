@@ -3,6 +3,15 @@
 
 #include <inttypes.h>
 
+/* Number of samples kept by the asynchronous sampling ring buffer */
+#define TMP006_RING_SIZE  4
+
+/* Maximum number of sensors handled by a TMP006Array */
+#define TMP006_ARRAY_MAX  8
+
+/* Addresses selected by the ADR0/ADR1 pins range from 0x40 to 0x47 */
+#define TMP006_I2C_ADDRESS 0x40
+
 /* The TMP006's sampling rate is 250 ms per sample, so it takes 4 seconds to average 16 samples (TMP006_CFG_16SAMPLE) */
 
 #define TMP006_CFG_1SAMPLE  0x0000
@@ -16,19 +25,95 @@
 #define TMP006_CFG_DRDYEN  0x0100
 #define TMP006_CFG_DRDY    0x0080
 
+/* No DRDY pin attached: poll() falls back to reading the config register */
+#define TMP006_NO_PIN      0xFF
+
 typedef struct {
 	double	tobj;
 	double	tdie;
 } TMP006_t;
 
+typedef struct {
+	int16_t	tobj;	/* Hundredths of a degree Celsius */
+	int16_t	tdie;	/* Hundredths of a degree Celsius */
+} TMP006_fixed_t;
+
+typedef struct {
+	double	s0;	/* Sensitivity (datasheet default 6e-14) */
+	double	a1;
+	double	a2;
+	double	b0;	/* Offset voltage coefficients */
+	double	b1;
+	double	b2;
+	double	c2;	/* Seebeck coefficient */
+} TMP006_cal_t;
+
+typedef struct {
+	int16_t	vobj;	/* Sensor voltage register (156.25 nV per LSB) */
+	int16_t	tamb;	/* Die temperature register (0.03125 C per LSB, left aligned by 2 bits) */
+} TMP006_raw_t;
+
+typedef struct {
+	unsigned long	ms;	/* millis() when the conversion was collected */
+	TMP006_raw_t	raw;
+} TMP006_sample_t;
+
 class TMP006 {
   public:
+    TMP006 (uint8_t address = TMP006_I2C_ADDRESS);
     byte init (uint16_t samples);
     byte setconfig (uint16_t mode);
     byte gettemp (TMP006_t *tmp006);
+    byte gettemp_fixed (TMP006_fixed_t *tmp006);
+
+    /* Asynchronous sampling (init with TMP006_CFG_DRDYEN for the DRDY pin to be driven) */
+    void attach_drdy (uint8_t pin);
+    void drdy_isr (void) { _pending = 1; };
+    byte poll (void);
+    byte available (void) { return _count; };
+    byte getsample (uint8_t age, TMP006_sample_t *sample);
+    byte latest (TMP006_t *tmp006);
+    byte latest_fixed (TMP006_fixed_t *tmp006);
+
+    /* Per-sensor calibration (NULL restores the datasheet defaults), 0 if a
+       constant is out of the fixed-point range (the one in use is kept) */
+    byte set_calibration (const TMP006_cal_t *cal);
+    void convert (const TMP006_raw_t *raw, TMP006_t *tmp006);
+    void convert_fixed (const TMP006_raw_t *raw, TMP006_fixed_t *tmp006);
 
   private:
     byte tmp006_test (void);
+    byte readreg (uint8_t reg, uint16_t *val);
+    byte readraw (TMP006_raw_t *raw);
+
+    uint8_t _address;
+    const TMP006_cal_t *_cal;   /* Calibration in use, NULL for defaults */
+    struct {                    /* Calibration scaled for convert_fixed() */
+      int16_t a1, a2;
+      int32_t b0;
+      int16_t b1, b2, c2;
+      uint16_t s0;
+    } _fx;
+    uint8_t _drdy;              /* DRDY pin (active low, open drain) */
+    volatile uint8_t _pending;  /* Set from the DRDY interrupt handler */
+    uint8_t _head;              /* Ring slot for the next sample */
+    uint8_t _count;             /* Samples held in the ring */
+    TMP006_sample_t _ring[TMP006_RING_SIZE];
+};
+
+class TMP006Array {
+  public:
+    TMP006Array (void): _num(0), _next(0) { };
+    byte add (TMP006 *sensor);
+    byte start (uint16_t samples);
+    int8_t poll (void);
+    byte size (void) { return _num; };
+    TMP006 *sensor (byte i) { return i < _num ? _sensors[i] : 0; };
+
+  private:
+    TMP006 *_sensors[TMP006_ARRAY_MAX];
+    uint8_t _num;   /* Sensors registered */
+    uint8_t _next;  /* First sensor looked at by the next poll() */
 };
 
 #endif
@@ -17,7 +17,9 @@ class XConsole: public XUtils {
     XConsole(Serial_& serial = Serial): _serial(serial) { };
 #endif
     virtual char xgetc (void);
+    virtual byte xready (void);
     virtual void xputc (char c);
+    virtual void xwrite (const uint8_t* buf, int len);
 
 #if EXPOSE_PRINT_INTERFACE
     inline size_t xprint(const __FlashStringHelper *ifsh) { _serial.print(ifsh); };
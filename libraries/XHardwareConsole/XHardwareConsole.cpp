@@ -6,6 +6,7 @@
 
 #include "Arduino.h"
 #include "XHardwareConsole.h"
+#include "XPerf.h"
 
 /*----------------------------------------------*/
 /* Get a char from the input stream             */
@@ -25,6 +26,19 @@ char XHardwareConsole::xgetc (void) {
   }
 }
 
+/*----------------------------------------------*/
+/* Check whether xgetc() would return at once   */
+/*----------------------------------------------*/
+
+byte XHardwareConsole::xready (void) {
+  if (_serial.available()) return 1;
+#if CAN_DETECT_SERIAL_DISCONNECT
+  /* Make sense if disconnection can be detected */
+  if (!_serial.dtr()) return 1;   /* xgetc() reports end of stream */
+#endif
+  return 0;
+}
+
 /*----------------------------------------------*/
 /* Put a char into the output stream            */
 /*----------------------------------------------*/
@@ -39,6 +53,7 @@ void XHardwareConsole::xputc (
   for (;;) {
     if (_serial.availableForWrite()) {
       _serial.write(c);
+      XPERF_BYTES(1);
       return;
     } else {
 #if CAN_DETECT_SERIAL_DISCONNECT
@@ -49,3 +64,16 @@ void XHardwareConsole::xputc (
     }
   }
 }
+
+/*----------------------------------------------*/
+/* Put raw bytes into the output stream         */
+/*----------------------------------------------*/
+
+void XHardwareConsole::xwrite (
+  const uint8_t* buf, /* Pointer to the data */
+  int len             /* Number of bytes */
+)
+{
+  _serial.write(buf, len);
+  XPERF_BYTES(len);
+}
@@ -13,7 +13,9 @@ class XHardwareConsole: public XUtils {
   public:
     XHardwareConsole(HardwareSerial& serial): _serial(serial) { };
     virtual char xgetc (void);
+    virtual byte xready (void);
     virtual void xputc (char c);
+    virtual void xwrite (const uint8_t* buf, int len);
 
 #if EXPOSE_PRINT_INTERFACE
     inline size_t xprint(const __FlashStringHelper *ifsh) { _serial.print(ifsh); };
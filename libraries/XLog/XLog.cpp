@@ -0,0 +1,347 @@
+/*
+ * Wear-levelled circular log of time-stamped samples
+ *
+ * The storage area is split into pages that are filled in
+ * turn, wrapping around to the oldest page once the last
+ * one is full, so that all pages wear at the same rate.
+ *
+ * Page layout:
+ *   seq (2 bytes LE), ~seq (2 bytes LE), records, end tag
+ *
+ * Each record is a tag byte (type and payload length)
+ * followed by the payload. The first record of a page is
+ * a key record holding absolute values; the following ones
+ * hold the differences from the previous record, as
+ * zig-zag encoded variable length integers.
+ *
+ * Power-fail safety: a record's payload and the end tag
+ * after it are written first, the record's own tag last;
+ * a page is opened by uncommitting its first record before
+ * the new sequence number is written. An interrupted write
+ * therefore leaves the log as it was before the write.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "XLog.h"
+
+#define HDR_SIZE      4
+
+#define TAG_END       0x00
+#define TAG_KEY       0x40
+#define TAG_DELTA     0x80
+#define TAG_TYPE(t)   ((t) & 0xC0)
+#define TAG_LEN(t)    ((t) & 0x3F)
+#define TAG_VALID(t)  ((TAG_TYPE(t) == TAG_KEY || TAG_TYPE(t) == TAG_DELTA) && TAG_LEN(t))
+
+#define KEY_LEN       (4 + 2 * XLOG_CHANNELS)
+#define DELTA_MAX     (5 + 3 * XLOG_CHANNELS)
+#define REC_MAX       (1 + (KEY_LEN > DELTA_MAX ? KEY_LEN : DELTA_MAX))
+
+#define PAGE_ADDR(p)  (_base + (p) * XLOG_PAGE_SIZE)
+
+/*----------------------------------------------*/
+/* Storage backends                             */
+/*----------------------------------------------*/
+
+uint8_t XLogEEPROM::read (uint16_t addr)
+{
+  return EEPROM.read(addr);
+}
+
+void XLogEEPROM::write (uint16_t addr, uint8_t val)
+{
+  EEPROM.update(addr, val);
+}
+
+#if !defined(ARDUINO)
+XLogFile::XLogFile (const char *path, uint16_t size)
+{
+  long len;
+
+  _f = fopen(path, "r+b");
+  if (!_f) _f = fopen(path, "w+b");
+  if (!_f) return;
+
+  fseek(_f, 0, SEEK_END);
+  for (len = ftell(_f); len < size; len++)
+    fputc(0xFF, _f);
+  fflush(_f);
+}
+
+XLogFile::~XLogFile ()
+{
+  if (_f) fclose(_f);
+}
+
+uint8_t XLogFile::read (uint16_t addr)
+{
+  int c;
+
+  if (!_f || fseek(_f, addr, SEEK_SET)) return 0xFF;
+  c = fgetc(_f);
+  return c == EOF ? 0xFF : (uint8_t) c;
+}
+
+void XLogFile::write (uint16_t addr, uint8_t val)
+{
+  if (!_f || read(addr) == val) return;
+  fseek(_f, addr, SEEK_SET);
+  fputc(val, _f);
+  fflush(_f);
+}
+#endif
+
+/*----------------------------------------------*/
+/* Log                                          */
+/*----------------------------------------------*/
+
+XLog::XLog (XLogStore &store, uint16_t base, uint16_t size):
+  _store(store), _base(base), _npages(size / XLOG_PAGE_SIZE), _head(0), _seq(0), _wpos(0)
+{
+  _head = _npages - 1;  /* The first page to be opened is page 0 */
+  _seq = 0xFFFF;
+  rewind();
+}
+
+byte XLog::pagevalid (  /* 1: the page holds records */
+  uint16_t page,        /* Page number */
+  uint16_t *seq         /* Its sequence number */
+)
+{
+  uint16_t addr = PAGE_ADDR(page);
+  uint8_t b[HDR_SIZE], i;
+
+  for (i = 0; i < HDR_SIZE; i++)
+    b[i] = _store.read(addr + i);
+
+  if ((uint8_t) ~b[0] != b[2] || (uint8_t) ~b[1] != b[3]) return 0;
+  if (TAG_TYPE(_store.read(addr + HDR_SIZE)) != TAG_KEY) return 0;  /* Not committed */
+
+  *seq = b[0] | ((uint16_t) b[1] << 8);
+  return 1;
+}
+
+long XLog::getvar (  /* Zig-zag decoded value */
+  uint16_t *addr     /* Address of the variable length integer, moved past it */
+)
+{
+  unsigned long v = 0;
+  uint8_t c, shift = 0;
+
+  do {
+    c = _store.read((*addr)++);
+    v |= (unsigned long) (c & 0x7F) << shift;
+    shift += 7;
+  } while ((c & 0x80) && shift < 35);
+
+  return (long) (v >> 1) ^ -(long) (v & 1);
+}
+
+byte XLog::decode (
+  uint16_t addr,        /* Address of the payload */
+  uint8_t tag,          /* Record tag */
+  XLOG_record_t *rec    /* Previous record on entry, decoded record on exit */
+)
+{
+  uint8_t i;
+
+  if (TAG_TYPE(tag) == TAG_KEY) {
+    rec->time = 0;
+    for (i = 0; i < 4; i++)
+      rec->time |= (unsigned long) _store.read(addr++) << (8 * i);
+    for (i = 0; i < XLOG_CHANNELS; i++) {
+      rec->v[i] = _store.read(addr) | ((uint16_t) _store.read(addr + 1) << 8);
+      addr += 2;
+    }
+  } else {
+    rec->time += getvar(&addr);
+    for (i = 0; i < XLOG_CHANNELS; i++)
+      rec->v[i] += getvar(&addr);
+  }
+
+  return 1;
+}
+
+static uint8_t putvar (  /* Bytes written */
+  uint8_t *buf,
+  long val
+)
+{
+  unsigned long v = ((unsigned long) val << 1) ^ (unsigned long) (val >> 31);  /* Zig-zag */
+  uint8_t n = 0;
+
+  while (v >= 0x80) {
+    buf[n++] = (uint8_t) v | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = (uint8_t) v;
+
+  return n;
+}
+
+uint8_t XLog::encode (  /* Payload length */
+  const XLOG_record_t *rec,   /* Record to be encoded */
+  const XLOG_record_t *ref,   /* Previous record, NULL for a key record */
+  uint8_t *buf                /* Tag and payload (REC_MAX bytes) */
+)
+{
+  uint8_t i, n = 1;
+
+  if (!ref) {
+    for (i = 0; i < 4; i++)
+      buf[n++] = (uint8_t) (rec->time >> (8 * i));
+    for (i = 0; i < XLOG_CHANNELS; i++) {
+      buf[n++] = (uint8_t) rec->v[i];
+      buf[n++] = (uint8_t) ((uint16_t) rec->v[i] >> 8);
+    }
+    buf[0] = TAG_KEY | (n - 1);
+  } else {
+    n += putvar(&buf[n], (long) (rec->time - ref->time));
+    for (i = 0; i < XLOG_CHANNELS; i++)
+      n += putvar(&buf[n], (long) rec->v[i] - ref->v[i]);
+    buf[0] = TAG_DELTA | (n - 1);
+  }
+
+  return n - 1;
+}
+
+void XLog::openpage (void)
+{
+  uint16_t addr;
+
+  if (++_head >= _npages) _head = 0;
+  _seq++;
+  addr = PAGE_ADDR(_head);
+
+  _store.write(addr + HDR_SIZE, TAG_END);   /* Discard the old contents first */
+  _store.write(addr, (uint8_t) _seq);
+  _store.write(addr + 1, (uint8_t) (_seq >> 8));
+  _store.write(addr + 2, (uint8_t) ~_seq);
+  _store.write(addr + 3, (uint8_t) (~_seq >> 8));
+
+  _wpos = HDR_SIZE;
+}
+
+uint16_t XLog::begin (void)
+{
+  uint16_t page, seq, addr, n = 0;
+  uint8_t tag;
+
+  _wpos = 0;
+
+  /* The page with the highest sequence number is the one to continue */
+  for (page = 0; page < _npages; page++) {
+    if (!pagevalid(page, &seq)) continue;
+    if (!n++ || (int16_t) (seq - _seq) > 0) {
+      _head = page;
+      _seq = seq;
+    }
+  }
+
+  if (n) {
+    /* Find the end of the records, keeping the last one as reference for deltas */
+    addr = PAGE_ADDR(_head);
+    _wpos = HDR_SIZE;
+    while (_wpos < XLOG_PAGE_SIZE) {
+      tag = _store.read(addr + _wpos);
+      if (!TAG_VALID(tag) || _wpos + 1 + TAG_LEN(tag) > XLOG_PAGE_SIZE) break;
+      decode(addr + _wpos + 1, tag, &_last);
+      _wpos += 1 + TAG_LEN(tag);
+    }
+  } else {
+    _head = _npages - 1;
+    _seq = 0xFFFF;
+  }
+
+  rewind();
+
+  return n;
+}
+
+void XLog::format (void)
+{
+  uint16_t page, addr;
+  uint8_t i;
+
+  for (page = 0; page < _npages; page++) {
+    addr = PAGE_ADDR(page);
+    _store.write(addr + HDR_SIZE, TAG_END);
+    for (i = 0; i < HDR_SIZE; i++)
+      _store.write(addr + i, 0xFF);
+  }
+
+  _head = _npages - 1;
+  _seq = 0xFFFF;
+  _wpos = 0;
+  rewind();
+}
+
+byte XLog::append (const XLOG_record_t *rec)
+{
+  uint8_t buf[REC_MAX], len = 0, i;
+  uint16_t addr;
+
+  if (_npages < 2) return 0;
+
+  if (_wpos) {
+    len = encode(rec, &_last, buf);
+    if (_wpos + 1 + len > XLOG_PAGE_SIZE) _wpos = 0;  /* Does not fit */
+  }
+  if (!_wpos) {
+    openpage();
+    len = encode(rec, 0, buf);
+  }
+
+  addr = PAGE_ADDR(_head) + _wpos;
+  for (i = 1; i <= len; i++)
+    _store.write(addr + i, buf[i]);
+  if (_wpos + 1 + len < XLOG_PAGE_SIZE)
+    _store.write(addr + 1 + len, TAG_END);
+  _store.write(addr, buf[0]);   /* Commit */
+
+  _wpos += 1 + len;
+  _last = *rec;
+
+  return 1;
+}
+
+void XLog::rewind (void)
+{
+  /* Pages are filled in ring order, so the oldest one follows the head */
+  _rpage = _head + 1 >= _npages ? 0 : _head + 1;
+  _rleft = _npages ? _npages - 1 : 0;
+  _rpos = 0;
+}
+
+byte XLog::read (XLOG_record_t *rec)
+{
+  uint16_t addr, seq;
+  uint8_t tag;
+
+  if (!_npages) return 0;
+
+  for (;;) {
+    addr = PAGE_ADDR(_rpage);
+    if (!_rpos)
+      _rpos = pagevalid(_rpage, &seq) ? HDR_SIZE : XLOG_PAGE_SIZE;
+
+    if (_rpos < XLOG_PAGE_SIZE) {
+      tag = _store.read(addr + _rpos);
+      if (TAG_VALID(tag) && _rpos + 1 + TAG_LEN(tag) <= XLOG_PAGE_SIZE) {
+        decode(addr + _rpos + 1, tag, &_rlast);
+        _rpos += 1 + TAG_LEN(tag);
+        *rec = _rlast;
+        return 1;
+      }
+      _rpos = XLOG_PAGE_SIZE;   /* End of this page */
+    }
+
+    if (!_rleft) return 0;
+    _rleft--;
+    if (++_rpage >= _npages) _rpage = 0;
+    _rpos = 0;
+  }
+}
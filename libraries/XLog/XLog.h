@@ -0,0 +1,112 @@
+#ifndef XLog_h
+#define XLog_h
+
+#include <inttypes.h>
+
+/* Values stored with each record */
+#define XLOG_CHANNELS   2
+
+/* Bytes per page, the unit the log wraps around in (16..255) */
+#define XLOG_PAGE_SIZE  64
+
+typedef struct {
+  unsigned long time;           /* Timestamp, e.g. RTC::toepoch() */
+  int16_t v[XLOG_CHANNELS];     /* Values, e.g. TMP006_fixed_t tobj and tdie */
+} XLOG_record_t;
+
+/* Byte addressable non-volatile storage the log lives in */
+class XLogStore {
+  public:
+    virtual uint8_t read (uint16_t addr) = 0;
+    virtual void write (uint16_t addr, uint8_t val) = 0;  /* Should skip unchanged bytes */
+};
+
+/* Internal EEPROM */
+class XLogEEPROM: public XLogStore {
+  public:
+    virtual uint8_t read (uint16_t addr);
+    virtual void write (uint16_t addr, uint8_t val);
+};
+
+#if !defined(ARDUINO)
+#include <stdio.h>
+
+/* Host stand-in: the log lives in a file, created erased (0xFF) if missing */
+class XLogFile: public XLogStore {
+  public:
+    XLogFile (const char *path, uint16_t size);
+    ~XLogFile ();
+    virtual uint8_t read (uint16_t addr);
+    virtual void write (uint16_t addr, uint8_t val);
+
+  private:
+    FILE *_f;
+};
+#endif
+
+class XLog {
+  public:
+    /**
+     * Constructor
+     *
+     * @param store Storage backend
+     * @param base First byte of the area reserved to the log
+     * @param size Size of the area in bytes (at least two pages)
+     */
+    XLog (XLogStore &store, uint16_t base, uint16_t size);
+
+    /**
+     * Recover the write position after a reset or power failure
+     *
+     * @return number of pages holding records
+     */
+    uint16_t begin (void);
+
+    /**
+     * Erase the log
+     */
+    void format (void);
+
+    /**
+     * Append a record
+     *
+     * @param rec Record to be appended
+     * @return 1 on success, 0 if the record cannot be encoded
+     */
+    byte append (const XLOG_record_t *rec);
+
+    /**
+     * Restart reading from the oldest record
+     */
+    void rewind (void);
+
+    /**
+     * Read the next record, oldest first
+     *
+     * @param rec Record read
+     * @return 1 if a record was read, 0 at the end of the log
+     */
+    byte read (XLOG_record_t *rec);
+
+  private:
+    byte pagevalid (uint16_t page, uint16_t *seq);
+    byte decode (uint16_t addr, uint8_t tag, XLOG_record_t *rec);
+    long getvar (uint16_t *addr);
+    uint8_t encode (const XLOG_record_t *rec, const XLOG_record_t *ref, uint8_t *buf);
+    void openpage (void);
+
+    XLogStore &_store;
+    uint16_t _base;
+    uint16_t _npages;
+    uint16_t _head;           /* Page being written */
+    uint16_t _seq;            /* Sequence number of the page being written */
+    uint8_t _wpos;            /* Write offset in that page, 0: no page open */
+    XLOG_record_t _last;      /* Last record written */
+
+    uint16_t _rpage;          /* Page being read */
+    uint16_t _rleft;          /* Pages left to read after it */
+    uint8_t _rpos;            /* Read offset in that page */
+    XLOG_record_t _rlast;     /* Last record read */
+};
+
+#endif
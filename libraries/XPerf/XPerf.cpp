@@ -0,0 +1,88 @@
+/*
+ * Performance counters for the instrumented libraries
+ *
+ * Probes are placed with XPERF_SCOPE() at the top of an
+ * operation and XPERF_BYTES() next to bus transfers; with
+ * XPERF_ENABLE set to 0 both expand to nothing and the
+ * table below is not allocated.
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "XPerf.h"
+
+#if XPERF_ENABLE
+
+static XPERF_counter_t table[XPERF_COUNTERS];
+
+unsigned long XPerf::bytes;
+
+static const PROGMEM char names[] =
+  "ili9341.init\0"
+  "ili9341.rectfill\0"
+  "ili9341.line\0"
+  "ili9341.blt\0"
+  "ili9341.putc\0"
+  "xutils.xputs\0"
+  "xutils.xprintf\0"
+  "rtc.gettime\0"
+  "rtc.settime\0"
+  "tmp006.gettemp\0"
+  "tmp006.poll\0"
+  "tmp006.convert\0"
+  "tmp006.convert_fixed\0"
+  "ili9341.blend\0";
+
+void XPerf::record (
+  uint8_t id,           /* Operation */
+  unsigned long us,     /* Time taken */
+  unsigned long bytes   /* Bus bytes moved */
+)
+{
+  XPERF_counter_t *c = &table[id];
+
+  c->calls++;
+  c->bytes += bytes;
+  c->total_us += us;
+  if (us > c->max_us) c->max_us = us;
+}
+
+void XPerf::reset (void)
+{
+  memset(table, 0, sizeof(table));
+}
+
+const XPERF_counter_t *XPerf::get (uint8_t id)
+{
+  return id < XPERF_COUNTERS ? &table[id] : 0;
+}
+
+const char *XPerf::name (uint8_t id)
+{
+  const char *name = names;
+
+
+  if (id >= XPERF_COUNTERS) return 0;
+  while (id--) name += strlen_P(name) + 1;
+
+  return name;
+}
+
+#else
+
+void XPerf::reset (void)
+{
+}
+
+const XPERF_counter_t *XPerf::get (uint8_t id)
+{
+  return 0;
+}
+
+const char *XPerf::name (uint8_t id)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef XPerf_h
+#define XPerf_h
+
+#include <inttypes.h>
+
+/* 1: Instrument the libraries (0 compiles all probes out; can be set on the compiler command line) */
+#ifndef XPERF_ENABLE
+#define XPERF_ENABLE  0
+#endif
+
+/*
+ * Instrumented operations, one row each in the counters table.
+ *
+ * Times are inclusive of nested instrumented operations (e.g.
+ * XPERF_ILI9341_PUTC includes the rectfill of a form feed) and
+ * so are bytes, which count what goes over the bus the library
+ * talks to: SPI or 8080 for ILI9341, I2C for RTC and TMP006, the serial
+ * port for the consoles.
+ */
+#define XPERF_ILI9341_INIT      0
+#define XPERF_ILI9341_RECTFILL  1
+#define XPERF_ILI9341_LINE      2
+#define XPERF_ILI9341_BLT       3
+#define XPERF_ILI9341_PUTC      4
+#define XPERF_XUTILS_XPUTS      5
+#define XPERF_XUTILS_XPRINTF    6
+#define XPERF_RTC_GETTIME       7
+#define XPERF_RTC_SETTIME       8
+#define XPERF_TMP006_GETTEMP    9
+#define XPERF_TMP006_POLL       10
+#define XPERF_TMP006_CONVERT    11
+#define XPERF_TMP006_CONVERT_FX 12
+#define XPERF_ILI9341_BLEND     13
+#define XPERF_COUNTERS          14
+
+typedef struct {
+  unsigned long calls;
+  unsigned long bytes;     /* Bytes moved over the bus */
+  unsigned long total_us;  /* Cumulative micros() */
+  unsigned long max_us;    /* Longest call */
+} XPERF_counter_t;
+
+class XUtils;
+
+class XPerf {
+  public:
+    /**
+     * Print the counters table (built with XUtils, so that the
+     * counters themselves need no other library)
+     *
+     * @param out Output stream (e.g. the console)
+     */
+    static void dump (XUtils &out);
+
+    /**
+     * Clear all counters
+     */
+    static void reset (void);
+
+    /**
+     * Get a counter
+     *
+     * @param id Operation (XPERF_...)
+     * @return counter, NULL if instrumentation is disabled
+     */
+    static const XPERF_counter_t *get (uint8_t id);
+
+    /**
+     * Get the name of an operation
+     *
+     * @param id Operation (XPERF_...)
+     * @return name in program memory, NULL if instrumentation is disabled
+     */
+    static const char *name (uint8_t id);
+
+#if XPERF_ENABLE
+    static void record (uint8_t id, unsigned long us, unsigned long bytes);
+    static unsigned long bytes;   /* Bus bytes moved so far */
+#endif
+};
+
+#if XPERF_ENABLE
+
+/* Accounts for the enclosing block when it goes out of scope */
+class XPerfScope {
+  public:
+    XPerfScope (uint8_t id): _id(id), _bytes(XPerf::bytes), _t0(micros()) { };
+    ~XPerfScope () { XPerf::record(_id, micros() - _t0, XPerf::bytes - _bytes); };
+
+  private:
+    uint8_t _id;
+    unsigned long _bytes, _t0;
+};
+
+#define XPERF_SCOPE(id)   XPerfScope _xperf_scope(id)
+#define XPERF_BYTES(n)    (XPerf::bytes += (n))
+
+#else
+
+#define XPERF_SCOPE(id)
+#define XPERF_BYTES(n)    ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Manager of an SPI bus shared by several devices
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "XSPIBus.h"
+
+void XSPIBus::acquire (
+  uint8_t cs,     /* Slave select pin */
+  const SPISettings &settings /* Transaction settings */
+)
+{
+  _stats.operations++;
+  if (_held && _cs == cs && _settings == &settings) return;  /* Batched */
+
+  flush();
+  SPI.beginTransaction(settings);
+  digitalWrite(cs, LOW);
+  _cs = cs;
+  _settings = &settings;
+  _held = 1;
+  _stats.transactions++;
+}
+
+void XSPIBus::flush (void)
+{
+  if (!_held) return;
+
+  digitalWrite(_cs, HIGH);
+  SPI.endTransaction();
+  _held = 0;
+}
+
+void XSPIBus::set_batching (
+  byte on         /* 1: batching, 0: a transaction per operation */
+)
+{
+  _batch = on;
+  if (!on) flush();
+}
+
+void XSPIBus::reset_stats (void)
+{
+  memset(&_stats, 0, sizeof(_stats));
+}
@@ -0,0 +1,82 @@
+#ifndef XSPIBus_h
+#define XSPIBus_h
+
+#include <inttypes.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+
+typedef struct {
+  unsigned long operations;     /* acquire() calls */
+  unsigned long transactions;   /* SPI transactions begun for them */
+} XSPIBUS_stats_t;
+
+/*
+ * Manager of an SPI bus shared by several devices
+ *
+ * Each device is known by its slave select pin (active low) and its
+ * transaction settings, which are kept apart: a device gets the bus
+ * in a transaction of its own, at its own clock and mode, with every
+ * other device deselected. Consecutive operations of a device with the
+ * same settings are batched: the bus stays with it, selected and in
+ * the same transaction, until another device (or other settings) takes
+ * it over or flush() is called, so that a run of operations costs one
+ * transaction rather than one each.
+ *
+ * All the devices on the bus must go through the manager; code that
+ * uses SPI directly (or an interrupt handler) must call flush() first.
+ */
+class XSPIBus {
+  public:
+    XSPIBus (void): _held(0), _batch(1) { reset_stats(); };
+
+    /**
+     * Start an operation of a device, taking the bus over unless the
+     * device holds it already with the same settings
+     *
+     * @param cs Slave select pin of the device
+     * @param settings Transaction settings of the device, known by
+     *        their address: a device keeps them in place
+     */
+    void acquire (uint8_t cs, const SPISettings &settings);
+
+    /**
+     * End an operation: the device keeps the bus (see set_batching())
+     */
+    void release (void) {
+      if (!_batch) flush();
+    };
+
+    /**
+     * Deselect the device holding the bus, if any, and end its transaction
+     */
+    void flush (void);
+
+    /**
+     * Set whether the bus stays with a device between its operations
+     *
+     * @param on 1: batching (default), 0: a transaction per operation
+     */
+    void set_batching (byte on);
+
+    /**
+     * Get the statistics
+     *
+     * @param stats Statistics
+     */
+    void get_stats (XSPIBUS_stats_t *stats) { *stats = _stats; };
+
+    /**
+     * Clear the statistics
+     */
+    void reset_stats (void);
+
+  private:
+    byte _held;             /* A device holds the bus */
+    byte _batch;
+    uint8_t _cs;            /* Device holding the bus */
+    const SPISettings *_settings;
+    XSPIBUS_stats_t _stats;
+};
+
+#endif
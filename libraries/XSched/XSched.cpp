@@ -0,0 +1,141 @@
+/*
+ * Cooperative task scheduler
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "XSched.h"
+
+XSched::XSched (void): _events(0), _running(-1)
+{
+  memset(_tasks, 0, sizeof(_tasks));
+}
+
+int8_t XSched::add (
+  unsigned long next,   /* Due time (ms) */
+  unsigned long period, /* 0: one-shot */
+  uint8_t events,       /* Event mask, 0: timer task */
+  void (*fn)(void)
+)
+{
+  int8_t i;
+
+  if (!fn) return -1;
+
+  if (_running >= 0 && _tasks[_running].fn == fn) {   /* One-shot re-arming itself: in place */
+    i = _running;
+    _running = -1;
+    _tasks[i].next = next;
+    _tasks[i].period = period;
+    _tasks[i].events = events;
+    return i;
+  }
+
+  for (i = 0; i < XSCHED_TASKS; i++) {
+    if (!_tasks[i].fn) {
+      memset(&_tasks[i], 0, sizeof(_tasks[i]));
+      _tasks[i].next = next;
+      _tasks[i].period = period;
+      _tasks[i].events = events;
+      _tasks[i].fn = fn;
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+int8_t XSched::every (unsigned long period, void (*fn)(void))
+{
+  if (!period) return -1;
+
+  return add(millis() + period, period, 0, fn);
+}
+
+int8_t XSched::after (unsigned long delay, void (*fn)(void))
+{
+  return add(millis() + delay, 0, 0, fn);
+}
+
+int8_t XSched::on_event (uint8_t mask, void (*fn)(void))
+{
+  if (!mask) return -1;
+
+  return add(0, 0, mask, fn);
+}
+
+void XSched::cancel (int8_t id)
+{
+  if (id >= 0 && id < XSCHED_TASKS) _tasks[id].fn = 0;
+  if (id == _running) _running = -1;
+}
+
+void XSched::signal (uint8_t mask)
+{
+  _events |= mask;  /* Interrupts are already disabled in a handler */
+}
+
+byte XSched::run (void)
+{
+  void (*fn)(void);
+  unsigned long now, late, skipped, t0;
+  uint8_t events, i;
+  byte n = 0;
+
+  noInterrupts();
+  events = _events;
+  _events = 0;
+  interrupts();
+
+  for (i = 0; i < XSCHED_TASKS; i++) {
+    if (!(fn = _tasks[i].fn)) continue;
+
+    if (_tasks[i].events) {
+      if (!(_tasks[i].events & events)) continue;
+      late = 0;
+    } else {
+      now = millis();
+      if ((long) (now - _tasks[i].next) < 0) continue;
+      late = now - _tasks[i].next;
+
+      if (_tasks[i].period) {
+        skipped = late / _tasks[i].period;
+        _tasks[i].stats.misses += skipped;
+        _tasks[i].next += (skipped + 1) * _tasks[i].period;
+      } else {
+        _running = i;       /* One-shot: freed once run, unless it re-arms itself */
+      }
+    }
+
+    _tasks[i].stats.runs++;
+    if (late > _tasks[i].stats.max_late) _tasks[i].stats.max_late = late;
+
+    t0 = micros();
+    fn();
+    t0 = micros() - t0;
+    if (_tasks[i].fn == fn && t0 > _tasks[i].stats.max_us) _tasks[i].stats.max_us = t0;
+    if (_running == i) _tasks[i].fn = 0;
+    _running = -1;
+
+    n++;
+  }
+
+  return n;
+}
+
+byte XSched::getstats (int8_t id, XSCHED_stats_t *stats)
+{
+  if (id < 0 || id >= XSCHED_TASKS || !_tasks[id].fn) return 0;
+
+  *stats = _tasks[id].stats;
+  return 1;
+}
+
+void XSched::reset_stats (void)
+{
+  uint8_t i;
+
+  for (i = 0; i < XSCHED_TASKS; i++)
+    memset(&_tasks[i].stats, 0, sizeof(_tasks[i].stats));
+}
@@ -0,0 +1,115 @@
+#ifndef XSched_h
+#define XSched_h
+
+#include <inttypes.h>
+
+/* Maximum number of tasks, including pending one-shot timers */
+#define XSCHED_TASKS  8
+
+/* Event flag n (0..7) for on_event()/signal() */
+#define XSCHED_EVENT(n) ((uint8_t) (1 << (n)))
+
+typedef struct {
+  unsigned long runs;
+  unsigned long misses;   /* Periodic activations skipped because the task was run too late */
+  unsigned long max_late; /* Longest delay past the due time (ms) */
+  unsigned long max_us;   /* Longest run (us) */
+} XSCHED_stats_t;
+
+/*
+ * Cooperative scheduler
+ *
+ * Tasks are plain functions that do a bounded amount of work
+ * and return; none of them may block. run() must be called
+ * from loop() as often as possible and runs every task that
+ * is due, in the order tasks were added.
+ *
+ * A periodic task that is started one or more whole periods
+ * late skips the activations it missed (counted in misses)
+ * rather than running several times in a row.
+ */
+class XSched {
+  public:
+    XSched (void);
+
+    /**
+     * Add a periodic task
+     *
+     * @param period Period in ms (first run after one period)
+     * @param fn Task function
+     * @return task id, -1 if the table is full
+     */
+    int8_t every (unsigned long period, void (*fn)(void));
+
+    /**
+     * Add a one-shot timer, removed once run
+     *
+     * A task that adds itself again while it runs is re-armed in its
+     * slot: it keeps its id and statistics.
+     *
+     * @param delay Delay in ms
+     * @param fn Task function
+     * @return task id, -1 if the table is full
+     */
+    int8_t after (unsigned long delay, void (*fn)(void));
+
+    /**
+     * Add a task run whenever any of the given event flags is signalled
+     *
+     * @param mask Event flags (XSCHED_EVENT(n) combined)
+     * @param fn Task function
+     * @return task id, -1 if the table is full
+     */
+    int8_t on_event (uint8_t mask, void (*fn)(void));
+
+    /**
+     * Remove a task
+     *
+     * @param id Task id
+     */
+    void cancel (int8_t id);
+
+    /**
+     * Set event flags from an interrupt handler (call it with
+     * interrupts disabled from anywhere else)
+     *
+     * @param mask Event flags (XSCHED_EVENT(n) combined)
+     */
+    void signal (uint8_t mask);
+
+    /**
+     * Run the tasks that are due
+     *
+     * @return number of tasks run
+     */
+    byte run (void);
+
+    /**
+     * Get task statistics
+     *
+     * @param id Task id
+     * @param stats Statistics
+     * @return 1 on success, 0 if no such task
+     */
+    byte getstats (int8_t id, XSCHED_stats_t *stats);
+
+    /**
+     * Clear the statistics of all tasks
+     */
+    void reset_stats (void);
+
+  private:
+    int8_t add (unsigned long next, unsigned long period, uint8_t events, void (*fn)(void));
+
+    struct {
+      void (*fn)(void);       /* NULL: free slot */
+      unsigned long next;     /* Due time (ms) */
+      unsigned long period;   /* 0: one-shot */
+      uint8_t events;         /* Event mask, 0: timer task */
+      XSCHED_stats_t stats;
+    } _tasks[XSCHED_TASKS];
+    volatile uint8_t _events; /* Signalled, not yet handled */
+    int8_t _running;          /* One-shot being run, -1: none (or re-armed) */
+};
+
+#endif
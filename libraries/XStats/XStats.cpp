@@ -0,0 +1,179 @@
+/*
+ * Streaming statistics and filters for sensor samples
+ *
+ * (C) 2016 Luigi Di Fraia
+ */
+
+#include "Arduino.h"
+#include "XStats.h"
+
+/*----------------------------------------------*/
+/* Exponential moving average                   */
+/*----------------------------------------------*/
+
+long XEma::push (long x)
+{
+  if (!_primed) {
+    _acc = x * ((long) 1 << _shift);
+    _primed = 1;
+  } else {
+    _acc += x - (_acc >> _shift);
+  }
+
+  return _acc >> _shift;
+}
+
+/*----------------------------------------------*/
+/* Windowed minimum/maximum                     */
+/*----------------------------------------------*/
+
+XMinMax::XMinMax (uint8_t window): _lohead(0), _locount(0), _hihead(0), _hicount(0), _seq(0)
+{
+  if (window < 1) window = 1;
+  if (window > XSTATS_WINDOW) window = XSTATS_WINDOW;
+  _window = window;
+  _lo[0].v = _hi[0].v = 0;
+}
+
+void XMinMax::insert (
+  entry_t *q,         /* Deque storage */
+  uint8_t *head,      /* Index of the front (extreme) entry */
+  uint8_t *count,     /* Entries in the deque */
+  long x,             /* New sample */
+  byte keep_below     /* 1: min deque, 0: max deque */
+)
+{
+  uint8_t tail;
+
+  /* Drop the front entry once it falls out of the window */
+  if (*count && (uint8_t) (_seq - q[*head].seq) >= _window) {
+    if (++*head == XSTATS_WINDOW) *head = 0;
+    (*count)--;
+  }
+
+  /* Drop entries from the back that can no longer become the extreme */
+  while (*count) {
+    tail = *head + *count - 1;
+    if (tail >= XSTATS_WINDOW) tail -= XSTATS_WINDOW;
+    if (keep_below ? q[tail].v < x : q[tail].v > x) break;
+    (*count)--;
+  }
+
+  tail = *head + *count;
+  if (tail >= XSTATS_WINDOW) tail -= XSTATS_WINDOW;
+  q[tail].v = x;
+  q[tail].seq = _seq;
+  (*count)++;
+}
+
+void XMinMax::push (long x)
+{
+  insert(_lo, &_lohead, &_locount, x, 1);
+  insert(_hi, &_hihead, &_hicount, x, 0);
+  _seq++;
+}
+
+/*----------------------------------------------*/
+/* Exponentially weighted variance              */
+/*----------------------------------------------*/
+
+void XVariance::push (long x)
+{
+  double diff, incr;
+
+  if (!_primed) {
+    _mean = x;
+    _primed = 1;
+    return;
+  }
+
+  diff = x - _mean;
+  incr = _alpha * diff;
+  _mean += incr;
+  _var = (1.0 - _alpha) * (_var + diff * incr);
+}
+
+/*----------------------------------------------*/
+/* Scalar Kalman filter                         */
+/*----------------------------------------------*/
+
+double XKalman::push (
+  unsigned long ts,   /* Sample timestamp */
+  long z              /* Measurement */
+)
+{
+  double k;
+
+  if (!_primed) {
+    _x = z;
+    _p = _r;
+    _ts = ts;
+    _primed = 1;
+    return _x;
+  }
+
+  /* Predict: the value drifts by q per elapsed time unit */
+  _p += _q * (double) (ts - _ts);
+  _ts = ts;
+
+  /* Update */
+  k = _p / (_p + _r);
+  _x += k * (z - _x);
+  _p *= 1.0 - k;
+
+  return _x;
+}
+
+/*----------------------------------------------*/
+/* Pipeline                                     */
+/*----------------------------------------------*/
+
+XStats::XStats (uint8_t shift, uint8_t window, double q, double r):
+  _ema(shift), _minmax(window), _var(shift), _kalman(q, r),
+  _count(0), _ts(0), _last(0), _alo(0), _ahi(0), _ahyst(0), _alarm(XSTATS_ALARM_NONE)
+{
+}
+
+void XStats::set_alarm (
+  long lo,      /* Low threshold */
+  long hi,      /* High threshold (>= lo) */
+  long hyst     /* Margin to clear an alarm */
+)
+{
+  _alo = lo;
+  _ahi = hi;
+  _ahyst = hyst;
+  _alarm = XSTATS_ALARM_NONE;
+}
+
+void XStats::push (
+  unsigned long ts,   /* Sample timestamp */
+  long x              /* Sample value */
+)
+{
+  long avg;
+
+  _ts = ts;
+  _last = x;
+  _count++;
+
+  avg = _ema.push(x);
+  _minmax.push(x);
+  _var.push(x);
+  _kalman.push(ts, x);
+
+  /* Alarms follow the average so that single outliers do not trip them */
+  if (_alo == _ahi) return;
+  switch (_alarm) {
+  case XSTATS_ALARM_NONE:
+    if (avg > _ahi) _alarm = XSTATS_ALARM_HIGH;
+    else if (avg < _alo) _alarm = XSTATS_ALARM_LOW;
+    break;
+  case XSTATS_ALARM_HIGH:
+    if (avg <= _ahi - _ahyst) _alarm = XSTATS_ALARM_NONE;
+    break;
+  case XSTATS_ALARM_LOW:
+    if (avg >= _alo + _ahyst) _alarm = XSTATS_ALARM_NONE;
+    break;
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef XStats_h
+#define XStats_h
+
+#include <inttypes.h>
+
+/* Longest window (in samples) tracked by XMinMax, up to 128 */
+#define XSTATS_WINDOW   16
+
+/* Alarm states */
+#define XSTATS_ALARM_NONE 0
+#define XSTATS_ALARM_LOW  1
+#define XSTATS_ALARM_HIGH 2
+
+/*
+ * Each stage takes a constant amount of memory and time per sample,
+ * so they can run continuously on every reading without keeping any
+ * sample history (other than the min/max window).
+ *
+ * Values are plain integers in the caller's units, e.g. hundredths of
+ * a degree as returned by TMP006::latest_fixed(). Timestamps can be
+ * millis() values or RTC::toepoch() seconds, as long as one stage
+ * always gets the same kind.
+ */
+
+/* Exponential moving average, alpha = 1 / 2^shift */
+class XEma {
+  public:
+    XEma (uint8_t shift): _acc(0), _shift(shift), _primed(0) { };
+    long push (long x);
+    long value (void) { return _acc >> _shift; };
+
+  private:
+    long _acc;        /* Average << shift */
+    uint8_t _shift;
+    uint8_t _primed;  /* Seeded with the first sample */
+};
+
+/* Minimum and maximum over the last <window> samples (monotonic deques) */
+class XMinMax {
+  public:
+    XMinMax (uint8_t window);
+    void push (long x);
+    long min (void) { return _lo[_lohead].v; };
+    long max (void) { return _hi[_hihead].v; };
+
+  private:
+    typedef struct {
+      long v;
+      uint8_t seq;    /* Sample number, modulo 256 */
+    } entry_t;
+
+    void insert (entry_t *q, uint8_t *head, uint8_t *count, long x, byte keep_below);
+
+    entry_t _lo[XSTATS_WINDOW], _hi[XSTATS_WINDOW];
+    uint8_t _lohead, _locount, _hihead, _hicount;
+    uint8_t _window;
+    uint8_t _seq;
+};
+
+/* Exponentially weighted mean and variance, alpha = 1 / 2^shift */
+class XVariance {
+  public:
+    XVariance (uint8_t shift): _mean(0), _var(0), _alpha(1.0 / ((long) 1 << shift)), _primed(0) { };
+    void push (long x);
+    double mean (void) { return _mean; };
+    double variance (void) { return _var; };
+
+  private:
+    double _mean, _var, _alpha;
+    uint8_t _primed;
+};
+
+/* Scalar Kalman filter for a slowly drifting value (random walk model) */
+class XKalman {
+  public:
+    /**
+     * Constructor
+     *
+     * @param q Process noise variance per timestamp unit
+     * @param r Measurement noise variance
+     */
+    XKalman (double q, double r): _x(0), _p(0), _q(q), _r(r), _ts(0), _primed(0) { };
+    double push (unsigned long ts, long z);
+    double value (void) { return _x; };
+    double error (void) { return _p; };
+
+  private:
+    double _x, _p, _q, _r;
+    unsigned long _ts;
+    uint8_t _primed;
+};
+
+/* All of the above, fed at once, plus threshold alarms on the average */
+class XStats {
+  public:
+    XStats (uint8_t shift, uint8_t window, double q, double r);
+    void push (unsigned long ts, long x);
+    void set_alarm (long lo, long hi, long hyst);
+    byte alarm (void) { return _alarm; };
+    unsigned long count (void) { return _count; };
+    unsigned long timestamp (void) { return _ts; };
+    long last (void) { return _last; };
+    long ema (void) { return _ema.value(); };
+    long min (void) { return _minmax.min(); };
+    long max (void) { return _minmax.max(); };
+    double variance (void) { return _var.variance(); };
+    double kalman (void) { return _kalman.value(); };
+
+  private:
+    XEma _ema;
+    XMinMax _minmax;
+    XVariance _var;
+    XKalman _kalman;
+    unsigned long _count, _ts;
+    long _last;
+    long _alo, _ahi, _ahyst;
+    uint8_t _alarm;
+};
+
+#endif
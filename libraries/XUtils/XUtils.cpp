@@ -8,6 +8,7 @@
 
 #include "Arduino.h"
 #include "XUtils.h"
+#include "XPerf.h"
 
 /*----------------------------------------------*/
 /* Get a line from the input stream (excluding  */
@@ -18,12 +19,35 @@ byte XUtils::xgets (  /* 0:End of stream, 1:A line arrived */
   char* buff, /* Pointer to the buffer */
   int len     /* Buffer length */
 )
+{
+  int i = 0;
+  byte r;
+
+  while ((r = xgets_poll(buff, len, &i)) == 2) ;
+
+  return r;
+}
+
+/*----------------------------------------------*/
+/* Non-blocking version of xgets: consumes only */
+/* the chars already received                   */
+/*----------------------------------------------*/
+
+byte XUtils::xgets_poll (  /* 0:End of stream, 1:A line arrived, 2:Line incomplete */
+  char* buff, /* Pointer to the buffer */
+  int len,    /* Buffer length */
+  int* idx    /* Chars stored so far (0 when starting a new line, updated) */
+)
 {
   char c;
   int i;
 
-  i = 0;
+  i = *idx;
   for (;;) {
+    if (!xready()) {      /* Nothing more received yet? */
+      *idx = i;
+      return 2;
+    }
     c = xgetc();          /* Get a char from the incoming stream */
     if (!c) return 0;     /* End of stream? */
     if (c == '\r') break; /* End of line? */
@@ -42,6 +66,7 @@ byte XUtils::xgets (  /* 0:End of stream, 1:A line arrived */
     }
   }
   buff[i] = 0;  /* Terminate with a \0 */
+  *idx = 0;
 #if XGETS_CHAR_ECHO
 #if !XPUTC_LF_CRLF
   xputc('\r');
@@ -119,6 +144,7 @@ void XUtils::xputs (          /* Put a string to the default device */
 {
   PGM_P pstr = reinterpret_cast<PGM_P>(str);
   char c;
+  XPERF_SCOPE(XPERF_XUTILS_XPUTS);
 
 
   while (1) {
@@ -128,6 +154,18 @@ void XUtils::xputs (          /* Put a string to the default device */
   }
 }
 
+/*----------------------------------------------*/
+/* Put raw bytes (binary data)                  */
+/*----------------------------------------------*/
+
+void XUtils::xwrite (
+  const uint8_t* buf, /* Pointer to the data */
+  int len             /* Number of bytes */
+)
+{
+  while (len-- > 0) xputc((char) *buf++);
+}
+
 /*----------------------------------------------*/
 /* Formatted string output                      */
 /*----------------------------------------------*/
@@ -137,6 +175,7 @@ void XUtils::xputs (          /* Put a string to the default device */
 )
 {
   char c;
+  XPERF_SCOPE(XPERF_XUTILS_XPUTS);
 
 
   while (1) {
@@ -204,14 +243,15 @@ void XUtils::xvprintf (
     case 'u' :          /* Unsigned decimal */
       r = 10; break;
     case 'x' :          /* Hexdecimal */
+    case 'X' :          /* Hexdecimal (upper case digits) */
       r = 16; break;
     default:          /* Unknown type (passthrough) */
       xputc(c); continue;
     }
 
     /* Get an argument and put it in numeral */
-    v = (f & 4) ? va_arg(arp, long) : ((d == 'D') ? (long)va_arg(arp, int) : (long)va_arg(arp, unsigned int));
-    if (d == 'D' && (v & 0x80000000)) {
+    v = (f & 4) ? va_arg(arp, long) : ((d == 'd') ? (long)va_arg(arp, int) : (long)va_arg(arp, unsigned int));
+    if (d == 'd' && (v & 0x80000000)) {
       v = 0 - v;
       f |= 8;
     }
@@ -235,9 +275,36 @@ void XUtils::xprintf (      /* Put a formatted string to the default device */
 )
 {
   va_list arp;
+  XPERF_SCOPE(XPERF_XUTILS_XPRINTF);
 
 
   va_start(arp, fmt);
   xvprintf(fmt, arp);
   va_end(arp);
 }
+
+/*----------------------------------------------*/
+/* Print the performance counters table (here   */
+/* so that XPerf does not depend on XUtils)     */
+/*----------------------------------------------*/
+
+void XPerf::dump (
+  XUtils &out   /* Output stream */
+)
+{
+#if XPERF_ENABLE
+  const XPERF_counter_t *c;
+  uint8_t i;
+
+
+  out.xputs(F("   calls      bytes   total us  max us  avg us  operation\n"));
+  for (i = 0; i < XPERF_COUNTERS; i++) {
+    c = XPerf::get(i);
+    out.xprintf(F("%8lu %10lu %10lu %7lu %7lu  %S\n"),
+      c->calls, c->bytes, c->total_us, c->max_us,
+      c->calls ? c->total_us / c->calls : 0UL, XPerf::name(i));
+  }
+#else
+  out.xputs(F("Instrumentation disabled (XPERF_ENABLE)\n"));
+#endif
+}
@@ -15,7 +15,7 @@
  *  xprintf(F("%-6u"), 100);           "100   "
  *  xprintf(F("%ld"), 12345678L);      "12345678"
  *  xprintf(F("%04x"), 0xA3);          "00a3"
- *  xprintf(F("%08lx"), 0x123ABC);     "00123ABC"
+ *  xprintf(F("%08lX"), 0x123ABC);     "00123ABC"
  *  xprintf(F("%016b"), 0x550F);       "0101010100001111"
  *  xprintf(F("%s"), "String");        "String"
  *  xprintf(F("%-4s"), "abc");         "abc "
@@ -27,13 +27,16 @@
 
 class XUtils {
   public:
-    virtual void xputc (char c);
-    virtual char xgetc (void);
+    virtual void xputc (char c) = 0;
+    virtual char xgetc (void) = 0;
+    virtual byte xready (void) { return 1; };  /* 1: xgetc() would not block */
+    virtual void xwrite (const uint8_t* buf, int len);  /* Raw bytes, no LF ==> CRLF conversion */
     void xputs (const __FlashStringHelper* str);
     void xputs (const char* str);
     void xprintf (const __FlashStringHelper* fmt, ...);
     static byte xatoi (const char **str, long *res);
     byte xgets (char* buff, int len);
+    byte xgets_poll (char* buff, int len, int* idx);
 
   private:
     void xvprintf (const __FlashStringHelper* fmt, va_list arp);
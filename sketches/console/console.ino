@@ -20,12 +20,34 @@
  * - how to get a temperature reading from a TMP006 contactless
  *   temperature sensor;
  *
+ * XStats:
+ * - how to keep running statistics of the TMP006 readings;
+ *
+ * XLog:
+ * - how to keep a log of time-stamped TMP006 readings in EEPROM;
+ *
+ * XPerf:
+ * - how to inspect the performance counters of the libraries
+ *   (when instrumentation is enabled in XPerf.h);
+ *
+ * XSched:
+ * - how to serve console input, clock refresh, sensor sampling
+ *   and logging as independent tasks, none of which blocks;
+ *
  * ILI9341 (Pin 16: SPI MOSI, Pin 14: SPI MISO, Pin 15: SPI SCK,
  * Pin 7: SPI SS, Pin 8: ILI RESET, Pin 9: ILI D/C):
  * - the use of various graphic operations, including lines,
  *   rectangles, text, etc.;
  * - the use of xprintf() and xputs() inherited from XConsole,
  *   whom ILI9341 is a child class of;
+ * - how to mirror the console on the display with the VT100
+ *   terminal emulator ILI9341Term;
+ * - how to initialize the display in the background at boot,
+ *   a step at a time from a task;
+ *
+ * XSPIBus:
+ * - how to share the SPI bus, each device with its own clock and
+ *   slave select, consecutive operations of a device batched;
  *
  * (C) 2016 Luigi Di Fraia
  */
@@ -36,31 +58,203 @@
 #include <XConsole.h>
 #include <RTC.h>
 #include <ILI9341.h>
+#include <ILI9341Term.h>
+#include <ILI9341Upload.h>
 #include <TMP006.h>
+#include <XStats.h>
+#include <EEPROM.h>
+#include <XLog.h>
+#include <XPerf.h>
+#include <XSched.h>
+#include <XSPIBus.h>
 
 /* 1: Use ILI9341 display */
 #define USE_ILI9341 1
 
+/* 1: Mirror the console in the bottom rows of the display (gy command) */
+#define USE_TERM    USE_ILI9341
+
 /* 1: Use RTC */
 #define USE_DS3231  1
 
 /* 1: Use TMP006 sensor */
 #define USE_TMP006  1
 
+/* 1: Log TMP006 readings in EEPROM (needs both RTC and TMP006) */
+#define USE_XLOG    (USE_DS3231 && USE_TMP006)
+
+/* EEPROM bytes reserved for sketch settings, the log takes the rest */
+#define EEPROM_SETTINGS_SIZE  32
+
+/* Sketch settings in EEPROM */
+#define EE_SPI_MAGIC    0   /* 1 byte: SPI_MAGIC if the ILI9341 SPI clocks below are valid */
+#define EE_SPI_WCLOCK   1   /* 4 bytes: write clock (Hz) */
+#define EE_SPI_RCLOCK   5   /* 4 bytes: read clock (Hz) */
+#define SPI_MAGIC       0xC5
+
+/* Console mirror size and position (character cells) */
+#define TERM_COLS       40
+#define TERM_ROWS       8
+#define TERM_ROW        32
+
+/* ILI9341 TE pin, or ILI9341_NO_PIN to poll the scanline instead */
+#define TFT_TE_PIN      ILI9341_NO_PIN
+
+/* ILI9341 control pins with the 8080 parallel bus (ILI9341_BUS in ILI9341Bus.h):
+   none on the data port (ILI9341_PAR8_PORT, PORTB: pins 8..11 and 14..17 here) */
+#define TFT_WR_PIN      5       /* PC6 */
+#define TFT_RD_PIN      6       /* PD7 */
+#define TFT_PAR8_RST_PIN 4      /* PD4 */
+#define TFT_PAR8_DC_PIN 12      /* PD6 */
+
+/* TMP006 DRDY pin, on an external interrupt (e.g. 7 without the display), or TMP006_NO_PIN */
+#define TMP006_DRDY_PIN TMP006_NO_PIN
+
+/* Task periods (ms) */
+#define CONSOLE_PERIOD  10
+#define CLOCK_PERIOD    1000
+#define SENSOR_PERIOD   50      /* Sensor polling, unless DRDY is wired */
+#define LOG_PERIOD      60000UL
+#define DISPLAY_PERIOD  1       /* Display initialization steps, at boot */
+
+/* Delay between the terminal connecting and the banner (ms) */
+#define BANNER_DELAY    100
+
+/* Scheduler events */
+#define EV_TMP006       XSCHED_EVENT(0)
+
+#if !USE_TERM
 XConsole console(Serial);
+#endif
+XSched Sched;
+
+/* Console state */
+#define CON_OFFLINE     0   /* Waiting for the terminal */
+#define CON_BANNER      1   /* Banner pending */
+#define CON_ONLINE      2
+byte ConState = CON_OFFLINE;
+char Line[64];      /* Console input buffer */
+int LineLen = 0;    /* Chars in it so far */
+
+/* Task ids, for statistics */
+int8_t TaskConsole = -1, TaskClock = -1, TaskSensor = -1, TaskLog = -1, TaskDisplay = -1;
 
 #if USE_ILI9341
+#if ILI9341_BUS == ILI9341_BUS_PAR8
+ILI9341 disp(0x07, TFT_PAR8_RST_PIN, TFT_PAR8_DC_PIN, TFT_WR_PIN, TFT_RD_PIN);  /* CS, RESET, D/C, WR, RD */
+#else
 ILI9341 disp(0x07, 0x08, 0x09);  /* SS, RESET, D/C */
+XSPIBus SpiBus;   /* Other SPI devices (e.g. a second display) share the bus through it */
+#endif
+#endif
+
+#if USE_TERM
+/* Console whose output is copied to a terminal while mirroring */
+class MirrorConsole: public XConsole {
+  public:
+#if defined(CORE_TEENSY)
+    MirrorConsole (usb_serial_class &serial, XUtils &mirror): XConsole(serial), mirroring(0), _mirror(mirror) { };
+#else
+    MirrorConsole (Serial_ &serial, XUtils &mirror): XConsole(serial), mirroring(0), _mirror(mirror) { };
+#endif
+    virtual void xputc (char c) {
+      XConsole::xputc(c);
+      if (mirroring) _mirror.xputc(c);
+    };
+
+    byte mirroring;
+
+  private:
+    XUtils &_mirror;
+};
+
+uint8_t TermCells[2 * TERM_COLS * TERM_ROWS];
+ILI9341Term term(disp, 0, TERM_ROW, TermCells, TERM_COLS, TERM_ROWS);
+MirrorConsole console(Serial, term);
+#endif
+
+#if USE_ILI9341 && USE_DS3231
+char ClockText[30];
+ILI9341Field ClockField(disp, 0, 1, ClockText, sizeof(ClockText), C_WHITE);  /* Time line under the greeting */
+byte ClockShown = 0;  /* ClockField is on screen, refreshed by task_clock */
 #endif
 
 #if USE_DS3231
 RTC rtc(DS3231_I2C_ADDRESS);
 byte RtcOk = 0;    /* RTC is available */
+TIME_t Now;        /* Time as of the last clock refresh */
+byte NowOk = 0;    /* Now is valid */
 #endif
 
 #if USE_TMP006
 TMP006 tmp006;
 byte Tmp006Ok = 0; /* TMP006 is available */
+XStats TempStats(3, XSTATS_WINDOW, 0.001, 25.0); /* Object temperature statistics (1/100 C, ms) */
+#endif
+
+#if USE_XLOG
+XLogEEPROM LogStore;
+XLog DataLog(LogStore, EEPROM_SETTINGS_SIZE, EEPROM.length() - EEPROM_SETTINGS_SIZE);
+#endif
+
+#if USE_TMP006
+/*----------------------------------------------*/
+/* Collect a TMP006 conversion, if one is ready */
+/*----------------------------------------------*/
+
+void sample_tmp006 (void)
+{
+  TMP006_sample_t sample;
+  TMP006_fixed_t ftemp;
+
+  if (!Tmp006Ok || !tmp006.poll()) return;
+
+  if (tmp006.getsample(0, &sample) && tmp006.latest_fixed(&ftemp))
+    TempStats.push(sample.ms, ftemp.tobj);
+}
+
+#if TMP006_DRDY_PIN != TMP006_NO_PIN
+void tmp006_drdy (void)
+{
+  tmp006.drdy_isr();
+  Sched.signal(EV_TMP006);
+}
+#endif
+#endif
+
+/*----------------------------------------------*/
+/* Show the statistics of a task                */
+/*----------------------------------------------*/
+
+void show_task_stats (
+  const __FlashStringHelper *name,  /* Task name */
+  int8_t id                         /* Task id */
+)
+{
+  XSCHED_stats_t st;
+
+  if (!Sched.getstats(id, &st)) return;
+
+  console.xputs(name);
+  console.xprintf(F(": runs %lu, missed %lu, max late %lu ms, max run %lu us\n"),
+    st.runs, st.misses, st.max_late, st.max_us);
+}
+
+#if USE_ILI9341 && USE_DS3231
+/*----------------------------------------------*/
+/* Show the time on the display                 */
+/*----------------------------------------------*/
+
+void show_clock (void)
+{
+  static const PROGMEM char months[] = "Jan\0Feb\0Mar\0Apr\0May\0Jun\0Jul\0Aug\0Sep\0Oct\0Nov\0Dec\0";
+
+  if (!NowOk) return;
+
+  ClockField.begin();
+  ClockField.xprintf(F("It's %S %u %u, %02u:%02u:%02u"), &months[(Now.month - 1) * 4], Now.mday, Now.year, Now.hour, Now.min, Now.sec);
+  ClockField.end();
+}
 #endif
 
 /*----------------------------------------------*/
@@ -71,40 +265,96 @@ void parse_and_execute_command (
   const char *ptr   /* Pointer to the command string */
 )
 {
-#if USE_DS3231
-  static const PROGMEM char months[] = "Jan\0Feb\0Mar\0Apr\0May\0Jun\0Jul\0Aug\0Sep\0Oct\0Nov\0Dec\0";
-#endif
   long p1;
 #if USE_ILI9341
-  long p2, p3, p4, p5;
+  long p2, p3, p4, p5, p6, p7;
+#if ILI9341_BUS == ILI9341_BUS_SPI
+  uint32_t wclock, rclock;
+#endif
+  ILI9341_frame_stats_t fstats;
+  ILI9341_upload_stats_t ustats;
 #endif
 #if USE_DS3231
   TIME_t t;
 #endif
 #if USE_TMP006
   TMP006_t temp;
+  TMP006_fixed_t ftemp;
+#endif
+#if USE_XLOG
+  XLOG_record_t rec;
 #endif
 
   switch (*ptr++) {
 #if USE_ILI9341
   case 'g' :  /* Graphic controls */
+#if USE_DS3231
+    ClockShown = 0;   /* Drawing may go over the clock */
+#endif
+    if (TaskDisplay >= 0 && *ptr != 'i') {
+      Serial.println(F("Display is initializing"));
+      break;
+    }
     switch (*ptr++) {
     case 'i' :  /* gi - Initialize display */
+      if (TaskDisplay >= 0) {   /* Done here instead */
+        Sched.cancel(TaskDisplay);
+        TaskDisplay = -1;
+      }
       disp.init();
       disp.font_color(C_WHITE);
       disp.xputs(F("Hello world!\n"));
 #if USE_DS3231
-      if (RtcOk && rtc.gettime(&t)) {
-        disp.xprintf(F("It's %S %u %u, %02u:%02u:%02u\n"), &months[(t.month - 1) * 4], t.mday, t.year, t.hour, t.min, t.sec);
+      if (RtcOk) {  /* Kept up to date by task_clock, redrawing only the characters that change */
+        ClockField.invalidate();
+        ClockShown = 1;
+        show_clock();
+        disp.locate(0, 2);
       }
 #endif
 #if USE_TMP006
-      if (Tmp006Ok && tmp006.gettemp(&temp)) {
-        disp.xprintf(F("Object temperature is: %d.%02d C\n"), (int) temp.tobj, ((int) (temp.tobj * 100.0)) % 100);
+      sample_tmp006();
+      if (Tmp006Ok && tmp006.latest_fixed(&ftemp)) {
+        disp.xprintf(F("Object temperature is: %s%d.%02d C\n"), ftemp.tobj < 0 ? "-" : "", abs(ftemp.tobj) / 100, abs(ftemp.tobj) % 100);
       }
 #endif
       break;
 
+#if ILI9341_BUS == ILI9341_BUS_SPI
+    case 'x' :  /* gx - Calibrate SPI clocks (and save them) */
+      if (!disp.calibrate()) {
+        Serial.println(F("Calibration failed"));
+        break;
+      }
+      disp.get_spi_clock(&wclock, &rclock);
+      EEPROM.put(EE_SPI_WCLOCK, wclock);
+      EEPROM.put(EE_SPI_RCLOCK, rclock);
+      EEPROM.update(EE_SPI_MAGIC, SPI_MAGIC);
+      console.xprintf(F("Write clock %lu Hz, read clock %lu Hz\n"), wclock, rclock);
+      break;
+#endif
+
+    case 't' :  /* gt <frames> - Tear-free animation, then frame statistics */
+      if (!XUtils::xatoi(&ptr, &p1)) break;
+      if (!disp.get_refresh_period() && !disp.tearing_on(TFT_TE_PIN)) {
+        Serial.println(F("No vertical sync"));
+        break;
+      }
+      disp.reset_frame_stats();
+      for (p2 = 0; p2 < p1; p2++) {   /* A bar sweeping the top of the screen */
+        p3 = (p2 * 4) % (disp.get_width() - 16);
+        disp.frame_begin();
+        if (p3) disp.rectfill(p3 - 4, p3 - 1, 0, 31, C_BLACK);
+        else disp.rectfill(0, disp.get_width() - 1, 0, 31, C_BLACK);
+        disp.rectfill(p3, p3 + 15, 0, 31, C_GREEN);
+        disp.frame_end();
+      }
+      disp.get_frame_stats(&fstats);
+      console.xprintf(F("Refresh %lu us: %lu frames, %lu missed, %lu late, write %lu us avg, %lu us max\n"),
+        disp.get_refresh_period(), fstats.frames, fstats.missed, fstats.late,
+        fstats.frames ? fstats.total_us / fstats.frames : 0UL, fstats.max_us);
+      break;
+
     case 'k' :  /* gk <l> <r> <t> <b> - Set mask */
       if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4)) break;
       disp.setmask(p1, p2, p3, p4);
@@ -117,6 +367,28 @@ void parse_and_execute_command (
       //console.xprintf(F("%ld, %ld, %ld, %ld, %ld\n"), p1, p2, p3, p4, p5);
       break;
 
+    case 'b' :  /* gb <l> <r> <t> <b> <col> <alpha> - Translucent rectangular fill */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4) || !XUtils::xatoi(&ptr, &p5) || !XUtils::xatoi(&ptr, &p6)) break;
+      disp.rectfill_alpha(p1, p2, p3, p4, p5, p6);
+      break;
+
+    case 'd' :  /* gd <x> <y> <r> <col> - Solid circle */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4)) break;
+      disp.circlefill(p1, p2, p3, p4);
+      break;
+
+    case 'r' :  /* gr <x> <y> <ro> <ri> <start> <end> <col> - Ring sector */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4) || !XUtils::xatoi(&ptr, &p5) || !XUtils::xatoi(&ptr, &p6) || !XUtils::xatoi(&ptr, &p7)) break;
+      disp.arc(p1, p2, p3, p4, p5, p6, p7);
+      break;
+
+#if USE_TERM
+    case 'y' :  /* gy - Toggle the console mirror */
+      console.mirroring = !console.mirroring;
+      if (console.mirroring) term.invalidate();   /* Repaint it all, the screen may have been drawn over */
+      break;
+#endif
+
     case 'm' :  /* gm <x> <y> - Set current position */
       if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2)) break;
       disp.moveto(p1, p2);
@@ -159,6 +431,37 @@ void parse_and_execute_command (
       //console.xprintf(F("%ld\n"), p1);
       break;
 
+    case 'p' :  /* gp [<l> <r> <t> <b>] - Stream a screen capture (binary, see tools/ili9341_capture.py) */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4)) {
+        p1 = 0; p2 = disp.get_width() - 1;
+        p3 = 0; p4 = disp.get_height() - 1;
+      }
+      if (!disp.capture(p1, p2, p3, p4, console))
+        Serial.println(F("Area off screen"));
+      break;
+
+    case 'u' :  /* gu <l> <r> <t> <b> <format> - Receive pixels into an area (binary, see tools/ili9341_upload.py) */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4) || !XUtils::xatoi(&ptr, &p5)) break;
+      {   /* Chunk buffers on the stack while uploading only */
+        ILI9341Upload upload(disp, console);
+        p6 = upload.run(p1, p2, p3, p4, p5);
+        upload.get_stats(&ustats);
+      }
+      console.xprintf(F("Upload status %ld: %lu bytes in %lu ms (%lu B/s), %u chunks, %u checksum mismatches\n"),
+        p6, ustats.bytes, ustats.ms, ustats.ms ? ustats.bytes * 1000UL / ustats.ms : 0UL, ustats.chunks, ustats.naks);
+      break;
+
+    case 'n' :  /* gn <font> - Select text font */
+      if (!XUtils::xatoi(&ptr, &p1)) break;
+      disp.font_face(p1 ? FontD24 : FontH8);
+      break;
+
+    case 'j' :  /* gj <l> <r> <t> <b> <flags> <text> - Lay out text in a box */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2) || !XUtils::xatoi(&ptr, &p3) || !XUtils::xatoi(&ptr, &p4) || !XUtils::xatoi(&ptr, &p5)) break;
+      while (*ptr == ' ') ptr++;
+      console.xprintf(F("%d lines\n"), disp.textbox(p1, p2, p3, p4, ptr, p5));
+      break;
+
     case 'w' :  /* gw <text> - Write text */
       while (*ptr == ' ') ptr++;
       if (!*ptr) break;
@@ -196,12 +499,101 @@ void parse_and_execute_command (
 #if USE_TMP006
   case 'm' :  /* Show object temperature */
     if (!Tmp006Ok) break;
-    if (tmp006.gettemp(&temp)) {
+    sample_tmp006();
+    if (tmp006.latest(&temp)) {
       Serial.println(temp.tobj);
     }
     break;
+
+  case 's' :  /* s - Show object temperature statistics */
+    if (!Tmp006Ok) break;
+    sample_tmp006();
+    if (!TempStats.count()) break;
+    console.xprintf(F("samples %lu, avg %ld, min %ld, max %ld, sd %ld, kalman %ld (1/100 C), alarm %u\n"),
+      TempStats.count(), TempStats.ema(), TempStats.min(), TempStats.max(),
+      lround(sqrt(TempStats.variance())), (long) TempStats.kalman(), TempStats.alarm());
+    break;
 #endif
 
+#if USE_XLOG
+  case 'l' :  /* Data log controls */
+    switch (*ptr++) {
+    case 'a' :  /* la - Append current time and temperatures to the log */
+      if (!RtcOk || !Tmp006Ok) break;
+      sample_tmp006();
+      if (!rtc.gettime(&t) || !tmp006.latest_fixed(&ftemp)) break;
+      rec.time = RTC::toepoch(&t);
+      rec.v[0] = ftemp.tobj;
+      rec.v[1] = ftemp.tdie;
+      if (!DataLog.append(&rec)) Serial.println(F("Log write failed"));
+      break;
+
+    case 'd' :  /* ld - Dump the log, oldest record first */
+      DataLog.rewind();
+      p1 = 0;
+      while (DataLog.read(&rec)) {
+        console.xprintf(F("%lu,%d,%d\n"), rec.time, rec.v[0], rec.v[1]);
+        p1++;
+      }
+      console.xprintf(F("%ld records\n"), p1);
+      break;
+
+    case 'f' :  /* lf - Erase the log */
+      DataLog.format();
+      break;
+
+#if USE_ILI9341
+    case 'p' :  /* lp <min> <max> - Plot the object temperatures of the log (1/100 C) */
+      if (!XUtils::xatoi(&ptr, &p1) || !XUtils::xatoi(&ptr, &p2)) break;
+      if (TaskDisplay >= 0) {
+        Serial.println(F("Display is initializing"));
+        break;
+      }
+      {
+        ILI9341Plot plot(disp, 0, disp.get_width() - 1, disp.get_height() / 2, disp.get_height() - 1, p1, p2, C_YELLOW, C_BLACK);
+
+        DataLog.rewind();
+        for (p3 = 0; DataLog.read(&rec); p3++) ;
+        plot.clear();
+        plot.set_decimation((p3 + disp.get_width() - 1) / disp.get_width());
+        DataLog.rewind();
+        while (DataLog.read(&rec)) plot.append(rec.v[0]);
+      }
+      break;
+#endif
+    }
+    break;
+#endif
+
+#if XPERF_ENABLE
+  case 'p' :  /* p[r] - Show/reset performance counters */
+    if (*ptr == 'r')
+      XPerf::reset();
+    else
+      XPerf::dump(console);
+    break;
+#endif
+
+  case 'x' :  /* x[r] - Show/reset task statistics */
+    if (*ptr == 'r') {
+      Sched.reset_stats();
+      break;
+    }
+    show_task_stats(F("console"), TaskConsole);
+#if USE_DS3231
+    show_task_stats(F("clock"), TaskClock);
+#endif
+#if USE_TMP006
+    show_task_stats(F("sensor"), TaskSensor);
+#endif
+#if USE_XLOG
+    show_task_stats(F("log"), TaskLog);
+#endif
+#if USE_ILI9341
+    show_task_stats(F("display"), TaskDisplay);   /* While it runs */
+#endif
+    break;
+
   case 'v' :  /* v - Show sketch version */
     Serial.println(F("1.4"));
     break;
@@ -211,16 +603,39 @@ void parse_and_execute_command (
 #if USE_ILI9341
       "[Graphic commands]\n"
       " gi - Initialize display module\n"
+#if ILI9341_BUS == ILI9341_BUS_SPI
+      " gx - Calibrate SPI clocks (after gi)\n"
+#endif
+      " gt <frames> - Tear-free animation test\n"
       " gk <l> <r> <t> <b> - Set active area\n"
       " gf <l> <r> <t> <b> <col> - Draw solid rectangular\n"
+      " gb <l> <r> <t> <b> <col> <alpha> - Draw translucent rectangular\n"
+      " gd <x> <y> <r> <col> - Draw solid circle\n"
+      " gr <x> <y> <ro> <ri> <start> <end> <col> - Draw ring sector\n"
+#if USE_TERM
+      " gy - Toggle console mirror on display\n"
+#endif
       " gm <x> <y> - Move current position\n"
       " gl <x> <y> <col> - Draw line to\n"
       " go <value> - Change display orientation\n"
       " gc <col> - Set current text color\n"
       " gs <x> <y> - Set current character position\n"
+      " gn <font> - Select text font (0: 6x8, 1: 24 pixel numerals)\n"
       " gw <text> - Write text\n"
+      " gj <l> <r> <t> <b> <flags> <text> - Lay out text in a box\n"
+      " gp [<l> <r> <t> <b>] - Stream a screen capture\n"
+      " gu <l> <r> <t> <b> <format> - Receive pixels (0: raw, 1: RLE)\n"
       " gv <top fixed> <scroll area> <bottom fixed> - Vertical scroll definition\n"
       " ga <start address> - Set vertical scroll start address\n"
+#endif
+#if USE_XLOG
+      "[Data log commands]\n"
+      " la - Append current time and temperatures\n"
+      " ld - Dump log (epoch seconds since 2000, 1/100 C object, 1/100 C die)\n"
+      " lf - Erase log\n"
+#if USE_ILI9341
+      " lp <min> <max> - Plot log object temperatures (1/100 C)\n"
+#endif
 #endif
       "[Misc Commands]\n"
       " c <value> - Convert numeric input to decimal\n"
@@ -229,6 +644,13 @@ void parse_and_execute_command (
 #endif
 #if USE_TMP006
       " m - Show object temperature\n"
+      " s - Show object temperature statistics\n"
+#endif
+      " x - Show task statistics\n"
+      " xr - Reset task statistics\n"
+#if XPERF_ENABLE
+      " p - Show performance counters\n"
+      " pr - Reset performance counters\n"
 #endif
       " v - Show sketch version\n"
       "\n"));
@@ -237,65 +659,36 @@ void parse_and_execute_command (
 }
 
 /*----------------------------------------------*/
-/* Sketch core                                  */
+/* Tasks                                        */
 /*----------------------------------------------*/
 
-void setup (void)
-{
-  /* Put your setup code here, to run once */
-
-  Serial.begin(9600); /* Initialize USB Serial (always 12 Mbit/sec) */
-#if USE_DS3231
-  Wire.begin(); /* Initialize the TWI bus used by the RTC and TMP006 modules */
-#endif
-#if USE_ILI9341
-  SPI.begin();  /* Initialize the SPI bus used by the TFT display module */
-#endif
-
-#if USE_DS3231
-  if (rtc.init() == 0) RtcOk = 1;
-#endif
-#if USE_TMP006
-  if (tmp006.init(TMP006_CFG_1SAMPLE) == 0) Tmp006Ok = 1;  /* New sample available every 250 ms */
-#endif
-}
-
-void loop (void)
+void show_banner (void)
 {
-  /* Put your main code here, to run repeatedly */
-
-  char Line[64];  /* Console input buffer */
-#if USE_DS3231
-  TIME_t t;
-#endif
 #if USE_TMP006
   TMP006_t temp;
 #endif
 
-  /* Wait until the USB CDC serial connection is opened/reopened */
-  while (!Serial || !Serial.dtr()) ;
-
   /* Discard anything that was received */
   while (Serial.available() > 0)
     Serial.read();
 
   /* Show banner */
-  Serial.println(F("\e[H\e[2JTest Console for Arduino by Luigi Di Fraia"));
+  console.xputs(F("\e[H\e[2JTest Console for Arduino by Luigi Di Fraia\n"));
 
   /* Remind user that a CR character suffices to terminate lines */
   Serial.println(F("Note: Ensure your terminal ends lines just with a CR"));
 
 #if USE_DS3231
   /* Show current time */
-  if (RtcOk && rtc.gettime(&t)) {
-    console.xprintf(F("Current time: %u/%u/%u %02u:%02u:%02u\n"), t.year, t.month, t.mday, t.hour, t.min, t.sec);
+  if (NowOk) {
+    console.xprintf(F("Current time: %u/%u/%u %02u:%02u:%02u\n"), Now.year, Now.month, Now.mday, Now.hour, Now.min, Now.sec);
   } else {
     Serial.println(F("RTC is not available"));
   }
 #endif
 #if USE_TMP006
-  /* Show object temperature */
-  if (Tmp006Ok && tmp006.gettemp(&temp)) {
+  /* Show object temperature, as of the last conversion collected */
+  if (Tmp006Ok && tmp006.latest(&temp)) {
     Serial.print(F("Object temperature is: "));
     Serial.println(temp.tobj);
   } else {
@@ -303,11 +696,142 @@ void loop (void)
   }
 #endif
 
-  /* Listen for commands and process them */
-  for (;;) {
-    Serial.print(F(">"));
-    if (!console.xgets(Line, sizeof(Line)))
-      break;  /* User disconnected */
-    parse_and_execute_command(Line);
+  Serial.print(F(">"));
+  LineLen = 0;
+  ConState = CON_ONLINE;
+}
+
+void task_console (void)
+{
+  switch (ConState) {
+  case CON_OFFLINE:
+    /* Wait until the USB CDC serial connection is opened/reopened */
+    if (Serial && Serial.dtr()) {
+      ConState = CON_BANNER;
+      Sched.after(BANNER_DELAY, show_banner);
+    }
+    break;
+
+  case CON_ONLINE:
+    /* Process whatever input has arrived, without waiting for more */
+    switch (console.xgets_poll(Line, sizeof(Line), &LineLen)) {
+    case 0:   /* User disconnected */
+      ConState = CON_OFFLINE;
+      break;
+    case 1:
+      parse_and_execute_command(Line);
+      console.xputc('>');
+      break;
+    }
+    break;
   }
+#if USE_TERM
+  if (console.mirroring) term.refresh();  /* Repaint the cells that changed */
+#endif
+}
+
+#if USE_DS3231
+void task_clock (void)
+{
+  NowOk = RtcOk && rtc.gettime(&Now);
+#if USE_ILI9341
+  if (ClockShown) show_clock();
+#endif
+}
+#endif
+
+#if USE_TMP006
+void task_sensor (void)
+{
+  sample_tmp006();  /* Collect the latest conversion, if any */
+}
+#endif
+
+#if USE_ILI9341
+void task_display (void)
+{
+  if (disp.init_step()) return;   /* Steps not yet due return at once */
+
+  Sched.cancel(TaskDisplay);      /* Display on and cleared */
+  TaskDisplay = -1;
+}
+#endif
+
+#if USE_XLOG
+void task_log (void)
+{
+  TMP006_fixed_t ftemp;
+  XLOG_record_t rec;
+
+  if (!NowOk || !Tmp006Ok || !tmp006.latest_fixed(&ftemp)) return;
+
+  rec.time = RTC::toepoch(&Now);
+  rec.v[0] = ftemp.tobj;
+  rec.v[1] = ftemp.tdie;
+  DataLog.append(&rec);
+}
+#endif
+
+/*----------------------------------------------*/
+/* Sketch core                                  */
+/*----------------------------------------------*/
+
+void setup (void)
+{
+  /* Put your setup code here, to run once */
+
+#if USE_ILI9341 && ILI9341_BUS == ILI9341_BUS_SPI
+  uint32_t wclock, rclock;
+#endif
+
+  Serial.begin(9600); /* Initialize USB Serial (always 12 Mbit/sec) */
+#if USE_DS3231
+  Wire.begin(); /* Initialize the TWI bus used by the RTC and TMP006 modules */
+#endif
+#if USE_ILI9341 && ILI9341_BUS == ILI9341_BUS_SPI
+  SPI.begin();  /* Initialize the SPI bus used by the TFT display module */
+  disp.share_bus(&SpiBus);
+
+  /* Use the SPI clocks found by the last calibration, if any */
+  if (EEPROM.read(EE_SPI_MAGIC) == SPI_MAGIC) {
+    EEPROM.get(EE_SPI_WCLOCK, wclock);
+    EEPROM.get(EE_SPI_RCLOCK, rclock);
+    disp.set_spi_clock(wclock, rclock);
+  }
+#endif
+#if USE_ILI9341
+  /* Bring the display up while the rest starts, rather than waiting for it */
+  disp.init_begin(ILI9341_INIT_CLEAR);
+  TaskDisplay = Sched.every(DISPLAY_PERIOD, task_display);
+#endif
+
+#if USE_DS3231
+  if (rtc.init() == 0) RtcOk = 1;
+  task_clock();
+  TaskClock = Sched.every(CLOCK_PERIOD, task_clock);
+#endif
+#if USE_TMP006
+  TempStats.set_alarm(-1000, 5000, 100);  /* Below -10 C or above 50 C */
+#if TMP006_DRDY_PIN != TMP006_NO_PIN
+  tmp006.attach_drdy(TMP006_DRDY_PIN);
+  attachInterrupt(digitalPinToInterrupt(TMP006_DRDY_PIN), tmp006_drdy, FALLING);
+  if (tmp006.init(TMP006_CFG_1SAMPLE | TMP006_CFG_DRDYEN) == 0) Tmp006Ok = 1;  /* New sample available every 250 ms */
+  TaskSensor = Sched.on_event(EV_TMP006, task_sensor);
+#else
+  if (tmp006.init(TMP006_CFG_1SAMPLE) == 0) Tmp006Ok = 1;  /* New sample available every 250 ms */
+  TaskSensor = Sched.every(SENSOR_PERIOD, task_sensor);
+#endif
+#endif
+#if USE_XLOG
+  DataLog.begin();  /* Continue from where the log was left */
+  TaskLog = Sched.every(LOG_PERIOD, task_log);
+#endif
+  TaskConsole = Sched.every(CONSOLE_PERIOD, task_console);
+}
+
+void loop (void)
+{
+  /* Put your main code here, to run repeatedly */
+
+  Sched.run();
 }
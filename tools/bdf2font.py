@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""
+Compile a BDF font into a run-length encoded ILI9341 font
+
+The output is a PROGMEM array in the FONTRL format documented in
+libraries/ILI9341/Fonts.h: an advance width per character, an offset
+per character and, per glyph, its cell (advance x font height) scanned
+raster by raster as pairs of background and foreground runs.
+
+  bdf2font.py [--name FontD24] [--first 0x20] [--last 0x7E] font.bdf [out.c]
+
+Glyphs are placed in their cell by their BBX offsets against the font
+ascent; pixels falling outside the cell are dropped with a warning.
+Characters of the range missing from the BDF get no glyph (advance 0).
+
+(C) 2016 Luigi Di Fraia
+"""
+
+import argparse
+import sys
+
+MAGIC = b"FONTRL"
+RUN_MAX = 15
+
+
+class BdfError(Exception):
+    pass
+
+
+def parse_bdf(lines):
+    """Parse a BDF font; returns (ascent, descent, {code: (dwidth, bbx, rows)})."""
+    ascent = descent = None
+    bbox = None
+    glyphs = {}
+    glyph = None
+    bitmap = None
+
+    for n, line in enumerate(lines, 1):
+        words = line.split()
+        if not words:
+            continue
+        key = words[0]
+        try:
+            if bitmap is not None:
+                if key == "ENDCHAR":
+                    if glyph["code"] >= 0:
+                        glyphs[glyph["code"]] = (glyph["dwidth"], glyph["bbx"], bitmap)
+                    glyph = bitmap = None
+                else:
+                    bitmap.append(int(key, 16))
+            elif key == "FONTBOUNDINGBOX":
+                bbox = [int(v) for v in words[1:5]]
+            elif key == "FONT_ASCENT":
+                ascent = int(words[1])
+            elif key == "FONT_DESCENT":
+                descent = int(words[1])
+            elif key == "STARTCHAR":
+                glyph = {"code": -1, "dwidth": None, "bbx": None}
+            elif key == "ENCODING":
+                glyph["code"] = int(words[1])
+            elif key == "DWIDTH":
+                glyph["dwidth"] = int(words[1])
+            elif key == "BBX":
+                glyph["bbx"] = [int(v) for v in words[1:5]]
+            elif key == "BITMAP":
+                if glyph["bbx"] is None:
+                    raise BdfError("BITMAP before BBX")
+                if glyph["dwidth"] is None:
+                    glyph["dwidth"] = glyph["bbx"][0] + glyph["bbx"][2]
+                bitmap = []
+        except (ValueError, IndexError, TypeError) as e:
+            raise BdfError("line %d: %s" % (n, e))
+
+    if ascent is None or descent is None:
+        if bbox is None:
+            raise BdfError("no FONT_ASCENT/FONT_DESCENT nor FONTBOUNDINGBOX")
+        ascent = bbox[1] + bbox[3]
+        descent = -bbox[3]
+    return ascent, descent, glyphs
+
+
+def render(glyph, ascent, height, warn):
+    """Render a glyph into its cell; returns (advance, rows of 0/1 pixels)."""
+    advance, (w, h, xoff, yoff), bitmap = glyph
+    cell = [[0] * advance for _ in range(height)]
+    top = ascent - (h + yoff)
+    lost = 0
+    for r, bits in enumerate(bitmap[:h]):
+        nbits = ((w + 7) // 8) * 8
+        for c in range(w):
+            if bits & (1 << (nbits - 1 - c)):
+                x, y = xoff + c, top + r
+                if 0 <= x < advance and 0 <= y < height:
+                    cell[y][x] = 1
+                else:
+                    lost += 1
+    if lost:
+        warn("%d pixel(s) outside the cell" % lost)
+    return advance, cell
+
+
+def encode(cell):
+    """Encode a cell as bytes of (background run << 4 | foreground run)."""
+    pixels = [p for row in cell for p in row]
+    out = bytearray()
+    i = 0
+    while i < len(pixels):
+        bg = 0
+        while i < len(pixels) and not pixels[i] and bg < RUN_MAX:
+            bg += 1
+            i += 1
+        fg = 0
+        if bg < RUN_MAX:    # A full background run may continue in the next byte
+            while i < len(pixels) and pixels[i] and fg < RUN_MAX:
+                fg += 1
+                i += 1
+        out.append(bg << 4 | fg)
+    return bytes(out)
+
+
+def compile_font(ascent, descent, glyphs, first, last, name, warn):
+    height = ascent + descent
+    if not 1 <= height <= 255:
+        raise BdfError("font height %d out of range" % height)
+
+    advances, offsets, data = [], [], bytearray()
+    seen = {}
+    for code in range(first, last + 1):
+        if code not in glyphs:
+            advances.append(0)
+            offsets.append(0)
+            continue
+        adv, cell = render(glyphs[code], ascent, height,
+                           lambda msg, code=code: warn("char 0x%02X: %s" % (code, msg)))
+        if not 1 <= adv <= 255:
+            raise BdfError("char 0x%02X: advance %d out of range" % (code, adv))
+        runs = encode(cell)
+        if runs not in seen:        # Identical glyphs share their runs
+            seen[runs] = len(data)
+            data += runs
+        advances.append(adv)
+        offsets.append(seen[runs])
+    if len(data) > 0xFFFF:
+        raise BdfError("run data over 64 KB")
+
+    head = MAGIC + name[:8].ljust(8).encode("ascii")
+    if not any(advances):
+        raise BdfError("no glyphs in 0x%02X..0x%02X" % (first, last))
+    return head, max(advances), height, advances, offsets, bytes(data)
+
+
+def c_source(name, first, last, font):
+    head, width, height, advances, offsets, data = font
+    out = []
+    out.append("/* Generated by tools/bdf2font.py */")
+    out.append("const PROGMEM uint8_t %s[] = {" % name)
+    out.append("  " + ",".join("'%s'" % chr(b) for b in head) + ",")
+    out.append("  %d,%d, /* Widest advance, height */" % (width, height))
+    out.append("  0x%02X,0x%02X, /* First and last character */" % (first, last))
+    out.append("  /* Advances */")
+    for i in range(0, len(advances), 16):
+        out.append("  " + ",".join("%d" % a for a in advances[i:i + 16]) + ",")
+    out.append("  /* Offsets */")
+    for i in range(0, len(offsets), 8):
+        out.append("  " + ",".join("0x%02X,0x%02X" % (o & 0xFF, o >> 8) for o in offsets[i:i + 8]) + ",")
+    out.append("  /* Runs (background << 4 | foreground) */")
+    starts = sorted(set(o for o, a in zip(offsets, advances) if a))
+    for i, off in enumerate(starts):
+        end = starts[i + 1] if i + 1 < len(starts) else len(data)
+        code = first + [k for k, (o, a) in enumerate(zip(offsets, advances)) if a and o == off][0]
+        label = chr(code) if 0x20 < code < 0x7F else "0x%02X" % code
+        for k in range(off, end, 16):
+            line = "  " + ",".join("0x%02X" % b for b in data[k:min(k + 16, end)]) + ","
+            out.append(line + (" // %s" % label if k == off else ""))
+    out.append("};")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile a BDF font into a run-length encoded ILI9341 font")
+    parser.add_argument("--name", default="Font", help="array name (default: Font)")
+    parser.add_argument("--first", type=lambda v: int(v, 0), default=None, help="first character (default: lowest in the font, at least 0x20)")
+    parser.add_argument("--last", type=lambda v: int(v, 0), default=None, help="last character (default: highest in the font, at most 0xFF)")
+    parser.add_argument("input", help="BDF font")
+    parser.add_argument("output", nargs="?", help="C source to write (default: stdout)")
+    args = parser.parse_args()
+
+    def warn(msg):
+        sys.stderr.write("warning: %s\n" % msg)
+
+    try:
+        with open(args.input) as f:
+            ascent, descent, glyphs = parse_bdf(f)
+        codes = [c for c in glyphs if 0x20 <= c <= 0xFF]
+        if not codes:
+            raise BdfError("no characters in 0x20..0xFF")
+        first = args.first if args.first is not None else min(codes)
+        last = args.last if args.last is not None else max(codes)
+        if not 0 <= first <= last <= 0xFF:
+            raise BdfError("bad character range 0x%02X..0x%02X" % (first, last))
+        font = compile_font(ascent, descent, glyphs, first, last, args.name, warn)
+    except (OSError, BdfError) as e:
+        sys.exit("error: %s" % e)
+
+    src = c_source(args.name, first, last, font)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(src)
+    else:
+        sys.stdout.write(src)
+    size = 18 + 3 * (last - first + 1) + len(font[5])
+    sys.stderr.write("%s: %d characters, %d bytes\n" % (args.name, last - first + 1, size))
+
+
+if __name__ == "__main__":
+    main()
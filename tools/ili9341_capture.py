@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""
+Reconstruct a PNG from an ILI9341 screen capture stream
+
+The stream is produced by ILI9341::capture(), e.g. with the console
+sketch's "gp" command. It is either read from a saved file or captured
+straight from the serial port (requires pyserial):
+
+  ili9341_capture.py --input capture.bin screen.png
+  ili9341_capture.py --port /dev/ttyACM0 [--rect L R T B] screen.png
+
+(C) 2016 Luigi Di Fraia
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"IC"
+
+
+class CaptureError(Exception):
+    pass
+
+
+def decode(read):
+    """Decode a stream, read(n) returning exactly n bytes; returns (width, height, pixels)."""
+    head = read(6)
+    if head[:2] != MAGIC:
+        raise CaptureError("not a capture stream")
+    width, height = struct.unpack("<HH", head[2:])
+
+    pixels = []
+    total = width * height
+    while len(pixels) < total:
+        n = read(1)[0]
+        if n & 0x80:
+            px, = struct.unpack(">H", read(2))
+            pixels.extend([px] * ((n & 0x7F) + 1))
+        else:
+            pixels.extend(struct.unpack(">%dH" % (n + 1), read(2 * (n + 1))))
+    if len(pixels) != total:
+        raise CaptureError("packet overruns the area")
+
+    checksum, = struct.unpack("<H", read(2))
+    if checksum != sum(pixels) & 0xFFFF:
+        raise CaptureError("checksum mismatch")
+
+    return width, height, pixels
+
+
+def rgb888(px):
+    """Expand an RGB565 pixel, replicating the top bits into the low ones."""
+    r = (px >> 11) & 0x1F
+    g = (px >> 5) & 0x3F
+    b = px & 0x1F
+    return (r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2)
+
+
+def write_png(path, width, height, pixels):
+    def chunk(kind, data):
+        return (struct.pack(">I", len(data)) + kind + data +
+                struct.pack(">I", zlib.crc32(kind + data) & 0xFFFFFFFF))
+
+    raw = bytearray()
+    for y in range(height):
+        raw.append(0)   # No filter
+        for px in pixels[y * width:(y + 1) * width]:
+            raw.extend(rgb888(px))
+
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(bytes(raw), 9)))
+        f.write(chunk(b"IEND", b""))
+
+
+def file_reader(f):
+    def read(n):
+        data = f.read(n)
+        if len(data) != n:
+            raise CaptureError("stream truncated")
+        return data
+    return read
+
+
+def serial_reader(port, rect, timeout):
+    import serial   # pyserial
+
+    link = serial.Serial(port, 115200, timeout=timeout)
+    link.reset_input_buffer()
+    cmd = "gp" + ("".join(" %d" % v for v in rect) if rect else "") + "\r"
+    link.write(cmd.encode("ascii"))
+
+    # Skip the command echo up to the magic bytes
+    window = b""
+    while window != MAGIC:
+        c = link.read(1)
+        if not c:
+            raise CaptureError("no capture stream from %s" % port)
+        window = (window + c)[-2:]
+
+    pending = bytearray(MAGIC)
+
+    def read(n):
+        data = bytes(pending[:n])
+        del pending[:n]
+        data += link.read(n - len(data))
+        if len(data) != n:
+            raise CaptureError("stream truncated")
+        return data
+    return read
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Reconstruct a PNG from an ILI9341 screen capture stream")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--input", help="file holding a capture stream")
+    source.add_argument("--port", help="serial port the console sketch runs on")
+    parser.add_argument("--rect", type=int, nargs=4, metavar=("L", "R", "T", "B"),
+                        help="area to capture (default: whole screen)")
+    parser.add_argument("--timeout", type=float, default=5.0, help="serial timeout in seconds")
+    parser.add_argument("output", help="PNG file to write")
+    args = parser.parse_args()
+
+    try:
+        if args.input:
+            with open(args.input, "rb") as f:
+                width, height, pixels = decode(file_reader(f))
+        else:
+            width, height, pixels = decode(serial_reader(args.port, args.rect, args.timeout))
+    except CaptureError as e:
+        sys.exit("error: %s" % e)
+
+    write_png(args.output, width, height, pixels)
+    print("%s: %d x %d" % (args.output, width, height))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""
+Upload an image into an ILI9341 area over the serial console
+
+The console sketch's "gu" command receives the pixels with
+ILI9341Upload, straight into the display window. The image is a PNG
+(8 bits per channel, not interlaced) or a capture stream saved by
+ili9341_capture.py, which is sent as it is (requires pyserial):
+
+  ili9341_upload.py --port /dev/ttyACM0 [--at X Y] [--raw] image.png
+  ili9341_upload.py --port /dev/ttyACM0 [--at X Y] capture.bin
+
+Pixels go as RLE packets (the capture stream ones) unless --raw is
+given. Chunks carry a sequence number and a checksum; the unit answers
+each one, ACK once drawn or NAK when damaged, and no more chunks are
+outstanding than it has buffers for.
+
+(C) 2016 Luigi Di Fraia
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+CAPTURE_MAGIC = b"IC"
+HELLO = b"UP"
+END = b"UE"
+ACK = 0x06
+NAK = 0x15
+RAW, RLE = 0, 1
+
+STATUS = {
+    0: "ok",
+    1: "timeout",
+    2: "protocol error",
+    3: "data past the end of the area",
+    4: "area off the display",
+}
+
+
+class UploadError(Exception):
+    pass
+
+
+def rgb565(r, g, b):
+    return (r >> 3) << 11 | (g >> 2) << 5 | b >> 3
+
+
+def read_png(path):
+    """Read a PNG; returns (width, height, RGB565 pixels)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise UploadError("%s: not a PNG" % path)
+
+    pos, idat, head = 8, bytearray(), None
+    while pos < len(data):
+        n, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + n]
+        if kind == b"IHDR":
+            head = struct.unpack(">IIBBBBB", body)
+        elif kind == b"IDAT":
+            idat += body
+        pos += n + 12
+    if head is None:
+        raise UploadError("%s: no IHDR" % path)
+    width, height, depth, ctype, _, _, interlace = head
+    channels = {0: 1, 2: 3, 4: 2, 6: 4}.get(ctype)
+    if depth != 8 or channels is None or interlace:
+        raise UploadError("%s: only 8-bit gray or RGB(A), not interlaced" % path)
+
+    raw = zlib.decompress(bytes(idat))
+    stride = width * channels
+    prev = bytearray(stride)
+    pixels = []
+    for y in range(height):
+        ftype = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for i in range(stride):     # Undo the filter
+            a = line[i - channels] if i >= channels else 0
+            b = prev[i]
+            c = prev[i - channels] if i >= channels else 0
+            if ftype == 1:
+                line[i] = (line[i] + a) & 0xFF
+            elif ftype == 2:
+                line[i] = (line[i] + b) & 0xFF
+            elif ftype == 3:
+                line[i] = (line[i] + (a + b) // 2) & 0xFF
+            elif ftype == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                line[i] = (line[i] + (a if pa <= pb and pa <= pc else b if pb <= pc else c)) & 0xFF
+        for x in range(width):
+            px = line[x * channels:(x + 1) * channels]
+            if channels < 3:
+                pixels.append(rgb565(px[0], px[0], px[0]))
+            else:
+                pixels.append(rgb565(px[0], px[1], px[2]))
+        prev = line
+    return width, height, pixels
+
+
+def read_capture(path):
+    """Read a capture stream; returns (width, height, RLE packets)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:2] != CAPTURE_MAGIC or len(data) < 8:
+        raise UploadError("%s: not a capture stream" % path)
+    width, height = struct.unpack("<HH", data[2:6])
+    return width, height, data[6:-2]
+
+
+def encode_raw(pixels):
+    return struct.pack(">%dH" % len(pixels), *pixels)
+
+
+def encode_rle(pixels):
+    """Encode as capture stream packets: runs of 2+ pixels, literals otherwise."""
+    out = bytearray()
+    i = 0
+    while i < len(pixels):
+        n = 1
+        while i + n < len(pixels) and n < 128 and pixels[i + n] == pixels[i]:
+            n += 1
+        if n > 1:
+            out.append(0x80 | (n - 1))
+            out += struct.pack(">H", pixels[i])
+            i += n
+            continue
+        n = 1
+        while i + n < len(pixels) and n < 128 and pixels[i + n] != pixels[i + n - 1]:
+            n += 1
+        if i + n < len(pixels):     # Leave the first pixel of a run to the run
+            n -= n > 1 and pixels[i + n] == pixels[i + n - 1]
+        out.append(n - 1)
+        out += struct.pack(">%dH" % n, *pixels[i:i + n])
+        i += n
+    return bytes(out)
+
+
+def upload(link, rect, fmt, data, log):
+    """Run the chunk protocol; returns (status, unit report)."""
+    link.reset_input_buffer()
+    link.write(("gu %d %d %d %d %d\r" % (rect + (fmt,))).encode("ascii"))
+
+    window = b""    # Skip the command echo up to the magic bytes
+    while window != HELLO:
+        c = link.read(1)
+        if not c:
+            raise UploadError("no answer to gu")
+        window = (window + c)[-2:]
+    size, credits = struct.unpack("<HB", link.read(3))
+
+    offsets = list(range(0, len(data), size)) + [len(data)]
+    chunks = len(offsets) - 1
+    next_ = 0       # Next chunk to send
+    inflight = 0    # Chunks unanswered
+    dead = 0        # Of those, the ones sent before a NAK rewound
+    resent = 0
+    t0 = time.time()
+    while True:
+        while inflight < credits and next_ < chunks:
+            body = data[offsets[next_]:offsets[next_ + 1]]
+            head = struct.pack("<BH", next_ & 0xFF, len(body))
+            link.write(head + body + struct.pack("<H", sum(head + body) & 0xFFFF))
+            inflight += 1
+            next_ += 1
+
+        c = link.read(1)
+        if not c:
+            raise UploadError("no answer after chunk %d of %d" % (next_, chunks))
+        if c[0] == ACK:
+            inflight -= 1
+        elif c[0] == NAK:
+            expected = link.read(1)[0]
+            inflight -= 1
+            if dead:
+                dead -= 1
+            else:
+                rewind = next_ - ((next_ - expected) & 0xFF)
+                resent += next_ - rewind
+                dead, next_ = inflight, rewind
+                log("chunk %d damaged, sending again" % rewind)
+        elif c == END[:1] and link.read(1) == END[1:]:
+            status = link.read(1)[0]
+            break
+        else:
+            raise UploadError("unexpected answer 0x%02X" % c[0])
+
+    seconds = time.time() - t0
+    report = link.readline().decode("ascii", "replace").strip()
+    log("%d bytes in %.2f s (%.0f B/s), %d chunks sent again" %
+        (len(data), seconds, len(data) / seconds if seconds else 0, resent))
+    return status, report
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Upload an image into an ILI9341 area over the serial console")
+    parser.add_argument("--port", required=True, help="serial port the console sketch runs on")
+    parser.add_argument("--at", type=int, nargs=2, metavar=("X", "Y"), default=(0, 0),
+                        help="top left corner of the area (default: 0 0)")
+    parser.add_argument("--raw", action="store_true", help="send RGB565 pixels as they are (PNG only)")
+    parser.add_argument("--baud", type=int, default=115200, help="serial speed")
+    parser.add_argument("--timeout", type=float, default=5.0, help="serial timeout in seconds")
+    parser.add_argument("input", help="PNG or capture stream")
+    args = parser.parse_args()
+
+    try:
+        with open(args.input, "rb") as f:
+            is_capture = f.read(2) == CAPTURE_MAGIC
+        if is_capture:
+            if args.raw:
+                raise UploadError("a capture stream is sent as RLE")
+            width, height, data = read_capture(args.input)
+            fmt = RLE
+        else:
+            width, height, pixels = read_png(args.input)
+            fmt = RAW if args.raw else RLE
+            data = encode_raw(pixels) if args.raw else encode_rle(pixels)
+
+        import serial   # pyserial
+
+        link = serial.Serial(args.port, args.baud, timeout=args.timeout)
+        x, y = args.at
+        status, report = upload(link, (x, x + width - 1, y, y + height - 1), fmt, data,
+                                lambda msg: sys.stderr.write("%s\n" % msg))
+    except (OSError, UploadError, zlib.error) as e:
+        sys.exit("error: %s" % e)
+
+    print(report)
+    if status:
+        sys.exit("error: %s" % STATUS.get(status, "status %d" % status))
+
+
+if __name__ == "__main__":
+    main()